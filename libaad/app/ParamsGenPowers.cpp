@@ -2,6 +2,9 @@
 #include <aad/Library.h>
 #include <aad/PublicParameters.h>
 #include <aad/EllipticCurves.h>
+#include <aad/Scheduler.h>
+
+#include <xutils/Timer.h>
 
 using namespace std;
 using namespace libaad;
@@ -10,17 +13,17 @@ int main(int argc, char *argv[])
 {
     libaad::initialize(nullptr, 0);
 
-    if(argc < 5) {
+    if(argc < 3 || (argc < 5 && string(argv[2]) != "--binary")) {
         cout << "Usage: " << argv[0] << " <trapdoor-file> <out-file> <start-incl> <end-excl>" << endl;
+        cout << "   or: " << argv[0] << " <trapdoor-file> --binary [<num-threads>]" << endl;
         cout << endl;
         cout << "Reads 's' and 'tau' from <trapdoor-file> and outputs q-PKE parameters (g_1^{s_i}, g_1^{tau s^i}, g_2^{s^i}) for i \\in [<start-incl>, <end-excl>) to <out-file>." << endl;
+        cout << "With --binary, also reads 'q' and outputs all parameters for i \\in [0, q] to <trapdoor-file>.bin, using <num-threads> threads (default: one per core)." << endl;
         return 1;
     }
 
     string inFile(argv[1]);
-    string outFile(argv[2]);
-    size_t start = static_cast<size_t>(std::stoi(argv[3])),
-        end = static_cast<size_t>(std::stoi(argv[4]));
+    bool binary = string(argv[2]) == "--binary";
 
     ifstream fin(inFile);
 
@@ -29,11 +32,31 @@ int main(int argc, char *argv[])
     }
 
     Fr s, tau;
+    size_t q;
     fin >> s;
     fin >> tau;
+    fin >> q;
+
+    size_t numPowers;
+    ManualTimer t;
+    if(binary) {
+        if(argc > 3)
+            Scheduler::configure(static_cast<size_t>(std::stoi(argv[3])));
 
-    PublicParameters::generate(start, end, s, tau, outFile, true);
+        PublicParameters::generateBinary(q, s, tau, PublicParameters::getBinaryFile(inFile), true);
+        numPowers = q + 1;
+    } else {
+        string outFile(argv[2]);
+        size_t start = static_cast<size_t>(std::stoi(argv[3])),
+            end = static_cast<size_t>(std::stoi(argv[4]));
+
+        PublicParameters::generate(start, end, s, tau, outFile, true);
+        numPowers = end > start ? end - start : 0;
+    }
 
+    auto usecs = t.stop().count();
+    logperf << "Generated " << numPowers << " powers in " << static_cast<double>(usecs) / 1000000.0 << " seconds ("
+        << static_cast<double>(numPowers) / (static_cast<double>(usecs) / 1000000.0) << " powers/second)" << endl;
 
     loginfo << "All done!" << endl;
 
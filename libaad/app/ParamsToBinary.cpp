@@ -0,0 +1,39 @@
+#include <iostream>
+#include <aad/Library.h>
+#include <aad/PublicParameters.h>
+#include <aad/EllipticCurves.h>
+
+using namespace std;
+using namespace libaad;
+
+int main(int argc, char *argv[])
+{
+    libaad::initialize(nullptr, 0);
+    
+    if(argc < 2) {
+        cout << "Usage: " << argv[0] << " <trapdoor-in-file> [<max-q>]" << endl;
+        cout << endl;
+        cout << "Reads the parameters from <trapdoor-in-file>-<i> for i = 0, 1, ... (or only the first <max-q> of them) and writes them in binary to <trapdoor-in-file>.bin, which can then be mapped in memory rather than parsed when loading the parameters (see PublicParameters::fromBinary())." << endl;
+        return 1;
+    }
+
+    string inFile(argv[1]);
+    int maxQ = argc > 2 ? std::stoi(argv[2]) : -1;
+    string binFile = PublicParameters::getBinaryFile(inFile);
+
+    PublicParameters pp(inFile, maxQ, true, false);
+
+    loginfo << "Writing " << pp.q + 1 << " parameters to " << binFile << " ..." << endl;
+    pp.writeBinary(binFile);
+
+    loginfo << "Checking " << binFile << " ..." << endl;
+    auto ppBin = PublicParameters::fromBinary(inFile, binFile, maxQ, false, false);
+    if(pp != *ppBin) {
+        logerror << "The parameters in " << binFile << " do not match the ones in the text files" << endl;
+        return 1;
+    }
+
+    loginfo << "All done!" << endl;
+
+    return 0;
+}
@@ -1,6 +1,7 @@
 #include <aad/Configuration.h>
 
 #include <cstdlib>
+#include <cstring>
 
 #include <aad/AADS.h>
 #include <aad/BitString.h>
@@ -14,7 +15,7 @@ using namespace libaad;
 using namespace libaad;
 using std::endl;
 
-void benchFrontierSizes(int n, bool progress = false);
+void benchFrontierSizes(int n, size_t upperChunkSize, bool progress = false);
 
 int main(int argc, char *argv[])
 {
@@ -24,17 +25,25 @@ int main(int argc, char *argv[])
     srand(42);
 
     int n = 1024*16-1;
+    size_t upperChunkSize = 1;
     if(argc > 1) {
+        if(strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0) {
+            std::cout << "Usage: " << argv[0] << " [numLeafs] [upperFrontierChunkSize]" << endl;
+            return 0;
+        }
         n = std::stoi(argv[1]);
     }
+    if(argc > 2) {
+        upperChunkSize = static_cast<size_t>(std::stoi(argv[2]));
+    }
 
     loginfo << endl;
     loginfo << "---------------------------------------------------------------------------------" << endl;
     loginfo << "WARNING: Frontier sizes refer to all nodes in the frontier tree, not just leaves!" << endl;
     loginfo << "---------------------------------------------------------------------------------" << endl;
     loginfo << endl;
-    loginfo << "Benchmarking frontier sizes for AAD of " << n << " leafs" << endl;
-    benchFrontierSizes(n, true);
+    loginfo << "Benchmarking frontier sizes for AAD of " << n << " leafs (" << upperChunkSize << " missing key prefixes per frontier leaf)" << endl;
+    benchFrontierSizes(n, upperChunkSize, true);
 
     std::cout << "Bench '" << argv[0] << "' finished successfully" << std::endl;
 
@@ -65,10 +74,39 @@ void printRootSizes(const AAD& aad, int currSize) {
         cout << size  << ", ";
     }
     cout << "(" << totalSize/currSize << "x overhead)" << endl;
+
+    loginfo << "Frontier leafs: ";
+    totalSize = 0;
+    for(auto root : roots) {
+        auto frontier = std::get<1>(root);
+        
+        int size = frontier->getNumLeafs();
+        totalSize += size;
+        cout << size  << ", ";
+    }
+    cout << "(" << totalSize << " total)" << endl;
     cout << endl;
 }
 
-void benchFrontierSizes(int n, bool progress) {
+/**
+ * Reports the average size of non-membership proofs, and what part of it is due to frontier paths and chunks of missing key prefixes.
+ */
+template<class AAD>
+void printNonMembProofSizes(const AAD& aad, int numSamples) {
+    size_t frontierSize = 0, chunksSize = 0;
+    for(int i = 0; i < numSamples; i++) {
+        auto proof = aad.completeMembershipProof("missing-key-" + std::to_string(i));
+        frontierSize += static_cast<size_t>(proof->getFrontierProofSize());
+        chunksSize += static_cast<size_t>(proof->getMissingPrefixChunksSize());
+    }
+
+    size_t samples = static_cast<size_t>(numSamples);
+    loginfo << "Avg. non-membership proof frontier paths: " << Utils::humanizeBytes(frontierSize / samples) << endl;
+    loginfo << "Avg. non-membership proof prefix chunks:  " << Utils::humanizeBytes(chunksSize / samples) << endl;
+    loginfo << "Avg. non-membership proof frontier total: " << Utils::humanizeBytes((frontierSize + chunksSize) / samples) << endl;
+}
+
+void benchFrontierSizes(int n, size_t upperChunkSize, bool progress) {
     std::vector<std::string> keys;
     keys.push_back("k" + std::to_string(1));
     for(int i = 0; i < 3*n/4; i++) {
@@ -76,7 +114,9 @@ void benchFrontierSizes(int n, bool progress) {
     }
 
     AAD<std::string, std::string> aad;
+    aad.setUpperFrontierChunkSize(upperChunkSize);
     int prevPct = -1;
+    ManualTimer t;
     for(int i = 0; i < n; i++) {
         // Pick a random key
         size_t r = static_cast<size_t>(rand()) % keys.size();
@@ -92,8 +132,10 @@ void benchFrontierSizes(int n, bool progress) {
             }
         }
     }
-    loginfo << "Finished appending " << n << " key value pairs" << endl;
+    auto usecs = t.stop().count();
+    loginfo << "Finished appending " << n << " key value pairs in " << usecs / 1000 << " ms" << endl;
 
     loginfo << "Final sizes for n = " << n << endl;
     printRootSizes(aad, n);
+    printNonMembProofSizes(aad, 32);
 }
@@ -1,6 +1,7 @@
 #include <aad/Configuration.h>
 
 #include <aad/Library.h>
+#include <aad/PublicParameters.h>
 
 #include <xassert/XAssert.h>
 #include <xutils/Timer.h>
@@ -71,6 +72,43 @@ void benchPairing(int iters) {
     logperf << t2 << endl;
 }
 
+void benchPreparedPairing(int iters) {
+    G2 g2tau = Fr::random_element() * G2::one();
+    G2Prepared g2tauPrepared = PrepareG2(g2tau);
+    const G2Prepared& g2Prepared = PublicParameters::getPreparedG2();
+
+    AveragingTimer t1("Pairing with g2 (unprepared)"), t2("Pairing with g2 (prepared)");
+    AveragingTimer t3("Pairing with g2^tau (unprepared)"), t4("Pairing with g2^tau (prepared)");
+    for(int i = 0; i < iters; i++) {
+        G1 a = G1::random_element();
+        GT gt1, gt2;
+
+        t1.startLap();
+        gt1 = ReducedPairing(a, G2::one());
+        t1.endLap();
+
+        t2.startLap();
+        gt2 = ReducedPairing(a, g2Prepared);
+        t2.endLap();
+
+        testAssertEqual(gt1, gt2);
+
+        t3.startLap();
+        gt1 = ReducedPairing(a, g2tau);
+        t3.endLap();
+
+        t4.startLap();
+        gt2 = ReducedPairing(a, g2tauPrepared);
+        t4.endLap();
+
+        testAssertEqual(gt1, gt2);
+    }
+    logperf << t1 << endl;
+    logperf << t2 << endl;
+    logperf << t3 << endl;
+    logperf << t4 << endl;
+}
+
 int main(int argc, char *argv[])
 {
     (void)argc; (void)argv;
@@ -92,6 +130,10 @@ int main(int argc, char *argv[])
     logperf << "Benchmarking pairing... " << endl;
     benchPairing(1024);
 
+    logperf << endl;
+    logperf << "Benchmarking pairing with fixed, prepared G2 elements... " << endl;
+    benchPreparedPairing(1024);
+
     std::cout << "Bench '" << argv[0] << "' finished successfully" << std::endl;
 
     return 0;
@@ -1,6 +1,8 @@
 #include <aad/Configuration.h>
+#include <aad/Endomorphism.h>
 #include <aad/Library.h>
 
+#include <aad/PolyCommit.h>
 #include <aad/PolyOps.h>
 #include <aad/Utils.h>
 #include <aad/EllipticCurves.h>
@@ -27,6 +29,14 @@ void benchMultiExp(const std::string& method, const std::vector<Group>& g1, cons
     std::string timerName = method + ", " + std::to_string(exp.size()) + " exps, " + std::to_string(numIters) + " iters, " + std::to_string(numCores) + " cores: ";
     AveragingTimer t(timerName);
 
+    // like PolyCommit with endomorphisms enabled, where the bases' images are precomputed once per PublicParameters
+    std::vector<Group> endo;
+    if(method == "glv_pre" && Endomorphism::has<Group>()) {
+        endo.reserve(g1.size());
+        for(auto& b : g1)
+            endo.push_back(Endomorphism::apply(b));
+    }
+
     for(int i = 0; i < numIters; i++) {
         t.startLap();
         if(method == "naive_plain")
@@ -46,6 +56,22 @@ void benchMultiExp(const std::string& method, const std::vector<Group>& g1, cons
         {
             libff::multi_exp<Group, Fr, libff::multi_exp_method_BDLO12>(g1.cbegin(), g1.cend(), exp.cbegin(), exp.cend(), numCores);
         }
+        else if(method == "auto")
+        {
+            // NOTE: these last two pick the method based on the size and always use all cores, like PolyCommit does
+            multiExp<Group>(g1.cbegin(), g1.cend(), exp.cbegin(), exp.cend());
+        }
+        else if(method == "glv")
+        {
+            // includes the time to split the exponents
+            multiExpEndo<Group>(g1.cbegin(), g1.cend(), exp.cbegin(), exp.cend());
+        }
+        else if(method == "glv_pre")
+        {
+            // includes the time to split the exponents, but not to compute the bases' images
+            multiExpEndo<Group>(g1.data(), g1.data() + g1.size(), endo.empty() ? nullptr : endo.data(),
+                exp.data(), exp.data() + exp.size());
+        }
         else
         {
             throw std::runtime_error("Invalid multi-exponentiation method name");
@@ -67,7 +93,9 @@ int main(int argc, char * argv[])
         cout << endl;
         cout << "Usage: " << argv[0] << " <method> <num-exps> <num-iters> [<skip-G2>]" << endl;
         cout << endl;
-        cout << "<method> can be either 'naive_plain', 'naive', 'bos_coster' or 'bdlo12'" << endl;
+        cout << "<method> can be either 'naive_plain', 'naive', 'bos_coster', 'bdlo12', 'auto', 'glv' or 'glv_pre'" << endl;
+        cout << "('auto' is what PolyCommit uses by default and 'glv_pre' is what it uses with endomorphisms enabled;" << endl;
+        cout << "'glv' also computes the bases' endomorphism images every time)" << endl;
         cout << "<skip-G2> can be either 0 or 1 (default 1)" << endl;
         cout << endl;
         return 1;
@@ -100,14 +128,18 @@ int main(int argc, char * argv[])
     }
     loginfo << endl;
     
+    bool allCoresOnly = method == "auto" || method == "glv" || method == "glv_pre";
+
     logperf << "Benchmarking '" << method << "' MultiExp in G1..." << endl;
-    benchMultiExp(method, g1, exp, numIters, 1);
+    if(!allCoresOnly)
+        benchMultiExp(method, g1, exp, numIters, 1);
     benchMultiExp(method, g1, exp, numIters, numCores);
 
     if(!skipG2) {
         logperf << endl;
         logperf << "Benchmarking '" << method << "' MultiExp in G2..." << endl;
-        benchMultiExp(method, g2, exp, numIters, 1);
+        if(!allCoresOnly)
+            benchMultiExp(method, g2, exp, numIters, 1);
         benchMultiExp(method, g2, exp, numIters, numCores);
     }
 
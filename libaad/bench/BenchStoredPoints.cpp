@@ -0,0 +1,153 @@
+#include <aad/Configuration.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+
+#ifdef __APPLE__
+# include <malloc/malloc.h>
+#else
+# include <malloc.h>
+#endif
+
+#include <aad/AADS.h>
+#include <aad/CompactPoint.h>
+#include <aad/Library.h>
+
+#include <xassert/XAssert.h>
+#include <xutils/Timer.h>
+#include <xutils/Log.h>
+
+using namespace libaad;
+using std::endl;
+
+/**
+ * The bytes allocated with new and not deleted yet, counted by the replacements of the global operator new and
+ * operator delete below. (The array and nothrow versions call these.)
+ */
+static std::atomic<size_t> liveBytes(0);
+
+static size_t allocatedSize(void * p) {
+#ifdef __APPLE__
+    return malloc_size(p);
+#else
+    return malloc_usable_size(p);
+#endif
+}
+
+void * operator new(size_t size) {
+    void * p = std::malloc(size == 0 ? 1 : size);
+    if(p == nullptr)
+        throw std::bad_alloc();
+    liveBytes += allocatedSize(p);
+    return p;
+}
+
+void operator delete(void * p) noexcept {
+    if(p != nullptr) {
+        liveBytes -= allocatedSize(p);
+        std::free(p);
+    }
+}
+
+void operator delete(void * p, size_t) noexcept {
+    operator delete(p);
+}
+
+template<class Group>
+void benchStoring(const char * name, size_t numIters);
+
+int main(int argc, char *argv[])
+{
+    initialize(nullptr, 0);
+    srand(42);
+
+    int n = 1024*4-1;
+    if(argc > 1) {
+        if(strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0) {
+            std::cout << "Usage: " << argv[0] << " [numLeafs]" << endl;
+            return 0;
+        }
+        n = std::stoi(argv[1]);
+    }
+
+#ifdef COMPRESS_STORED_POINTS
+    loginfo << "Stored points are compressed" << endl;
+#else
+    loginfo << "Stored points are affine" << endl;
+#endif
+    loginfo << "G1: " << sizeof(G1) << " bytes, stored in " << sizeof(CompactG1) << " bytes" << endl;
+    loginfo << "G2: " << sizeof(G2) << " bytes, stored in " << sizeof(CompactG2) << " bytes" << endl;
+    loginfo << endl;
+
+    // what a built AAD really takes, rather than what sizeof() says its points should take
+    size_t vmsBefore, rssBefore, vmsAfter, rssAfter;
+    getMemUsage(vmsBefore, rssBefore);
+    size_t liveBefore = liveBytes;
+
+    loginfo << "Appending " << n << " key-value pairs..." << endl;
+    std::unique_ptr<AAD<std::string, std::string>> aad(new AAD<std::string, std::string>());
+    for(int i = 0; i < n; i++) {
+        aad->append("k" + std::to_string(rand() % (n/2 + 1)), "v" + std::to_string(i));
+    }
+
+    getMemUsage(vmsAfter, rssAfter);
+    size_t allocated = liveBytes - liveBefore;
+
+    size_t numForestNodes = 0, numRoots = 0, numFrontierNodes = 0;
+    for(auto& tup : aad->getIndexedForest().getTrees()) {
+        numForestNodes += 2*static_cast<size_t>(std::get<0>(tup)) - 1;
+        numRoots++;
+    }
+    for(auto& root : aad->getRootATs()) {
+        numFrontierNodes += static_cast<size_t>(std::get<1>(root)->getSize());
+    }
+
+    loginfo << "Forest:    " << numForestNodes << " nodes, " << numRoots << " roots" << endl;
+    loginfo << "Frontiers: " << numFrontierNodes << " nodes" << endl;
+    logperf << "Allocated: " << Utils::humanizeBytes(allocated) << " ("
+        << allocated / static_cast<size_t>(n) << " bytes per key-value pair)" << endl;
+    // NOTE: the allocator keeps some of what it got from the OS, so RSS is only a rough check on the number above
+    logperf << "RSS grew:  " << Utils::humanizeBytes(rssAfter > rssBefore ? rssAfter - rssBefore : 0) << endl;
+
+    loginfo << "(Build with and without COMPRESS_STORED_POINTS and compare, to see what compressing saves)" << endl;
+    loginfo << endl;
+
+    // what it costs to store points and to get them back
+    benchStoring<G1>("G1", 1024);
+    benchStoring<G2>("G2", 1024);
+
+    std::cout << "Bench '" << argv[0] << "' finished successfully" << std::endl;
+
+    return 0;
+}
+
+template<class Group>
+void benchStoring(const char * name, size_t numIters) {
+    std::vector<Group> points;
+    for(size_t i = 0; i < numIters; i++) {
+        points.push_back(Group::random_element());
+    }
+
+    std::vector<CompactPoint<Group>> stored(numIters);
+    AveragingTimer setTimer(std::string("Storing a ") + name + " point");
+    for(size_t i = 0; i < numIters; i++) {
+        setTimer.startLap();
+        stored[i].set(points[i]);
+        setTimer.endLap();
+    }
+
+    AveragingTimer getTimer(std::string("Getting a stored ") + name + " point");
+    for(size_t i = 0; i < numIters; i++) {
+        getTimer.startLap();
+        Group p = stored[i].get();
+        getTimer.endLap();
+
+        testAssertEqual(p, points[i]);
+    }
+
+    logperf << setTimer << endl;
+    logperf << getTimer << endl;
+}
@@ -6,6 +6,7 @@
 #include <aad/BitString.h>
 #include <aad/Hashing.h>
 #include <aad/Library.h>
+#include <aad/Scheduler.h>
 #include <aad/Utils.h>
 
 #include <xassert/XAssert.h>
@@ -26,11 +27,9 @@ int main(int argc, char *argv[])
     srand(seed);
     bool sanityCheck = false;
 
-    loginfo << "Initial NTL numThreads: " << NTL::AvailableThreads() << endl;
-
     int n = 8, batchSize = 1;
     if((argc > 1 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) || argc < 2) {
-        std::cout << "Usage: " << argv[0] << " <public-params-file> [n] [batchSize] [sanity-check] [ntlNumCores] [out-file]" << endl;
+        std::cout << "Usage: " << argv[0] << " <public-params-file> [n] [batchSize] [sanity-check] [numThreads] [out-file]" << endl;
         std::cout << endl;
         std::cout << "Append times in <out-file> are in millseconds." << endl;
         return 1;
@@ -49,16 +48,15 @@ int main(int argc, char *argv[])
     }
 
     if(argc > 5) {
-        int ntlNumCores = std::stoi(argv[5]);
-        if(ntlNumCores > static_cast<int>(getNumCores())) {
-            logerror << "Number of cores for libntl (" << ntlNumCores << ") cannot be bigger than # of cores on machine, which is " << getNumCores() << endl;
+        int numThreads = std::stoi(argv[5]);
+        if(numThreads > static_cast<int>(getNumCores())) {
+            logerror << "Number of threads (" << numThreads << ") cannot be bigger than # of cores on machine, which is " << getNumCores() << endl;
             return 1;
         }
 
-        if(ntlNumCores > 0) {
-            NTL::SetNumThreads(static_cast<long>(ntlNumCores));
-            loginfo << "Changed NTL NumThreads to " << ntlNumCores << endl;
-            loginfo << "NTL pool active: " << NTL::GetThreadPool()->active() << endl;
+        // NOTE: NTL stays single-threaded; all parallel work (including NTL calls) runs on the scheduler's threads
+        if(numThreads > 0) {
+            Scheduler::configure(static_cast<size_t>(numThreads));
         }
     }
 
@@ -68,7 +66,9 @@ int main(int argc, char *argv[])
     }
 
 
-    std::unique_ptr<PublicParameters> pp(new PublicParameters(ppFile, n*SecParam*4, true, false));
+    // NOTE: we load more public parameters as the AAD grows, rather than all of them up front (and we map them from
+    // the binary file, if there is one)
+    auto pp = PublicParameters::open(ppFile, n*SecParam*4, true, false, batchSize*SecParam*4);
 
     loginfo << "Randomness seed is " << seed << endl;
     loginfo << "AAD batch size is " << batchSize << endl;
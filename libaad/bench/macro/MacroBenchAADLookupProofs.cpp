@@ -28,19 +28,21 @@ using std::endl;
 
 std::mt19937 *urng;
 
-void benchMembProofSize(int dictSize, int numSamples, const std::vector<int>& numValues, const std::string& fileName, bool progress = false);
+void benchMembProofSize(int dictSize, int numSamples, const std::vector<int>& numValues, const std::string& fileName, bool progress = false, bool batchVerify = false, size_t numThreads = 1);
 
 int main(int argc, char *argv[])
 {
     int numSamples = 10, dictSize = 1023;
     std::string seedStr = "42";
     std::vector<int> numValues = {0, 1, 2, 4, 8, 16, 32};
+    bool batchVerify = false;
+    size_t numThreads = 1;
 
     initialize(nullptr, 0);
 
     if(argc > 1) {
         if(strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0) {
-            std::cout << "Usage: " << argv[0] << " [dictSize] [randSeed]" << endl;
+            std::cout << "Usage: " << argv[0] << " [dictSize] [randSeed] [batchVerify] [numThreads]" << endl;
             return 0;
         }
         auto oldDictSize = dictSize;
@@ -50,6 +52,12 @@ int main(int argc, char *argv[])
     if(argc > 2) {
         seedStr.assign(argv[2]);
     }
+    if(argc > 3) {
+        batchVerify = std::stoi(argv[3]) != 0;
+    }
+    if(argc > 4) {
+        numThreads = static_cast<size_t>(std::stoi(argv[4]));
+    }
     unsigned int seed = static_cast<unsigned int>(std::stoi(seedStr.c_str()));
     
     loginfo << "Seeding srand() with " << seedStr << "..." << endl;
@@ -62,7 +70,10 @@ int main(int argc, char *argv[])
 
 
     std::string fileName = "aad-memb-proof-" + std::to_string(dictSize) + ".csv";
-    benchMembProofSize(dictSize, numSamples, numValues, fileName, true);
+    if(batchVerify)
+        loginfo << "Verifying all pairing equations in a proof with a single multi-pairing" << endl;
+    loginfo << "Verifying the trees in each proof using " << numThreads << " thread(s)" << endl;
+    benchMembProofSize(dictSize, numSamples, numValues, fileName, true, batchVerify, numThreads);
 
     printMemUsage("Memory usage before exiting benchmark");
 
@@ -85,7 +96,7 @@ void initKeys(std::vector<std::string>& keys, int numSamples, const std::vector<
     }
 }
 
-void benchMembProofSize(int dictSize, int numSamples, const std::vector<int>& numValues, const std::string& fileName, bool progress) {
+void benchMembProofSize(int dictSize, int numSamples, const std::vector<int>& numValues, const std::string& fileName, bool progress, bool batchVerify, size_t numThreads) {
     AAD<std::string, std::string> aad;
 
     // pick random leaves for the key-value pairs
@@ -199,6 +210,8 @@ void benchMembProofSize(int dictSize, int numSamples, const std::vector<int>& nu
             }
 
             // time memb proof verification
+            mp->setBatchVerification(batchVerify);
+            mp->setNumThreads(numThreads);
             timeMemb.startLap();
             testAssertTrue(mp->verify(key, values, digest));
             auto membVerTime = timeMemb.endLap();
@@ -3,9 +3,16 @@
 #include <aad/BinaryTree.h>
 #include <aad/PublicParameters.h>
 #include <aad/Hashing.h>
+#include <aad/PairingBatch.h>
+#include <aad/Scheduler.h>
 
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
 #include <vector>
 
+
 namespace libaad {
 
 // (AT accumulator, frontier accumulator, Merkle hash)
@@ -37,9 +44,22 @@ public:
 
     bool verified;
 
+protected:
+    /**
+     * When batch verification is enabled, verify() collects all pairing equations in here rather than checking them
+     * one by one, and checks them all at the end.
+     */
+    bool batchVerification;
+    std::unique_ptr<PairingBatch> pairingBatch;
+
+    /**
+     * The number of threads verify() uses to verify the trees in the forest in parallel (1 means no extra threads).
+     */
+    size_t numThreads;
+
 public:
     AADProof(PublicParameters *pp)
-        : pp(pp), forestProofs(nullptr), verified(false)
+        : pp(pp), forestProofs(nullptr), verified(false), batchVerification(false), numThreads(1)
     {}
 
     virtual ~AADProof() {
@@ -57,6 +77,23 @@ public:
 
     bool simulate() const { return !hasPublicParameters(); }
 
+    /**
+     * Enables checking all pairing equations in the proof with a single multi-pairing during verify().
+     * If the batch fails, the equations are checked one by one to log which ones failed.
+     */
+    void setBatchVerification(bool enable) { batchVerification = enable; }
+    bool isBatchVerification() const { return batchVerification; }
+
+    /**
+     * Lets verify() check each tree in the forest on a different thread, using up to 'n' of the Scheduler's threads.
+     * The result does not depend on the number of threads.
+     */
+    void setNumThreads(size_t n) {
+        assertStrictlyPositive(n);
+        numThreads = n;
+    }
+    size_t getNumThreads() const { return numThreads; }
+
     virtual int getProofSize() const {
         return getForestProofSize();
     }
@@ -208,7 +245,10 @@ public:
         assertFalse(data->merkleHash.isUnset());
     }
 
-    bool verifySubsetProofs(Node* node) {
+    /**
+     * If 'batch' is not null, the pairing checks are added to it rather than checked right away.
+     */
+    bool verifySubsetProofs(Node* node, PairingBatch* batch = nullptr) {
         logtrace << "Verifying subset proof at node " << node->getLabel() << " ..." << endl;
         if(node == nullptr) {
             throw std::logic_error("Expected non-null node as input!");
@@ -227,7 +267,9 @@ public:
             auto parentAcc = *parentData->acc;
             auto acc = *data->acc;
             auto proof = *data->subsetProof;
-            if(ReducedPairing(parentAcc, G2::one()) != ReducedPairing(acc, proof) && !this->simulate()) {
+            if(batch != nullptr) {
+                batch->addEquality(parentAcc, G2::one(), acc, proof, node, "subset proof against parent accumulator");
+            } else if(ReducedPairing(parentAcc, PublicParameters::getPreparedG2()) != ReducedPairing(acc, proof) && !this->simulate()) {
                 logerror << "Subset check failed along Merkle path" << endl;
                 return false;
             }
@@ -243,16 +285,82 @@ public:
         }
 
         if(node->left && !leftMerkleSib)
-            leftRet = verifySubsetProofs(node->left.get());
+            leftRet = verifySubsetProofs(node->left.get(), batch);
 
         if(node->right && !rightMerkleSib)
-            rightRet = verifySubsetProofs(node->right.get());
+            rightRet = verifySubsetProofs(node->right.get(), batch);
 
         assertTrue(node->left != nullptr || node->right != nullptr || isMerkleLeaf(node));
 
         return leftRet && rightRet;
     }
 
+protected:
+    /**
+     * Call at the start of verify(): if batch verification is enabled, pairing checks will be collected from now on.
+     */
+    void startPairingBatch() {
+        pairingBatch.reset(batchVerification ? new PairingBatch(pp) : nullptr);
+    }
+
+    /**
+     * Returns a new batch for collecting the pairing checks of one tree in the forest, or null if batch verification is
+     * disabled. The tree's batch is later merged into the proof's batch via mergePairingBatch().
+     */
+    std::unique_ptr<PairingBatch> newTreePairingBatch() const {
+        return std::unique_ptr<PairingBatch>(pairingBatch != nullptr ? new PairingBatch(pp) : nullptr);
+    }
+
+    void mergePairingBatch(const std::unique_ptr<PairingBatch>& treeBatch) {
+        if(treeBatch != nullptr) {
+            assertNotNull(pairingBatch);
+            pairingBatch->merge(*treeBatch);
+        }
+    }
+
+    /**
+     * Call at the end of verify() with the result of all the other checks: checks the collected pairing equations (if any).
+     */
+    bool finishPairingBatch(bool ok) {
+        std::unique_ptr<PairingBatch> b(std::move(pairingBatch));
+        if(!ok || b == nullptr || b->size() == 0)
+            return ok;
+
+        if(b->verify() || this->simulate())
+            return true;
+
+        logerror << "Batched check of " << b->size() << " pairing equations failed, checking them one by one" << endl;
+        b->verifyEach();
+        return false;
+    }
+
+    /**
+     * Calls verifyTree(i) for every tree i in the forest and returns true if all calls return true.
+     * With more than one thread, the trees are handed out to the threads dynamically, so calls for different trees
+     * must not touch any shared state. The calls stop early once one of them fails.
+     */
+    bool verifyTrees(size_t numTrees, const std::function<bool(size_t)>& verifyTree) const {
+        size_t n = std::min(numThreads, numTrees);
+        if(n <= 1) {
+            for(size_t i = 0; i < numTrees; i++) {
+                if(!verifyTree(i))
+                    return false;
+            }
+            return true;
+        }
+
+        // NOTE: the Scheduler installs NTL's modulus on its threads
+        std::atomic<bool> failed(false);
+        Scheduler::parallelFor(0, numTrees, [&](size_t i) {
+            if(failed)
+                return;
+            if(!verifyTree(i))
+                failed = true;
+        }, n);
+        return !failed;
+    }
+
+public:
     int getForestProofSize(Node* node) const {
         int size = 0;
 
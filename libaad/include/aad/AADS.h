@@ -4,15 +4,25 @@
 #include <boost/container/flat_map.hpp>
 #include <boost/container/map.hpp>
 #include <map>
+#include <mutex>
 
 #include <aad/AccumulatedTree.h>
+#include <aad/AppendLog.h>
 #include <aad/MembProof.h>
 #include <aad/AppendOnlyProof.h>
 #include <aad/CommitUtils.h>
+#include <aad/CompactPoint.h>
 #include <aad/EllipticCurves.h>
+#include <aad/FlatAADProof.h>
 #include <aad/Hashing.h>
+#include <aad/KeyInterner.h>
 #include <aad/PublicParameters.h>
 #include <aad/PolyInterpolation.h>
+#include <aad/RootStore.h>
+#include <aad/Scheduler.h>
+#include <aad/Snapshot.h>
+#include <aad/TaskGraph.h>
+#include <aad/ValueLog.h>
 
 #include <xutils/Utils.h>
 #include <xutils/NotImplementedException.h>
@@ -25,11 +35,16 @@ namespace libaad {
 
 class Sha256 {
 public:
-    BitString hashK(const std::string& k) {
+    BitString hashK(std::string_view k) {
         return hashString(k);
     }
 
-    BitString hashKV(const std::string& k, const std::string& v, int idx) {
+    BitString hashV(std::string_view v, int idx) {
+        return hashValue(v, idx);
+    }
+
+    // NOTE: hashKV(k, v, idx) = hashK(k) | hashV(v, idx) (see LeafPolyCache)
+    BitString hashKV(std::string_view k, std::string_view v, int idx) {
         return hashKeyValuePair(k, v, idx);
     }
 };
@@ -43,6 +58,8 @@ class AAD {
 public:
     class DataType;     // data stored in internal nodes in the forest
     class LeafDataType; // data stored in leaf nodes in the forest
+    class StoredLeafDataType;   // a leaf that stores its value
+    class LoggedLeafDataType;   // a leaf whose value is in the value log
     class MerkleData;           // data stored in Merkle nodes in a membership or append-only proof
     class LeafMerkleData;       // data stored in leaf Merkle nodes in a membership proof
     class MergeFunc;    // function that merges two nodes' data in the forest
@@ -60,11 +77,18 @@ public:
     using MembProofPtrType = std::unique_ptr<MembProofType>;
     using AppendOnlyProofType = AppendOnlyProof<MerkleData>;
     using AppendOnlyProofPtrType = std::unique_ptr<AppendOnlyProofType>;
+    using FlatMembProofType = FlatMembershipProof<SecParam, CryptoHash, MerkleData>;       // see writeMembershipProof()
+    using FlatAppendOnlyProofType = FlatAppendOnlyProof<MerkleData>;                        // see writeAppendOnlyProof()
+    using VerifierContextType = VerifierContext<KeyT, ValT, SecParam, CryptoHash>;    // client-side cache for verifying membership proofs
+    using LeafPolyCacheType = LeafPolyCache<KeyT, SecParam, CryptoHash>;            // server-side cache of key polynomials for new leaves
 
     using AccTreeNodePtrType = Node*;
     using AccTreeType = AccumulatedTree;
     using AccTreePtrType = AccTreeType*;
-    using IndexedForestType = IndexedForest<KeyT, DataType, MergeFunc>;
+    using IndexedForestType = IndexedForest<KeyId, DataType, MergeFunc>;    // indexes leaves by their interned key
+    using KeyInternerType = KeyInterner<KeyT>;
+    // what a ValuesRange yields: a view of a std::string value, or a copy of any other value
+    using ValueRefType = typename std::conditional<std::is_same<ValT, std::string>::value, std::string_view, ValT>::type;
 
 public:
     class DataType {
@@ -74,13 +98,20 @@ public:
         // The Merkle hash
         MerkleHash merkleHash;
         // AT accumulator over all prefixes (G1)
-        G1 acc, eAcc;
+        CompactG1 acc, eAcc;
         // Append-only proof (none for roots) (G2)
-        G2 subsetProof;
+        CompactG2 subsetProof;
         // Disjointness/GCD proof here consisting of Bezout coefficients (only for roots) (both in G2)
-        std::unique_ptr<G2> x, y;  // e(acc, x) e(frontierAcc, y) = e(g,g)
+        struct BezoutProof {
+            CompactG2 x, y;  // e(acc, x) e(frontierAcc, y) = e(g,g)
+        };
+        // NOTE: Only roots have one, and every node starts out as a root, so x and y live together in a single
+        // allocation, rather than in every node (which would more than double the size of a node).
+        std::unique_ptr<BezoutProof> bezout;
         // AT polynomial here (only for roots)
         std::vector<Fr> accPoly;
+        // ...and/or in a mapped snapshot or spill file, which keeps it until the root is merged (see getAccPoly())
+        MappedPoly mappedAccPoly;
 
         // The accumulated tree (AT) (only for roots)
         std::unique_ptr<AccTreeType> at;
@@ -88,145 +119,459 @@ public:
         // Also, the frontier polynomial is not needed once frontier proofs are computed.
         std::unique_ptr<FrontierType> frontier;
 
+        // For roots spilled by a RootStore or restored from a snapshot: where the AT is (even after it is read back
+        // in, see getAT()), and the spill files, which also hold the AT polynomial if it was spilled (see mappedAccPoly)
+        SpilledRegion spilledAT;
+        std::vector<std::shared_ptr<MappedFile>> spillFiles;
+        // When a merge (or anything else but a proof's containsKey()) last needed this root's AT or AT polynomial
+        // (see RootStore::enforceBudget())
+        std::chrono::steady_clock::time_point lastUsed;
+        // Guards reading the AT back in, since concurrent proofs can need the same spilled root (see containsKey())
+        std::mutex atMutex;
+
     public:
         // Called when copying node data during a membership proof
         DataType(int size)
             : size(size),
               acc(G1::one()), eAcc(G1::one()), subsetProof(G2::one()),
-              x(nullptr), y(nullptr),
-              at(nullptr), frontier(nullptr)
+              bezout(nullptr),
+              at(nullptr), frontier(nullptr),
+              lastUsed(std::chrono::steady_clock::now())
         {
         }
 
         // We added a computeFrontier flag because, when merging repeatedly, we waste time computing the frontier
         // just to discard it in the next merge.
-        DataType(PublicParameters * pp, AccTreePtrType at, int size, bool computeFrontier)
+        //
+        // When 'retainFrontier' is true, the frontier keeps its lower frontier leaves around so that the next merged
+        // frontier can reuse them. When merging, 'left' and 'right' are the children, whose retained frontier leaves
+        // (if any) are reused here for all keys that did not get new values.
+        //
+        // 'upperChunkSize' is the number of missing key prefixes (i.e., upper frontier nodes) stored in a frontier leaf.
+        //
+        // If 'atPoly' is not empty, it is the AT's polynomial, which was already computed (e.g., for a leaf, via a LeafPolyCache).
+        DataType(PublicParameters * pp, AccTreePtrType at, int size, bool computeFrontier,
+            bool retainFrontier = false, DataType * left = nullptr, DataType * right = nullptr, size_t upperChunkSize = 1,
+            std::vector<Fr>&& atPoly = std::vector<Fr>())
             : DataType(size)
+        {
+            TaskGraph graph;
+            addTasks(graph, pp, at, computeFrontier, retainFrontier, left, right, upperChunkSize, std::move(atPoly));
+            graph.run();
+        }
+
+        /**
+         * Adds the tasks that compute this node's AT polynomial, accumulators and (if 'computeFrontier') frontier and
+         * disjointness proof to 'graph', with the same arguments as the constructor above. The caller then runs the graph.
+         *
+         * The frontier only depends on the AT, so it is computed at the same time as the AT's polynomial and accumulators.
+         *
+         * Returns the tasks after which accPoly and acc (respectively) are ready, so the caller can add tasks that depend on them.
+         */
+        std::tuple<std::vector<TaskGraph::TaskId>, std::vector<TaskGraph::TaskId>> addTasks(TaskGraph& graph, PublicParameters * pp, AccTreePtrType at,
+            bool computeFrontier, bool retainFrontier, DataType * left, DataType * right, size_t upperChunkSize,
+            std::vector<Fr>&& atPoly)
         {
             //logdbg << "DataType(" << size << "), frontier = " << computeFrontier << endl;
             bool simulate = pp == nullptr;
             this->at.reset(at);
 
+            std::vector<TaskGraph::TaskId> polyReady, accReady;
+            // NOTE: the checks below use the accumulators as computed, rather than decompress the stored ones again
+            // (see CompactPoint)
+            std::shared_ptr<std::tuple<G1, G1>> accs;
             if(!simulate) {
                 assertNotNull(pp);
-                std::tie(acc, eAcc) = CommitUtils::commitAT(at, accPoly, pp, true);
+                if(atPoly.empty()) {
+                    polyReady.push_back(graph.add([this] {
+                        CommitUtils::interpolateAT(this->at.get(), accPoly);
+                    }));
+                } else {
+                    accPoly = std::move(atPoly);
+                }
 
-                assertEqual(ReducedPairing(acc, pp->getG2toTau()), ReducedPairing(eAcc, G2::one()));
+                accs = std::make_shared<std::tuple<G1, G1>>();
+                auto accTask = graph.add([this, pp, accs] {
+                    std::get<0>(*accs) = CommitUtils::commitAcc(accPoly, pp, false);
+                    acc = std::get<0>(*accs);
+                }, polyReady);
+                auto eAccTask = graph.add([this, pp, accs] {
+                    std::get<1>(*accs) = CommitUtils::commitAcc(accPoly, pp, true);
+                    eAcc = std::get<1>(*accs);
+                }, polyReady);
+                graph.add([pp, accs] {
+                    assertEqual(ReducedPairing(std::get<0>(*accs), pp->getPreparedG2toTau()),
+                        ReducedPairing(std::get<1>(*accs), PublicParameters::getPreparedG2()));
+                }, {accTask, eAccTask});
+                accReady.push_back(accTask);
             } else {
                 acc = G1::one();
                 eAcc = G1::one(); // normally this should be g^{tau}, but we have no public params when simulate=true
             }
 
             if(computeFrontier && EnableFrontier) {
-                ManualTimer t;
-                std::chrono::microseconds::rep micros = 0;
-
-                // Create an empty frontier
-                frontier.reset(new FrontierType(pp));
-
-                // Get upper frontier nodes and pointers to 'upper frontier leafs' or 'lower frontier roots'
-                std::vector<BitString> upperFrontierNodes;
-                std::vector<AccTreeNodePtrType> lowerRoots;
-                t.restart();
-                at->getUpperFrontier(upperFrontierNodes, lowerRoots);
-                micros += t.stop().count();
-
-                // First, get lower frontier nodes for each value in the AT
-                std::vector<BitString> frontierNodes;
-                for(auto lowRoot : lowerRoots) {
+                auto frontierTask = graph.add([=] {
+                    ManualTimer t;
+                    std::chrono::microseconds::rep micros = 0;
+
+                    // Create an empty frontier
+                    frontier.reset(new FrontierType(pp, retainFrontier));
+
+                    FrontierPtrType leftFrontier = left != nullptr ? left->frontier.get() : nullptr;
+                    FrontierPtrType rightFrontier = right != nullptr ? right->frontier.get() : nullptr;
+                    bool canReuse = (leftFrontier != nullptr && leftFrontier->isRetainingLeaves()) ||
+                        (rightFrontier != nullptr && rightFrontier->isRetainingLeaves());
+
+                    // Get upper frontier nodes and the 'lower frontier roots' (i.e., the keys). We get them from the AT's
+                    // sorted leaf hashes if we have them, which is faster than walking the AT.
+                    bool useSorted = at->hasSortedLeaves();
+                    std::vector<BitString> upperFrontierNodes;
+                    std::vector<AccTreeNodePtrType> lowerRoots;
+                    std::vector<SortedFrontier::Range> lowerRanges;
                     t.restart();
-                    frontierNodes.clear();  // clear upper frontier nodes or previous iteration's lower frontier nodes
-
-                    // NOTE(Alin): Getting the label after already having the node pointer is a bit inefficient
-                    // because we already walked down the tree to obtain the node pointer and could've gotten the label too.
-                    BitString keyHash = lowRoot->getLabel();
-                    
-                    at->getLowerFrontier(frontierNodes, keyHash, lowRoot);
-                    std::sort(frontierNodes.begin(), frontierNodes.end());
+                    if(useSorted) {
+                        at->getUpperFrontier(upperFrontierNodes, lowerRanges);
+                    } else {
+                        at->getUpperFrontier(upperFrontierNodes, lowerRoots);
+                    }
                     micros += t.stop().count();
-
-                    size_t chunkSize = SecParam * 4;
-                    size_t numChunks = frontierNodes.size() / chunkSize;
-                    auto it = frontierNodes.cbegin();
-                    for(size_t i = 0; i < numChunks; i++) {
-                        frontier->addMissingValuesPrefixes(keyHash, it, it + static_cast<long>(chunkSize));
-                        it += static_cast<long>(chunkSize);
+                    size_t numKeys = useSorted ? lowerRanges.size() : lowerRoots.size();
+
+                    // First, get lower frontier nodes for each value in the AT
+                    std::vector<BitString> frontierNodes;
+                    for(size_t i = 0; i < numKeys; i++) {
+                        t.restart();
+                        frontierNodes.clear();  // clear upper frontier nodes or previous iteration's lower frontier nodes
+
+                        BitString keyHash;
+                        AccTreeNodePtrType lowRoot = nullptr;
+                        int numValues = 0;
+                        if(useSorted) {
+                            const auto& range = lowerRanges[i];
+                            keyHash = SortedFrontier::toBitString(at->getSortedLeaves()[std::get<0>(range)], SecParam * 2);
+                            numValues = static_cast<int>(std::get<1>(range) - std::get<0>(range));
+                            // we only need the lower root to find the key's retained frontier leaves
+                            if(retainFrontier || canReuse)
+                                std::tie(std::ignore, lowRoot, std::ignore) = at->containsKey(keyHash);
+                        } else {
+                            lowRoot = lowerRoots[i];
+                            // NOTE(Alin): Getting the label after already having the node pointer is a bit inefficient
+                            // because we already walked down the tree to obtain the node pointer and could've gotten the label too.
+                            keyHash = lowRoot->getLabel();
+                            if(retainFrontier || canReuse)
+                                numValues = AccTreeType::getNumLeaves(lowRoot);
+                        }
+
+                        // If the key got no new values in this merge, its lower frontier did not change, so we reuse
+                        // its leaves from one of the children's frontiers.
+                        if(canReuse && (
+                            frontier->addRetainedValuesPrefixes(leftFrontier, lowRoot, keyHash, numValues) ||
+                            frontier->addRetainedValuesPrefixes(rightFrontier, lowRoot, keyHash, numValues)))
+                        {
+                            micros += t.stop().count();
+                            continue;
+                        }
+                    
+                        if(useSorted) {
+                            // already sorted
+                            at->getLowerFrontier(frontierNodes, lowerRanges[i]);
+                        } else {
+                            at->getLowerFrontier(frontierNodes, keyHash, lowRoot);
+                            std::sort(frontierNodes.begin(), frontierNodes.end());
+                        }
+                        micros += t.stop().count();
+
+                        size_t chunkSize = SecParam * 4;
+                        size_t numChunks = frontierNodes.size() / chunkSize;
+                        auto it = frontierNodes.cbegin();
+                        for(size_t c = 0; c < numChunks; c++) {
+                            frontier->addMissingValuesPrefixes(keyHash, it, it + static_cast<long>(chunkSize), lowRoot, numValues);
+                            it += static_cast<long>(chunkSize);
+                        }
+                        size_t leftOver = frontierNodes.size() % chunkSize;
+                        if(leftOver > 0) {
+                            frontier->addMissingValuesPrefixes(keyHash, it, it + static_cast<long>(leftOver), lowRoot, numValues);
+                        }
                     }
-                    size_t leftOver = frontierNodes.size() % chunkSize;
-                    if(leftOver > 0) {
-                        frontier->addMissingValuesPrefixes(keyHash, it, it + static_cast<long>(leftOver));
+
+#ifdef LIBAAD_PROFILE
+                    if(canReuse && !simulate) {
+                        logperf << "Reused lower frontiers of " << frontier->getNumReusedKeys() << " out of " << numKeys
+                            << " keys (" << frontier->getNumReusedLeaves() << " frontier leaves)" << endl;
                     }
-                }
+#endif
                 
-                // Second, add prefixes for the missing keys (upper frontier)
-                for(auto& prefix : upperFrontierNodes) {
-                    frontier->addMissingKeyPrefix(prefix);
-                }
+                    // Second, add prefixes for the missing keys (upper frontier)
+                    if(upperChunkSize <= 1) {
+                        for(auto& prefix : upperFrontierNodes) {
+                            frontier->addMissingKeyPrefix(prefix);
+                        }
+                    } else {
+                        // NOTE: getUpperFrontier returns the prefixes sorted lexicographically, so each chunk covers a
+                        // contiguous range of the key space.
+                        assertLessThanOrEqual(upperChunkSize, static_cast<size_t>(SecParam * 4));
+                        auto it = upperFrontierNodes.cbegin();
+                        while(it != upperFrontierNodes.cend()) {
+                            auto chunkEnd = it + static_cast<long>(std::min(upperChunkSize,
+                                static_cast<size_t>(upperFrontierNodes.cend() - it)));
+                            frontier->addMissingKeyPrefixes(it, chunkEnd);
+                            it = chunkEnd;
+                        }
+                    }
 
-                t.restart();
-                std::vector<BitString>().swap(upperFrontierNodes);
-                micros += t.stop().count();
+                    t.restart();
+                    std::vector<BitString>().swap(upperFrontierNodes);
+                    micros += t.stop().count();
 
-                //logdbg << "Finalizing frontier..." << endl;
+                    //logdbg << "Finalizing frontier..." << endl;
                 
-                frontier->finalize();
-                 
-                if(!simulate) {
-                    printOpPerf(micros, "frontierCompute", static_cast<size_t>(frontier->getSize()));
-                    assertNotNull(pp);
+                    frontier->finalize();
 
-                    // compute EEA between AT and frontier polynomials
-                    std::vector<Fr> coeffX, coeffY;
-                    auto& frRootPoly = frontier->getRootPoly();
-                    assertFalse(libfqfft::_is_zero(frRootPoly));
-                    ManualTimer eeaCompTimer;
-                    eea_ntl(accPoly, frRootPoly, coeffX, coeffY);
-                    printOpPerf(eeaCompTimer.stop().count(), "computeEEA", frRootPoly.size());
+                    if(!simulate)
+                        printOpPerf(micros, "frontierCompute", static_cast<size_t>(frontier->getSize()));
+                });
 
-                    // clear the frontier polynomial
-                    std::vector<Fr>().swap(frRootPoly);
+                if(!simulate) {
+                    // compute EEA between AT and frontier polynomials
+                    // NOTE: The root's EEA is the biggest single step of a merge and nothing else in this merge can
+                    // start before it is done, so it runs on NTL's own threads (see eea_ntl()).
+                    auto coeffs = std::make_shared<std::tuple<std::vector<Fr>, std::vector<Fr>>>();
+                    auto eeaDeps = polyReady;
+                    eeaDeps.push_back(frontierTask);
+                    auto eeaTask = graph.add([this, coeffs] {
+                        auto& frRootPoly = frontier->getRootPoly();
+                        assertFalse(libfqfft::_is_zero(frRootPoly));
+                        ManualTimer eeaCompTimer;
+                        eea_ntl(accPoly, frRootPoly, std::get<0>(*coeffs), std::get<1>(*coeffs),
+                            static_cast<long>(Scheduler::get().getNumThreads()));
+                        printOpPerf(eeaCompTimer.stop().count(), "computeEEA", frRootPoly.size());
+
+                        // clear the frontier polynomial
+                        std::vector<Fr>().swap(frRootPoly);
+                    }, eeaDeps);
 
                     // commit to EEA coeffs (assuming no next MergeFunc call)
-                    ManualTimer eeaCommitTimer;
-                    x.reset(new G2(PolyCommit::commitG2(*pp, coeffX, false)));
-                    y.reset(new G2(PolyCommit::commitG2(*pp, coeffY, false)));
-                    printOpPerf(eeaCommitTimer.stop().count(), "commitEEA", coeffX.size() + coeffY.size());
-            
-                    assertEqual(ReducedPairing(acc, *x)*ReducedPairing(frontier->getRootAcc(), *y), ReducedPairing(G1::one(), G2::one()));
+                    // NOTE: x and y are set by different tasks, but in the same BezoutProof
+                    bezout.reset(new BezoutProof());
+                    auto xy = std::make_shared<std::tuple<G2, G2>>();
+                    auto xTask = graph.add([this, pp, coeffs, xy] {
+                        ManualTimer eeaCommitTimer;
+                        std::get<0>(*xy) = PolyCommit::commitG2(*pp, std::get<0>(*coeffs), false);
+                        bezout->x = std::get<0>(*xy);
+                        printOpPerf(eeaCommitTimer.stop().count(), "commitEEA", std::get<0>(*coeffs).size());
+                    }, {eeaTask});
+                    auto yTask = graph.add([this, pp, coeffs, xy] {
+                        ManualTimer eeaCommitTimer;
+                        std::get<1>(*xy) = PolyCommit::commitG2(*pp, std::get<1>(*coeffs), false);
+                        bezout->y = std::get<1>(*xy);
+                        printOpPerf(eeaCommitTimer.stop().count(), "commitEEA", std::get<1>(*coeffs).size());
+                    }, {eeaTask});
+
+                    graph.add([this, accs, xy] {
+                        assertEqual(ReducedPairing(std::get<0>(*accs), std::get<0>(*xy))*ReducedPairing(frontier->getRootAcc(), std::get<1>(*xy)), ReducedPairing(G1::one(), PublicParameters::getPreparedG2()));
+                    }, {accReady[0], xTask, yTask});
                 } else {
-                    x.reset(new G2(G2::one()));
-                    y.reset(new G2(G2::one()));
+                    bezout.reset(new BezoutProof());
+                    bezout->x = G2::one();
+                    bezout->y = G2::one();
                 }
             }
+
+            return std::make_tuple(polyReady, accReady);
         }
 
         virtual ~DataType() {
         }
         
     public:
+        /**
+         * Returns the AT polynomial, reading it in from the snapshot if this node was restored from one (or from
+         * its spill file if it was spilled).
+         */
+        std::vector<Fr>& getAccPoly() {
+            lastUsed = std::chrono::steady_clock::now();
+            // the mapped copy stays put, so spilling this root again need not write it again (see spill())
+            if(accPoly.empty() && mappedAccPoly.isSet())
+                accPoly.assign(mappedAccPoly.data(), mappedAccPoly.data() + mappedAccPoly.size());
+            return accPoly;
+        }
+
+        /**
+         * Returns the AT, reading it back in if it was spilled. (Only for roots.)
+         */
+        AccTreePtrType getAT() {
+            lastUsed = std::chrono::steady_clock::now();
+            return loadAT();
+        }
+
+        /**
+         * Like getAT()->containsKey(), but returns only whether the key was found and, if not, its first missing prefix.
+         * If the AT was spilled, looks the key up in the spill file rather than read the AT back in. Unlike getAT(),
+         * this does not count as a use of the root (see RootStore::enforceBudget()), since proofs probe every root.
+         *
+         * Safe to call concurrently (e.g., from concurrent proofs), but not with spill().
+         */
+        std::tuple<bool, BitString> containsKey(const BitString& keyHash) {
+            bool found;
+            BitString missingPrefix;
+            if(!isResident() && spilledAT.isSet()) {
+                SnapshotReader in(spilledAT.file, spilledAT.offset);
+                if(AccTreeType::containsKeyInSnapshot(in, keyHash, found, missingPrefix))
+                    return std::make_tuple(found, missingPrefix);
+            }
+
+            std::tie(found, std::ignore, missingPrefix) = loadAT()->containsKey(keyHash);
+            return std::make_tuple(found, missingPrefix);
+        }
+
+        std::chrono::steady_clock::time_point getLastUsed() const { return lastUsed; }
+
+        bool isResident() {
+            std::lock_guard<std::mutex> lock(atMutex);
+            return at != nullptr;
+        }
+
+        /**
+         * Returns the number of bytes taken up in RAM by the AT and AT polynomial.
+         */
+        size_t getResidentBytes() const {
+            return accPoly.capacity() * sizeof(Fr) + (at != nullptr ? at->getMemoryUsage() : 0);
+        }
+
+        /**
+         * Moves the AT and AT polynomial (whichever are in RAM) out of RAM. (Only for roots.) Since a root's AT and
+         * AT polynomial do not change until it is merged, whatever was already spilled (or is in a mapped snapshot)
+         * is simply dropped from RAM and only the rest is written to a new spill file in 'store'.
+         *
+         * Must not be called concurrently with proofs (see AAD::trimRoots()).
+         */
+        void spill(RootStore& store) {
+            std::lock_guard<std::mutex> lock(atMutex);
+            bool spillPoly = !accPoly.empty() && !mappedAccPoly.isSet();
+            bool spillAT = at != nullptr && !spilledAT.isSet();
+
+            if(spillPoly || spillAT) {
+                size_t atBegin = 0, atEnd = 0;
+                auto file = store.spill([this, spillPoly, spillAT, &atBegin, &atEnd](SnapshotWriter& out) {
+                    out.writePoly(spillPoly ? accPoly : std::vector<Fr>());
+                    atBegin = static_cast<size_t>(out.getPosition());
+                    if(spillAT)
+                        at->writeSnapshot(out);
+                    atEnd = static_cast<size_t>(out.getPosition());
+                });
+
+                SnapshotReader in(file);
+                auto poly = in.readPoly();
+                if(spillPoly) {
+                    assertTrue(poly.isSet());
+                    mappedAccPoly = poly;
+                }
+                if(spillAT)
+                    spilledAT = SpilledRegion(file, atBegin, atEnd - atBegin);
+                spillFiles.push_back(file);
+            }
+
+            std::vector<Fr>().swap(accPoly);   // clears memory
+            at.reset(nullptr);
+        }
+
         void freeAfterMerge() {
-            x.reset(nullptr);
-            y.reset(nullptr);
+            bezout.reset(nullptr);
             std::vector<Fr>().swap(accPoly);   // clears memory
+            mappedAccPoly.reset();
             assertNull(at); // was std::move'd so should be null
+            spilledAT = SpilledRegion();
             frontier.reset(nullptr);
+            spillFiles.clear();
+        }
+
+    protected:
+        /**
+         * Reads the AT back in from its spill file (or snapshot), if it is not in RAM. The file keeps it, so it can be
+         * dropped from RAM again without being rewritten.
+         */
+        AccTreePtrType loadAT() {
+            std::lock_guard<std::mutex> lock(atMutex);
+            if(at == nullptr && spilledAT.isSet()) {
+                SnapshotReader in(spilledAT.file, spilledAT.offset);
+                at.reset(AccTreeType::readSnapshot(in));
+                if(at->getMaxDepth() != SecParam*4)
+                    throw std::runtime_error("Snapshot has an AT of the wrong depth");
+
+                // the frontier's retained keys refer to the nodes of the AT we spilled (or to none, if restored)
+                if(frontier != nullptr)
+                    frontier->relinkRetained(at.get());
+            }
+            return at.get();
         }
     };
 
     class LeafDataType : public DataType {
     public:
-        KeyT k;
-        ValT v; 
+        // The key, interned in the AAD (see AAD::getLeafKey())
+        KeyId keyId;
         int leafNo;
 
+    protected:
+        // The path of a leaf's key-value pair in its AT and (maybe) the AT's polynomial
+        using LeafPathAndPoly = std::tuple<BitString, std::vector<Fr>>;
+
+    public:
+        /**
+         * Creates a new leaf in the forest. If 'polyCache' is given, the leaf's AT polynomial is computed from the
+         * key's cached polynomial.
+         *
+         * 'keyId' is the key's id in the AAD's KeyInterner. 'k' and 'v' can be a KeyT and a ValT or anything they can
+         * be explicitly constructed from (e.g., std::string_view's, for std::string keys and values).
+         *
+         * If 'valueLog' is given, the value is appended to it and the leaf is a LoggedLeafDataType, which only has
+         * the value's offset in the log. Otherwise, it is a StoredLeafDataType, which has the value itself.
+         */
+        template<class K, class V>
+        static LeafDataType * create(PublicParameters * pp, KeyId keyId, const K& k, const V& v, int leafNo,
+            int batchSize, bool retainFrontier = false, size_t upperChunkSize = 1,
+            LeafPolyCacheType * polyCache = nullptr, ValueLog * valueLog = nullptr)
+        {
+            auto pathAndPoly = getLeafPathAndPoly(pp, k, v, leafNo, polyCache);
+            if(valueLog != nullptr)
+                return new LoggedLeafDataType(pp, keyId, valueLog->append(v), leafNo, batchSize, retainFrontier,
+                    upperChunkSize, std::move(pathAndPoly));
+            else
+                return new StoredLeafDataType(pp, keyId, ValT(v), leafNo, batchSize, retainFrontier,
+                    upperChunkSize, std::move(pathAndPoly));
+        }
+
+        /**
+         * Creates a leaf restored from a snapshot, which restores the rest of its data too.
+         */
+        static LeafDataType * restore(KeyId keyId, ValT&& v, int leafNo, ValueLog * valueLog = nullptr) {
+            if(valueLog != nullptr)
+                return new LoggedLeafDataType(keyId, valueLog->append(v), leafNo);
+            else
+                return new StoredLeafDataType(keyId, std::move(v), leafNo);
+        }
+
     public:
-        // Used when creating a new leaf in the forest
-        LeafDataType(PublicParameters * pp, const KeyT& k, const ValT& v, int leafNo, int batchSize)
+        /**
+         * Returns the value of this leaf, reading it from 'valueLog' if it is there.
+         */
+        virtual ValT getValue(const ValueLog * valueLog) const = 0;
+
+        /**
+         * Like getValue(), but returns a view of the value if it is a std::string.
+         */
+        virtual ValueRefType getValueRef(const ValueLog * valueLog) const = 0;
+
+    protected:
+        LeafDataType(PublicParameters * pp, KeyId keyId, int leafNo, int batchSize, bool retainFrontier,
+            size_t upperChunkSize, LeafPathAndPoly&& pathAndPoly)
             : DataType(pp, 
-                new AccTreeType(SecParam*4, CryptoHash().hashKV(k, v, leafNo)), 
+                new AccTreeType(SecParam*4, std::get<0>(pathAndPoly)), 
                 1,
-                batchSize == 1 ? leafNo % 2 == 0 : false), // only computes frontier if batchSize is 1 and leaf is even numbered (e.g., 0, 2, 4, ...)
-             k(k), v(v), leafNo(leafNo)
+                batchSize == 1 ? leafNo % 2 == 0 : false, // only computes frontier if batchSize is 1 and leaf is even numbered (e.g., 0, 2, 4, ...)
+                retainFrontier, nullptr, nullptr, upperChunkSize,
+                std::move(std::get<1>(pathAndPoly))),
+             keyId(keyId), leafNo(leafNo)
         {
             bool simulate = pp == nullptr;
             if(!simulate) {
@@ -240,6 +585,84 @@ public:
             }
         }
 
+        LeafDataType(KeyId keyId, int leafNo)
+            : DataType(1), keyId(keyId), leafNo(leafNo)
+        {}
+
+        template<class K, class V>
+        static LeafPathAndPoly getLeafPathAndPoly(PublicParameters * pp, const K& k, const V& v, int leafNo, LeafPolyCacheType * polyCache) {
+            LeafPathAndPoly ret;
+            // when simulating, the AT polynomial is not needed
+            // NOTE: a hash without hashV() never gets a cache (see setLeafPolyCacheSize()), so we do not instantiate
+            // LeafPolyCache::getLeafPoly() for it
+            if constexpr(HasValueHash<CryptoHash>::value) {
+                if(polyCache != nullptr && pp != nullptr) {
+                    polyCache->getLeafPoly(k, v, leafNo, std::get<0>(ret), std::get<1>(ret));
+                    return ret;
+                }
+            } else {
+                (void)pp;
+                assertNull(polyCache);
+            }
+
+            std::get<0>(ret) = CryptoHash().hashKV(k, v, leafNo);
+            return ret;
+        }
+    };
+
+    // A leaf that has its value
+    class StoredLeafDataType : public LeafDataType {
+    public:
+        ValT v;
+
+    public:
+        StoredLeafDataType(PublicParameters * pp, KeyId keyId, ValT&& v, int leafNo, int batchSize,
+            bool retainFrontier, size_t upperChunkSize, typename LeafDataType::LeafPathAndPoly&& pathAndPoly)
+            : LeafDataType(pp, keyId, leafNo, batchSize, retainFrontier, upperChunkSize, std::move(pathAndPoly)),
+              v(std::move(v))
+        {}
+
+        StoredLeafDataType(KeyId keyId, ValT&& v, int leafNo)
+            : LeafDataType(keyId, leafNo), v(std::move(v))
+        {}
+
+    public:
+        virtual ValT getValue(const ValueLog *) const { return v; }
+
+        virtual ValueRefType getValueRef(const ValueLog *) const { return v; }
+    };
+
+    // A leaf whose value is in the AAD's value log (see AAD::setValueLog()), so it only has the value's offset there
+    class LoggedLeafDataType : public LeafDataType {
+    public:
+        uint64_t logOffset;
+
+    public:
+        LoggedLeafDataType(PublicParameters * pp, KeyId keyId, uint64_t logOffset, int leafNo, int batchSize,
+            bool retainFrontier, size_t upperChunkSize, typename LeafDataType::LeafPathAndPoly&& pathAndPoly)
+            : LeafDataType(pp, keyId, leafNo, batchSize, retainFrontier, upperChunkSize, std::move(pathAndPoly)),
+              logOffset(logOffset)
+        {}
+
+        LoggedLeafDataType(KeyId keyId, uint64_t logOffset, int leafNo)
+            : LeafDataType(keyId, leafNo), logOffset(logOffset)
+        {}
+
+    public:
+        virtual ValT getValue(const ValueLog * valueLog) const {
+            ValT val;
+            ValueLog::fromBytes(valueLog->getValue(logOffset), val);
+            return val;
+        }
+
+        virtual ValueRefType getValueRef(const ValueLog * valueLog) const {
+            if constexpr(std::is_same<ValT, std::string>::value) {
+                auto view = valueLog->getValue(logOffset);
+                return std::string_view(view.data, view.size);
+            } else {
+                return getValue(valueLog);
+            }
+        }
     };
     
     // Used for Merkle proof data
@@ -269,30 +692,80 @@ public:
     // Used for forest leaves in a membership proof
     class LeafMerkleData : public MerkleData {
     public:
-        KeyT k;
+        std::shared_ptr<const KeyT> k;  // all leaves in a membership proof have the same key, so they share it
         ValT v;
         int leafNo;
 
     public:
         // Used when copying a leaf during a membership proof
-        LeafMerkleData(const KeyT& k, const ValT& v, int leafNo)
-            : MerkleData(MerkleData::Type::Leaf), k(k), v(v), leafNo(leafNo)
+        LeafMerkleData(const std::shared_ptr<const KeyT>& k, ValT&& v, int leafNo)
+            : MerkleData(MerkleData::Type::Leaf), k(k), v(std::move(v)), leafNo(leafNo)
         {
         }
     };
 
+    /**
+     * The values of a key, as a range over its leaves: iterating yields a std::string_view of every value if ValT is
+     * std::string (of the value in its leaf or in the value log), or a copy of every value otherwise.
+     */
+    class ValuesRange {
+    public:
+        using LeafVector = std::vector<ForestNodePtrType>;
+
+        class Iterator {
+        protected:
+            typename LeafVector::const_iterator it;
+            const ValueLog * valueLog;
+
+        public:
+            Iterator(typename LeafVector::const_iterator it, const ValueLog * valueLog)
+                : it(it), valueLog(valueLog)
+            {}
+
+        public:
+            ValueRefType operator*() const {
+                auto leafData = dynamic_cast<const LeafDataType*>((*it)->getData());
+                assertNotNull(leafData);
+                return leafData->getValueRef(valueLog);
+            }
+
+            Iterator& operator++() { ++it; return *this; }
+            bool operator==(const Iterator& other) const { return it == other.it; }
+            bool operator!=(const Iterator& other) const { return it != other.it; }
+        };
+
+    protected:
+        const LeafVector& leaves;
+        const ValueLog * valueLog;
+
+    public:
+        ValuesRange(const LeafVector& leaves, const ValueLog * valueLog)
+            : leaves(leaves), valueLog(valueLog)
+        {}
+
+    public:
+        Iterator begin() const { return Iterator(leaves.begin(), valueLog); }
+        Iterator end() const { return Iterator(leaves.end(), valueLog); }
+        size_t size() const { return leaves.size(); }
+        bool empty() const { return leaves.empty(); }
+    };
+
     class MergeFunc {
     protected:
         int batchSize;
+        bool incrementalFrontier;
+        size_t upperChunkSize;
         PublicParameters *pp;
 
     public:
         MergeFunc()
-            : batchSize(1) {
+            : batchSize(1), incrementalFrontier(false), upperChunkSize(1) {
         }
 
     public:
         void setBatchSize(int size) { batchSize = size; }
+        void setIncrementalFrontier(bool enable) { incrementalFrontier = enable; }
+        void setUpperFrontierChunkSize(size_t size) { upperChunkSize = size; }
         void setPublicParameters(PublicParameters *p) { pp = p; }
 
         DataPtrType operator() (ForestNodePtrType leftNode, ForestNodePtrType rightNode, bool isLastMerge)
@@ -304,7 +777,9 @@ public:
             //logdbg << "Merging size " << left->size << " with size " << right->size 
             //    << " ... (isLastMerge = " << isLastMerge << ")" << endl;
 
-            // Merges the two children ATs
+            // Merges the two children ATs (reading them back in first, if they were spilled)
+            left->getAT();
+            right->getAT();
             auto at = new AccTreeType(std::move(left->at), std::move(right->at));
             //std::chrono::milliseconds mus1 = std::chrono::duration_cast<std::chrono::milliseconds>(t1.stop());
 
@@ -317,7 +792,13 @@ public:
             //logdbg << "batchSize: " << batchSize << endl;
             //logdbg << "log2floor(" << batchSize << "): " << Utils::log2floor(batchSize) << endl;
             //logdbg << "haveFullBatch: " << haveFullBatch << endl;
-            auto data = new DataType(pp, at, left->size + right->size, isLastMerge && haveFullBatch);
+            // The steps of a merge form a small task graph: the parent's AT polynomial, its accumulators, its frontier
+            // (which only needs the AT), the children's subset proofs and the Merkle hash.
+            TaskGraph graph;
+            auto data = new DataType(left->size + right->size);
+            std::vector<TaskGraph::TaskId> polyReady, accReady;
+            std::tie(polyReady, accReady) = data->addTasks(graph, pp, at, isLastMerge && haveFullBatch,
+                incrementalFrontier, left, right, upperChunkSize, std::vector<Fr>());
             //std::chrono::milliseconds mus2 = std::chrono::duration_cast<std::chrono::milliseconds>(t2.stop());
 
             //if(mus1.count() + mus2.count() > 100) {
@@ -329,28 +810,32 @@ public:
             if(!simulate) {
                 assertNotNull(pp);
 
-                // now parent AT is ready, so compute append-only proofs (store in 'left' and 'right')
-                std::vector<Fr> quotient, rem;
-                poly_divide_ntl(quotient, rem, data->accPoly, left->accPoly);
-                assertTrue(libfqfft::_is_zero(rem));
-                left->subsetProof = PolyCommit::commitG2(*pp, quotient, false);
-
-                quotient.clear();
-                rem.clear();
-                poly_divide_ntl(quotient, rem, data->accPoly, right->accPoly);
-                assertTrue(libfqfft::_is_zero(rem));
-                right->subsetProof = PolyCommit::commitG2(*pp, quotient, false);
+                // once the parent's AT polynomial is ready, compute append-only proofs (store in 'left' and 'right')
+                for(auto child : { left, right }) {
+                    graph.add([this, data, child] {
+                        std::vector<Fr> quotient, rem;
+                        poly_divide_ntl(quotient, rem, data->accPoly, child->getAccPoly());
+                        assertTrue(libfqfft::_is_zero(rem));
+                        child->subsetProof = PolyCommit::commitG2(*pp, quotient, false);
+                    }, polyReady);
+                }
 
                 // compute Merkle hash
-                data->merkleHash = MerkleHash(data->acc, left->merkleHash, right->merkleHash);
+                graph.add([data, left, right] {
+                    data->merkleHash = MerkleHash(data->acc, left->merkleHash, right->merkleHash);
+                }, accReady);
             } else {
                 left->subsetProof = G2::one();
                 right->subsetProof = G2::one();
                 data->merkleHash = MerkleHash::dummy();
             }
 
-            assertEqual(ReducedPairing(data->acc, G2::one()), ReducedPairing(left->acc, left->subsetProof));
-            assertEqual(ReducedPairing(data->acc, G2::one()), ReducedPairing(right->acc, right->subsetProof));
+            graph.run();
+
+            // NOTE: decompresses every stored point only once (see CompactPoint)
+            GT parentPairing = ReducedPairing(data->acc.get(), PublicParameters::getPreparedG2());
+            assertEqual(parentPairing, ReducedPairing(left->acc.get(), left->subsetProof.get()));
+            assertEqual(parentPairing, ReducedPairing(right->acc.get(), right->subsetProof.get()));
 
             // No longer need AT and frontier in the merged old roots
             left->freeAfterMerge();
@@ -365,11 +850,19 @@ protected:
     PublicParameters * params;
     bool simulate;
     int batchSize;  // only computes frontiers for trees with more leaves than 'batchSize'
+    bool incrementalFrontier;   // reuses lower frontier leaves of the merged trees when computing a new frontier
+    size_t upperChunkSize;      // number of missing key prefixes per frontier leaf
+    std::unique_ptr<LeafPolyCacheType> leafPolyCache; // caches the key part of new leaves' AT polynomials (null if disabled)
     MergeFunc mergeFunc;
+    std::shared_ptr<MappedFile> snapshot;   // the snapshot this AAD was restored from, if any (see restoreSnapshot())
+    std::unique_ptr<AppendLog> appendLog;   // logs every append, if enabled (see openAppendLog())
+    std::unique_ptr<RootStore> rootStore;   // spills cold roots' ATs and AT polynomials to disk, if enabled (see setRootStore())
+    std::unique_ptr<ValueLog> valueLog;     // stores the leaves' values, if enabled (see setValueLog())
+    KeyInternerType keys;                   // the only copy of every distinct key (in RAM, anyway)
 
 public:
     AAD(PublicParameters * p = nullptr)
-        : params(p), simulate(p == nullptr), batchSize(1)
+        : params(p), simulate(p == nullptr), batchSize(1), incrementalFrontier(false), upperChunkSize(1), leafPolyCache(nullptr)
     {
         mergeFunc.setPublicParameters(p);
         forest.setMergeFunc(&mergeFunc);
@@ -387,6 +880,86 @@ public:
         mergeFunc.setBatchSize(size);
     }
 
+    /**
+     * When enabled, frontiers keep the polynomials and commitments of their lower frontier leaves, so that
+     * the frontier of a merged tree only recomputes the leaves of keys that got new values (plus the
+     * upper frontier leaves and the frontier tree above the leaves). Costs extra memory for the retained
+     * polynomials. Must be set before appending.
+     *
+     * NOTE: Only the leaves are reused. Every level of the frontier tree above them is still rebuilt, so this
+     * saves the lower frontier's hashing and leaf polynomials, not the products up the tree. Either way, the
+     * digests are the same.
+     */
+    void setIncrementalFrontier(bool enable) {
+        assertEqual(forest.getCount(), 0);
+
+        incrementalFrontier = enable;
+        mergeFunc.setIncrementalFrontier(enable);
+    }
+
+    /**
+     * Groups the missing key prefixes (i.e., the upper frontier) in chunks of 'size' per frontier leaf, rather than one
+     * per leaf. This makes frontiers smaller and faster to compute and shortens frontier paths in non-membership proofs,
+     * but these proofs then have to include all the prefixes in the chunk. Must be set before appending.
+     */
+    void setUpperFrontierChunkSize(size_t size) {
+        assertStrictlyPositive(size);
+        assertLessThanOrEqual(size, static_cast<size_t>(SecParam * 4));
+        assertEqual(forest.getCount(), 0);
+
+        upperChunkSize = size;
+        mergeFunc.setUpperFrontierChunkSize(size);
+    }
+
+    /**
+     * Caches the key polynomials (i.e., the key part of the AT polynomial) of up to 'maxKeys' recently-appended keys,
+     * so appending a value for a hot key only interpolates the value part of the new leaf's AT. Disabled by default
+     * (i.e., 0), since it only pays off if keys get appended to repeatedly, and each cached key polynomial takes up
+     * about 256 coefficients.
+     *
+     * Only available if CryptoHash can hash values on their own (see HasValueHash).
+     */
+    void setLeafPolyCacheSize(size_t maxKeys) {
+        static_assert(HasValueHash<CryptoHash>::value, "The leaf polynomial cache needs CryptoHash::hashV(v, idx)");
+        leafPolyCache.reset(maxKeys > 0 ? new LeafPolyCacheType(maxKeys) : nullptr);
+    }
+
+    const LeafPolyCacheType* getLeafPolyCache() const { return leafPolyCache.get(); }
+
+    /**
+     * Keeps the roots' ATs and AT polynomials under 'ramBudget' bytes, by spilling the coldest ones that take up at
+     * least 'minSpillBytes' to (unlinked, memory-mapped) files in 'spillDir' (see RootStore). They are read back in
+     * when a merge or a proof needs them. The budget is enforced after every append, but not after proofs (which
+     * are const and can run concurrently), so ATs read back in by proofs stay in RAM until the next append or
+     * trimRoots().
+     */
+    void setRootStore(const std::string& spillDir, size_t ramBudget, size_t minSpillBytes = RootStore::DefaultMinSpillBytes) {
+        rootStore.reset(new RootStore(spillDir, ramBudget, minSpillBytes));
+        enforceRootBudget();
+    }
+
+    const RootStore* getRootStore() const { return rootStore.get(); }
+
+    /**
+     * Spills cold roots again until they fit in the RootStore's RAM budget (e.g., after many proofs read spilled ATs
+     * back in). Does nothing if there is no RootStore. Must not be called concurrently with proofs.
+     */
+    void trimRoots() {
+        enforceRootBudget();
+    }
+
+    /**
+     * Stores the values of new leaves in a memory-mapped log in 'file' (see ValueLog), rather than in the leaves
+     * themselves, which then only have the value's offset in the log (see LoggedLeafDataType). getValueViews() then returns the values without copying them. Must be set before appending
+     * (or restoring a snapshot).
+     */
+    void setValueLog(const std::string& file, uint64_t maxSize = 1ull << 40) {
+        assertEqual(forest.getCount(), 0);
+        valueLog.reset(new ValueLog(file, maxSize));
+    }
+
+    const ValueLog* getValueLog() const { return valueLog.get(); }
+
     int getSize() const { return forest.getCount(); }
 
     KeyT getKeyByLeafNo(int leafNo) {
@@ -396,7 +969,7 @@ public:
         assertNotNull(leafNode);
         auto data = dynamic_cast<LeafDataType*>(leafNode->data.get());
         assertNotNull(data);
-        return data->k;
+        return getLeafKey(data);
     }
 
     std::vector<std::tuple<AccTreePtrType, FrontierPtrType>> getRootATs() const {
@@ -405,7 +978,7 @@ public:
         for(auto tup : trees) {
             auto rootNode = std::get<1>(tup);
             auto data = rootNode->data.get();
-            roots.push_back(std::make_tuple(data->at.get(), data->frontier.get()));
+            roots.push_back(std::make_tuple(data->getAT(), data->frontier.get()));
         }
 
         return roots;
@@ -451,32 +1024,58 @@ public:
     }
 
     void append(const KeyT& k, const ValT& v) {
-        int i = forest.getCount();
+        appendKeyValue(k, v);
+    }
 
-        //logdbg << endl;
-        //logdbg << "Append #" << i+1 << ": (" << k << ", " << v << ") ..." << endl;
+    /**
+     * Like append(const KeyT&, const ValT&), but for AADs of std::string keys and values, so that callers that already
+     * have the key and value in some buffer (e.g., a request) do not need to copy them into std::string's. The key is
+     * only copied if it is new (see KeyInterner) and the value only once, into its leaf (or the value log).
+     */
+    template<class K = KeyT, class V = ValT, typename std::enable_if<
+        std::is_same<K, std::string>::value && std::is_same<V, std::string>::value, int>::type = 0>
+    void append(std::string_view k, std::string_view v) {
+        appendKeyValue(k, v);
+    }
 
-        auto leafData = new LeafDataType(params, k, v, i, batchSize);
-        forest.appendLeaf(leafData, k);
-        //logdbg << "Num trees: " << forest.getNumTrees() << endl;
+    /**
+     * Returns the key of 'leaf' (which only has the id of its key).
+     */
+    KeyT getLeafKey(const LeafDataType * leaf) const {
+        return KeyT(keys.get(leaf->keyId));
     }
 
+    /**
+     * Returns the number of distinct keys in the AAD.
+     */
+    size_t getNumKeys() const { return keys.size(); }
+
+    const KeyInternerType& getKeyInterner() const { return keys; }
+
     /**
      * Returns the keys in the AAD, in no particular order.
      */
     std::vector<KeyT> getKeys() const {
-        std::vector<KeyT> keys;
-        forest.getLookupKeys(keys);
-        return keys;
+        std::vector<KeyId> ids;
+        forest.getLookupKeys(ids);
+
+        std::vector<KeyT> ks;
+        ks.reserve(ids.size());
+        for(auto id : ids) {
+            ks.push_back(KeyT(keys.get(id)));
+        }
+        return ks;
     }
 
     /**
      * Returns the list of values for 'key', in the order they were inserted!
+     *
+     * NOTE: This copies every value. getValuesRange() does not.
      */
     std::list<ValT> getValues(const KeyT& key) const {
         std::list<ValT> vals;
 
-        const auto& leaves = forest.getLeaves(key);
+        const auto& leaves = forest.getLeaves(keys.find(key));
 
         // WARNING: Assuming the leaves were added to the vector in the order they were appended!
         for(auto leafNode : leaves) {
@@ -484,12 +1083,40 @@ public:
             auto leafData = dynamic_cast<LeafDataType*>(leafNode->getData());
             assertNotNull(leafData);
 
-            vals.push_back(leafData->v);
+            vals.push_back(leafData->getValue(valueLog.get()));
         }
         
         return vals;
     }
 
+    /**
+     * Like getValues(), but returns views of the values in the value log, rather than copies (see setValueLog()).
+     * The views are valid for as long as this AAD is around.
+     */
+    std::vector<ValueLog::View> getValueViews(const KeyT& key) const {
+        assertNotNull(valueLog);
+        std::vector<ValueLog::View> views;
+
+        const auto& leaves = forest.getLeaves(keys.find(key));
+        views.reserve(leaves.size());
+        for(auto leafNode : leaves) {
+            auto leafData = dynamic_cast<LoggedLeafDataType*>(leafNode->getData());
+            assertNotNull(leafData);
+            views.push_back(valueLog->getValue(leafData->logOffset));
+        }
+
+        return views;
+    }
+
+    /**
+     * Returns the values for 'key', in the order they were inserted, as a range over the key's leaves, so that
+     * iterating over them allocates nothing (see ValuesRange). Valid until the next append.
+     */
+    template<class K>
+    ValuesRange getValuesRange(const K& key) const {
+        return ValuesRange(forest.getLeaves(keys.find(key)), valueLog.get());
+    }
+
     AppendOnlyProofPtrType appendOnlyProof(int prevVersion) {
         // NOTE: Append-only proof does not include EEA proofs in the new roots (we assume when the client gets the new digest it also gets EEA proofs)
         AppendOnlyProofPtrType proof(new AppendOnlyProofType(params));
@@ -527,7 +1154,7 @@ public:
                     destNode->setData(new MerkleData(MerkleData::Type::Leaf));
                     // ...and the subset proof
                     if(!destNode->isRoot()) {
-                        destNode->data->subsetProof.reset(new G2(!simulate ? srcData->subsetProof : G2::random_element()));
+                        destNode->data->subsetProof.reset(new G2(!simulate ? srcData->subsetProof.get() : G2::random_element()));
                     }
                 } else {
                     logtrace << " * Source node is 'on path'" << endl;
@@ -551,11 +1178,11 @@ public:
 
                     // For "on path" nodes (except root), copy AT accumulator (if not already there)
                     if(!destNode->isRoot() && destData->acc == nullptr)
-                        destData->acc.reset(new G1(!simulate ? srcData->acc : G1::random_element()));
+                        destData->acc.reset(new G1(!simulate ? srcData->acc.get() : G1::random_element()));
 
                     // For "on path" nodes (except root), copy AT subset proof (if not already there)
                     if(!destNode->isRoot() && destData->subsetProof == nullptr)
-                        destData->subsetProof.reset(new G2(!simulate ? srcData->subsetProof : G2::random_element()));
+                        destData->subsetProof.reset(new G2(!simulate ? srcData->subsetProof.get() : G2::random_element()));
                 }
             }
         };
@@ -575,6 +1202,7 @@ public:
         }
 
         MembProofPtrType membProof(new MembProofType(params));
+        auto proofKey = std::make_shared<const KeyT>(k);
 
         /**
          * When isSrcSibling is true, it means we are copying a (source) sibling node over. 
@@ -587,7 +1215,7 @@ public:
          * So we either overwrite previously-set sibling node or overwrite "on path" node.
          */
         std::function<void(ForestNodePtrType, typename MembProofType::ForestNodePtrType, bool)> copierFunc = 
-        [this](ForestNodePtrType srcNode, typename MembProofType::ForestNodePtrType destNode, bool isSrcSibling) {
+        [this, &proofKey](ForestNodePtrType srcNode, typename MembProofType::ForestNodePtrType destNode, bool isSrcSibling) {
             assertNotNull(srcNode);
             assertNotNull(destNode);
 
@@ -619,10 +1247,12 @@ public:
                     //    << ", value " << leafData->v << " and index " << leafData->leafNo << endl;
                     assertNotNull(leafData);
                     // For leafs, copy the <k,v,i> pair
-                    destNode->setData(new LeafMerkleData(leafData->k, leafData->v, leafData->leafNo));
+                    // NOTE: the proof must have its own copy of the value, so it is copied straight out of the value log
+                    // (all the leaves have the same key, so the proof has a single copy of it)
+                    destNode->setData(new LeafMerkleData(proofKey, leafData->getValue(valueLog.get()), leafData->leafNo));
                     // ...and the subset proof
                     if(!destNode->isRoot()) {
-                        destNode->data->subsetProof.reset(new G2(!simulate ? srcData->subsetProof : G2::random_element()));
+                        destNode->data->subsetProof.reset(new G2(!simulate ? srcData->subsetProof.get() : G2::random_element()));
                     }
                 } else {
                     logtrace << " * Source node is 'on path'" << endl;
@@ -646,17 +1276,18 @@ public:
 
                     // For "on path" nodes (except root), copy AT accumulator (if not already there)
                     if(!destNode->isRoot() && destData->acc == nullptr)
-                        destData->acc.reset(new G1(!simulate ? srcData->acc : G1::random_element()));
+                        destData->acc.reset(new G1(!simulate ? srcData->acc.get() : G1::random_element()));
 
                     // For "on path" nodes (except root), copy AT subset proof (if not already there)
                     if(!destNode->isRoot() && destData->subsetProof == nullptr)
-                        destData->subsetProof.reset(new G2(!simulate ? srcData->subsetProof : G2::random_element()));
+                        destData->subsetProof.reset(new G2(!simulate ? srcData->subsetProof.get() : G2::random_element()));
                 }
             }
         };
 
         // Get Merkle paths to all values of 'k', if any.
-        membProof->forestProofs = forest.partialMembershipProof(k, copierFunc);
+        // (A key that was never appended has no id, and thus no values.)
+        membProof->forestProofs = forest.partialMembershipProof(keys.find(k), copierFunc);
 
         for(auto tree : *membProof->forestProofs) {
             if(tree != nullptr) {
@@ -672,13 +1303,14 @@ public:
         BitString missingPrefix;
 
         // Go through all roots and do completeness proofs (handles non-membership of 'k')
-        for(auto tup : getRootATs()) {
+        for(auto tup : forest.getTrees()) {
             bool found;
-            auto accuTree = std::get<0>(tup); // get AT
-            auto frontier = std::get<1>(tup); // get frontier
+            auto data = std::get<1>(tup)->getData();
+            auto frontier = data->frontier.get(); // get frontier
 
             // Check if key is in AT, and if not, get is first missing prefix for frontier proofs later
-            std::tie(found, std::ignore, missingPrefix) = accuTree->containsKey(keyHash);
+            // (without reading the AT back in, if it was spilled)
+            std::tie(found, missingPrefix) = data->containsKey(keyHash);
 
             // Get frontier proofs, either for completeness of k's values or for non-membership of k
             auto frontierProof = frontier->getFrontierProof(
@@ -688,8 +1320,13 @@ public:
             membProof->frontierProofs->push_back(frontierProof);
 
             // Map missing prefixes to their frontier proof
-            if(!found)
+            if(!found) {
                 membProof->missingPrefixes[frontierProof] = missingPrefix;
+
+                // If the upper frontier is chunked, the client needs all other prefixes in the missing prefix's leaf too
+                if(upperChunkSize > 1)
+                    membProof->missingPrefixChunks[frontierProof] = frontier->getPrefixChunk(missingPrefix);
+            }
         }
 
         // We won't have Merkle paths in every tree in the forest, but we store nullptr's where we don't
@@ -700,9 +1337,586 @@ public:
         return membProof;
     }
 
+    /**
+     * Like appendOnlyProof(), but writes the proof to 'out' in the flat wire format (see FlatProof), rather than build
+     * it out of BinaryTree's. Returns the size of the proof. The client verifies it in place (see FlatAppendOnlyProofType).
+     */
+    size_t writeAppendOnlyProof(int prevVersion, std::string& out) const {
+        auto oldRoots = forest.getOldRoots(prevVersion);
+        std::set<ForestNodePtrType> oldRootSet(oldRoots.begin(), oldRoots.end());
+
+        FlatProofWriter w(FlatProof::Kind::AppendOnly);
+        writeFlatForestProofs(w, oldRootSet, false, [](const std::tuple<int, ForestNodePtrType>&) {});
+        return w.finish(out);
+    }
+
+    /**
+     * Like completeMembershipProof(), but writes the proof to 'out' in the flat wire format (see FlatProof), rather than
+     * build it out of BinaryTree's. Returns the size of the proof. The client verifies it in place (see FlatMembProofType).
+     */
+    size_t writeMembershipProof(const KeyT& k, std::string& out) const {
+        if(!EnableFrontier) {
+            throw std::runtime_error("Cannot do complete membership proofs with EnableFrontier = false");
+        }
+
+        const auto& leaves = forest.getLeaves(keys.find(k));
+        std::set<ForestNodePtrType> leafSet(leaves.begin(), leaves.end());
+        BitString keyHash = CryptoHash().hashK(k);
+
+        FlatProofWriter w(FlatProof::Kind::Membership);
+        writeFlatForestProofs(w, leafSet, true, [this, &w, &keyHash](const std::tuple<int, ForestNodePtrType>& tree) {
+            auto data = std::get<1>(tree)->getData();
+            auto frontier = data->frontier.get();
+            assertNotNull(frontier);
+
+            bool found;
+            BitString missingPrefix;
+            std::tie(found, missingPrefix) = data->containsKey(keyHash);
+
+            // A missing key's frontier proof comes with its missing prefix (and the other prefixes in its frontier
+            // leaf, if the upper frontier is chunked), as data
+            w.beginFrontier();
+            if(!found) {
+                w.addData(static_cast<uint8_t>(upperChunkSize > 1));
+                w.addData(missingPrefix);
+                if(upperChunkSize > 1) {
+                    auto chunk = frontier->getPrefixChunk(missingPrefix);
+                    w.addData(static_cast<uint32_t>(chunk.size()));
+                    for(auto& prefix : chunk) {
+                        w.addData(prefix);
+                    }
+                }
+            }
+
+            std::unique_ptr<BinaryTree<DataNode<typename FrontierType::ProofData>>> frontierProof(
+                frontier->getFrontierProof(found ? keyHash : missingPrefix, found));
+            writeFlatFrontierNode(w, frontierProof->getRoot());
+        });
+
+        return w.finish(out);
+    }
+
     const IndexedForestType& getIndexedForest() const {
         return forest;
     }
+
+    /**
+     * Writes the full state of this AAD to 'file', so it can be restored with restoreSnapshot() without replaying
+     * the appends: the forest (with every node's accumulators, subset proof and Merkle hash and every leaf's key-value
+     * pair) and, for the roots, their ATs, AT polynomials, frontiers and disjointness proofs.
+     *
+     * The leaf polynomial cache is not saved.
+     */
+    void saveSnapshot(const std::string& file) const {
+        ManualTimer t;
+        SnapshotWriter out(file);
+
+        out.writeBytes(SnapshotMagic, sizeof(SnapshotMagic));
+        out.write(static_cast<uint32_t>(SnapshotVersion));
+        out.write(static_cast<int32_t>(SecParam));
+        out.write(EnableFrontier);
+        out.write(simulate);
+        out.write(static_cast<uint32_t>(sizeof(G1)));
+        out.write(static_cast<uint32_t>(sizeof(G2)));
+        out.write(static_cast<uint32_t>(sizeof(Fr)));
+
+        out.write(static_cast<int32_t>(batchSize));
+        out.write(incrementalFrontier);
+        out.write(static_cast<uint64_t>(upperChunkSize));
+
+        out.write(static_cast<int32_t>(forest.getCount()));
+        out.write(static_cast<uint64_t>(forest.getNumTrees()));
+        for(auto& tup : forest.getTrees()) {
+            auto root = std::get<1>(tup);
+            out.write(static_cast<int32_t>(std::get<0>(tup)));
+            writeSnapshotNode(out, root);
+            writeSnapshotRoot(out, root->getData());
+        }
+
+        out.close();
+        logperf << "Saved snapshot of AAD with " << forest.getCount() << " leaves to '" << file << "' in "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(t.stop()).count() << " ms" << endl;
+    }
+
+    /**
+     * Restores this (empty) AAD from a snapshot written by saveSnapshot(), including the settings the snapshot was
+     * taken with (e.g., setBatchSize()). The AAD must have been created with public parameters iff the snapshotted one was.
+     *
+     * The snapshot is memory-mapped and read in place. Everything needed for digests and proofs is restored right away,
+     * but the roots' ATs and AT polynomials and the frontier leaves' polynomials, which make up most of the snapshot,
+     * are left in the mapped file until a merge or a frontier proof needs them. Thus, 'file' must not be modified while this
+     * AAD is around (but a new snapshot can be saved over it, since saveSnapshot() replaces the file).
+     *
+     * Throws std::runtime_error if the snapshot is invalid, corrupted or was taken by an incompatible build or AAD.
+     */
+    void restoreSnapshot(const std::string& file) {
+        assertEqual(forest.getCount(), 0);
+        ManualTimer t;
+        SnapshotReader in(file);
+
+        auto magic = in.readBytes(sizeof(SnapshotMagic));
+        uint32_t version;
+        in.read(version);
+        if(std::memcmp(magic, SnapshotMagic, sizeof(SnapshotMagic)) != 0 || version != SnapshotVersion) {
+            logerror << "'" << file << "' is not an AAD snapshot (or has an unsupported version)" << endl;
+            throw std::runtime_error("Not an AAD snapshot (or unsupported version)");
+        }
+
+        int32_t secParam;
+        bool enableFrontier, wasSimulated;
+        uint32_t g1Size, g2Size, frSize;
+        in.read(secParam);
+        in.read(enableFrontier);
+        in.read(wasSimulated);
+        in.read(g1Size);
+        in.read(g2Size);
+        in.read(frSize);
+        if(secParam != SecParam || enableFrontier != EnableFrontier ||
+            g1Size != sizeof(G1) || g2Size != sizeof(G2) || frSize != sizeof(Fr))
+        {
+            logerror << "Snapshot '" << file << "' was taken by an AAD with different parameters or by a different build" << endl;
+            throw std::runtime_error("Snapshot was taken by an incompatible AAD");
+        }
+        if(wasSimulated != simulate) {
+            logerror << "Snapshot '" << file << "' was taken " << (wasSimulated ? "without" : "with")
+                << " public parameters, but this AAD " << (simulate ? "has none" : "has them") << endl;
+            throw std::runtime_error("Snapshot was taken by an incompatible AAD");
+        }
+
+        int32_t snapBatchSize;
+        bool snapIncrementalFrontier;
+        uint64_t snapUpperChunkSize;
+        in.read(snapBatchSize);
+        in.read(snapIncrementalFrontier);
+        in.read(snapUpperChunkSize);
+        if(snapBatchSize <= 0 || snapUpperChunkSize == 0 || snapUpperChunkSize > static_cast<uint64_t>(SecParam * 4))
+            throw std::runtime_error("Snapshot has corrupted settings");
+        setBatchSize(snapBatchSize);
+        setIncrementalFrontier(snapIncrementalFrontier);
+        setUpperFrontierChunkSize(static_cast<size_t>(snapUpperChunkSize));
+
+        int32_t count;
+        uint64_t numTrees;
+        in.read(count);
+        in.read(numTrees);
+
+        // NOTE: We only hand the trees over to the forest once they were all read, so we do not leak them (or leave
+        // the forest half-restored) if the snapshot turns out to be corrupted.
+        std::vector<std::unique_ptr<ForestNodeType>> roots;
+        std::vector<int> sizes;
+        std::vector<ForestNodePtrType> leaves;
+        // NOTE: a corrupted count must not make us reserve more than the snapshot could possibly have
+        leaves.reserve(std::min(static_cast<size_t>(std::max(count, 0)), in.getRemaining()));
+        int numLeaves = 0;
+        size_t numKeys = keys.size();
+        try {
+            for(uint64_t i = 0; i < numTrees; i++) {
+                int32_t size;
+                in.read(size);
+                if(size <= 0 || (size & (size - 1)) != 0 || (!sizes.empty() && size >= sizes.back()))
+                    throw std::runtime_error("Snapshot has a corrupted forest");
+
+                roots.emplace_back(readSnapshotNode(in, size, leaves));
+                readSnapshotRoot(in, roots.back()->getData());
+                sizes.push_back(size);
+                numLeaves += size;
+            }
+            if(numLeaves != count || !in.atEnd())
+                throw std::runtime_error("Snapshot has a corrupted forest");
+        } catch(...) {
+            // the leaves read so far are freed with 'roots', so their keys must go too
+            keys.truncate(numKeys);
+            throw;
+        }
+
+        std::list<std::tuple<int, ForestNodePtrType>> trees;
+        for(size_t i = 0; i < roots.size(); i++) {
+            trees.push_back(std::make_tuple(sizes[i], roots[i].release()));
+        }
+        forest.restoreTrees(std::move(trees), count);
+
+        // leaves were read in the order they were appended, which is the order the key index expects them in
+        for(auto leaf : leaves) {
+            forest.indexLeaf(leaf, dynamic_cast<LeafDataType*>(leaf->getData())->keyId);
+        }
+
+        snapshot = in.getMappedFile();
+        logperf << "Restored AAD with " << count << " leaves from snapshot '" << file << "' in "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(t.stop()).count() << " ms" << endl;
+    }
+
+    /**
+     * Logs every append from now on to the append log in 'file' (see AppendLog), before applying it, so that appends
+     * made after the last snapshot can be recovered with recover(). Appends are committed to the log in groups of
+     * 'groupSize' or after 'maxDelay', so the last few appends can be lost in a crash, unless syncAppendLog() is called.
+     */
+    void openAppendLog(const std::string& file, size_t groupSize = 64, std::chrono::milliseconds maxDelay = std::chrono::milliseconds(10)) {
+        appendLog.reset(new AppendLog(file, groupSize, maxDelay));
+    }
+
+    /**
+     * Returns after all appends so far are committed to the append log.
+     */
+    void syncAppendLog() {
+        assertNotNull(appendLog);
+        appendLog->sync();
+    }
+
+    const AppendLog* getAppendLog() const { return appendLog.get(); }
+
+    /**
+     * Takes a snapshot of this AAD in 'snapshotFile' and then empties the append log, whose appends are all in the
+     * snapshot now. (If we crash in between, recover() skips the logged appends that are already in the snapshot.)
+     */
+    void checkpoint(const std::string& snapshotFile) {
+        assertNotNull(appendLog);
+        appendLog->sync();
+        // NOTE: saveSnapshot() only returns once the snapshot is durable (see SnapshotWriter::close()), so we never
+        // empty the log while its appends are only in a snapshot a crash could still lose
+        saveSnapshot(snapshotFile);
+        appendLog->truncate();
+    }
+
+    /**
+     * Recovers this (empty) AAD after a restart: restores the snapshot in 'snapshotFile' (if any) and replays the appends
+     * in the append log 'logFile' that came after the snapshot, as regular appends. A torn record at the end of the log
+     * (i.e., an append we crashed while logging) is truncated. Then, logs the following appends to 'logFile' (see openAppendLog()).
+     *
+     * Returns the number of replayed appends.
+     */
+    uint64_t recover(const std::string& snapshotFile, const std::string& logFile,
+        size_t groupSize = 64, std::chrono::milliseconds maxDelay = std::chrono::milliseconds(10))
+    {
+        assertEqual(forest.getCount(), 0);
+        assertNull(appendLog);
+
+        if(std::ifstream(snapshotFile).good()) {
+            restoreSnapshot(snapshotFile);
+        } else {
+            logwarn << "No snapshot in '" << snapshotFile << "', replaying the whole append log" << endl;
+        }
+
+        ManualTimer t;
+        auto numReplayed = AppendLog::replay(logFile, static_cast<uint64_t>(forest.getCount()),
+            [this](uint64_t leafNo, const std::string& payload) {
+                KeyT k;
+                ValT v;
+                size_t pos = 0;
+                AppendLog::decode(payload, pos, k);
+                AppendLog::decode(payload, pos, v);
+                assertEqual(leafNo, static_cast<uint64_t>(forest.getCount()));
+                append(k, v);
+            });
+        logperf << "Replayed " << numReplayed << " appends from '" << logFile << "' in "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(t.stop()).count() << " ms" << endl;
+
+        openAppendLog(logFile, groupSize, maxDelay);
+        return numReplayed;
+    }
+
+protected:
+    template<class K, class V>
+    void appendKeyValue(const K& k, const V& v) {
+        int i = forest.getCount();
+
+        //logdbg << endl;
+        //logdbg << "Append #" << i+1 << ": (" << k << ", " << v << ") ..." << endl;
+
+        // NOTE: the leaf needs the key's id, so a new key is interned first and forgotten again if the append fails
+        // before it is part of the forest, so a failed append does not leave a key with no values behind
+        size_t numKeys = keys.size();
+        KeyId keyId = keys.intern(k);
+        std::unique_ptr<LeafDataType> leafData;
+        try {
+            leafData.reset(LeafDataType::create(params, keyId, k, v, i, batchSize, incrementalFrontier,
+                upperChunkSize, leafPolyCache.get(), valueLog.get()));
+
+            // NOTE: we only log the append once its leaf is created, since creating it can fail (e.g., if the value log
+            // is full) and then the next append gets the same leaf number. From here on, the append is part of the
+            // forest (the forest counts the leaf before merging it), even if a merge throws.
+            if(appendLog != nullptr) {
+                std::string payload;
+                AppendLog::encode(payload, k);
+                AppendLog::encode(payload, v);
+                appendLog->append(static_cast<uint64_t>(i), payload);
+            }
+        } catch(...) {
+            keys.truncate(numKeys);
+            throw;
+        }
+
+        forest.appendLeaf(leafData.release(), keyId);
+        //logdbg << "Num trees: " << forest.getNumTrees() << endl;
+
+        enforceRootBudget();
+    }
+
+    void enforceRootBudget() {
+        if(rootStore == nullptr)
+            return;
+
+        std::vector<DataPtrType> roots;
+        for(auto& tup : forest.getTrees()) {
+            roots.push_back(std::get<1>(tup)->getData());
+        }
+        rootStore->enforceBudget(roots);
+    }
+
+    /**
+     * Writes the forest part of a flat proof for every tree in the forest: the Merkle paths to the nodes in 'leaves'
+     * (i.e., the key's leaves, for membership proofs, or the old roots, for append-only proofs), if the tree has any.
+     * Then, calls 'writeFrontier' for the tree.
+     */
+    void writeFlatForestProofs(FlatProofWriter& w, const std::set<ForestNodePtrType>& leaves, bool withValues,
+        const std::function<void(const std::tuple<int, ForestNodePtrType>&)>& writeFrontier) const
+    {
+        // the ancestors of the leaves (stopping at ancestors we already have)
+        std::set<Node*> onPath;
+        for(auto leaf : leaves) {
+            Node* n = leaf->parent;
+            while(n != nullptr && onPath.insert(n).second)
+                n = n->parent;
+        }
+
+        for(auto& tree : forest.getTrees()) {
+            auto root = std::get<1>(tree);
+            w.beginTree();
+            if(leaves.count(root) > 0 || onPath.count(root) > 0) {
+                w.beginForest();
+                writeFlatForestNode(w, root, leaves, onPath, withValues);
+            }
+            writeFrontier(tree);
+        }
+    }
+
+    /**
+     * Writes the Merkle path nodes under 'node' in preorder, with the same data the copierFunc's in appendOnlyProof()
+     * and completeMembershipProof() copy into BinaryTree's. Leaves also get their value and leaf number, if 'withValues'.
+     */
+    void writeFlatForestNode(FlatProofWriter& w, ForestNodePtrType node, const std::set<ForestNodePtrType>& leaves,
+        const std::set<Node*>& onPath, bool withValues) const
+    {
+        auto data = node->getData();
+        assertNotNull(data);
+        bool isRoot = node->isRoot();
+
+        if(leaves.count(node) > 0) {
+            w.addNode(false, FlatProof::ForestLeaf | (isRoot ? 0 : FlatProof::HasG2));
+            if(!isRoot)
+                w.addPoint(!simulate ? data->subsetProof.get() : G2::random_element());
+
+            if(withValues) {
+                auto leafData = dynamic_cast<LeafDataType*>(data);
+                assertNotNull(leafData);
+                w.addData(leafData->getValueRef(valueLog.get()));
+                w.addData(static_cast<int32_t>(leafData->leafNo));
+            }
+        } else if(onPath.count(node) > 0) {
+            w.addNode(true, FlatProof::ForestOnPath | (isRoot ? 0 : FlatProof::HasG1 | FlatProof::HasG2));
+            if(!isRoot) {
+                w.addPoint(!simulate ? data->acc.get() : G1::random_element());
+                w.addPoint(!simulate ? data->subsetProof.get() : G2::random_element());
+            }
+
+            auto left = dynamic_cast<ForestNodePtrType>(node->left.get());
+            auto right = dynamic_cast<ForestNodePtrType>(node->right.get());
+            assertNotNull(left);
+            assertNotNull(right);
+            writeFlatForestNode(w, left, leaves, onPath, withValues);
+            writeFlatForestNode(w, right, leaves, onPath, withValues);
+        } else {
+            // a sibling of a node on the path
+            w.addNode(false, FlatProof::ForestSibling | FlatProof::HasHash);
+            assertEqual(data->merkleHash.getBytes().size(), FlatProof::HashSize);
+            w.addHash(data->merkleHash.getBytes().data());
+        }
+    }
+
+    /**
+     * Writes a frontier proof node (see Frontier::getFrontierProof()) and its subtree in preorder.
+     */
+    static void writeFlatFrontierNode(FlatProofWriter& w, Node* node) {
+        using ProofData = typename FrontierType::ProofData;
+        auto proofNode = dynamic_cast<DataNode<ProofData>*>(node);
+        assertNotNull(proofNode);
+        auto data = proofNode->getData();
+        assertNotNull(data);
+
+        uint8_t mask;
+        switch(data->getType()) {
+        case ProofData::Type::Leaf:             mask = FlatProof::FrontierLeaf; break;
+        case ProofData::Type::SiblingLeaf:      mask = FlatProof::FrontierSiblingLeaf; break;
+        case ProofData::Type::SiblingNonLeaf:   mask = FlatProof::FrontierSiblingNonLeaf; break;
+        case ProofData::Type::OnPath:           mask = FlatProof::FrontierOnPath; break;
+        case ProofData::Type::Root:             mask = FlatProof::FrontierRoot; break;
+        default:
+            throw std::logic_error("Frontier proof node has unknown type");
+        }
+
+        // the client has the root's accumulator in the digest
+        if(!node->isRoot()) {
+            mask = static_cast<uint8_t>(mask |
+                (data->hasG1() ? FlatProof::HasG1 : 0) |
+                (data->hasG1ext() ? FlatProof::HasG1ext : 0) |
+                (data->hasG2() ? FlatProof::HasG2 : 0));
+        }
+
+        bool hasChildren = node->left != nullptr;
+        assertEqual(hasChildren, node->right != nullptr);
+        w.addNode(hasChildren, mask);
+        if(mask & FlatProof::HasG1)
+            w.addPoint(data->getG1());
+        if(mask & FlatProof::HasG1ext)
+            w.addPoint(data->getG1ext());
+        if(mask & FlatProof::HasG2)
+            w.addPoint(data->getG2());
+
+        if(hasChildren) {
+            writeFlatFrontierNode(w, node->left.get());
+            writeFlatFrontierNode(w, node->right.get());
+        }
+    }
+
+    static constexpr char SnapshotMagic[8] = { 'L', 'I', 'B', 'A', 'A', 'D', 'S', 'S' };
+    static constexpr uint32_t SnapshotVersion = 1;
+
+    /**
+     * Writes a forest node and its subtree, in preorder. The shape of the subtree is not written, since forest trees
+     * are complete: restoreSnapshot() infers it from the size of the tree.
+     */
+    void writeSnapshotNode(SnapshotWriter& out, ForestNodePtrType node) const {
+        auto data = node->getData();
+        assertNotNull(data);
+
+        out.write(!data->merkleHash.isUnset());
+        if(!data->merkleHash.isUnset())
+            out.writeBytes(data->merkleHash.getBytes().data(), MerkleHashSize);
+        out.write(data->acc);
+        out.write(data->eAcc);
+        out.write(data->subsetProof);
+
+        if(node->isLeaf()) {
+            auto leafData = dynamic_cast<LeafDataType*>(data);
+            assertNotNull(leafData);
+            out.write(getLeafKey(leafData));
+            out.write(leafData->getValue(valueLog.get()));
+            out.write(static_cast<int32_t>(leafData->leafNo));
+        } else {
+            writeSnapshotNode(out, dynamic_cast<ForestNodePtrType>(node->left.get()));
+            writeSnapshotNode(out, dynamic_cast<ForestNodePtrType>(node->right.get()));
+        }
+    }
+
+    /**
+     * Writes the data only roots have: the disjointness proof, the AT polynomial, the AT and the frontier.
+     */
+    void writeSnapshotRoot(SnapshotWriter& out, DataPtrType data) const {
+        // NOTE: x and y are written separately, as before they shared an allocation
+        out.write(data->bezout != nullptr);
+        if(data->bezout != nullptr)
+            out.write(data->bezout->x);
+        out.write(data->bezout != nullptr);
+        if(data->bezout != nullptr)
+            out.write(data->bezout->y);
+
+        if(data->mappedAccPoly.isSet())
+            out.writePoly(data->mappedAccPoly.data(), data->mappedAccPoly.size());
+        else
+            out.writePoly(data->accPoly);
+
+        // a spilled AT is already in the snapshot format, so we copy it over rather than read it back in (and since
+        // it is never spilled again, we need not look at 'at', which a concurrent proof might be reading back in)
+        out.write(data->spilledAT.isSet() || data->at != nullptr);
+        if(data->spilledAT.isSet())
+            out.writeBytes(data->spilledAT.data(), data->spilledAT.size);
+        else if(data->at != nullptr)
+            data->at->writeSnapshot(out);
+
+        out.write(data->frontier != nullptr);
+        if(data->frontier != nullptr)
+            data->frontier->writeSnapshot(out);
+    }
+
+    ForestNodePtrType readSnapshotNode(SnapshotReader& in, int size, std::vector<ForestNodePtrType>& leaves) {
+        bool hasMerkleHash;
+        MerkleHash merkleHash;
+        G1 acc, eAcc;
+        G2 subsetProof;
+        in.read(hasMerkleHash);
+        if(hasMerkleHash)
+            merkleHash = MerkleHash(in.readBytes(MerkleHashSize));
+        in.read(acc);
+        in.read(eAcc);
+        in.read(subsetProof);
+
+        std::unique_ptr<DataType> data;
+        std::unique_ptr<ForestNodeType> left, right;
+        if(size == 1) {
+            KeyT k;
+            ValT v;
+            int32_t leafNo;
+            in.read(k);
+            in.read(v);
+            in.read(leafNo);
+            if(leafNo != static_cast<int32_t>(leaves.size()))
+                throw std::runtime_error("Snapshot has a corrupted forest");
+
+            // NOTE: if this (or reading the rest of the snapshot) fails, restoreSnapshot() forgets the key again
+            KeyId keyId = keys.intern(k);
+            data.reset(LeafDataType::restore(keyId, std::move(v), leafNo, valueLog.get()));
+        } else {
+            left.reset(readSnapshotNode(in, size / 2, leaves));
+            right.reset(readSnapshotNode(in, size / 2, leaves));
+            data.reset(new DataType(size));
+        }
+
+        data->merkleHash = merkleHash;
+        data->acc = acc;
+        data->eAcc = eAcc;
+        data->subsetProof = subsetProof;
+
+        auto node = NodeFactory::makeNode(data.release(), left.release(), right.release());
+        if(size == 1)
+            leaves.push_back(node);
+        return node;
+    }
+
+    void readSnapshotRoot(SnapshotReader& in, DataPtrType data) {
+        bool hasX, hasY, hasAT, hasFrontier;
+        in.read(hasX);
+        if(hasX) {
+            data->bezout.reset(new typename DataType::BezoutProof());
+            in.read(data->bezout->x);
+        }
+        in.read(hasY);
+        if(hasY != hasX)
+            throw std::runtime_error("Snapshot has a root with only one Bezout coefficient");
+        if(hasY)
+            in.read(data->bezout->y);
+
+        data->mappedAccPoly = in.readPoly();
+
+        // the AT stays in the mapped snapshot, like a spilled one, until a merge needs it (see DataType::getAT()),
+        // while proofs look keys up in it there (see DataType::containsKey())
+        in.read(hasAT);
+        if(hasAT) {
+            size_t atBegin = in.getPosition();
+            if(AccTreeType::skipSnapshot(in) != SecParam*4)
+                throw std::runtime_error("Snapshot has an AT of the wrong depth");
+            data->spilledAT = SpilledRegion(in.getMappedFile(), atBegin, in.getPosition() - atBegin);
+        }
+
+        // the frontier's retained keys are linked to the AT's nodes once it is read in (see DataType::loadAT())
+        in.read(hasFrontier);
+        if(hasFrontier)
+            data->frontier.reset(FrontierType::readSnapshot(in, params, nullptr));
+    }
 };
 
+template<class KeyT, class ValT, bool EnableFrontier, int SecParam, class CryptoHash>
+constexpr char AAD<KeyT, ValT, EnableFrontier, SecParam, CryptoHash>::SnapshotMagic[8];
+
+template<class KeyT, class ValT, bool EnableFrontier, int SecParam, class CryptoHash>
+constexpr uint32_t AAD<KeyT, ValT, EnableFrontier, SecParam, CryptoHash>::SnapshotVersion;
+
 }
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <aad/BinaryTree.h>
+#include <aad/Snapshot.h>
+#include <aad/SortedFrontier.h>
 
 #include <tuple>
 #include <vector>
@@ -25,13 +27,28 @@ public:
     using AccumulatedTreeType = AccumulatedTree;
     using AccumulatedTreePtrType = AccumulatedTreeType*;
 
+    /**
+     * The deepest AT a snapshot can have (see readSnapshotHeader()), far deeper than the ATs of any hash we use
+     * (e.g., 4 * 128 bits), so a corrupted depth cannot make readSnapshot() recurse without bound.
+     */
+    static const int MaxSnapshotDepth = 4096;
+
 protected:
     std::unique_ptr<BinaryTreeType> tree;
     int maxDepth;   // the maximum depth of the AT (and minimum too actually, since ATs are fixed depth)
 
+    /**
+     * The hashes of the AT's leaves, in sorted order, so we can compute frontiers without walking the trie (see SortedFrontier).
+     * Only valid if all appended paths were full-depth and maxDepth fits in a SortedFrontier::Hash.
+     */
+    std::vector<SortedFrontier::Hash> sortedLeaves;
+    bool hasSorted;
+    size_t numNodes;    // the number of nodes in the trie, so we can tell how much memory this AT takes up
+
 public:
     AccumulatedTree(int maxDepth)
-        : tree(new BinaryTreeType()), maxDepth(maxDepth)
+        : tree(new BinaryTreeType()), maxDepth(maxDepth),
+          hasSorted(static_cast<size_t>(maxDepth) <= SortedFrontier::MaxBits), numNodes(0)
     {}
 
     /**
@@ -47,12 +64,21 @@ public:
      * Merges the two ATs into this AT.
      */
     AccumulatedTree(std::unique_ptr<AccumulatedTreeType> left, std::unique_ptr<AccumulatedTreeType> right)
-        : tree(std::move(left->tree)), maxDepth(left->maxDepth)
+        : tree(std::move(left->tree)), maxDepth(left->maxDepth), hasSorted(left->hasSorted && right->hasSorted)
     {
         assertNull(left->tree);
         assertEqual(left->maxDepth, right->maxDepth);
 
-        mergeBinaryTrees(right->tree.get());
+        numNodes = left->numNodes + right->numNodes - mergeBinaryTrees(right->tree.get());
+
+        if(hasSorted) {
+            sortedLeaves.reserve(left->sortedLeaves.size() + right->sortedLeaves.size());
+            std::merge(left->sortedLeaves.begin(), left->sortedLeaves.end(),
+                right->sortedLeaves.begin(), right->sortedLeaves.end(),
+                std::back_inserter(sortedLeaves));
+            // the trie stores each leaf once, so we do too
+            sortedLeaves.erase(std::unique(sortedLeaves.begin(), sortedLeaves.end()), sortedLeaves.end());
+        }
     }
 
     ~AccumulatedTree() {
@@ -64,6 +90,36 @@ public:
         return tree->getRoot()->getSize();
     }
 
+    int getMaxDepth() const { return maxDepth; }
+
+    /**
+     * Returns true if the sorted hashes of this AT's leaves are available (see getSortedLeaves()).
+     */
+    bool hasSortedLeaves() const { return hasSorted; }
+
+    const std::vector<SortedFrontier::Hash>& getSortedLeaves() const {
+        assertTrue(hasSorted);
+        return sortedLeaves;
+    }
+
+    /**
+     * Returns (roughly) the number of bytes of memory taken up by this AT's trie and sorted leaf hashes.
+     */
+    size_t getMemoryUsage() const {
+        return numNodes * sizeof(Node) + sortedLeaves.capacity() * sizeof(SortedFrontier::Hash);
+    }
+
+    /**
+     * Returns the number of leaves under the specified AT node (e.g., the number of values under a key's lower root).
+     */
+    static int getNumLeaves(NodePtrType node) {
+        if(node == nullptr)
+            return 0;
+        if(node->isLeaf())
+            return 1;
+        return getNumLeaves(node->left.get()) + getNumLeaves(node->right.get());
+    }
+
     /**
      * Appends a path of nodes, as specified by the label of the bottom-most node in the path.
      * For example, if path = [ 0 1 1 ], appends a root \varepsilon, its left child 0,
@@ -71,8 +127,23 @@ public:
      */
     void appendPath(const BitString& lastNode) {
         assertNotNull(tree);
-        if(tree->getRoot() == nullptr)
+        if(hasSorted) {
+            if(lastNode.size() == static_cast<size_t>(maxDepth)) {
+                auto hash = SortedFrontier::toHash(lastNode);
+                auto it = std::lower_bound(sortedLeaves.begin(), sortedLeaves.end(), hash);
+                if(it == sortedLeaves.end() || *it != hash)
+                    sortedLeaves.insert(it, hash);
+            } else {
+                // partial paths create leaves above max depth, which SortedFrontier does not handle
+                hasSorted = false;
+                std::vector<SortedFrontier::Hash>().swap(sortedLeaves);
+            }
+        }
+
+        if(tree->getRoot() == nullptr) {
             tree->setRoot(NodeFactory::makeNode());
+            numNodes++;
+        }
 
         auto parent = tree->getRoot();
         assertNotNull(parent);
@@ -84,6 +155,7 @@ public:
                 if(parent->right == nullptr) {
                     parent->right.reset(NodeFactory::makeNode());
                     parent->right->parent = parent;
+                    numNodes++;
                 }
                 parent = parent->right.get();
             } else {
@@ -91,6 +163,7 @@ public:
                 if(parent->left == nullptr) {
                     parent->left.reset(NodeFactory::makeNode());
                     parent->left->parent = parent;
+                    numNodes++;
                 }
                 parent = parent->left.get();
             }
@@ -139,6 +212,23 @@ public:
         return std::make_tuple(found, nodePtr, prefix);
     }
 
+    /**
+     * Like containsKey(), but looks the key up in an AT written by writeSnapshot() (e.g., in a mapped spill file)
+     * without reading the AT in. Returns false if the snapshot has no sorted leaf hashes to look the key up in.
+     */
+    static bool containsKeyInSnapshot(SnapshotReader& in, const BitString& hashOfKey, bool& found, BitString& missingPrefix) {
+        int32_t maxDepth;
+        bool hasSorted;
+        uint64_t count;
+        readSnapshotHeader(in, maxDepth, hasSorted, count);
+        if(!hasSorted)
+            return false;
+
+        auto hashes = in.readBytes(count, sizeof(SortedFrontier::Hash));
+        found = SortedFrontier::findPrefix(hashes, static_cast<size_t>(count), hashOfKey, missingPrefix);
+        return true;
+    }
+
     /**
      * Returns the set of frontier nodes (i.e., prefixes) corresponding to this AT.
      */
@@ -166,6 +256,22 @@ public:
         getFrontierHelper(tree->getRoot(), BitString::empty(), frontier, lowerRoots, maxDepth / 2, true); 
     }
 
+    /**
+     * Like getUpperFrontier() above, but computed from the sorted leaf hashes rather than the trie. Returns the
+     * range of sorted leaf hashes under each lower root, which can be passed to getLowerFrontier() below.
+     */
+    void getUpperFrontier(std::vector<BitString>& frontier, std::vector<SortedFrontier::Range>& lowerRanges) const {
+        SortedFrontier::getUpperFrontier(getSortedLeaves(), static_cast<size_t>(maxDepth), frontier, lowerRanges);
+    }
+
+    /**
+     * Returns the lower frontier under a lower root (as returned by getUpperFrontier() above) from the sorted leaf hashes,
+     * already sorted by BitString::operator<.
+     */
+    void getLowerFrontier(std::vector<BitString>& frontier, const SortedFrontier::Range& lowerRange) const {
+        SortedFrontier::getLowerFrontier(getSortedLeaves(), lowerRange, static_cast<size_t>(maxDepth), frontier);
+    }
+
     /**
      * Given a key, returns the lower frontier nodes in this AT associated with all values of that key.
      * (Lower frontier nodes are used to prove complete membership of all values of a key.)
@@ -189,20 +295,132 @@ public:
         getFrontierHelper(lowerRoot, nodeLabel, frontier, lowerRoots, maxDepth - static_cast<int>(nodeLabel.size()), false);
     }
 
+    /**
+     * Writes this AT to a snapshot: its sorted leaf hashes if we have them (see hasSortedLeaves()), which are much
+     * smaller than the trie, or the shape of the trie otherwise.
+     */
+    void writeSnapshot(SnapshotWriter& out) const {
+        out.write(static_cast<int32_t>(maxDepth));
+        out.write(hasSorted);
+        if(hasSorted) {
+            out.write(static_cast<uint64_t>(sortedLeaves.size()));
+            out.writeBytes(sortedLeaves.data(), sortedLeaves.size() * sizeof(SortedFrontier::Hash));
+        } else {
+            // one byte per node, in preorder, telling which children the node has
+            std::vector<unsigned char> shape;
+            if(tree->getRoot() != nullptr) {
+                tree->getRoot()->preorderTraverse([&shape](NodePtrType node) {
+                    shape.push_back(static_cast<unsigned char>((node->left != nullptr ? 1 : 0) | (node->right != nullptr ? 2 : 0)));
+                });
+            }
+            out.write(static_cast<uint64_t>(shape.size()));
+            out.writeBytes(shape.data(), shape.size());
+        }
+    }
+
+    /**
+     * Restores an AT written by writeSnapshot(). Throws std::runtime_error if the snapshot is truncated or corrupted.
+     */
+    static AccumulatedTree* readSnapshot(SnapshotReader& in) {
+        int32_t maxDepth;
+        bool hasSorted;
+        uint64_t count;
+        readSnapshotHeader(in, maxDepth, hasSorted, count);
+
+        std::unique_ptr<AccumulatedTree> at(new AccumulatedTree(maxDepth));
+        at->hasSorted = hasSorted;
+        if(hasSorted) {
+            auto hashes = reinterpret_cast<const SortedFrontier::Hash*>(in.readBytes(count, sizeof(SortedFrontier::Hash)));
+            at->sortedLeaves.assign(hashes, hashes + count);
+
+            // rebuild the trie from the leaf hashes directly, which is faster than appendPath() since they are already sorted
+            if(count > 0) {
+                at->tree->setRoot(NodeFactory::makeNode());
+                at->numNodes++;
+            }
+            for(auto& hash : at->sortedLeaves) {
+                auto parent = at->tree->getRoot();
+                for(size_t i = 0; i < static_cast<size_t>(maxDepth); i++) {
+                    bool bit = SortedFrontier::getBit(hash, i);
+                    if(!parent->hasChild(bit)) {
+                        parent->setChild(NodeFactory::makeNode(), bit);
+                        at->numNodes++;
+                    }
+                    parent = parent->getChild(bit);
+                }
+            }
+        } else {
+            auto shape = in.readBytes(count, 1);
+            size_t i = 0;
+            if(count > 0)
+                at->tree->setRoot(readSnapshotShape(shape, static_cast<size_t>(count), i, maxDepth));
+            if(i != count)
+                throw std::runtime_error("Snapshot has a corrupted AT");
+            at->numNodes = static_cast<size_t>(count);    // one byte per node
+        }
+
+        return at.release();
+    }
+
+    /**
+     * Skips over an AT written by writeSnapshot() without reading it in (e.g., so it can be read in later, from
+     * where it is in the mapped snapshot). Returns the AT's maximum depth, so the caller can check it is the one
+     * it expects.
+     */
+    static int skipSnapshot(SnapshotReader& in) {
+        int32_t maxDepth;
+        bool hasSorted;
+        uint64_t count;
+        readSnapshotHeader(in, maxDepth, hasSorted, count);
+        in.readBytes(count, hasSorted ? sizeof(SortedFrontier::Hash) : 1);
+        return maxDepth;
+    }
+
+protected:
+    /**
+     * Reads what writeSnapshot() writes before the leaf hashes or the shape, and checks that the AT's maximum depth
+     * makes sense, since readSnapshot() walks (or recurses) that deep.
+     */
+    static void readSnapshotHeader(SnapshotReader& in, int32_t& maxDepth, bool& hasSorted, uint64_t& count) {
+        in.read(maxDepth);
+        in.read(hasSorted);
+        in.read(count);
+        if(maxDepth <= 0 || maxDepth > MaxSnapshotDepth ||
+            (hasSorted && static_cast<size_t>(maxDepth) > SortedFrontier::MaxBits))
+        {
+            throw std::runtime_error("Snapshot has a corrupted AT");
+        }
+    }
+
+    static NodePtrType readSnapshotShape(const unsigned char * shape, size_t count, size_t& i, int depthLeft) {
+        if(i >= count || depthLeft < 0)
+            throw std::runtime_error("Snapshot has a corrupted AT");
+
+        std::unique_ptr<Node> node(NodeFactory::makeNode());
+        unsigned char children = shape[i++];
+        if(children & 1)
+            node->setChild(readSnapshotShape(shape, count, i, depthLeft - 1), false);
+        if(children & 2)
+            node->setChild(readSnapshotShape(shape, count, i, depthLeft - 1), true);
+        return node.release();
+    }
+
 public:
     /**
      * We use this to merge ATs and to merge proof trees in the AT forest (and maybe the frontier too).
      * WARNING: This restiches part of tree 'b' into tree 'a', returning the modified 'a'. The caller
      * will then free 'a'.
+     *
+     * Returns the number of nodes that were in both trees.
      */
-    void mergeBinaryTrees(BinaryTreePtrType src)
+    size_t mergeBinaryTrees(BinaryTreePtrType src)
     {
         auto rootA = tree->getRoot();
         auto rootB = src->getRoot();
         assertNotNull(rootA);
         assertNotNull(rootB);
 
-        mergeTreesHelper(rootA, rootB);
+        return mergeTreesHelper(rootA, rootB);
     }
 
 protected:
@@ -245,10 +463,11 @@ protected:
     }
 
     /**
-     * We use this to merge two ATs together.
+     * We use this to merge two ATs together. Returns the number of nodes in both subtrees.
      */
-    static void mergeTreesHelper(NodePtrType dest, NodePtrType src) {
+    static size_t mergeTreesHelper(NodePtrType dest, NodePtrType src) {
         assertTrue(dest != nullptr && src != nullptr);
+        size_t numShared = 1;
 
         for(bool childIdx : { true, false }) {
             NodePtrType destChild = dest->getChild(childIdx);
@@ -263,9 +482,11 @@ protected:
             }
 
             if(destChild != nullptr && srcChild != nullptr) {
-                mergeTreesHelper(destChild, srcChild);
+                numShared += mergeTreesHelper(destChild, srcChild);
             }
         }
+
+        return numShared;
     }
 };
 
@@ -308,6 +529,14 @@ public:
         keyToLeaves[lookupKey].push_back(leafPtr);
         BinaryForestType::appendLeaf(leafPtr);
     }
+
+    /**
+     * Adds a leaf of a restored tree (see BinaryForest::restoreTrees()) to the index. Must be called for every leaf,
+     * in the order the leaves were originally appended.
+     */
+    void indexLeaf(NodePtrType leafPtr, const LookupT& lookupKey) {
+        keyToLeaves[lookupKey].push_back(leafPtr);
+    }
     
     /**
      * Returns paths to all leaves with the specified key.
@@ -388,12 +617,11 @@ public:
         }
     }
 
-    std::vector<NodePtrType> getLeaves(const LookupT& key) const {
-        if(keyToLeaves.count(key) > 0) {
-            return keyToLeaves.at(key);
-        } else {
-            return std::vector<NodePtrType>();
-        }
+    const std::vector<NodePtrType>& getLeaves(const LookupT& key) const {
+        static const std::vector<NodePtrType> noLeaves;
+
+        auto it = keyToLeaves.find(key);
+        return it != keyToLeaves.end() ? it->second : noLeaves;
     }
     
     template<class Container>
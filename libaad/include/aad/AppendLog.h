@@ -0,0 +1,152 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+
+namespace libaad {
+
+/**
+ * A write-ahead log of appends, so an AAD can recover the appends made after its last snapshot (see AAD::recover()).
+ *
+ * Every record stores the leaf number of the append and an opaque payload (the encoded key-value pair, see encode()),
+ * protected by a checksum. Records are buffered and written out by a background thread with a single fdatasync()
+ * per group of records ("group commit"): when 'groupSize' records are pending or 'maxDelay' after the first pending
+ * record, whichever comes first. Thus, append() never waits for the disk, but the last few appends before a crash
+ * can be lost. Callers that need an append to be durable call sync().
+ *
+ * A crash can leave a partially-written ("torn") record at the end of the log. Since appends are identified by their
+ * leaf number and replayed in order, such a record (and anything after it) is simply truncated.
+ */
+class AppendLog {
+public:
+    using ReplayFunc = std::function<void(uint64_t leafNo, const std::string& payload)>;
+
+protected:
+    std::string file;
+    int fd;
+    size_t groupSize;
+    std::chrono::milliseconds maxDelay;
+
+    std::mutex mutex;
+    std::condition_variable pendingCv;  // signals the flusher that a group is ready (or that we are stopping)
+    std::condition_variable durableCv;  // signals sync() callers that a group was committed
+    std::string pending;                // records not written yet
+    uint64_t numAppended, numDurable;   // number of records appended and committed (since the log was opened)
+    uint64_t numSyncs;
+    bool flushRequested, stopping;
+    bool inCommit;                      // true while the flusher writes a group without holding the mutex
+    std::exception_ptr error;           // set if the flusher failed to write the log
+    std::thread flusher;
+
+public:
+    /**
+     * Opens (or creates) the log. If the log ends with a torn record, truncates it first (see replay()).
+     */
+    AppendLog(const std::string& file, size_t groupSize = 64, std::chrono::milliseconds maxDelay = std::chrono::milliseconds(10));
+
+    /**
+     * Commits the pending records and closes the log.
+     */
+    ~AppendLog();
+
+    AppendLog(const AppendLog&) = delete;
+    AppendLog& operator=(const AppendLog&) = delete;
+
+public:
+    /**
+     * Adds a record for the append with the specified leaf number to the log. Returns without waiting for the
+     * record to be committed. Throws std::runtime_error if a previous group could not be written.
+     */
+    void append(uint64_t leafNo, const std::string& payload);
+
+    /**
+     * Returns after all records appended so far are committed to disk.
+     */
+    void sync();
+
+    /**
+     * Commits the pending records and then empties the log, once the flusher is done writing (so none of its writes
+     * can land after the truncation). Called after taking a snapshot, which makes all records appended so far redundant.
+     */
+    void truncate();
+
+    /**
+     * Returns the number of fdatasync() calls so far (i.e., the number of group commits).
+     */
+    uint64_t getNumSyncs();
+
+    const std::string& getFile() const { return file; }
+
+public:
+    /**
+     * Calls 'func' on the records in the log for appends with leaf numbers 'fromLeafNo' and above, in order, and
+     * returns the number of such records. Records for earlier appends (e.g., already in a snapshot) are skipped.
+     * 'func' can be empty, which only checks the log.
+     *
+     * If the log ends with a torn or corrupted record, the log is truncated right before it. If the log is not an
+     * append log or skips over some appends, throws std::runtime_error. A missing log has no records.
+     */
+    static uint64_t replay(const std::string& file, uint64_t fromLeafNo, const ReplayFunc& func);
+
+    /**
+     * Helpers for encoding the fields of a record's payload (and decoding them, starting at offset 'pos', which they
+     * advance). Strings are length-prefixed, other types must be trivially copyable and are copied as they are.
+     */
+    template<class T>
+    static void encode(std::string& buf, const T& val) {
+        static_assert(std::is_trivially_copyable<T>::value, "Can only encode trivially-copyable types as they are");
+        buf.append(reinterpret_cast<const char *>(&val), sizeof(T));
+    }
+
+    static void encode(std::string& buf, const std::string& str) {
+        encode(buf, std::string_view(str));
+    }
+
+    static void encode(std::string& buf, std::string_view str) {
+        encode(buf, static_cast<uint64_t>(str.size()));
+        buf.append(str);
+    }
+
+    template<class T>
+    static void decode(const std::string& buf, size_t& pos, T& val) {
+        static_assert(std::is_trivially_copyable<T>::value, "Can only decode trivially-copyable types as they are");
+        if(sizeof(T) > buf.size() - pos)
+            throw std::runtime_error("Append log record is too short");
+        std::memcpy(&val, buf.data() + pos, sizeof(T));
+        pos += sizeof(T);
+    }
+
+    static void decode(const std::string& buf, size_t& pos, std::string& str) {
+        uint64_t size;
+        decode(buf, pos, size);
+        if(size > buf.size() - pos)
+            throw std::runtime_error("Append log record is too short");
+        str.assign(buf, pos, static_cast<size_t>(size));
+        pos += static_cast<size_t>(size);
+    }
+
+protected:
+    void flusherLoop();
+
+    /**
+     * Writes out 'records' and commits them with fdatasync(). Called without holding the mutex.
+     */
+    void commit(const std::string& records);
+
+    /**
+     * Waits for the flusher to commit all records appended so far. Assumes the mutex is held by 'lock'.
+     */
+    void waitDurable(std::unique_lock<std::mutex>& lock);
+};
+
+} // end of namespace libaad
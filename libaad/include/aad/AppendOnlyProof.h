@@ -22,10 +22,19 @@ public:
 
 public:
     bool verify(const Digest& oldDigest, const Digest& newDigest) {
+        this->startPairingBatch();
+        return this->finishPairingBatch(verifyHelper(oldDigest, newDigest));
+    }
+
+protected:
+    bool verifyHelper(const Digest& oldDigest, const Digest& newDigest) {
         size_t oldidx = 0;
         assertEqual(this->forestProofs->size(), newDigest.size());
         std::vector<ForestNodePtrType> oldRoots;
+        std::vector<size_t> treesToCheck;     // trees whose Merkle hashes and subset proofs must be checked
 
+        // First, match the old roots in each tree with the old digest. This is cheap but sequential, since
+        // the old roots of a tree come after the old roots of the previous trees in the old digest.
         for(size_t i = 0; i < this->forestProofs->size(); i++) {
             logtrace << "Verifying forest tree #" << i << endl;
 
@@ -42,12 +51,10 @@ public:
             assertNotNull(rootData);
 
             // If the old root is also a new root, we only check that the new root has the same digest 
-            // (this only happens for the biggest tree in the forest, which is always the 1st tree)
+            // (this only happens for the biggest trees in the forest, so all the trees before this one are old roots too)
             if(rootData->isOldRoot()) {
-                assertIsZero(oldidx);
-                // remove the frontier accumulator from the new digest, since the old root will not have it
-                if(oldDigest[0] != newDigest[0]) {
-                    logerror << "New digest has different 1st tree" << endl;
+                if(oldidx != i || oldidx >= oldDigest.size() || oldDigest[oldidx] != newDigest[i]) {
+                    logerror << "New digest has different tree #" << i << endl;
                     return false;
                 } else {
                     // Mark old root as validated and move on to next subtree in proof
@@ -73,11 +80,32 @@ public:
                 assertNotNull(data->subsetProof);
                 assertTrue(data->merkleHash.isUnset());
 
+                if(oldidx >= oldDigest.size()) {
+                    logerror << "Proof has more old roots than the old digest" << endl;
+                    return false;
+                }
+
                 data->acc.reset(new G1(std::get<0>(oldDigest[oldidx])));
                 data->merkleHash = std::get<2>(oldDigest[oldidx]);
                 oldidx++;   // marks this root as ready for validation
             }
 
+            treesToCheck.push_back(i);
+        }
+
+        if(oldidx != oldDigest.size())
+            return false;
+
+        // Then, check the trees independently (maybe in parallel), each one with its own pairing batch
+        std::vector<std::unique_ptr<PairingBatch>> treeBatches(treesToCheck.size());
+        for(auto& b : treeBatches) {
+            b = this->newTreePairingBatch();
+        }
+
+        bool ok = this->verifyTrees(treesToCheck.size(), [&](size_t j) {
+            size_t i = treesToCheck[j];
+            auto root = (*this->forestProofs)[i]->getRoot();
+
             // Pass 2: recursively compute the root Merkle hash
             this->computeMerkleHashes(root, false);
 
@@ -89,13 +117,17 @@ public:
             }
 
             // Pass 3: recursively check subset proofs
-            if(!this->verifySubsetProofs(root))
-                return false;
-
-            // Done checking forest paths!
+            return this->verifySubsetProofs(root, treeBatches[j].get());
+        });
+        if(!ok)
+            return false;
+
+        // Done checking forest paths!
+        for(auto& b : treeBatches) {
+            this->mergePairingBatch(b);
         }
 
-        return oldidx == oldDigest.size();
+        return true;
     }
 };
 
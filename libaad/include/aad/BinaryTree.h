@@ -450,6 +450,16 @@ public:
      */
     int getCount() const { return count; }
 
+    /**
+     * Replaces the trees in this (empty) forest with already-built trees (e.g., restored from a snapshot), given as
+     * <size, rootNode> pairs, biggest tree first, with 'numLeaves' leaves in total.
+     */
+    void restoreTrees(std::list<std::tuple<int, NodePtrType>>&& restored, int numLeaves) {
+        assertTrue(trees.empty());
+        trees = std::move(restored);
+        count = numLeaves;
+    }
+
     /**
      * Take each two roots in tree and create a parent for them. Proceed recursively for parents.
      */
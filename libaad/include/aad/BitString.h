@@ -231,6 +231,20 @@ public:
         return ret;
     }
 
+    /**
+     * Returns true if this BitString is a (not necessarily strict) prefix of 'other'.
+     */
+    bool isPrefixOf(const BitString& other) const {
+        if(size() > other.size())
+            return false;
+
+        for(size_t i = 0; i < size(); i++) {
+            if(operator[](i) != other[i])
+                return false;
+        }
+        return true;
+    }
+
     std::string toString() const {
         if(size() == 0) {
             return "empty";
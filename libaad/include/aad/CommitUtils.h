@@ -31,8 +31,14 @@ public:
     }
 
     static std::tuple<G1, G1> commitAT(AccumulatedTree * at, std::vector<Fr>& accPoly, const PublicParameters* pp, bool extractable) {
-        G1 acc, eAcc = G1::one();
+        interpolateAT(at, accPoly);
+        return commitPoly(accPoly, pp, extractable);
+    }
 
+    /**
+     * Computes the AT's polynomial, whose roots are the hashes of all prefixes in the AT.
+     */
+    static void interpolateAT(AccumulatedTree * at, std::vector<Fr>& accPoly) {
         // get roots of AT polynomial
         ManualTimer t;
         std::vector<BitString> prefixes = at->getPrefixes();
@@ -50,17 +56,27 @@ public:
         micros = t.stop().count();
         printOpPerf(micros, "interpolate_AT", accPoly.size());
         std::vector<Fr>().swap(hashes);      // clear hashes
+    }
 
-        // commit to polynomial
-        t.restart();
-        acc = pp != nullptr ? PolyCommit::commitG1(*pp, accPoly, false) : simulateCommitment<G1>(accPoly);
-        if(extractable)
-            eAcc = pp != nullptr ? PolyCommit::commitG1(*pp, accPoly, true) : simulateCommitment<G1>(accPoly);
-        micros = t.stop().count();
-        printOpPerf(micros, (extractable ? "commitExtr" : "commitNoEx"), accPoly.size()); 
-
+    /**
+     * Commits to an already-interpolated AT polynomial (e.g., a leaf AT's polynomial from a LeafPolyCache).
+     */
+    static std::tuple<G1, G1> commitPoly(const std::vector<Fr>& accPoly, const PublicParameters* pp, bool extractable) {
+        G1 acc = commitAcc(accPoly, pp, false);
+        G1 eAcc = extractable ? commitAcc(accPoly, pp, true) : G1::one();
         return std::make_tuple(acc, eAcc);
     }
+
+    /**
+     * Commits to an AT polynomial, extractably or not (i.e., computes the AT's acc or eAcc).
+     */
+    static G1 commitAcc(const std::vector<Fr>& accPoly, const PublicParameters* pp, bool extractable) {
+        ManualTimer t;
+        G1 acc = pp != nullptr ? PolyCommit::commitG1(*pp, accPoly, extractable) : simulateCommitment<G1>(accPoly);
+        auto micros = t.stop().count();
+        printOpPerf(micros, (extractable ? "commitExtr" : "commitNoEx"), accPoly.size()); 
+        return acc;
+    }
 };
 
 }
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <aad/EllipticCurves.h>
+
+namespace libaad {
+
+/**
+ * A group element stored in as little memory as we can, for the elements that long-lived structures keep around:
+ * the accumulators and proofs in forest and frontier nodes. libff keeps points in projective (or Jacobian)
+ * coordinates, which take 96 bytes in G1 and 192 bytes in G2 on BN128.
+ *
+ * On BN128, a CompactPoint keeps the point in affine coordinates, without Z (64 and 128 bytes). If built with
+ * COMPRESS_STORED_POINTS, it only keeps X and the parity of Y (32 and 64 bytes), and recomputes Y with a square root
+ * in get(). Either way, the point at infinity and the parity of Y are kept in the top two bits of X, which BN128's
+ * (254-bit) field elements never use. On other curves, the point is stored as is.
+ *
+ * Storing a point takes a field inversion, to get its affine coordinates, and getting a compressed point back takes a
+ * square root, so this is meant for points that are stored once and used seldom (e.g., only in proofs).
+ */
+template<class Group>
+class CompactPoint {
+public:
+#ifdef CURVE_BN128
+# ifdef COMPRESS_STORED_POINTS
+    static constexpr size_t Size = sizeof(Group::X);
+# else
+    static constexpr size_t Size = 2 * sizeof(Group::X);
+# endif
+#else
+    static constexpr size_t Size = sizeof(Group);
+#endif
+
+    /**
+     * The size of a point written by compress(), which always compresses, regardless of COMPRESS_STORED_POINTS.
+     */
+#ifdef CURVE_BN128
+    static constexpr size_t CompressedSize = sizeof(Group::X);
+#else
+    static constexpr size_t CompressedSize = sizeof(Group);
+#endif
+
+protected:
+    alignas(uint64_t) unsigned char bytes[Size];
+
+public:
+    /**
+     * The point at infinity.
+     */
+    CompactPoint() { setZero(); }
+
+    CompactPoint(const Group& p) { set(p); }
+
+    CompactPoint& operator=(const Group& p) {
+        set(p);
+        return *this;
+    }
+
+public:
+    void set(const Group& p);
+
+    /**
+     * Returns the point, in the projective coordinates libff works with.
+     */
+    Group get() const;
+
+    operator Group() const { return get(); }
+
+    bool operator==(const CompactPoint& other) const { return get() == other.get(); }
+    bool operator!=(const CompactPoint& other) const { return !operator==(other); }
+
+    /**
+     * Writes 'p' in CompressedSize bytes at 'out' (e.g., in a proof; see FlatProofWriter).
+     */
+    static void compress(const Group& p, unsigned char * out);
+
+    /**
+     * Reads back a point written by compress(). Since the bytes might come from an untrusted proof, this checks the
+     * point is on the curve (and, for G2, in the subgroup of order r) and that the bytes are exactly what compress()
+     * would have written for it. Throws std::runtime_error if not.
+     */
+    static Group decompress(const unsigned char * in);
+
+protected:
+    void setZero();
+};
+
+template<> void CompactPoint<G1>::set(const G1& p);
+template<> void CompactPoint<G2>::set(const G2& p);
+template<> G1 CompactPoint<G1>::get() const;
+template<> G2 CompactPoint<G2>::get() const;
+template<> void CompactPoint<G1>::setZero();
+template<> void CompactPoint<G2>::setZero();
+template<> void CompactPoint<G1>::compress(const G1& p, unsigned char * out);
+template<> void CompactPoint<G2>::compress(const G2& p, unsigned char * out);
+template<> G1 CompactPoint<G1>::decompress(const unsigned char * in);
+template<> G2 CompactPoint<G2>::decompress(const unsigned char * in);
+
+using CompactG1 = CompactPoint<G1>;
+using CompactG2 = CompactPoint<G2>;
+
+} // end of namespace libaad
@@ -24,6 +24,18 @@ namespace libaad {
     auto ReducedPairing(Args&&... args) -> decltype(libff::default_ec_pp::reduced_pairing(std::forward<Args>(args)...)) {
         return libff::default_ec_pp::reduced_pairing(std::forward<Args>(args)...);
     }
+
+    // A G2 element with its Miller loop line coefficients precomputed, for pairing a fixed G2 element with many G1 elements
+    using G2Prepared = typename libff::default_ec_pp::G2_precomp_type;
+
+    inline G2Prepared PrepareG2(const G2& b) {
+        return libff::default_ec_pp::precompute_G2(b);
+    }
+
+    // Pairing with a prepared G2 element, which skips recomputing the G2 element's line coefficients
+    inline GT ReducedPairing(const G1& a, const G2Prepared& b) {
+        return libff::default_ec_pp::final_exponentiation(libff::default_ec_pp::miller_loop(libff::default_ec_pp::precompute_G1(a), b));
+    }
     
     constexpr static int G1ElementSize = 32; // WARNING: Assuming BN128 curve
     constexpr static int G2ElementSize = 64; // WARNING: Assuming BN128 curve
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+
+#include <aad/EllipticCurves.h>
+
+namespace libaad {
+
+/**
+ * Efficiently-computable endomorphisms of BN128's groups: phi(x, y) = (beta x, y) on G1 (GLV) and the
+ * "untwist-Frobenius-twist" map psi on G2 (GLS). Each one acts on its group as multiplication by a fixed
+ * scalar lambda, so a scalar e can be split into two halves of about 128 bits, e = e1 + e2 lambda (mod r),
+ * and e P = e1 P + e2 endo(P). Multi-exponentiations over the halves need half the doublings.
+ *
+ * The endomorphisms are set up (and checked against lambda) the first time they are used. If the curve is not
+ * BN128 or a check fails, has<Group>() returns false and callers should fall back to the usual algorithms.
+ */
+class Endomorphism {
+public:
+    /**
+     * Returns true if the endomorphism of this group is available.
+     */
+    template<class Group>
+    static bool has();
+
+    /**
+     * Returns endo(P) = lambda P.
+     */
+    static G1 apply(const G1& p);
+    static G2 apply(const G2& q);
+
+    /**
+     * Splits every (base, exponent) pair in the input into two pairs with exponents of about half the size:
+     * (+/-base, |e1|) and (+/-endo(base), |e2|), where e = e1 + e2 lambda, and appends them to 'bases' and 'exps'.
+     * If 'endo_begin' is not null, it points to the precomputed endo(base)'s (see PublicParameters::useEndomorphisms()).
+     */
+    template<class Group>
+    static void split(
+        const Group * base_begin,
+        const Group * base_end,
+        const Fr * exp_begin,
+        const Fr * exp_end,
+        std::vector<Group>& bases,
+        std::vector<Fr>& exps,
+        const Group * endo_begin = nullptr);
+
+    /**
+     * Returns true if Q (e.g., a point on the twist read from a proof) is in G2, the subgroup of order r. With the
+     * endomorphism, this checks psi(Q) = lambda Q, which only holds on G2 and needs a scalar multiplication by the
+     * 128-bit lambda rather than by r. Otherwise, checks r Q = 0.
+     */
+    static bool isInG2(const G2& q);
+};
+
+} // end of namespace libaad
@@ -0,0 +1,622 @@
+#pragma once
+
+#include <aad/AADProof.h>
+#include <aad/FlatProof.h>
+#include <aad/MembProof.h>
+
+#include <functional>
+#include <list>
+#include <string>
+#include <vector>
+
+namespace libaad {
+
+/**
+ * A proof in the flat wire format (see FlatProof), verified in place: verify() walks the proof trees in preorder,
+ * straight out of the buffer, and never builds them. The buffer must outlive the proof.
+ *
+ * Verification checks the same things as for the proofs made of BinaryTree's (see AADProof) and supports the same
+ * batch verification and threads. The base class only provides those (there are no forestProofs).
+ */
+template<
+    class MerkleDataType
+>
+class FlatAADProof : public AADProof<MerkleDataType> {
+protected:
+    using AADProofType = AADProof<MerkleDataType>;
+    using Cursor = FlatProof::Cursor;
+
+    /**
+     * Reads the rest of a leaf of a forest proof (i.e., what follows its subset proof) at 'c' and returns its
+     * accumulator and Merkle hash. Returns false if the leaf is not valid.
+     */
+    using LeafFunc = std::function<bool(Cursor& c, G1& acc, MerkleHash& hash)>;
+
+protected:
+    FlatProofReader proof;
+
+public:
+    /**
+     * Throws std::runtime_error if 'buf' is not a flat proof of the given kind.
+     */
+    FlatAADProof(PublicParameters *pp, const unsigned char * buf, size_t len, FlatProof::Kind kind)
+        : AADProofType(pp), proof(buf, len)
+    {
+        static_assert(FlatProof::HashSize == MerkleHashSize, "Flat proofs store Merkle hashes as is");
+        if(proof.getKind() != kind)
+            throw std::runtime_error("Flat proof is of the wrong kind");
+    }
+
+public:
+    /**
+     * Returns the actual size of the proof, in bytes.
+     */
+    virtual int getProofSize() const {
+        return static_cast<int>(proof.size());
+    }
+
+    const FlatProofReader& getReader() const { return proof; }
+
+protected:
+    /**
+     * Calls 'f' and returns what it returns, or false if the proof turns out to be corrupted (i.e., if reading it throws).
+     */
+    bool readsValidProof(const std::function<bool()>& f) const {
+        try {
+            return f();
+        } catch(const std::runtime_error& e) {
+            logerror << "Invalid flat proof: " << e.what() << endl;
+            return false;
+        }
+    }
+
+    /**
+     * Verifies the forest proof subtree at 'c' (and moves 'c' past it), like AADProof::prevalidateForestProof(),
+     * computeMerkleHashes() and verifySubsetProofs() do for a tree of nodes. 'parentAcc' is the accumulator of the
+     * node's parent, or null for the root, whose accumulator is 'rootAcc' (unless the root is a leaf).
+     *
+     * Returns the node's Merkle hash in 'hash' and whether the node is a sibling in 'isSibling'.
+     */
+    bool verifyForestNode(Cursor& c, const G1 * parentAcc, const G1& rootAcc, const LeafFunc& leafFunc,
+        PairingBatch* batch, size_t depth, MerkleHash& hash, bool& isSibling)
+    {
+        uint8_t mask;
+        bool hasChildren = proof.readNode(c, mask);
+        uint8_t type = mask & FlatProof::TypeMask;
+        bool isRoot = parentAcc == nullptr;
+
+        isSibling = type == FlatProof::ForestSibling;
+        if(isSibling) {
+            if(hasChildren || isRoot || mask != (FlatProof::ForestSibling | FlatProof::HasHash)) {
+                logerror << "Malformed sibling node in forest proof" << endl;
+                return false;
+            }
+            hash = MerkleHash(proof.readHash(c));
+            return true;
+        }
+
+        // the root has no accumulator (the client has it in the digest) nor subset proof
+        bool isLeaf = type == FlatProof::ForestLeaf;
+        uint8_t points = isRoot ? 0 : (isLeaf ? FlatProof::HasG2 : FlatProof::HasG1 | FlatProof::HasG2);
+        if((!isLeaf && type != FlatProof::ForestOnPath) || hasChildren == isLeaf || (mask & ~FlatProof::TypeMask) != points) {
+            logerror << "Malformed node in forest proof" << endl;
+            return false;
+        }
+        if(depth > FlatProof::MaxDepth) {
+            logerror << "Forest proof is too deep" << endl;
+            return false;
+        }
+
+        G1 acc;
+        G2 subsetProof;
+        if(isLeaf) {
+            if(!isRoot)
+                subsetProof = proof.template readPoint<G2>(c);
+            if(!leafFunc(c, acc, hash))
+                return false;
+        } else {
+            if(isRoot) {
+                acc = rootAcc;
+            } else {
+                acc = proof.template readPoint<G1>(c);
+                subsetProof = proof.template readPoint<G2>(c);
+            }
+
+            MerkleHash leftHash, rightHash;
+            bool leftSib, rightSib;
+            if(!verifyForestNode(c, &acc, rootAcc, leafFunc, batch, depth + 1, leftHash, leftSib) ||
+                !verifyForestNode(c, &acc, rootAcc, leafFunc, batch, depth + 1, rightHash, rightSib))
+                return false;
+
+            if(leftSib && rightSib) {
+                logerror << "Cannot have both children be sibling nodes" << endl;
+                return false;
+            }
+
+            hash = MerkleHash(acc, leftHash, rightHash);
+        }
+
+        // Check subset proof against parent
+        if(!isRoot) {
+            if(batch != nullptr) {
+                batch->addEquality(*parentAcc, G2::one(), acc, subsetProof, nullptr, "subset proof against parent accumulator");
+            } else if(ReducedPairing(*parentAcc, PublicParameters::getPreparedG2()) != ReducedPairing(acc, subsetProof) && !this->simulate()) {
+                logerror << "Subset check failed along Merkle path" << endl;
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * Verifies the forest proof of the i'th tree and checks its root Merkle hash is in 'digest'.
+     */
+    bool verifyForestTree(size_t i, const Digest& digest, const LeafFunc& leafFunc, PairingBatch* batch) {
+        Cursor c = proof.getTree(i).forest;
+        MerkleHash hash;
+        bool isSibling;
+        if(!verifyForestNode(c, nullptr, std::get<0>(digest[i]), leafFunc, batch, 0, hash, isSibling))
+            return false;
+
+        if(hash != std::get<2>(digest[i]) && !this->simulate()) {
+            logerror << "Merkle root did not match" << endl;
+            return false;
+        }
+        return true;
+    }
+};
+
+/**
+ * A membership proof in the flat wire format (see AAD::writeMembershipProof() and MembershipProof).
+ */
+template<
+    int SecParam,
+    class CryptoHash,
+    class MerkleDataType
+>
+class FlatMembershipProof : public FlatAADProof<MerkleDataType> {
+protected:
+    using FlatAADProofType = FlatAADProof<MerkleDataType>;
+    using Cursor = typename FlatAADProofType::Cursor;
+
+    /**
+     * A node of a frontier proof, once read (see verifyFrontierNode()).
+     */
+    struct FrontierNode {
+        uint8_t type;
+        bool hasG1, hasG1ext, hasG2;
+        G1 g1, g1ext;
+        G2 g2;
+        size_t chunkBegin, chunkEnd;    // the prefixes of a (reconstructed) leaf, in the expected frontier
+    };
+
+public:
+    FlatMembershipProof(PublicParameters *pp, const unsigned char * buf, size_t len)
+        : FlatAADProofType(pp, buf, len, FlatProof::Kind::Membership)
+    {}
+
+    FlatMembershipProof(PublicParameters *pp, const std::string& buf)
+        : FlatMembershipProof(pp, reinterpret_cast<const unsigned char *>(buf.data()), buf.size())
+    {}
+
+public:
+    /**
+     * See MembershipProof::verify().
+     */
+    template<class Key, class Val>
+    bool verify(const Key& k, const std::list<Val>& values, const Digest& digest,
+        VerifierContext<Key, Val, SecParam, CryptoHash>* ctx = nullptr)
+    {
+        if(ctx != nullptr) {
+            assertTrue(ctx->getPublicParameters() == this->pp);
+        }
+        this->startPairingBatch();
+        return this->finishPairingBatch(verifyHelper(k, values, digest, ctx));
+    }
+
+protected:
+    template<class Key, class Val>
+    bool verifyHelper(const Key& k, std::list<Val> values, const Digest& digest, VerifierContext<Key, Val, SecParam, CryptoHash>* ctx) {
+        this->verified = true;
+        size_t numTrees = this->proof.getNumTrees();
+        if(numTrees != digest.size()) {
+            logerror << "Proof has " << numTrees << " trees, but digest has " << digest.size() << endl;
+            return false;
+        }
+
+        std::vector<std::vector<std::tuple<Val, int>>> treeValIds(numTrees);
+        std::vector<std::unique_ptr<PairingBatch>> treeBatches(numTrees);
+        for(size_t i = 0; i < numTrees; i++) {
+            treeBatches[i] = this->newTreePairingBatch();
+        }
+
+        bool ok = this->verifyTrees(numTrees, [&](size_t i) {
+            return this->readsValidProof([&]() {
+                return verifyTree(i, k, digest, treeValIds[i], treeBatches[i].get(), ctx);
+            });
+        });
+        if(!ok)
+            return false;
+
+        for(size_t i = 0; i < numTrees; i++) {
+            this->mergePairingBatch(treeBatches[i]);
+
+            for(auto& valId : treeValIds[i]) {
+                Utils::removeFirst(values, std::get<0>(valId));
+            }
+        }
+
+        // All values should've been validated and removed
+        return values.empty();
+    }
+
+    /**
+     * See MembershipProof::verifyTree().
+     */
+    template<class Key, class Val>
+    bool verifyTree(size_t i, const Key& k, const Digest& digest, std::vector<std::tuple<Val, int>>& valIds,
+        PairingBatch* batch, VerifierContext<Key, Val, SecParam, CryptoHash>* ctx)
+    {
+        logtrace << "Verifying forest tree #" << i << endl;
+        auto tree = this->proof.getTree(i);
+        std::vector<BitString> expectedFrontier;
+
+        if(tree.frontier.node == FlatProof::NoProof) {
+            logerror << "No frontier proof for forest tree #" << i << endl;
+            return false;
+        }
+
+        if(tree.forest.node != FlatProof::NoProof) {
+            // The leaves have the key's values (and leaf numbers), but not the key, which is the one we are looking up
+            auto leafFunc = [&](Cursor& c, G1& acc, MerkleHash& hash) {
+                Val v;
+                int32_t leafNo;
+                this->proof.readData(c, v);
+                this->proof.readData(c, leafNo);
+
+                // Compute leaf's AT accumulator (or get it from the verifier's cache)
+                if(ctx != nullptr) {
+                    acc = ctx->getLeafAcc(k, v, leafNo);
+                } else {
+                    AccumulatedTree at(SecParam*4, CryptoHash().hashKV(k, v, leafNo));
+                    assertTrue(at.getPrefixes().size() == 513);
+                    std::tie(acc, std::ignore) = CommitUtils::commitAT(&at,
+                        this->hasPublicParameters() ? &this->params() : nullptr,
+                        false);
+                }
+                hash = MerkleHash(acc);
+
+                valIds.push_back(std::make_tuple(std::move(v), leafNo));
+                return true;
+            };
+
+            if(!this->verifyForestTree(i, digest, leafFunc, batch))
+                return false;
+
+            assertFalse(valIds.empty());
+            getLowerFrontierPrefixes<SecParam>(k, valIds, expectedFrontier);
+        } else {
+            // Key is not present in the current forest tree, so the frontier proof comes with a missing prefix of the key
+            // (and the other prefixes in its frontier leaf, if chunked)
+            Cursor c = tree.frontier;
+            uint8_t isChunked;
+            BitString missingPrefix;
+            this->proof.readData(c, isChunked);
+            this->proof.readData(c, missingPrefix);
+            if(!missingPrefix.isPrefixOf(CryptoHash().hashK(k))) {
+                logerror << "Missing prefix is not a prefix of the key's hash" << endl;
+                return false;
+            }
+
+            if(isChunked == 0) {
+                expectedFrontier.push_back(missingPrefix);
+            } else {
+                uint32_t chunkSize;
+                this->proof.readData(c, chunkSize);
+                if(chunkSize == 0 || chunkSize > SecParam * 4) {
+                    logerror << "Missing prefix's frontier leaf has the wrong number of prefixes" << endl;
+                    return false;
+                }
+
+                expectedFrontier.resize(chunkSize);
+                for(auto& prefix : expectedFrontier) {
+                    this->proof.readData(c, prefix);
+                }
+                if(std::find(expectedFrontier.begin(), expectedFrontier.end(), missingPrefix) == expectedFrontier.end()) {
+                    logerror << "Missing prefix is not in its frontier leaf's chunk" << endl;
+                    return false;
+                }
+            }
+        }
+
+        Cursor c = tree.frontier;
+        size_t cursor = 0;
+        FrontierNode root;
+        if(!verifyFrontierNode(c, std::get<1>(digest[i]), expectedFrontier, cursor, batch, 0, root))
+            return false;
+
+        if(cursor != expectedFrontier.size()) {
+            logerror << "Did not find prefixes for all missing keys/values" << endl;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Reads the frontier proof subtree at 'c' into 'n' and verifies it, like MembershipProof::fillInFrontierLeaves(),
+     * isExtractableFrontier() and verifyFrontier() do for a tree of nodes: leaves take the next (up to) SecParam*4
+     * prefixes of 'expectedFrontier' after 'cursor', and their commitments are computed once their sibling is known.
+     * The root's G1 accumulator is 'rootAcc'.
+     */
+    bool verifyFrontierNode(Cursor& c, const G1& rootAcc, const std::vector<BitString>& expectedFrontier, size_t& cursor,
+        PairingBatch* batch, size_t depth, FrontierNode& n)
+    {
+        uint8_t mask;
+        bool hasChildren = this->proof.readNode(c, mask);
+        n.type = mask & FlatProof::TypeMask;
+        n.hasG1 = (mask & FlatProof::HasG1) != 0;
+        n.hasG1ext = (mask & FlatProof::HasG1ext) != 0;
+        n.hasG2 = (mask & FlatProof::HasG2) != 0;
+
+        bool isRoot = depth == 0;
+        bool isInternal = n.type == FlatProof::FrontierRoot || n.type == FlatProof::FrontierOnPath;
+        bool hasPoints = (mask & (FlatProof::HasG1 | FlatProof::HasG1ext | FlatProof::HasG2)) != 0;
+        if(n.type < FlatProof::FrontierLeaf || n.type > FlatProof::FrontierRoot || isRoot != (n.type == FlatProof::FrontierRoot) ||
+            hasChildren != isInternal || (mask & FlatProof::HasHash) != 0 ||
+            ((isRoot || n.type == FlatProof::FrontierLeaf) && hasPoints))
+        {
+            logerror << "Malformed node in frontier proof" << endl;
+            return false;
+        }
+        if(depth > FlatProof::MaxDepth) {
+            logerror << "Frontier proof is too deep" << endl;
+            return false;
+        }
+
+        if(n.hasG1)
+            n.g1 = this->proof.template readPoint<G1>(c);
+        if(n.hasG1ext)
+            n.g1ext = this->proof.template readPoint<G1>(c);
+        if(n.hasG2)
+            n.g2 = this->proof.template readPoint<G2>(c);
+
+        if(isRoot) {
+            n.g1 = rootAcc;
+            n.hasG1 = true;
+        }
+
+        if(n.type == FlatProof::FrontierLeaf) {
+            // the verifier reconstructs the leaf from its prefixes (see MembershipProof::fillInFrontierLeaves())
+            if(cursor >= expectedFrontier.size()) {
+                logerror << "Frontier proof has more leaves than prefixes" << endl;
+                return false;
+            }
+            n.chunkBegin = cursor;
+            n.chunkEnd = cursor + std::min(expectedFrontier.size() - cursor, static_cast<size_t>(SecParam * 4));
+            cursor = n.chunkEnd;
+        }
+
+        if(!hasChildren)
+            return true;
+
+        FrontierNode left, right;
+        if(!verifyFrontierNode(c, rootAcc, expectedFrontier, cursor, batch, depth + 1, left) ||
+            !verifyFrontierNode(c, rootAcc, expectedFrontier, cursor, batch, depth + 1, right))
+            return false;
+
+        // a leaf gets a commitment in the group its sibling has none in
+        if(left.type == FlatProof::FrontierLeaf)
+            commitFrontierLeaf(expectedFrontier, !right.hasG2, left);
+        if(right.type == FlatProof::FrontierLeaf)
+            commitFrontierLeaf(expectedFrontier, !left.hasG2, right);
+
+        // Check the node is extractable (see MembershipProof::isExtractableFrontier())
+        if(n.type == FlatProof::FrontierOnPath) {
+            if(n.hasG1ext) {
+                if(!n.hasG1) {
+                    logerror << "Extractable frontier node has no G1 accumulator" << endl;
+                    return false;
+                }
+                if(batch != nullptr) {
+                    batch->addEquality(n.g1, this->hasPublicParameters() ? this->params().getG2toTau() : G2::one(),
+                        n.g1ext, G2::one(), nullptr, "frontier G1 accumulator extractability");
+                } else if(ReducedPairing(n.g1, this->hasPublicParameters() ? this->params().getPreparedG2toTau() : PublicParameters::getPreparedG2()) !=
+                    ReducedPairing(n.g1ext, PublicParameters::getPreparedG2()) && !this->simulate()) {
+                    logerror << "Frontier G1 accumulator is not extractable" << endl;
+                    return false;
+                }
+            } else {
+                for(auto t : { left.type, right.type }) {
+                    if(t != FlatProof::FrontierOnPath && t != FlatProof::FrontierLeaf) {
+                        logerror << "Frontier proof is not extractable everyhere" << endl;
+                        return false;
+                    }
+                }
+            }
+        }
+
+        // Check the node's accumulator against its children's (see MembershipProof::verifyFrontier())
+        if(!(left.hasG1 || left.hasG2) || !(right.hasG1 || right.hasG2) || !n.hasG1) {
+            logerror << "Frontier node is missing accumulators" << endl;
+            return false;
+        }
+
+        G1 acc1;
+        G2 acc2;
+        if(left.hasG2 && right.hasG1) {
+            acc1 = right.g1;
+            acc2 = left.g2;
+        } else if(!left.hasG2 && right.hasG2 && left.hasG1) {
+            acc1 = left.g1;
+            acc2 = right.g2;
+        } else {
+            logerror << "Expected one of the two siblings to have a G2 accumulator" << endl;
+            return false;
+        }
+
+        bool checkG2 = n.hasG2;
+        if(batch != nullptr) {
+            batch->addEquality(n.g1, G2::one(), acc1, acc2, nullptr, "frontier accumulator against children");
+            if(checkG2)
+                batch->addEquality(n.g1, G2::one(), G1::one(), n.g2, nullptr, "frontier G1 and G2 accumulators match");
+            return true;
+        }
+
+        auto gt = ReducedPairing(n.g1, PublicParameters::getPreparedG2());
+        if(gt != ReducedPairing(acc1, acc2) && !this->simulate()) {
+            logerror << "A frontier node's accumulator did not verify against children" << endl;
+            return false;
+        }
+
+        if(checkG2 && gt != ReducedPairing(G1::one(), n.g2) && !this->simulate()) {
+            logerror << "Non leaf frontier node does not have same G1 and G2 accumulators" << endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    void commitFrontierLeaf(const std::vector<BitString>& expectedFrontier, bool inG2, FrontierNode& leaf) {
+        std::vector<Fr> leafPoly;
+        getFrontierLeafPoly(expectedFrontier.cbegin() + static_cast<long>(leaf.chunkBegin),
+            expectedFrontier.cbegin() + static_cast<long>(leaf.chunkEnd), leafPoly);
+
+        if(inG2) {
+            leaf.g2 = this->simulate() ? simulateCommitment<G2>(leafPoly) : PolyCommit::commitG2(this->params(), leafPoly, false);
+            leaf.hasG2 = true;
+        } else {
+            leaf.g1 = this->simulate() ? simulateCommitment<G1>(leafPoly) : PolyCommit::commitG1(this->params(), leafPoly, false);
+            leaf.hasG1 = true;
+        }
+    }
+};
+
+/**
+ * An append-only proof in the flat wire format (see AAD::writeAppendOnlyProof() and AppendOnlyProof).
+ */
+template<
+    class MerkleDataType
+>
+class FlatAppendOnlyProof : public FlatAADProof<MerkleDataType> {
+protected:
+    using FlatAADProofType = FlatAADProof<MerkleDataType>;
+    using Cursor = typename FlatAADProofType::Cursor;
+
+public:
+    FlatAppendOnlyProof(PublicParameters *pp, const unsigned char * buf, size_t len)
+        : FlatAADProofType(pp, buf, len, FlatProof::Kind::AppendOnly)
+    {}
+
+    FlatAppendOnlyProof(PublicParameters *pp, const std::string& buf)
+        : FlatAppendOnlyProof(pp, reinterpret_cast<const unsigned char *>(buf.data()), buf.size())
+    {}
+
+public:
+    bool verify(const Digest& oldDigest, const Digest& newDigest) {
+        this->startPairingBatch();
+        return this->finishPairingBatch(this->readsValidProof([&]() {
+            return verifyHelper(oldDigest, newDigest);
+        }));
+    }
+
+protected:
+    /**
+     * See AppendOnlyProof::verifyHelper().
+     */
+    bool verifyHelper(const Digest& oldDigest, const Digest& newDigest) {
+        this->verified = true;
+        size_t numTrees = this->proof.getNumTrees();
+        if(numTrees != newDigest.size()) {
+            logerror << "Proof has " << numTrees << " trees, but new digest has " << newDigest.size() << endl;
+            return false;
+        }
+
+        // First, find out which old roots (i.e., entries of the old digest) are in each tree, which only needs the
+        // shape of the proof. The old roots of a tree come after the old roots of the previous trees.
+        size_t oldidx = 0;
+        std::vector<size_t> treesToCheck, firstOldRoot;
+        for(size_t i = 0; i < numTrees; i++) {
+            Cursor c = this->proof.getTree(i).forest;
+
+            // 'new' trees contain no old roots, so they are not part of the proof
+            if(c.node == FlatProof::NoProof)
+                continue;
+
+            // If the old root is also a new root, we only check that the new root has the same digest
+            // (this only happens for the biggest trees in the forest, so all the trees before this one are old roots too)
+            uint8_t mask;
+            Cursor peek = c;
+            bool hasChildren = this->proof.readNode(peek, mask);
+            if(!hasChildren && (mask & FlatProof::TypeMask) == FlatProof::ForestLeaf) {
+                if(oldidx != i || oldidx >= oldDigest.size() || oldDigest[oldidx] != newDigest[i]) {
+                    logerror << "New digest has different tree #" << i << endl;
+                    return false;
+                }
+                oldidx++;
+                continue;
+            }
+
+            treesToCheck.push_back(i);
+            firstOldRoot.push_back(oldidx);
+            size_t numLeaves = 0;
+            if(!countForestLeaves(c, 0, numLeaves))
+                return false;
+            oldidx += numLeaves;
+        }
+
+        if(oldidx != oldDigest.size()) {
+            logerror << "Proof has " << oldidx << " old roots, but old digest has " << oldDigest.size() << endl;
+            return false;
+        }
+
+        // Then, check the trees independently (maybe in parallel), each one with its own pairing batch
+        std::vector<std::unique_ptr<PairingBatch>> treeBatches(treesToCheck.size());
+        for(auto& b : treeBatches) {
+            b = this->newTreePairingBatch();
+        }
+
+        bool ok = this->verifyTrees(treesToCheck.size(), [&](size_t j) {
+            // Old roots get their AT accumulator and Merkle hash from the old digest, in order
+            size_t next = firstOldRoot[j];
+            auto leafFunc = [&](Cursor&, G1& acc, MerkleHash& hash) {
+                if(next >= oldDigest.size())
+                    return false;
+                acc = std::get<0>(oldDigest[next]);
+                hash = std::get<2>(oldDigest[next]);
+                next++;
+                return true;
+            };
+
+            return this->readsValidProof([&]() {
+                return this->verifyForestTree(treesToCheck[j], newDigest, leafFunc, treeBatches[j].get());
+            });
+        });
+        if(!ok)
+            return false;
+
+        for(auto& b : treeBatches) {
+            this->mergePairingBatch(b);
+        }
+
+        return true;
+    }
+
+    // adds the number of leaves in the forest proof subtree at 'c' to 'numLeaves' (and moves 'c' past its nodes)
+    bool countForestLeaves(Cursor& c, size_t depth, size_t& numLeaves) const {
+        if(depth > FlatProof::MaxDepth) {
+            logerror << "Forest proof is too deep" << endl;
+            return false;
+        }
+
+        uint8_t mask;
+        if(this->proof.readNode(c, mask))
+            return countForestLeaves(c, depth + 1, numLeaves) && countForestLeaves(c, depth + 1, numLeaves);
+
+        if((mask & FlatProof::TypeMask) == FlatProof::ForestLeaf)
+            numLeaves++;
+        return true;
+    }
+};
+
+} // end of namespace libaad
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <aad/BitString.h>
+#include <aad/CompactPoint.h>
+#include <aad/EllipticCurves.h>
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace libaad {
+
+/**
+ * The wire format of membership and append-only proofs, which can be written straight into a buffer (see
+ * AAD::writeMembershipProof() and AAD::writeAppendOnlyProof()) and verified in place, without building a tree of
+ * heap nodes first (see FlatMembershipProof and FlatAppendOnlyProof). Thus, a server can keep proofs in memory or
+ * on disk and hand them out without copying them around.
+ *
+ * A flat proof is a Header, a table with a TreeEntry for every tree in the forest, followed by these regions:
+ *  - the shape of the proof trees, as one bit for every node in preorder, set if the node has (two) children,
+ *  - a mask byte for every node, with its type and which group elements and Merkle hash it has,
+ *  - the group elements of the nodes, in preorder, compressed (see CompactPoint::compress()),
+ *  - the Merkle hashes of the nodes, in preorder,
+ *  - any other data (e.g., the values in the leaves of membership proofs), in the order it was written.
+ *
+ * Every tree has a forest proof and/or a frontier proof, whose first node, group element, hash and data byte are given
+ * by a Cursor in its TreeEntry (or NoProof). Integers are in host byte order, like in snapshots.
+ */
+class FlatProof {
+public:
+    enum class Kind : uint32_t { Membership = 1, AppendOnly = 2 };
+
+    static const uint32_t Magic = 0x50444141;   // "AADP"
+    static const uint32_t Version = 1;
+    static const uint32_t NoProof = UINT32_MAX;
+    static const size_t HashSize = 32;
+
+    /**
+     * Proof trees are never deeper than this (forest trees are at most 32 levels deep and frontier trees at most
+     * as deep as an AT's paths), so verifiers bail out of corrupted proofs rather than recurse forever.
+     */
+    static const size_t MaxDepth = 1024;
+
+    // The bits of a node's mask byte
+    static const uint8_t TypeMask = 0x07;
+    static const uint8_t HasG1 = 1 << 3;
+    static const uint8_t HasG1ext = 1 << 4;
+    static const uint8_t HasG2 = 1 << 5;
+    static const uint8_t HasHash = 1 << 6;
+
+    // The types of nodes in forest proofs
+    static const uint8_t ForestSibling = 0;
+    static const uint8_t ForestOnPath = 1;
+    static const uint8_t ForestLeaf = 2;       // a key-value pair (in membership proofs) or an old root (in append-only proofs)
+
+    // The types of nodes in frontier proofs (see Frontier::ProofData::Type)
+    static const uint8_t FrontierLeaf = 1;
+    static const uint8_t FrontierSiblingLeaf = 2;
+    static const uint8_t FrontierSiblingNonLeaf = 3;
+    static const uint8_t FrontierOnPath = 4;
+    static const uint8_t FrontierRoot = 5;
+
+    /**
+     * Where a proof tree (or what is left of it) starts: the index of its next node and the offsets of its next
+     * group element, hash and data byte in their regions.
+     */
+    struct Cursor {
+        uint32_t node, point, hash, data;
+    };
+
+    struct TreeEntry {
+        Cursor forest, frontier;
+    };
+
+    struct Header {
+        uint32_t magic, version, kind, numTrees;
+        uint32_t numNodes, pointBytes, hashBytes, dataBytes;
+    };
+
+    static Cursor noProof() { return Cursor{NoProof, NoProof, NoProof, NoProof}; }
+};
+
+/**
+ * Writes a flat proof (see FlatProof), one tree at a time: call beginTree() for every tree in the forest and then
+ * beginForest() and/or beginFrontier() before adding the nodes of its forest and/or frontier proof in preorder.
+ * The group elements, hash and data of a node are added right after the node.
+ */
+class FlatProofWriter {
+protected:
+    FlatProof::Kind kind;
+    std::vector<FlatProof::TreeEntry> trees;
+    uint32_t numNodes;
+    std::string shape, masks, points, hashes, data;
+
+public:
+    FlatProofWriter(FlatProof::Kind kind)
+        : kind(kind), numNodes(0)
+    {}
+
+public:
+    void beginTree() { trees.push_back(FlatProof::TreeEntry{FlatProof::noProof(), FlatProof::noProof()}); }
+    void beginForest();
+    void beginFrontier();
+
+    void addNode(bool hasChildren, uint8_t mask);
+
+    template<class Group>
+    void addPoint(const Group& p) {
+        size_t offset = points.size();
+        points.resize(offset + CompactPoint<Group>::CompressedSize);
+        CompactPoint<Group>::compress(p, reinterpret_cast<unsigned char *>(&points[offset]));
+    }
+
+    void addHash(const unsigned char * hash) { hashes.append(reinterpret_cast<const char *>(hash), FlatProof::HashSize); }
+
+    template<class T>
+    void addData(const T& val) {
+        static_assert(std::is_trivially_copyable<T>::value, "Can only write strings, bit strings or trivially-copyable types");
+        data.append(reinterpret_cast<const char *>(&val), sizeof(T));
+    }
+
+    void addData(std::string_view str);
+    void addData(const std::string& str) { addData(std::string_view(str)); }
+    void addData(const BitString& bs);
+
+    /**
+     * Writes the proof to 'out' (replacing what was in it) and returns its size.
+     */
+    size_t finish(std::string& out) const;
+
+protected:
+    FlatProof::Cursor getCursor() const;
+};
+
+/**
+ * Reads a flat proof (see FlatProof) in place, from a buffer that must outlive the reader. The constructor checks the
+ * header and the sizes of the regions, and every read checks it stays within its region, so a corrupted proof makes
+ * the reader throw std::runtime_error rather than read past the buffer.
+ */
+class FlatProofReader {
+protected:
+    const unsigned char * buf;
+    size_t len;
+    FlatProof::Header header;
+    const unsigned char * table, * shape, * masks, * points, * hashes, * data;
+
+public:
+    FlatProofReader(const unsigned char * buf, size_t len);
+    FlatProofReader(const std::string& str)
+        : FlatProofReader(reinterpret_cast<const unsigned char *>(str.data()), str.size())
+    {}
+
+public:
+    FlatProof::Kind getKind() const { return static_cast<FlatProof::Kind>(header.kind); }
+    size_t getNumTrees() const { return header.numTrees; }
+    size_t size() const { return len; }
+
+    FlatProof::TreeEntry getTree(size_t i) const;
+
+    /**
+     * Reads the node at 'c' into 'mask' and returns true if the node has children.
+     */
+    bool readNode(FlatProof::Cursor& c, uint8_t& mask) const;
+
+    /**
+     * Reads a group element and checks it is on the curve.
+     */
+    template<class Group>
+    Group readPoint(FlatProof::Cursor& c) const {
+        return CompactPoint<Group>::decompress(readRegion(points, header.pointBytes, c.point, CompactPoint<Group>::CompressedSize));
+    }
+
+    /**
+     * Returns a pointer to the HashSize bytes of the hash at 'c', in the proof.
+     */
+    const unsigned char * readHash(FlatProof::Cursor& c) const { return readRegion(hashes, header.hashBytes, c.hash, FlatProof::HashSize); }
+
+    template<class T>
+    void readData(FlatProof::Cursor& c, T& val) const {
+        static_assert(std::is_trivially_copyable<T>::value, "Can only read strings, bit strings or trivially-copyable types");
+        std::memcpy(&val, readRegion(data, header.dataBytes, c.data, sizeof(T)), sizeof(T));
+    }
+
+    /**
+     * Returns a view of a string in the proof.
+     */
+    void readData(FlatProof::Cursor& c, std::string_view& str) const;
+
+    void readData(FlatProof::Cursor& c, std::string& str) const {
+        std::string_view view;
+        readData(c, view);
+        str.assign(view.data(), view.size());
+    }
+
+    void readData(FlatProof::Cursor& c, BitString& bs) const;
+
+protected:
+    // returns a pointer to the 'count' bytes at 'offset' in a region of 'regionSize' bytes and moves 'offset' past them
+    const unsigned char * readRegion(const unsigned char * region, uint32_t regionSize, uint32_t& offset, size_t count) const;
+};
+
+} // end of namespace libaad
@@ -2,11 +2,15 @@
 
 #include <functional>   // std::hash
 #include <map>
+#include <mutex>
+#include <unordered_map>
 
+#include <aad/CompactPoint.h>
 #include <aad/Hashing.h>
 #include <aad/PolyCommit.h>
 #include <aad/PolyInterpolation.h>
 #include <aad/PublicParameters.h>
+#include <aad/Snapshot.h>
 
 #include <libfqfft/polynomial_arithmetic/basic_operations.hpp>
 
@@ -30,37 +34,59 @@ public:
     using BinaryTreePtrType = BinaryTreeType*;
     using BinaryForestType = BinaryForest<DataType, MergeFunc>;
 
+    /**
+     * The deepest a frontier tree in a snapshot can be (see readSnapshotNode()): finalize() merges at most one
+     * perfect tree per bit of the (int32_t) number of leaves, so a valid tree is less than 64 deep.
+     */
+    static const int MaxSnapshotDepth = 64;
+
 public:
     class DataType {
     public:
         // accumulator over all prefixes in all leaves underneath this node
-        G1 acc1, eAcc1; // extractable accumulator in G1
-        G2 acc2;        // non-extractable accumulator in G2
+        CompactG1 acc1, eAcc1; // extractable accumulator in G1
+        CompactG2 acc2;        // non-extractable accumulator in G2
         //boost::variant<std::tuple<G1, G1>, G2> acc;
-        // polynomial over all leaves underneath this node
+        // polynomial over all leaves underneath this node (kept only for leaves, as a 'recipe' for their
+        // ancestors' polynomials, and for the root until the EEA is computed)
+        // NOTE: A leaf's polynomial has one coefficient (i.e., an Fr) per prefix in the leaf, plus one, so all leaves
+        // together take about as much memory as the root's polynomial did. They live as long as the frontier does,
+        // unless a retained key's leaves are moved into the next frontier (see addRetainedValuesPrefixes()).
         std::vector<Fr> poly;
+        // a leaf's polynomial, when restored from a snapshot, until it is needed (see getPoly())
+        MappedPoly mappedPoly;
+        // which of the accumulators above were computed already
+        bool hasAcc1, hasEAcc1, hasAcc2;
     public:
         DataType()
-            : acc1(G1::one()), eAcc1(G1::one()), acc2(G2::one())
+            : acc1(G1::one()), eAcc1(G1::one()), acc2(G2::one()),
+              hasAcc1(false), hasEAcc1(false), hasAcc2(false)
         {}
 
     public:
-        void commitToPolynomial(PublicParameters* pp, bool clearPoly, bool isLeaf, bool isRoot) {
-            acc1 = PolyCommit::commitG1(*pp, poly, false);
-            if(!isLeaf) {
-                eAcc1 = PolyCommit::commitG1(*pp, poly, true);
-                if(!isRoot) {
-                    acc2 = PolyCommit::commitG2(*pp, poly, false);
-                    assertEqual(ReducedPairing(acc1, G2::one()), ReducedPairing(G1::one(), acc2));
-                }
-            
-                assertEqual(ReducedPairing(acc1, pp->getG2toTau()), ReducedPairing(eAcc1, G2::one()));
-            }
+        /**
+         * Returns this node's polynomial, reading it in from the snapshot if this node was restored from one.
+         */
+        std::vector<Fr>& getPoly() {
+            mappedPoly.loadInto(poly);
+            return poly;
+        }
 
-            // Get rid of the polynomial, unless it's the root polynomial, which we need for EEA with the AT polynomial
-            if(clearPoly) {
-                std::vector<Fr>().swap(poly);
-                assertEqual(poly.capacity(), 0);
+        /**
+         * Checks that the accumulators computed so far commit to the same polynomial.
+         */
+        void checkAccumulators(PublicParameters* pp) const {
+            (void)pp;
+            if(!hasAcc1)
+                return;
+
+            // NOTE: decompresses acc1 only once (see CompactPoint)
+            G1 a1 = acc1.get();
+            if(hasAcc2) {
+                assertEqual(ReducedPairing(a1, PublicParameters::getPreparedG2()), ReducedPairing(G1::one(), acc2.get()));
+            }
+            if(hasEAcc1) {
+                assertEqual(ReducedPairing(a1, pp->getPreparedG2toTau()), ReducedPairing(eAcc1.get(), PublicParameters::getPreparedG2()));
             }
         }
     };
@@ -120,16 +146,31 @@ public:
         }
     };
 
+    /**
+     * The lower frontier leaves of a key. These remain valid in a merged AT, as long as the key's
+     * lower root is the same AT node and the key has no new values.
+     */
+    class RetainedKey {
+    public:
+        BitString keyHash;
+        int numValues;
+        std::vector<NodePtrType> leaves;    // the key's leaves in the frontier that currently holds this object
+
+    public:
+        RetainedKey(const BitString& keyHash, int numValues)
+            : keyHash(keyHash), numValues(numValues)
+        {}
+    };
+
     class MergeFunc {
     protected:
-        microseconds::rep multTime, commitTime;
+        microseconds::rep multTime;
         size_t multCoeffs;
-        size_t commCoeffs;
         PublicParameters *pp;
 
     public:
         MergeFunc()
-            : multTime(0), commitTime(0), multCoeffs(0), commCoeffs(0)
+            : multTime(0), multCoeffs(0)
         {}
 
     public:
@@ -154,17 +195,14 @@ public:
                 poly_multiply(parent->poly, left->poly, right->poly);
                 multTime += t.stop().count();
                 multCoeffs += parent->poly.size();
-            
-                // Commit to left and right polynomials (note that this commits to the leaves as well)
-                commCoeffs += left->poly.size() + right->poly.size();
-                t.restart();
-                left->commitToPolynomial(pp, true, leftNode->isLeaf(), false);
-                right->commitToPolynomial(pp, true, rightNode->isLeaf(), false);
-                commitTime += t.stop().count();
-
-                // We defer committing to the parent poly until the next MergeFunc or finalize().
-                // (This is because by then we knew if we should commit in G1 or in G2 for a left or right child. However,
-                //  this is irrelevant now, because we don't use this scheme anymore.)
+
+                // We do not commit to the children here: their accumulators are computed lazily, only if a frontier
+                // proof needs them (see Frontier::materializeRoles). Leaves keep their polynomials so we can recompute
+                // the polynomials of their ancestors later, but internal nodes no longer need theirs.
+                if(!leftNode->isLeaf())
+                    std::vector<Fr>().swap(left->poly);
+                if(!rightNode->isLeaf())
+                    std::vector<Fr>().swap(right->poly);
             } else {
                 // accumulators already initialized to one() in constructor
                 // NOTE: we could pick them randomly, but that would be too slow with libff, instead
@@ -176,7 +214,6 @@ public:
 
         void printStatistics() const {
             printOpPerf(multTime, "frontierMult", multCoeffs);
-            printOpPerf(commitTime, "frontierCommit", commCoeffs);
         }
     };
 
@@ -204,13 +241,38 @@ protected:
      */
     std::vector<std::tuple<BitString, std::vector<NodePtrType>>> keyToAccumulatorLeaf; // we don't care about fast lookup right now
 
+    /**
+     * When the upper frontier is chunked (see addMissingKeyPrefixes()), maps a leaf to all the missing
+     * key prefixes in it, which the verifier needs in order to reconstruct the leaf.
+     */
+    std::unordered_map<NodePtrType, std::vector<BitString>> upperLeafPrefixes;
+
+    /**
+     * Maps a key's lower root in the AT to the polynomials and commitments of its lower frontier leaves,
+     * so the frontier of the next merged AT can reuse them. Only filled in when 'retainLeaves' is true.
+     */
+    std::unordered_map<Node*, RetainedKey> retained;
+    // Retained keys restored from a snapshot without their AT, which relinkRetained() moves into 'retained'
+    std::vector<RetainedKey> unlinkedRetained;
+    bool retainLeaves;
+    int numReusedKeys, numReusedLeaves;
+
     PublicParameters *params;
     bool simulate;
     MergeFunc mergeFunc;
 
+    /**
+     * Guards the accumulators memoized in the frontier nodes (and the leaves' polynomials, which are read in from
+     * snapshots on demand) and the retained keys (which are relinked when a spilled AT is read back in), since
+     * frontier proofs for different keys can be computed concurrently (e.g., by AAD::completeMembershipProof(), which
+     * is const). Concurrent proofs are only safe with one another, not with appends or AAD::trimRoots().
+     */
+    mutable std::mutex rolesMutex;
+
 public:
-    Frontier(PublicParameters * p = nullptr)
-        : upperTree(nullptr), params(p), simulate(p == nullptr)
+    Frontier(PublicParameters * p = nullptr, bool retainLeaves = false)
+        : upperTree(nullptr), retainLeaves(retainLeaves), numReusedKeys(0), numReusedLeaves(0),
+          params(p), simulate(p == nullptr)
     {
         mergeFunc.setPublicParameters(p);
         lowerTrees.setMergeFunc(&mergeFunc);
@@ -228,7 +290,7 @@ public:
         assertNotNull(data);
         return data->poly;
     }
-    G1& getRootAcc() const {
+    G1 getRootAcc() const {
         auto root = upperTree->getRoot();
         assertNotNull(root);
         auto data = root->getData();
@@ -238,6 +300,10 @@ public:
 
     int getNumLeafs() const { return lowerTrees.getCount(); }
 
+    bool isRetainingLeaves() const { return retainLeaves; }
+    int getNumReusedKeys() const { return numReusedKeys; }
+    int getNumReusedLeaves() const { return numReusedLeaves; }
+
     int getSize() const {
         return upperTree->getRoot()->getSize();
     }
@@ -251,6 +317,19 @@ public:
         }));
     }
 
+    /**
+     * Returns all the missing key prefixes stored in the same leaf as 'prefix'. If the upper frontier is not
+     * chunked, this is just 'prefix'.
+     */
+    std::vector<BitString> getPrefixChunk(const BitString& prefix) {
+        auto it = upperLeafPrefixes.find(getPrefixLeaf(prefix));
+        if(it == upperLeafPrefixes.end()) {
+            return std::vector<BitString>(1, prefix);
+        } else {
+            return it->second;
+        }
+    }
+
     std::vector<NodePtrType>& getKeyLeaves(const BitString& keyHash) {
         auto it = std::find_if(
             keyToAccumulatorLeaf.begin(),
@@ -282,12 +361,48 @@ public:
         keyPrefixToLeaf.push_back(std::make_tuple(prefix, leafPtr));
     }
 
+    /**
+     * Takes a chunk of prefixes for missing keys and creates a single leaf for them with a characteristic
+     * polynomial. This makes for fewer leaves (and thus fewer merges and shorter frontier proofs) than
+     * addMissingKeyPrefix(), but a non-membership proof will have to include all the prefixes in the chunk.
+     */
+    void addMissingKeyPrefixes(std::vector<BitString>::const_iterator pfxbeg, std::vector<BitString>::const_iterator pfxend) {
+        assertTrue(pfxbeg != pfxend);
+        if(pfxend - pfxbeg == 1) {
+            addMissingKeyPrefix(*pfxbeg);
+            return;
+        }
+
+        auto data = new DataType();
+        if(!simulate) {
+            assertNotNull(params);
+
+            std::vector<Fr> hashes;
+            hashToField(pfxbeg, pfxend, hashes);
+            poly_from_roots_ntl(data->poly, hashes);
+        } else {
+            // do nothing
+        }
+
+        NodePtrType leafPtr = NodeFactory::makeNode(data);
+        lowerTrees.appendLeaf(leafPtr);
+        for(auto it = pfxbeg; it != pfxend; it++) {
+            keyPrefixToLeaf.push_back(std::make_tuple(*it, leafPtr));
+        }
+        upperLeafPrefixes[leafPtr] = std::vector<BitString>(pfxbeg, pfxend);
+    }
+
     /**
      * Takes a batch of prefixes (could be 2 or more) associated with the missing
      * values for the specified key and creates a leaf for them with a characteristic
      * polynomial.
+     *
+     * If this frontier retains its leaves, 'lowRoot' and 'numValues' identify the key's
+     * lower root in the AT (and its number of values), so the leaf can be reused later.
      */
-    void addMissingValuesPrefixes(const BitString& keyHash, std::vector<BitString>::const_iterator pfxbeg, std::vector<BitString>::const_iterator pfxend) {
+    void addMissingValuesPrefixes(const BitString& keyHash, std::vector<BitString>::const_iterator pfxbeg, std::vector<BitString>::const_iterator pfxend,
+        Node* lowRoot = nullptr, int numValues = 0)
+    {
         auto data = new DataType();
         if(!simulate) {
             assertNotNull(params);
@@ -301,27 +416,92 @@ public:
         }
          
         auto leafPtr = NodeFactory::makeNode(data);
-        lowerTrees.appendLeaf(leafPtr);
+        appendValuesLeaf(keyHash, leafPtr);
 
-        auto it = std::find_if(
-            keyToAccumulatorLeaf.begin(),
-            keyToAccumulatorLeaf.end(),
-            [&keyHash](const std::tuple<BitString, std::vector<NodePtrType>>& tup) {
-                return std::get<0>(tup) == keyHash;
-        });
+        if(retainLeaves) {
+            assertNotNull(lowRoot);
+            auto it = retained.find(lowRoot);
+            if(it == retained.end()) {
+                it = retained.emplace(lowRoot, RetainedKey(keyHash, numValues)).first;
+            }
+            it->second.leaves.push_back(leafPtr);
+        }
+    }
 
-        //logdbg << "Adding prefixes for key " << keyHash << " to leaf " << leafPtr->getLabel() << endl;
+    /**
+     * Reuses the lower frontier leaves of a key from the frontier of a child AT that was merged into this
+     * frontier's AT. This works only if the key has no new values in the merged AT: i.e., its lower root is
+     * the same node and it has the same number of values as when the child's frontier was computed. In that case,
+     * the leaves' polynomials (and commitments, if computed) are moved over from the child's frontier (which will
+     * be freed after the merge anyway) and true is returned.
+     *
+     * Otherwise, returns false and the caller needs to call addMissingValuesPrefixes() for the key.
+     */
+    bool addRetainedValuesPrefixes(Frontier* child, Node* lowRoot, const BitString& keyHash, int numValues) {
+        if(child == nullptr || child->retained.empty())
+            return false;
 
-        if(it == keyToAccumulatorLeaf.end()) {
-            std::vector<NodePtrType> vec;
-            vec.push_back(leafPtr);
-            keyToAccumulatorLeaf.push_back(std::make_tuple(keyHash, vec));
+        auto it = child->retained.find(lowRoot);
+        if(it == child->retained.end())
+            return false;
+
+        RetainedKey& rk = it->second;
+        if(rk.numValues != numValues || rk.keyHash != keyHash)
+            return false;
+
+        for(auto& leaf : rk.leaves) {
+            auto oldData = leaf->getData();
+            auto data = new DataType();
+            if(!simulate) {
+                data->poly = std::move(oldData->getPoly());
+                data->acc1 = oldData->acc1;
+                data->hasAcc1 = oldData->hasAcc1;
+            }
+
+            auto leafPtr = NodeFactory::makeNode(data);
+            appendValuesLeaf(keyHash, leafPtr);
+            leaf = leafPtr;
+        }
+
+        numReusedKeys++;
+        numReusedLeaves += static_cast<int>(rk.leaves.size());
+
+        if(retainLeaves) {
+            retained.emplace(lowRoot, std::move(rk));
+        }
+        child->retained.erase(it);
+        return true;
+    }
+
+protected:
+    void appendValuesLeaf(const BitString& keyHash, NodePtrType leafPtr) {
+        lowerTrees.appendLeaf(leafPtr);
+
+        // NOTE: A key's leaves are always added consecutively, so we only need to check the last key.
+        if(!keyToAccumulatorLeaf.empty() && std::get<0>(keyToAccumulatorLeaf.back()) == keyHash) {
+            std::get<1>(keyToAccumulatorLeaf.back()).push_back(leafPtr);
         } else {
-            auto& vec = std::get<1>(*it);
-            vec.push_back(leafPtr);
+            auto it = std::find_if(
+                keyToAccumulatorLeaf.begin(),
+                keyToAccumulatorLeaf.end(),
+                [&keyHash](const std::tuple<BitString, std::vector<NodePtrType>>& tup) {
+                    return std::get<0>(tup) == keyHash;
+            });
+
+            //logdbg << "Adding prefixes for key " << keyHash << " to leaf " << leafPtr->getLabel() << endl;
+
+            if(it == keyToAccumulatorLeaf.end()) {
+                std::vector<NodePtrType> vec;
+                vec.push_back(leafPtr);
+                keyToAccumulatorLeaf.push_back(std::make_tuple(keyHash, vec));
+            } else {
+                auto& vec = std::get<1>(*it);
+                vec.push_back(leafPtr);
+            }
         }
     }
 
+public:
     /**
      * Easiest way to build a frontier accumulator was to maintain a bunch of 2^i-sized
      * trees and "merge" them later: we create a new tree whose leaves are these old trees.
@@ -336,11 +516,11 @@ public:
             if(!simulate) {
                 assertNotNull(params);
                 auto root = upperTree->getRoot();
-                auto rootData = root->getData();
-                // We don't clear the poly yet because we need it for computing EEA
-                rootData->commitToPolynomial(params, false, false, true);
+                // We don't clear the poly yet because we need it for computing EEA.
+                // NOTE: The root's accumulators are needed for the digest, so we compute them eagerly. All other nodes'
+                // accumulators are computed lazily by getFrontierProof().
+                materializeRoles(std::vector<RoleRequest>(1, RoleRequest{root, true, true, false}));
 
-                //assertEqual(rootData->acc.which(), 0);
                 assertFinalized(root->left.get(), BitString("0"));
                 assertFinalized(root->right.get(), BitString("1"));
 
@@ -363,34 +543,13 @@ public:
 
         (void)bs;
         //logdbg << "Checking node: " << bs << endl;
-        assertEqual(data->poly.capacity(), 0);
-        //if(node->getBit() == 0) {
-        //    assertEqual(data->acc.which(), 0);
-        //} else {
-        //    assertEqual(data->acc.which(), 1);
-        //}
-        if(!node->isLeaf() && !simulate) {
+        if(node->isLeaf()) {
+            // leaves keep their polynomials, so we can recompute their ancestors' polynomials
+            assertTrue(simulate || !data->poly.empty());
+        } else {
+            assertEqual(data->poly.capacity(), 0);
             // In the frontier, every node has a left and right child, unless it's a leaf
-            auto left = dynamic_cast<NodePtrType>(node->left.get());
-            auto right = dynamic_cast<NodePtrType>(node->right.get());
-            assertNotNull(left);
-            assertNotNull(right);
-#ifndef NDEBUG
-            // assert leaves don't have accumulators in G2
-            if(!left->isLeaf() && !right->isLeaf()) {
-                auto leftData = left->getData();
-                auto rightData = right->getData();
-                assertNotNull(leftData);
-                assertNotNull(rightData);
-                assertEqual(ReducedPairing(data->acc1, G2::one()), ReducedPairing(leftData->acc1, rightData->acc2));
-                assertEqual(ReducedPairing(data->acc1, G2::one()), ReducedPairing(rightData->acc1, leftData->acc2));
-                // root doesn't have acc in G2
-                if(!node->isRoot()) {
-                    assertEqual(ReducedPairing(G1::one(), data->acc2), ReducedPairing(leftData->acc1, rightData->acc2));
-                    assertEqual(ReducedPairing(G1::one(), data->acc2), ReducedPairing(rightData->acc1, leftData->acc2));
-                }
-            }
-#endif
+            assertTrue(node->hasTwoChildren());
         }
 
         BitString leftLab(bs), rightLab(bs);
@@ -422,8 +581,12 @@ public:
 
         auto proof = new BinaryTree<DataNode<ProofData>>(new DataNode<ProofData>());
 
+        // Remembers the frontier node each proof node was copied from, so we can compute the accumulators that remain
+        // in the proof after removing the useless ones below.
+        std::unordered_map<DataNode<ProofData>*, NodePtrType> srcOf;
+
         // WARNING: Apparently, using an auto here results in a compile error
-        std::function<void(NodePtrType, DataNode<ProofData>*, bool)> copierFunc = [this](
+        std::function<void(NodePtrType, DataNode<ProofData>*, bool)> copierFunc = [&srcOf](
             NodePtrType srcNode, DataNode<ProofData>* destNode, bool isSibling)
         {
             assertNotNull(srcNode);
@@ -431,7 +594,6 @@ public:
             assertNotNull(destNode);
             bool isRoot = srcNode->isRoot();
             bool isLeaf = srcNode->isLeaf();
-            auto srcData = srcNode->getData();
 
             // might have data set from previous copyPathToRoot call
             if(!destNode->hasData()) {
@@ -448,10 +610,13 @@ public:
 
             //logdbg << "Copying node " << srcNode->getLabel() << " (isLeaf = " << isLeaf << ", isSibling = " << isSibling << ")..." << endl;
 
-            G1 g1rand = G1::random_element();
-            G1 g1 = !simulate ? srcData->acc1 : g1rand;
-            G1 g1ext = !simulate ? srcData->eAcc1 : g1rand;
-            G2 g2 = !simulate ? srcData->acc2 : G2::random_element();
+            srcOf[destNode] = srcNode;
+
+            // NOTE: We only mark which accumulators are needed here, using placeholders. The actual accumulators
+            // are filled in (and computed, if needed) after we remove the useless ones.
+            G1 g1 = G1::zero();
+            G1 g1ext = G1::zero();
+            G2 g2 = G2::zero();
             auto type = destData->getType();
             if(isSibling) { // if it's a sibling node, then it needs an accumulator in G2, unless it's a sibling leaf, which don't have G2
                 if(isLeaf) {
@@ -597,9 +762,442 @@ public:
         });
 #endif
 
+        // Now fill in the accumulators that are left in the proof: first, collect the ones we need, so we can
+        // compute them all at once
+        std::vector<std::tuple<DataNode<ProofData>*, NodePtrType>> needed;
+        std::vector<RoleRequest> requests;
+        proof->getRoot()->preorderTraverse([this, &srcOf, &needed, &requests](Node * node) {
+            auto dataNode = castProofNode(node);
+            auto data = dataNode->getData();
+            if(data->getType() == ProofData::Type::Root)
+                return;
+
+            bool needG1 = data->hasG1(), needG1ext = data->hasG1ext(), needG2 = data->hasG2();
+            if(!needG1 && !needG1ext && !needG2)
+                return;
+
+            if(simulate) {
+                if(needG1)
+                    data->setG1(G1::random_element());
+                if(needG1ext)
+                    data->setG1ext(G1::random_element());
+                if(needG2)
+                    data->setG2(G2::random_element());
+                return;
+            }
+
+            auto it = srcOf.find(dataNode);
+            assertTrue(it != srcOf.end());
+            needed.push_back(std::make_tuple(dataNode, it->second));
+            requests.push_back(RoleRequest{it->second, needG1, needG1ext, needG2});
+        });
+
+        materializeRoles(requests);
+
+        std::lock_guard<std::mutex> lock(rolesMutex);
+        for(auto& n : needed) {
+            auto data = std::get<0>(n)->getData();
+            auto srcData = std::get<1>(n)->getData();
+            if(data->hasG1())
+                data->setG1(srcData->acc1);
+            if(data->hasG1ext())
+                data->setG1ext(srcData->eAcc1);
+            if(data->hasG2())
+                data->setG2(srcData->acc2);
+        }
+
         return proof;
     }
 
+    /**
+     * A frontier node and the accumulators (or 'roles') we need for it.
+     */
+    struct RoleRequest {
+        NodePtrType node;
+        bool needG1, needG1ext, needG2;
+    };
+
+    /**
+     * Computes (and memoizes) the requested accumulators of the specified frontier nodes. The nodes' polynomials are
+     * recomputed from the leaves underneath them, if needed, and discarded afterwards.
+     *
+     * Frontier nodes have small polynomials, except for the ones near the root, so all commitments are computed with
+     * PolyCommit's batch API, which commits to different polynomials on different cores.
+     *
+     * Only holds 'rolesMutex' to check which accumulators are missing and to store the new ones. The polynomials are
+     * multiplied and committed to without it, so concurrent proofs for different keys do not wait on one another.
+     * This also matters because the thread waiting on the commitments runs other scheduler jobs meanwhile, which
+     * might compute proofs for this frontier too (i.e., call this again). Two concurrent calls might thus compute
+     * the same accumulator twice, which is harmless. The caller must not hold 'rolesMutex'.
+     *
+     * NOTE: The products are not kept between calls, since they would add up to as much memory as the leaves'
+     * polynomials for every level of the frontier.
+     */
+    void materializeRoles(const std::vector<RoleRequest>& requests) {
+        if(requests.empty())
+            return;
+        assertNotNull(params);
+
+        std::unique_lock<std::mutex> lock(rolesMutex);
+        std::vector<std::tuple<DataPtrType, bool, bool, bool>> needed;
+        for(auto& r : requests) {
+            auto data = r.node->getData();
+            assertNotNull(data);
+            needed.push_back(std::make_tuple(data, r.needG1 && !data->hasAcc1, r.needG1ext && !data->hasEAcc1,
+                r.needG2 && !data->hasAcc2));
+        }
+        lock.unlock();
+
+        // The requested nodes are usually a path and its siblings, so a node's children are often requested too.
+        // Thus, we keep the products of all requested nodes (see getSubtreePoly()) so their parents can reuse them.
+        // NOTE: leaves and the root keep their polynomials (see MergeFunc and finalize())
+        std::unordered_map<NodePtrType, std::vector<Fr>> products;
+        for(size_t i = 0; i < requests.size(); i++) {
+            auto& r = requests[i];
+            auto data = std::get<0>(needed[i]);
+            bool needAny = std::get<1>(needed[i]) || std::get<2>(needed[i]) || std::get<3>(needed[i]);
+            if(needAny && getOwnPoly(r.node).empty())
+                products[r.node];
+        }
+
+        std::vector<const std::vector<Fr>*> g1Polys, g2Polys;
+        std::vector<bool> g1Extractable;
+        std::vector<DataPtrType> g1Data, g2Data;
+        std::vector<Fr> unused;
+
+        for(size_t i = 0; i < requests.size(); i++) {
+            auto& r = requests[i];
+            DataPtrType data;
+            bool needG1, needG1ext, needG2;
+            std::tie(data, needG1, needG1ext, needG2) = needed[i];
+            if(!needG1 && !needG1ext && !needG2)
+                continue;
+
+            // requested nodes always get their product stored in 'products', so 'unused' stays empty
+            const std::vector<Fr>* p = &getSubtreePoly(r.node, products, unused);
+
+            if(needG1) {
+                g1Polys.push_back(p);
+                g1Extractable.push_back(false);
+                g1Data.push_back(data);
+            }
+            if(needG1ext) {
+                g1Polys.push_back(p);
+                g1Extractable.push_back(true);
+                g1Data.push_back(data);
+            }
+            if(needG2) {
+                g2Polys.push_back(p);
+                g2Data.push_back(data);
+            }
+        }
+
+        std::vector<G1> g1Comms;
+        std::vector<G2> g2Comms;
+        if(!g1Polys.empty())
+            PolyCommit::commitG1Batch(*params, g1Polys, g1Extractable, g1Comms);
+        if(!g2Polys.empty())
+            PolyCommit::commitG2Batch(*params, g2Polys, g2Comms);
+        lock.lock();
+
+        for(size_t i = 0; i < g1Data.size(); i++) {
+            if(g1Extractable[i]) {
+                g1Data[i]->eAcc1 = g1Comms[i];
+                g1Data[i]->hasEAcc1 = true;
+            } else {
+                g1Data[i]->acc1 = g1Comms[i];
+                g1Data[i]->hasAcc1 = true;
+            }
+        }
+        for(size_t i = 0; i < g2Data.size(); i++) {
+            g2Data[i]->acc2 = g2Comms[i];
+            g2Data[i]->hasAcc2 = true;
+        }
+
+        for(auto& r : requests)
+            r.node->getData()->checkAccumulators(params);
+    }
+
+    /**
+     * Returns a node's own polynomial, reading it in from the snapshot first, if needed. Takes 'rolesMutex' for that,
+     * since concurrent proofs might need the same leaf. Once read in, the polynomial does not change while proofs are
+     * computed, so the caller can use it without the lock.
+     */
+    const std::vector<Fr>& getOwnPoly(NodePtrType node) const {
+        std::lock_guard<std::mutex> lock(rolesMutex);
+        return node->getData()->getPoly();
+    }
+
+    /**
+     * Returns the polynomial of a frontier node: its own, if it kept it (i.e., leaves and the root), or else the
+     * product of its children's polynomials, computed bottom-up. The product goes in the node's entry in 'products',
+     * if it has one (and is computed only once), or else in 'tmp'.
+     */
+    const std::vector<Fr>& getSubtreePoly(NodePtrType node, std::unordered_map<NodePtrType, std::vector<Fr>>& products,
+        std::vector<Fr>& tmp) const
+    {
+        auto& own = getOwnPoly(node);
+        if(!own.empty() || node->isLeaf()) {
+            assertFalse(own.empty());
+            return own;
+        }
+
+        auto it = products.find(node);
+        if(it != products.end() && !it->second.empty())
+            return it->second;
+
+        auto left = dynamic_cast<NodePtrType>(node->left.get());
+        auto right = dynamic_cast<NodePtrType>(node->right.get());
+        assertNotNull(left);
+        assertNotNull(right);
+
+        std::vector<Fr> leftTmp, rightTmp;
+        auto& p = it != products.end() ? it->second : tmp;
+        poly_multiply(p, getSubtreePoly(left, products, leftTmp), getSubtreePoly(right, products, rightTmp));
+        return p;
+    }
+
+public:
+    /**
+     * Writes this (finalized) frontier to a snapshot. The leaves' polynomials are written so they can be mapped in
+     * place, since they are only needed to compute accumulators that were not computed yet.
+     *
+     * 'upperLeafPrefixes' is not written, since it can be rebuilt from 'keyPrefixToLeaf'. Retained keys are written
+     * by their key hash, from which readSnapshot() finds their lower roots in the restored AT.
+     */
+    void writeSnapshot(SnapshotWriter& out) const {
+        assertNotNull(upperTree);
+        auto root = upperTree->getRoot();
+        assertNotNull(root);
+        std::lock_guard<std::mutex> lock(rolesMutex);
+
+        out.write(retainLeaves);
+        out.write(static_cast<int32_t>(numReusedKeys));
+        out.write(static_cast<int32_t>(numReusedLeaves));
+        out.write(static_cast<int32_t>(lowerTrees.getCount()));
+
+        // the tree, in preorder: a flags byte per node, followed by its accumulators and (for leaves) its polynomial
+        std::unordered_map<NodePtrType, uint32_t> leafIdx;
+        root->preorderTraverse([&out, &leafIdx](Node * node) {
+            auto data = dynamic_cast<NodePtrType>(node)->getData();
+            assertNotNull(data);
+            bool isLeaf = node->isLeaf();
+            out.write(static_cast<uint8_t>((isLeaf ? 1 : 0) | (data->hasAcc1 ? 2 : 0) | (data->hasEAcc1 ? 4 : 0) | (data->hasAcc2 ? 8 : 0)));
+            if(data->hasAcc1)
+                out.write(data->acc1);
+            if(data->hasEAcc1)
+                out.write(data->eAcc1);
+            if(data->hasAcc2)
+                out.write(data->acc2);
+
+            if(isLeaf) {
+                auto idx = static_cast<uint32_t>(leafIdx.size());
+                leafIdx[dynamic_cast<NodePtrType>(node)] = idx;
+                if(data->mappedPoly.isSet())
+                    out.writePoly(data->mappedPoly.data(), data->mappedPoly.size());
+                else
+                    out.writePoly(data->poly);
+            }
+        });
+
+        out.write(static_cast<uint64_t>(keyPrefixToLeaf.size()));
+        for(auto& tup : keyPrefixToLeaf) {
+            out.write(std::get<0>(tup));
+            out.write(leafIdx.at(std::get<1>(tup)));
+        }
+
+        out.write(static_cast<uint64_t>(keyToAccumulatorLeaf.size()));
+        for(auto& tup : keyToAccumulatorLeaf) {
+            out.write(std::get<0>(tup));
+            writeSnapshotLeaves(out, std::get<1>(tup), leafIdx);
+        }
+
+        out.write(static_cast<uint64_t>(retained.size() + unlinkedRetained.size()));
+        for(auto& kv : retained)
+            writeSnapshotRetained(out, kv.second, leafIdx);
+        for(auto& rk : unlinkedRetained)
+            writeSnapshotRetained(out, rk, leafIdx);
+    }
+
+    /**
+     * Restores a frontier written by writeSnapshot(). 'at' is the (restored) AT this frontier was computed for, or
+     * nullptr if it was left in the snapshot, in which case relinkRetained() must be called once it is read in.
+     * The leaves' polynomials stay in the mapped snapshot until they are needed.
+     *
+     * Throws std::runtime_error if the snapshot is truncated or corrupted.
+     */
+    static Frontier* readSnapshot(SnapshotReader& in, PublicParameters * pp, AccumulatedTree * at) {
+        bool retainLeaves;
+        int32_t numReusedKeys, numReusedLeaves, numLeaves;
+        in.read(retainLeaves);
+        in.read(numReusedKeys);
+        in.read(numReusedLeaves);
+        in.read(numLeaves);
+        if(numLeaves <= 0)
+            throw std::runtime_error("Snapshot has a corrupted frontier");
+
+        std::unique_ptr<Frontier> frontier(new Frontier(pp, retainLeaves));
+        frontier->numReusedKeys = numReusedKeys;
+        frontier->numReusedLeaves = numReusedLeaves;
+
+        // NOTE: counts read from the snapshot only bound what we reserve once we know the snapshot could have them
+        std::vector<NodePtrType> leaves;
+        leaves.reserve(std::min(static_cast<size_t>(numLeaves), in.getRemaining()));
+        std::unique_ptr<NodeType> root(readSnapshotNode(in, leaves, MaxSnapshotDepth));
+        if(leaves.size() != static_cast<size_t>(numLeaves))
+            throw std::runtime_error("Snapshot has a corrupted frontier");
+        auto rootPtr = root.release();
+        frontier->upperTree.reset(new BinaryTreeType(rootPtr));
+        frontier->lowerTrees.restoreTrees({ std::make_tuple(numLeaves, rootPtr) }, numLeaves);
+
+        uint64_t count;
+        in.read(count);
+        frontier->keyPrefixToLeaf.reserve(static_cast<size_t>(std::min<uint64_t>(count, in.getRemaining())));
+        std::unordered_map<NodePtrType, std::vector<BitString>> leafPrefixes;
+        for(uint64_t i = 0; i < count; i++) {
+            BitString prefix;
+            uint32_t idx;
+            in.read(prefix);
+            in.read(idx);
+            auto leaf = getSnapshotLeaf(leaves, idx);
+            frontier->keyPrefixToLeaf.push_back(std::make_tuple(prefix, leaf));
+            leafPrefixes[leaf].push_back(prefix);
+        }
+        // only leaves with a chunk of several missing key prefixes have an entry (see addMissingKeyPrefixes())
+        for(auto& kv : leafPrefixes) {
+            if(kv.second.size() > 1)
+                frontier->upperLeafPrefixes[kv.first] = std::move(kv.second);
+        }
+
+        in.read(count);
+        frontier->keyToAccumulatorLeaf.reserve(static_cast<size_t>(std::min<uint64_t>(count, in.getRemaining())));
+        for(uint64_t i = 0; i < count; i++) {
+            BitString keyHash;
+            in.read(keyHash);
+            frontier->keyToAccumulatorLeaf.push_back(std::make_tuple(keyHash, readSnapshotLeaves(in, leaves)));
+        }
+
+        in.read(count);
+        for(uint64_t i = 0; i < count; i++) {
+            BitString keyHash;
+            int32_t numValues;
+            in.read(keyHash);
+            in.read(numValues);
+
+            RetainedKey rk(keyHash, numValues);
+            rk.leaves = readSnapshotLeaves(in, leaves);
+            if(at == nullptr) {
+                frontier->unlinkedRetained.push_back(std::move(rk));
+                continue;
+            }
+
+            bool found;
+            Node* lowRoot;
+            std::tie(found, lowRoot, std::ignore) = at->containsKey(keyHash);
+            if(!found)
+                throw std::runtime_error("Snapshot has a retained frontier key that is not in the AT");
+            frontier->retained.emplace(lowRoot, std::move(rk));
+        }
+
+        return frontier.release();
+    }
+
+    /**
+     * Points the retained keys at their lower roots in 'at', which replaced the AT this frontier was computed for
+     * (e.g., because it was spilled to disk and read back in by a RootStore, or left in the snapshot this frontier
+     * was restored from).
+     */
+    void relinkRetained(const AccumulatedTree * at) {
+        std::lock_guard<std::mutex> lock(rolesMutex);
+        std::unordered_map<Node*, RetainedKey> relinked;
+        auto relink = [at, &relinked](RetainedKey&& rk) {
+            bool found;
+            Node* lowRoot;
+            std::tie(found, lowRoot, std::ignore) = at->containsKey(rk.keyHash);
+            if(!found)
+                throw std::runtime_error("Retained frontier key is not in the AT");
+            relinked.emplace(lowRoot, std::move(rk));
+        };
+
+        for(auto& kv : retained)
+            relink(std::move(kv.second));
+        for(auto& rk : unlinkedRetained)
+            relink(std::move(rk));
+        retained.swap(relinked);
+        unlinkedRetained.clear();
+    }
+
+protected:
+    static void writeSnapshotRetained(SnapshotWriter& out, const RetainedKey& rk,
+        const std::unordered_map<NodePtrType, uint32_t>& leafIdx)
+    {
+        out.write(rk.keyHash);
+        out.write(static_cast<int32_t>(rk.numValues));
+        writeSnapshotLeaves(out, rk.leaves, leafIdx);
+    }
+
+    static void writeSnapshotLeaves(SnapshotWriter& out, const std::vector<NodePtrType>& leaves,
+        const std::unordered_map<NodePtrType, uint32_t>& leafIdx)
+    {
+        out.write(static_cast<uint64_t>(leaves.size()));
+        for(auto leaf : leaves)
+            out.write(leafIdx.at(leaf));
+    }
+
+    static std::vector<NodePtrType> readSnapshotLeaves(SnapshotReader& in, const std::vector<NodePtrType>& leaves) {
+        uint64_t count;
+        in.read(count);
+        std::vector<NodePtrType> vec;
+        vec.reserve(static_cast<size_t>(std::min<uint64_t>(count, in.getRemaining() / sizeof(uint32_t))));
+        for(uint64_t i = 0; i < count; i++) {
+            uint32_t idx;
+            in.read(idx);
+            vec.push_back(getSnapshotLeaf(leaves, idx));
+        }
+        return vec;
+    }
+
+    static NodePtrType getSnapshotLeaf(const std::vector<NodePtrType>& leaves, uint32_t idx) {
+        if(idx >= leaves.size())
+            throw std::runtime_error("Snapshot has a corrupted frontier");
+        return leaves[idx];
+    }
+
+    /**
+     * Reads a node and its subtree, which must be at most 'depthLeft' deep. The nodes are owned by the subtree's root
+     * as soon as they are read, so a corrupted or truncated snapshot does not leak them.
+     */
+    static NodePtrType readSnapshotNode(SnapshotReader& in, std::vector<NodePtrType>& leaves, int depthLeft) {
+        if(depthLeft < 0)
+            throw std::runtime_error("Snapshot has a corrupted frontier");
+
+        uint8_t flags;
+        in.read(flags);
+
+        std::unique_ptr<DataType> data(new DataType());
+        data->hasAcc1 = (flags & 2) != 0;
+        data->hasEAcc1 = (flags & 4) != 0;
+        data->hasAcc2 = (flags & 8) != 0;
+        if(data->hasAcc1)
+            in.read(data->acc1);
+        if(data->hasEAcc1)
+            in.read(data->eAcc1);
+        if(data->hasAcc2)
+            in.read(data->acc2);
+
+        if(flags & 1) {
+            data->mappedPoly = in.readPoly();
+            std::unique_ptr<NodeType> leaf(NodeFactory::makeNode(data.release()));
+            leaves.push_back(leaf.get());
+            return leaf.release();
+        } else {
+            // frontier trees are full (see assertFinalized()), so internal nodes always have two children
+            std::unique_ptr<NodeType> left(readSnapshotNode(in, leaves, depthLeft - 1));
+            std::unique_ptr<NodeType> right(readSnapshotNode(in, leaves, depthLeft - 1));
+            return NodeFactory::makeNode(data.release(), left.release(), right.release());
+        }
+    }
+
 public:
     static DataNode<ProofData>* castProofNode(Node* node) {
         assertNotNull(node);
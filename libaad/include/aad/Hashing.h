@@ -2,6 +2,7 @@
 
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <sstream>        
 #include <gmp.h>
 
@@ -53,9 +54,18 @@ public:
         : MerkleHash(acc, empty(), empty())
     {}
 
+    /**
+     * Restores a hash from its MerkleHashSize bytes (see getBytes()).
+     */
+    explicit MerkleHash(const unsigned char * bytes)
+        : hash(bytes, bytes + MerkleHashSize)
+    {}
+
 public:
     bool isUnset() const { return hash.empty(); }
 
+    const std::vector<unsigned char>& getBytes() const { return hash; }
+
     bool operator!=(const MerkleHash& other) const {
         return operator==(other) == false;
     }
@@ -170,7 +180,7 @@ public:
     }
 };
 
-BitString hashString(const std::string& s) {
+BitString hashString(std::string_view s) {
     std::vector<unsigned char> hash(picosha2::k_digest_size);
     picosha2::hash256(s, hash);  // SHA256(k)
     BitString bs;
@@ -178,11 +188,11 @@ BitString hashString(const std::string& s) {
     return bs;
 }
 
-BitString hashKey(const std::string& k) {
+BitString hashKey(std::string_view k) {
     return hashString(k);
 }
 
-BitString hashValue(const std::string& v, int idx) {
+BitString hashValue(std::string_view v, int idx) {
     std::vector<unsigned char> valHash(picosha2::k_digest_size);
     std::vector<unsigned char> idxHash(picosha2::k_digest_size);
     std::vector<unsigned char> valIdxHash(picosha2::k_digest_size);
@@ -203,7 +213,7 @@ BitString hashValue(const std::string& v, int idx) {
     return hash;
 }
 
-BitString hashKeyValuePair(const std::string& k, const std::string& v, int idx) {
+BitString hashKeyValuePair(std::string_view k, std::string_view v, int idx) {
     assertEqual(picosha2::k_digest_size, 256 / 8);
 
     BitString hash;
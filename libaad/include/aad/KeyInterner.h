@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/functional/hash.hpp>
+
+#include <xassert/XAssert.h>
+
+namespace libaad {
+
+/**
+ * Identifies a distinct key in a KeyInterner.
+ */
+using KeyId = uint32_t;
+
+/**
+ * Keeps a single copy of every distinct key and gives it an id, so an AAD's leaves and its key index can refer to
+ * keys by id, rather than copy the key for every value appended under it. Ids are handed out in order, starting at 0.
+ */
+template<class Key>
+class KeyInterner {
+public:
+    static const KeyId NotFound = UINT32_MAX;
+
+protected:
+    std::unordered_map<Key, KeyId, boost::hash<Key>> ids;
+    std::vector<const Key*> keys;   // NOTE: points to the keys in 'ids', which do not move since it is node-based
+
+public:
+    /**
+     * Returns the id of 'k', adding it if we do not have it yet.
+     */
+    KeyId intern(const Key& k) {
+        auto it = ids.find(k);
+        if(it == ids.end()) {
+            assertStrictlyLessThan(keys.size(), static_cast<size_t>(NotFound));
+            it = ids.emplace(k, static_cast<KeyId>(keys.size())).first;
+            keys.push_back(&it->first);
+        }
+        return it->second;
+    }
+
+    /**
+     * Returns the id of 'k' or NotFound if it was never interned.
+     */
+    KeyId find(const Key& k) const {
+        auto it = ids.find(k);
+        return it == ids.end() ? NotFound : it->second;
+    }
+
+    const Key& get(KeyId id) const { return *keys.at(id); }
+
+    size_t size() const { return keys.size(); }
+
+    /**
+     * Forgets the keys interned after the first 'newSize' ones (e.g., when the append or restore that interned them
+     * fails), so their ids are handed out again.
+     */
+    void truncate(size_t newSize) {
+        while(keys.size() > newSize) {
+            ids.erase(*keys.back());
+            keys.pop_back();
+        }
+    }
+};
+
+/**
+ * Interns strings in an arena of large, fixed-size chunks, rather than in a std::string per key, and looks them up by
+ * std::string_view, so interning a key that is already there does not allocate.
+ */
+template<>
+class KeyInterner<std::string> {
+public:
+    static const KeyId NotFound = UINT32_MAX;
+
+protected:
+    static const size_t ChunkSize = 64 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> chunks, largeKeys;
+    size_t chunkUsed;   // bytes used in the last chunk
+    size_t arenaSize;
+    std::unordered_map<std::string_view, KeyId> ids;    // NOTE: views of the copies in 'chunks'
+    std::vector<std::string_view> keys;
+
+public:
+    KeyInterner()
+        : chunkUsed(ChunkSize), arenaSize(0)
+    {}
+
+    KeyInterner(const KeyInterner&) = delete;
+    KeyInterner& operator=(const KeyInterner&) = delete;
+
+public:
+    KeyId intern(std::string_view k);
+
+    KeyId find(std::string_view k) const {
+        auto it = ids.find(k);
+        return it == ids.end() ? NotFound : it->second;
+    }
+
+    std::string_view get(KeyId id) const { return keys.at(id); }
+
+    size_t size() const { return keys.size(); }
+
+    /**
+     * Forgets the keys interned after the first 'newSize' ones (e.g., when the append or restore that interned them
+     * fails), so their ids are handed out again. Their space in the arena is only given back if they were the last
+     * keys copied into it.
+     */
+    void truncate(size_t newSize);
+
+    /**
+     * Returns the number of bytes allocated for the arena.
+     */
+    size_t getArenaSize() const { return arenaSize; }
+
+protected:
+    /**
+     * Copies 'k' into the arena.
+     */
+    std::string_view copyToArena(std::string_view k);
+};
+
+} // end of namespace libaad
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <mutex>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <aad/BitString.h>
+#include <aad/EllipticCurves.h>
+#include <aad/Hashing.h>
+#include <aad/LruCache.h>
+#include <aad/PolyInterpolation.h>
+#include <aad/PolyOps.h>
+
+#include <xassert/XAssert.h>
+#include <xutils/Log.h>
+
+namespace libaad {
+
+/**
+ * True if CryptoHash can hash a value on its own, with hashV(v, idx), which LeafPolyCache needs (see below). Other
+ * hashes only have to provide hashK(k) and hashKV(k, v, idx).
+ */
+template<class CryptoHash, class = void>
+struct HasValueHash : std::false_type {};
+
+template<class CryptoHash>
+struct HasValueHash<CryptoHash, std::void_t<decltype(std::declval<CryptoHash>().hashV(std::string_view(), 0))>>
+    : std::true_type {};
+
+/**
+ * Computes the polynomials of leaf ATs, caching the part that only depends on the key.
+ *
+ * The AT of a leaf has a single path, hashKV(k, v, leafNo) = hashK(k) | hashV(v, leafNo), and its polynomial has the
+ * hashes of all SecParam*4 + 1 prefixes of the path as roots. The first SecParam*2 + 1 prefixes are prefixes of the key
+ * hash, so for every (hot) key we cache the key hash and the polynomial with those prefixes as roots ("key polynomial").
+ * A leaf's polynomial is then the key polynomial times the polynomial of the remaining prefixes ("value polynomial").
+ *
+ * Keeps at most 'maxKeys' keys: when full, evicts the least-recently-used key, so hot keys stay cached.
+ * Can be used by several threads at the same time.
+ */
+template<class Key, int SecParam, class CryptoHash>
+class LeafPolyCache {
+public:
+    static constexpr size_t KeyBits = static_cast<size_t>(SecParam*2);
+
+protected:
+    mutable std::mutex mutex;
+    // key -> (key hash, key polynomial), which can be looked up by anything comparable to a Key (e.g., a std::string_view)
+    LruCache<Key, std::tuple<BitString, std::vector<Fr>>, std::less<>> keys;
+    size_t numHits, numMisses;
+
+public:
+    LeafPolyCache(size_t maxKeys = 4096)
+        : keys(maxKeys), numHits(0), numMisses(0)
+    {}
+
+public:
+    size_t getMaxKeys() const { return keys.getMaxEntries(); }
+
+    size_t getNumCachedKeys() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return keys.size();
+    }
+
+    size_t getNumHits() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return numHits;
+    }
+
+    size_t getNumMisses() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return numMisses;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        keys.clear();
+    }
+
+    /**
+     * Returns the path of the key-value pair in its leaf AT (i.e., hashKV(k, v, leafNo)) and the leaf AT's polynomial.
+     */
+    template<class K, class Val>
+    void getLeafPoly(const K& k, const Val& v, int leafNo, BitString& path, std::vector<Fr>& leafPoly) {
+        static_assert(HasValueHash<CryptoHash>::value, "LeafPolyCache needs CryptoHash::hashV(v, idx)");
+        std::vector<Fr> keyPoly;
+        getKeyPoly(k, path, keyPoly);
+        assertEqual(path.size(), KeyBits);
+
+        // NOTE: the key hash is cached, so only hash the value
+        path << CryptoHash().hashV(v, leafNo);
+        assertEqual(path.size(), static_cast<size_t>(SecParam*4));
+
+        std::vector<Fr> hashes, valuePoly;
+        hashPrefixes(path, KeyBits + 1, path.size(), hashes);
+        poly_from_roots_ntl(valuePoly, hashes);
+
+        leafPoly.clear();
+        poly_multiply(leafPoly, keyPoly, valuePoly);
+        assertEqual(leafPoly.size(), path.size() + 2);
+    }
+
+    /**
+     * Hashes the prefixes of 'path' of length 'from' through 'to' (inclusive) to field elements, like CommitUtils::commitAT() does for an AT.
+     */
+    static void hashPrefixes(const BitString& path, size_t from, size_t to, std::vector<Fr>& hashes) {
+        assertLessThanOrEqual(from, to);
+        assertLessThanOrEqual(to, path.size());
+        hashes.reserve(hashes.size() + to - from + 1);
+
+        BitString prefix;
+        for(size_t i = 0; i < from; i++)
+            prefix.push_back(path[i]);
+        hashes.push_back(hashToField(prefix));
+
+        for(size_t len = from + 1; len <= to; len++) {
+            prefix.push_back(path[len - 1]);
+            hashes.push_back(hashToField(prefix));
+        }
+    }
+
+protected:
+    template<class K>
+    void getKeyPoly(const K& k, BitString& keyHash, std::vector<Fr>& keyPoly) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto cached = keys.find(k);
+            if(cached != nullptr) {
+                numHits++;
+                keyHash = std::get<0>(*cached);
+                keyPoly = std::get<1>(*cached);
+                return;
+            }
+            numMisses++;
+        }
+
+        keyHash = CryptoHash().hashK(k);
+        std::vector<Fr> hashes;
+        hashPrefixes(keyHash, 0, KeyBits, hashes);
+        poly_from_roots_ntl(keyPoly, hashes);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        keys.insert(Key(k), std::make_tuple(keyHash, keyPoly));
+    }
+};
+
+} // end of libaad namespace
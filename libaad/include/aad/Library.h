@@ -25,4 +25,17 @@ using NTL::ZZ;
 
 int getSecParam();
 
+/**
+ * Installs the NTL modulus set up by initialize() on the calling thread. NTL's modulus is thread-local, so a thread
+ * other than the one that called initialize() needs to call this before it calls NTL-based functions, such as
+ * poly_from_roots_ntl(), poly_divide_ntl() or eea_ntl(). The Scheduler's threads do this automatically.
+ */
+void installNtlContext();
+
+/**
+ * Returns a number that changes every time initialize() sets up the NTL modulus, so threads can tell if they need
+ * to call installNtlContext() again.
+ */
+int getNtlContextVersion();
+
 } // end of namespace libaad
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <functional>
+#include <list>
+#include <map>
+#include <utility>
+
+#include <xassert/XAssert.h>
+
+namespace libaad {
+
+/**
+ * A map that keeps at most 'maxEntries' entries: when full, adding an entry evicts the least-recently-used one.
+ * Looking an entry up with find() counts as using it. Entries can be looked up by anything 'Compare' can compare
+ * with a Key (e.g., a std::string_view for std::string keys, with std::less<>).
+ *
+ * NOTE: Not thread-safe, callers lock around it (e.g., like LeafPolyCache does).
+ */
+template<class Key, class Val, class Compare = std::less<Key>>
+class LruCache {
+protected:
+    struct Entry {
+        Val val;
+        typename std::list<const Key*>::iterator pos;   // in 'order'
+    };
+
+    std::map<Key, Entry, Compare> entries;
+    std::list<const Key*> order;    // most-recently-used first; points to the keys in 'entries', which do not move since it is node-based
+    size_t maxEntries;
+
+public:
+    LruCache(size_t maxEntries)
+        : maxEntries(maxEntries)
+    {
+        assertStrictlyPositive(maxEntries);
+    }
+
+public:
+    size_t size() const { return entries.size(); }
+    size_t getMaxEntries() const { return maxEntries; }
+
+    void clear() {
+        entries.clear();
+        order.clear();
+    }
+
+    /**
+     * Returns the value of 'k' (and marks it as the most-recently-used) or nullptr if 'k' is not cached. The pointer
+     * is valid until the next call to insert() or clear().
+     */
+    template<class K>
+    Val* find(const K& k) {
+        auto it = entries.find(k);
+        if(it == entries.end())
+            return nullptr;
+
+        order.splice(order.begin(), order, it->second.pos);
+        return &it->second.val;
+    }
+
+    /**
+     * Caches 'val' as the value of 'k' (replacing any previous value), evicting the least-recently-used entry if full.
+     */
+    void insert(Key k, Val val) {
+        auto it = entries.find(k);
+        if(it != entries.end()) {
+            it->second.val = std::move(val);
+            order.splice(order.begin(), order, it->second.pos);
+            return;
+        }
+
+        if(entries.size() >= maxEntries) {
+            entries.erase(entries.find(*order.back()));
+            order.pop_back();
+        }
+
+        it = entries.emplace(std::move(k), Entry{std::move(val), order.end()}).first;
+        order.push_front(&it->first);
+        it->second.pos = order.begin();
+    }
+};
+
+} // end of libaad namespace
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+
+namespace libaad {
+
+/**
+ * A read-only, memory-mapped file. Used to load large files (e.g., binary public parameters) without reading or parsing
+ * them: the OS pages them in on demand and shares the pages between processes.
+ */
+class MappedFile {
+protected:
+    unsigned char * ptr;
+    size_t len;
+
+public:
+    /**
+     * Maps all of 'file' in memory. If 'hugePages' is true, asks the kernel to back the mapping with transparent huge
+     * pages (only honored if the file lives on a filesystem that supports them, such as a tmpfs or hugetlbfs mount),
+     * which avoids a TLB miss for almost every point when walking through multi-GB files.
+     *
+     * Throws std::runtime_error if the file cannot be opened or mapped.
+     */
+    MappedFile(const std::string& file, bool hugePages = false);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+public:
+    const unsigned char * data() const { return ptr; }
+    size_t size() const { return len; }
+
+    /**
+     * Asks the OS to start reading in the 'count' bytes at 'addr', which must be inside the mapping.
+     */
+    void prefetch(const void * addr, size_t count) const;
+
+    /**
+     * Tells the OS this file will be read sequentially, so it reads ahead aggressively and drops pages behind us.
+     */
+    void adviseSequential() const;
+};
+
+} // end of namespace libaad
@@ -6,7 +6,10 @@
 #include <aad/CommitUtils.h>
 #include <aad/EllipticCurves.h>
 #include <aad/Frontier.h>
+#include <aad/SortedFrontier.h>
+#include <aad/VerifierContext.h>
 
+#include <algorithm>
 #include <vector>
 
 #include <xutils/Utils.h>
@@ -17,6 +20,80 @@ using libaad::ReducedPairing;
 
 namespace libaad {
 
+/**
+ * What a commitment to the polynomial 'exp' looks like when simulating (i.e., without public parameters).
+ */
+template<class Group>
+Group simulateCommitment(const std::vector<Fr>& exp) {
+    std::vector<Group> bases;
+    for(size_t i = 0; i < exp.size(); i++) {
+        bases.push_back(Group::one());
+    }
+    return multiExp<Group>(bases, exp);
+}
+
+/**
+ * Computes the polynomial of a frontier leaf, whose roots are the (hashed) prefixes in [beg, end).
+ */
+template<class It>
+void getFrontierLeafPoly(It beg, It end, std::vector<Fr>& leafPoly) {
+    std::vector<Fr> roots;
+    hashToField(beg, end, roots);
+    poly_from_roots_ntl(leafPoly, roots);
+
+    if(leafPoly.size() > 513) {
+        throw std::runtime_error("Frontier leaf polynomial degree should be 513 or less");
+    }
+}
+
+/**
+ * Returns the lower frontier of key 'k' with values 'valIds' (and their leaf numbers), sorted, which membership proof
+ * verifiers reconstruct to check the key's frontier proofs.
+ */
+template<int SecParam, class Key, class Val>
+void getLowerFrontierPrefixes(
+    const Key& k,
+    const std::vector<std::tuple<Val, int>>& valIds,
+    std::vector<BitString>& frontier)
+{
+    BitString keyHash(hashKey(k));
+
+    // If the hashes fit, compute the lower frontier from the sorted leaf hashes, which avoids building an AT
+    if(static_cast<size_t>(SecParam*4) <= SortedFrontier::MaxBits) {
+        std::vector<SortedFrontier::Hash> hashes;
+        hashes.reserve(valIds.size());
+        for(auto& valId : valIds) {
+            BitString path(keyHash);
+            path << hashValue(std::get<0>(valId), std::get<1>(valId));
+            hashes.push_back(SortedFrontier::toHash(path));
+        }
+        std::sort(hashes.begin(), hashes.end());
+        hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+
+        // already sorted
+        SortedFrontier::getLowerFrontier(hashes, std::make_tuple(size_t(0), hashes.size()), static_cast<size_t>(SecParam*4), frontier);
+        assertFalse(frontier.empty());
+        return;
+    }
+
+    AccumulatedTree at(SecParam*4);
+    for(auto& valId : valIds) {
+        auto& val = std::get<0>(valId);
+        auto& id = std::get<1>(valId);
+
+        BitString path(keyHash);
+        path << hashValue(val, id);
+
+        //logdbg << "Appending " << path << " to reconstructed AT" << endl;
+        at.appendPath(path);
+    }
+
+    at.getLowerFrontier(frontier, keyHash);
+    assertFalse(frontier.empty());
+    std::sort(frontier.begin(), frontier.end());
+    //logdbg << "Lower frontier for key " << k << " with " << valIds.size() << " values: " << frontier.size() << " prefixes" << endl;
+}
+
 template<
     int SecParam,
     class CryptoHash,
@@ -53,6 +130,13 @@ public:
      */
     boost::unordered_map<FrontierTreePtrType, BitString> missingPrefixes;
 
+    /**
+     * When the server chunks missing key prefixes into frontier leaves, a missing prefix comes with all the other
+     * prefixes in its leaf, so the client can reconstruct the leaf. Maps the root of a frontier "proof tree" to the
+     * chunk of its missing prefix (if chunked).
+     */
+    boost::unordered_map<FrontierTreePtrType, std::vector<BitString>> missingPrefixChunks;
+
 public:
     MembershipProof(PublicParameters *pp)
         : AADProofType(pp), frontierProofs(new FrontierProofsType())
@@ -71,25 +155,21 @@ public:
 public:
     template<class Group>
     Group simulateCommitment(const std::vector<Fr>& exp) {
-        std::vector<Group> bases;
-        for(size_t i = 0; i < exp.size(); i++) {
-            bases.push_back(Group::one());
-        }
-        return multiExp<Group>(bases, exp);
+        return libaad::simulateCommitment<Group>(exp);
     }
 
-    bool fillInFrontierLeaves(FrontierNodePtrType root, std::vector<BitString>& expectedFrontier) {
+    bool fillInFrontierLeaves(FrontierNodePtrType root, const std::vector<BitString>& expectedFrontier) {
         assertFalse(expectedFrontier.empty());
-        size_t initialSize = expectedFrontier.size();
-        fillInFrontierLeavesRecursive(root, expectedFrontier);
-        if(!expectedFrontier.empty()) {
-            logerror << "Did not find leaves for all frontier nodes. Started with " << initialSize 
-                << " leaves but " << expectedFrontier.size() << " still remained." << endl;
+        size_t cursor = 0;  // the frontier leaves consume the expected frontier in order, SecParam*4 prefixes at a time
+        fillInFrontierLeavesRecursive(root, expectedFrontier, cursor);
+        if(cursor != expectedFrontier.size()) {
+            logerror << "Did not find leaves for all frontier nodes. Started with " << expectedFrontier.size() 
+                << " leaves but " << expectedFrontier.size() - cursor << " still remained." << endl;
         }
-        return expectedFrontier.empty();
+        return cursor == expectedFrontier.size();
     }
     
-    void fillInFrontierLeavesRecursive(FrontierNodePtrType root, std::vector<BitString>& expectedFrontier) {
+    void fillInFrontierLeavesRecursive(FrontierNodePtrType root, const std::vector<BitString>& expectedFrontier, size_t& cursor) {
         if(root != nullptr) {
             auto data = root->getData();
             assertNotNull(data);
@@ -101,19 +181,13 @@ public:
             if(data->getType() == FrontierProofData::Type::Leaf) {
                 //logdbg << "Filling in frontier leaf " << root->getLabel() << " (subtree size: " << root->getSize() << ")" <<endl;
 
-                assertFalse(expectedFrontier.empty());
-                size_t chunkSize = expectedFrontier.size() >= SecParam * 4 ? SecParam * 4 : expectedFrontier.size();
-                auto beg = expectedFrontier.cbegin();
+                assertStrictlyLessThan(cursor, expectedFrontier.size());
+                size_t chunkSize = std::min(expectedFrontier.size() - cursor, static_cast<size_t>(SecParam * 4));
+                auto beg = expectedFrontier.cbegin() + static_cast<long>(cursor);
                 auto end = beg + static_cast<long>(chunkSize);
 
-                std::vector<Fr> roots;
                 std::vector<Fr> leafPoly;
-                hashToField(beg, end, roots);
-                poly_from_roots_ntl(leafPoly, roots);
-
-                if(leafPoly.size() > 513) {
-                    throw std::runtime_error("Frontier leaf polynomial degree should be 513 or less");
-                }
+                getFrontierLeafPoly(beg, end, leafPoly);
 
                 FrontierNodePtrType sibling = dynamic_cast<FrontierNodePtrType>(root->getSibling());
                 assertNotNull(sibling);
@@ -136,8 +210,8 @@ public:
                     }
                 }
 
-                // remove first chunkSize elements from expectedFrontier
-                expectedFrontier.erase(beg, end);
+                // move past the chunkSize elements of expectedFrontier in this leaf
+                cursor += chunkSize;
             } else {
                 if(isLeaf) {
                     // if it's a sibling leaf node, ignore 
@@ -151,8 +225,8 @@ public:
                     assertTrue(left != nullptr); 
                     assertTrue(right != nullptr);
 
-                    fillInFrontierLeavesRecursive(left, expectedFrontier);
-                    fillInFrontierLeavesRecursive(right, expectedFrontier);
+                    fillInFrontierLeavesRecursive(left, expectedFrontier, cursor);
+                    fillInFrontierLeavesRecursive(right, expectedFrontier, cursor);
                 }
             }
         } else {
@@ -160,14 +234,17 @@ public:
         }
     }
 
-    bool isExtractableFrontier(FrontierNodePtrType node) {
+    /**
+     * If 'batch' is not null, the pairing checks are added to it rather than checked right away (same for verifyFrontier()).
+     */
+    bool isExtractableFrontier(FrontierNodePtrType node, PairingBatch* batch = nullptr) {
         auto left = dynamic_cast<FrontierNodePtrType>(node->left.get());
         auto right = dynamic_cast<FrontierNodePtrType>(node->right.get());
 
         if(node->isRoot()) {
             assertNotNull(left); 
             assertNotNull(right);
-            return isExtractableFrontier(left) && isExtractableFrontier(right);
+            return isExtractableFrontier(left, batch) && isExtractableFrontier(right, batch);
         } else {
             auto data = node->getData();
             assertNotNull(data);
@@ -181,7 +258,11 @@ public:
 
                 if(data->hasG1ext()) {
                     // check node is extractable, if it has g1ext
-                    if(ReducedPairing(data->getG1(), this->hasPublicParameters() ? this->params().getG2toTau() : G2::one()) != ReducedPairing(data->getG1ext(), G2::one()) && !this->simulate()) {
+                    if(batch != nullptr) {
+                        batch->addEquality(data->getG1(), this->hasPublicParameters() ? this->params().getG2toTau() : G2::one(),
+                            data->getG1ext(), G2::one(), node, "frontier G1 accumulator extractability");
+                    } else if(ReducedPairing(data->getG1(), this->hasPublicParameters() ? this->params().getPreparedG2toTau() : PublicParameters::getPreparedG2()) != 
+                        ReducedPairing(data->getG1ext(), PublicParameters::getPreparedG2()) && !this->simulate()) {
                         logerror << "Frontier G1 accumulator is not extractable" << endl;
                         return false;
                     }
@@ -200,7 +281,7 @@ public:
                 }
 
                 // INVARIANT: either parent is extractable or it's not but both its children are OnPath/Leaf (and we verify them to be extractable recursively)
-                return isExtractableFrontier(left) && isExtractableFrontier(right);
+                return isExtractableFrontier(left, batch) && isExtractableFrontier(right, batch);
             } else {
                 // leaf is extractable
                 // sibling+leaf, sibling+non-leaf need not be extractable
@@ -209,7 +290,7 @@ public:
         }
     }
 
-    bool verifyFrontier(FrontierNodePtrType root) {
+    bool verifyFrontier(FrontierNodePtrType root, PairingBatch* batch = nullptr) {
         // the case where the proof path is just the root node should never arise because frontiers are large (512 nodes at least)
         bool isRoot = root->isRoot();
         bool isLeaf = root->isLeaf();
@@ -256,23 +337,34 @@ public:
             }
 
             assertTrue(data->hasG1());
+            bool checkG2 = data->getType() != FrontierProofData::Type::Leaf && data->hasG2();
+            if(batch != nullptr) {
+                batch->addEquality(data->getG1(), G2::one(), acc1, acc2, root, "frontier accumulator against children");
+                if(checkG2)
+                    batch->addEquality(data->getG1(), G2::one(), G1::one(), data->getG2(), root, "frontier G1 and G2 accumulators match");
+
+                bool l = verifyFrontier(left, batch);
+                bool r = verifyFrontier(right, batch);
+                return l && r;
+            }
+
             // get current node's accumulator and children accumulators and check the subset proof
-            auto gt = ReducedPairing(data->getG1(), G2::one());
+            auto gt = ReducedPairing(data->getG1(), PublicParameters::getPreparedG2());
             if(gt != ReducedPairing(acc1, acc2) && !this->simulate()) {
                 logerror << "A frontier node's accumulator did not verify against children" << endl;
                 return false;
             }
 
             // check G1 and G2 match in on path node, if it has them
-            if(data->getType() != FrontierProofData::Type::Leaf && data->hasG1() && data->hasG2()) {
+            if(checkG2) {
                 if(gt != ReducedPairing(G1::one(), data->getG2()) && !this->simulate()) {
                     logerror << "Non leaf node " << root->getLabel() << " does not have same G1 and G2 accumulators" << endl;
                     return false;
                 }
             }
 
-            bool l = verifyFrontier(left);
-            bool r = verifyFrontier(right);
+            bool l = verifyFrontier(left, batch);
+            bool r = verifyFrontier(right, batch);
             return l && r;
         }
     }
@@ -283,143 +375,209 @@ public:
         const std::vector<std::tuple<Val, int>>& valIds,
         std::vector<BitString>& frontier) const
     {
-        BitString keyHash(hashKey(k));
-
-        AccumulatedTree at(SecParam*4);
-        for(auto& valId : valIds) {
-            auto& val = std::get<0>(valId);
-            auto& id = std::get<1>(valId);
-
-            BitString path(keyHash);
-            path << hashValue(val, id);
-
-            //logdbg << "Appending " << path << " to reconstructed AT" << endl;
-            at.appendPath(path);
-        }
-
-        at.getLowerFrontier(frontier, keyHash);
-        assertFalse(frontier.empty());
-        std::sort(frontier.begin(), frontier.end());
-        //logdbg << "Lower frontier for key " << k << " with " << valIds.size() << " values: " << frontier.size() << " prefixes" << endl;
+        libaad::getLowerFrontierPrefixes<SecParam>(k, valIds, frontier);
     }
 
     /**
      * NOTE: We specify the expected values in 'values' for debugging purposes. The values are already in the Merkle paths in the proof
      * and we verify completeness via the frontier. We could've checked that the values are what we expected outside of this function by
      * returning the values.
+     *
+     * If 'ctx' is given, leaf accumulators are looked up in (and added to) it rather than recomputed.
      */
     template<class Key, class Val>
-    bool verify(const Key& k, std::list<Val> values, const Digest& digest) {
+    bool verify(const Key& k, const std::list<Val>& values, const Digest& digest,
+        VerifierContext<Key, Val, SecParam, CryptoHash>* ctx = nullptr)
+    {
+        if(ctx != nullptr) {
+            assertTrue(ctx->getPublicParameters() == this->pp);
+        }
+        this->startPairingBatch();
+        return this->finishPairingBatch(verifyHelper(k, values, digest, ctx));
+    }
+
+protected:
+    template<class Key, class Val>
+    bool verifyHelper(const Key& k, std::list<Val> values, const Digest& digest, VerifierContext<Key, Val, SecParam, CryptoHash>* ctx) {
         this->verified = true;
         assertEqual(this->forestProofs->size(), frontierProofs->size());
         assertEqual(this->forestProofs->size(), digest.size());
 
-        std::vector<std::tuple<Val, int>> valIds; // values and their indexes (for the current tree in the forest)
-        valIds.reserve(values.size());
-        std::vector<ForestNodePtrType> leafs;   // leafs with key-value pairs (for the current tree in the forest)
-        leafs.reserve(values.size());
+        // The trees are verified independently (maybe in parallel), each one with its own values and pairing batch
+        size_t numTrees = this->forestProofs->size();
+        std::vector<std::vector<std::tuple<Val, int>>> treeValIds(numTrees);
+        std::vector<std::unique_ptr<PairingBatch>> treeBatches(numTrees);
+        for(size_t i = 0; i < numTrees; i++) {
+            treeBatches[i] = this->newTreePairingBatch();
+        }
+
+        bool ok = this->verifyTrees(numTrees, [&](size_t i) {
+            return verifyTree(i, k, digest, values.size(), treeValIds[i], treeBatches[i].get(), ctx);
+        });
+        if(!ok)
+            return false;
+
+        // Merge the results in the order of the trees, so they do not depend on which thread verified what
+        for(size_t i = 0; i < numTrees; i++) {
+            this->mergePairingBatch(treeBatches[i]);
+
+            // Mark values as verified by removing them from 'values'
+            for(auto& valId : treeValIds[i]) {
+                Utils::removeFirst(values, std::get<0>(valId));
+            }
+        }
+
+        // All values should've been validated and removed
+        return values.empty();
+    }
+
+    /**
+     * Verifies the forest path and the frontier of the i'th tree in the forest. Returns the values (and their indexes) found
+     * in the tree in 'valIds'. Only touches the i'th forest and frontier proof, so different trees can be verified in parallel.
+     */
+    template<class Key, class Val>
+    bool verifyTree(size_t i, const Key& k, const Digest& digest, size_t numValues, std::vector<std::tuple<Val, int>>& valIds,
+        PairingBatch* batch, VerifierContext<Key, Val, SecParam, CryptoHash>* ctx)
+    {
+        logtrace << "Verifying forest tree #" << i << endl;
+        std::vector<ForestNodePtrType> leafs;   // leafs with key-value pairs
+        leafs.reserve(numValues);
+        valIds.reserve(numValues);
         std::vector<BitString> expectedFrontier;
-        expectedFrontier.reserve(values.empty() ? 1 : values.size() * SecParam * 2);
+        expectedFrontier.reserve(numValues == 0 ? 1 : numValues * SecParam * 2);
 
-        for(size_t i = 0; i < this->forestProofs->size(); i++) {
-            logtrace << "Verifying forest tree #" << i << endl;
-            leafs.clear();
-            valIds.clear();
-            expectedFrontier.clear();
-
-            auto merkleSubtree = (*this->forestProofs)[i];
-            auto frontierSubtree = (*frontierProofs)[i];
-
-            if(merkleSubtree != nullptr) {
-                auto root = merkleSubtree->getRoot();
-                assertNotNull(root);
-                auto rootData = root->getData();
-                assertNotNull(rootData);
-
-                // Copy root AT accumulator into proof, unless the root is a leaf in which case we compute it
-                if(!root->isLeaf())
-                    rootData->acc.reset(new G1(std::get<0>(digest[i])));
-
-                // Pass 1: get a vector of pointers to all leafs with data.
-                if(!this->prevalidateForestProof(root, leafs))
-                    return false;
+        auto merkleSubtree = (*this->forestProofs)[i];
+        auto frontierSubtree = (*frontierProofs)[i];
 
-                for(auto leaf : leafs) {
-                    // Store every value and its leafNo in valIds. We need these to check the frontier later.
-                    auto data = dynamic_cast<LeafMerkleDataType*>(leaf->getData());
-                    assertNotNull(data);
-                    valIds.push_back(std::make_tuple(data->v, data->leafNo));
+        if(merkleSubtree != nullptr) {
+            auto root = merkleSubtree->getRoot();
+            assertNotNull(root);
+            auto rootData = root->getData();
+            assertNotNull(rootData);
 
-                    // Key in leafs should match actual key
-                    if(data->k != k)
-                        return false;
+            // Copy root AT accumulator into proof, unless the root is a leaf in which case we compute it
+            if(!root->isLeaf())
+                rootData->acc.reset(new G1(std::get<0>(digest[i])));
+
+            // Pass 1: get a vector of pointers to all leafs with data.
+            if(!this->prevalidateForestProof(root, leafs))
+                return false;
+
+            for(auto leaf : leafs) {
+                // Store every value and its leafNo in valIds. We need these to check the frontier later.
+                auto data = dynamic_cast<LeafMerkleDataType*>(leaf->getData());
+                assertNotNull(data);
+                valIds.push_back(std::make_tuple(data->v, data->leafNo));
 
-                    // Compute leaf's AT accumulator
+                // Key in leafs should match actual key
+                if(data->k == nullptr || *data->k != k)
+                    return false;
+
+                // Compute leaf's AT accumulator (or get it from the verifier's cache)
+                G1 acc;
+                if(ctx != nullptr) {
+                    acc = ctx->getLeafAcc(k, data->v, data->leafNo);
+                } else {
                     AccumulatedTree at(SecParam*4, CryptoHash().hashKV(k, data->v, data->leafNo));
-                    G1 acc;
                     assertTrue(at.getPrefixes().size() == 513);
                     std::tie(acc, std::ignore) = CommitUtils::commitAT(&at,
                         this->hasPublicParameters() ? &this->params() : nullptr, 
                         false);
-                    data->acc.reset(new G1(acc));
-
-                    // Also, mark values as verified by removing them from 'values'
-                    Utils::removeFirst(values, data->v);
                 }
+                data->acc.reset(new G1(acc));
+            }
 
-                // Pass 2: recursively compute the root Merkle hash
-                this->computeMerkleHashes(root, true);
+            // Pass 2: recursively compute the root Merkle hash
+            this->computeMerkleHashes(root, true);
 
-                // Next, check root Merkle hash matches the one in digest
-                auto& expectedHash = std::get<2>(digest[i]);
-                if(root->getData()->merkleHash != expectedHash && !this->simulate()) {
-                    logerror << "Merkle root did not match" << endl;
-                    return false;
-                }
+            // Next, check root Merkle hash matches the one in digest
+            auto& expectedHash = std::get<2>(digest[i]);
+            if(root->getData()->merkleHash != expectedHash && !this->simulate()) {
+                logerror << "Merkle root did not match" << endl;
+                return false;
+            }
 
-                // Pass 3: recursively check subset proofs
-                if(!this->verifySubsetProofs(root))
-                    return false;
+            // Pass 3: recursively check subset proofs
+            if(!this->verifySubsetProofs(root, batch))
+                return false;
 
-                // Done checking forest paths!
+            // Done checking forest paths!
 
-                // Compute lower frontier from valIds 
-                assertFalse(valIds.empty());
-                getLowerFrontierPrefixes(k, valIds, expectedFrontier);
-            } else {
-                // Key is not present in the current forest tree, so ensure \exists prefix of key in frontier
-                expectedFrontier.push_back(missingPrefixes[frontierSubtree]);
+            // Compute lower frontier from valIds 
+            assertFalse(valIds.empty());
+            getLowerFrontierPrefixes(k, valIds, expectedFrontier);
+        } else {
+            // Key is not present in the current forest tree, so ensure \exists prefix of key in frontier
+            // (NOTE: find() rather than operator[], which would insert into the map shared by all trees)
+            auto prefixIt = missingPrefixes.find(frontierSubtree);
+            if(prefixIt == missingPrefixes.end()) {
+                logerror << "No missing prefix for forest tree #" << i << endl;
+                return false;
             }
-
-            // Copy root frontier accumulator into proof
-            auto frontierRoot = frontierSubtree->getRoot();
-            assertNotNull(frontierRoot);
-            assertFalse(frontierRoot->data->hasG1());
-            frontierRoot->data->setG1(std::get<1>(digest[i]));
-             
-            //logdbg << "Frontier size (nodes): " << frontierSubtree->getRoot()->getSize() << endl;
-            if(!fillInFrontierLeaves(frontierSubtree->getRoot(), expectedFrontier)) {
-                logerror << "Did not find prefixes for all missing keys/values" << endl;
+            auto& missingPrefix = prefixIt->second;
+            if(!missingPrefix.isPrefixOf(CryptoHash().hashK(k))) {
+                logerror << "Missing prefix is not a prefix of the key's hash" << endl;
                 return false;
             }
 
-            if(!isExtractableFrontier(frontierRoot)) {
-                logerror << "Frontier proof is not extractable everyhere" << endl;
-                return false;
+            auto chunkIt = missingPrefixChunks.find(frontierSubtree);
+            if(chunkIt == missingPrefixChunks.end()) {
+                expectedFrontier.push_back(missingPrefix);
+            } else {
+                // The missing prefix's frontier leaf is reconstructed from its whole chunk
+                auto& chunk = chunkIt->second;
+                if(chunk.empty() || chunk.size() > SecParam * 4 ||
+                    std::find(chunk.begin(), chunk.end(), missingPrefix) == chunk.end())
+                {
+                    logerror << "Missing prefix is not in its frontier leaf's chunk" << endl;
+                    return false;
+                }
+                expectedFrontier.insert(expectedFrontier.end(), chunk.begin(), chunk.end());
             }
+        }
+
+        // Copy root frontier accumulator into proof
+        auto frontierRoot = frontierSubtree->getRoot();
+        assertNotNull(frontierRoot);
+        assertFalse(frontierRoot->data->hasG1());
+        frontierRoot->data->setG1(std::get<1>(digest[i]));
+         
+        //logdbg << "Frontier size (nodes): " << frontierSubtree->getRoot()->getSize() << endl;
+        if(!fillInFrontierLeaves(frontierSubtree->getRoot(), expectedFrontier)) {
+            logerror << "Did not find prefixes for all missing keys/values" << endl;
+            return false;
+        }
+
+        if(!isExtractableFrontier(frontierRoot, batch)) {
+            logerror << "Frontier proof is not extractable everyhere" << endl;
+            return false;
+        }
  
-            if(!verifyFrontier(frontierRoot)) {
-                logerror << "Frontier proof for completeness of values did NOT verify" << endl;
-                return false;
-            }
+        if(!verifyFrontier(frontierRoot, batch)) {
+            logerror << "Frontier proof for completeness of values did NOT verify" << endl;
+            return false;
         }
 
-        // All values should've been validated and removed
-        return values.empty();
+        return true;
     }
 
+public:
     virtual int getProofSize() const {
-        return this->getForestProofSize() + getFrontierProofSize();
+        return this->getForestProofSize() + getFrontierProofSize() + getMissingPrefixChunksSize();
+    }
+
+    /**
+     * Returns the size of the missing key prefix chunks in this proof, if any, assuming each prefix is encoded
+     * as one byte for its length followed by its bits.
+     */
+    int getMissingPrefixChunksSize() const {
+        int size = 0;
+        for(auto& kv : missingPrefixChunks) {
+            for(auto& prefix : kv.second) {
+                size += 1 + static_cast<int>((prefix.size() + 7) / 8);
+            }
+        }
+        return size;
     }
 
     int getFrontierProofSize() const {
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <aad/BinaryTree.h>
+#include <aad/EllipticCurves.h>
+#include <aad/PublicParameters.h>
+
+#include <vector>
+
+#include <xassert/XAssert.h>
+#include <xutils/Log.h>
+
+namespace libaad {
+
+/**
+ * Collects pairing equations e(a, b) = e(c, d) and checks all of them at once.
+ *
+ * Each equation is raised to a fresh random exponent r and moved to one side, giving e(r a, b) e(-r c, d) = 1.
+ * The product of all these is checked with a single multi-Miller loop followed by a single final exponentiation,
+ * instead of paying a final exponentiation for every pairing. If any of the equations does not hold, the product
+ * is 1 with probability at most 2^{-RandomExpBits} (over the choice of the r's). So the r's need only be
+ * RandomExpBits long, rather than as long as the group order, which halves the cost of the scalar multiplications.
+ *
+ * G1 elements paired with one of the fixed G2 elements (i.e., g2 and g2^tau) are first summed up, so all equations
+ * involving g2 (or g2^tau) on one side only cost one Miller loop in total, using the prepared g2 (or g2^tau).
+ */
+class PairingBatch {
+public:
+    static const size_t RandomExpBits = 128;
+
+protected:
+    using ECPP = libff::default_ec_pp;
+    using Fqk = typename ECPP::Fqk_type;
+    using RandomExp = libff::bigint<(RandomExpBits + GMP_NUMB_BITS - 1) / GMP_NUMB_BITS>;
+
+    /**
+     * A single equation e(a, b) = e(c, d), kept around so we can check it on its own if the batch fails.
+     */
+    struct Equation {
+        G1 a;
+        G2 b;
+        G1 c;
+        G2 d;
+        const Node* node;   // the proof node the equation was checked at, if any (for diagnostics)
+        const char* what;   // description of what the equation checks (for diagnostics)
+    };
+
+protected:
+    std::vector<Equation> equations;
+
+    std::vector<G2> fixedG2;            // fixed G2 elements, which G1 elements are aggregated on
+    std::vector<const G2Prepared*> fixedG2Prepared;
+    std::vector<G1> fixedG1Sums;        // the sum of the (randomized) G1 elements paired with each fixed G2 element
+    std::vector<G1> otherG1;            // the (randomized) G1 elements paired with a non-fixed G2 element ...
+    std::vector<G2> otherG2;            // ... and those G2 elements
+
+public:
+    /**
+     * If the public parameters are given, equations involving g2^tau are aggregated too.
+     */
+    PairingBatch(const PublicParameters* pp) {
+        fixedG2.push_back(G2::one());
+        fixedG2Prepared.push_back(&PublicParameters::getPreparedG2());
+        if(pp != nullptr) {
+            fixedG2.push_back(pp->getG2toTau());
+            fixedG2Prepared.push_back(&pp->getPreparedG2toTau());
+        }
+        fixedG1Sums.resize(fixedG2.size(), G1::zero());
+    }
+
+public:
+    size_t size() const { return equations.size(); }
+
+    /**
+     * Adds the equation e(a, b) = e(c, d), which was checked at the specified proof node (null for flat proofs,
+     * which have no nodes; see FlatProof).
+     */
+    void addEquality(const G1& a, const G2& b, const G1& c, const G2& d, const Node* node, const char* what) {
+        equations.push_back(Equation{a, b, c, d, node, what});
+
+        RandomExp r = randomExp();
+        add(r * a, b);
+        add(-(r * c), d);
+    }
+
+    /**
+     * Adds all the equations in another batch (e.g., collected by a different thread) to this batch.
+     */
+    void merge(const PairingBatch& other) {
+        assertEqual(fixedG2.size(), other.fixedG2.size());
+        equations.insert(equations.end(), other.equations.begin(), other.equations.end());
+        for(size_t i = 0; i < fixedG2.size(); i++)
+            fixedG1Sums[i] = fixedG1Sums[i] + other.fixedG1Sums[i];
+        otherG1.insert(otherG1.end(), other.otherG1.begin(), other.otherG1.end());
+        otherG2.insert(otherG2.end(), other.otherG2.begin(), other.otherG2.end());
+    }
+
+    /**
+     * Returns true if all equations added so far hold (with overwhelming probability) and false if one of them does not.
+     */
+    bool verify() const {
+        Fqk f = Fqk::one();
+
+        for(size_t i = 0; i < fixedG2.size(); i++) {
+            if(fixedG1Sums[i].is_zero())
+                continue;
+
+            f = f * ECPP::miller_loop(ECPP::precompute_G1(fixedG1Sums[i]), *fixedG2Prepared[i]);
+        }
+
+        // Miller loops over two pairs at a time share their squarings
+        assertEqual(otherG1.size(), otherG2.size());
+        size_t i = 0;
+        for(; i + 1 < otherG1.size(); i += 2) {
+            f = f * ECPP::double_miller_loop(
+                ECPP::precompute_G1(otherG1[i]), ECPP::precompute_G2(otherG2[i]),
+                ECPP::precompute_G1(otherG1[i + 1]), ECPP::precompute_G2(otherG2[i + 1]));
+        }
+        if(i < otherG1.size()) {
+            f = f * ECPP::miller_loop(ECPP::precompute_G1(otherG1[i]), ECPP::precompute_G2(otherG2[i]));
+        }
+
+        return ECPP::final_exponentiation(f) == GT::one();
+    }
+
+    /**
+     * Checks every equation on its own and logs the ones that fail. Meant to be called after verify() fails, to find out why.
+     * Returns the number of failed equations.
+     */
+    size_t verifyEach() const {
+        size_t numFailed = 0;
+        for(auto& eq : equations) {
+            if(ReducedPairing(eq.a, eq.b) != ReducedPairing(eq.c, eq.d)) {
+                if(eq.node != nullptr)
+                    logerror << "Pairing check failed: " << eq.what << " (at node " << eq.node->getLabel() << ")" << endl;
+                else
+                    logerror << "Pairing check failed: " << eq.what << endl;
+                numFailed++;
+            }
+        }
+        return numFailed;
+    }
+
+protected:
+    /**
+     * Returns a random, non-zero RandomExpBits-bit exponent: the low limbs of a random field element.
+     */
+    static RandomExp randomExp() {
+        RandomExp r;
+        do {
+            auto full = Fr::random_element().as_bigint();
+            for(size_t i = 0; i < static_cast<size_t>(r.N); i++)
+                r.data[i] = full.data[i];
+        } while(r.is_zero());
+        return r;
+    }
+
+    void add(const G1& g1, const G2& g2) {
+        for(size_t i = 0; i < fixedG2.size(); i++) {
+            if(g2 == fixedG2[i]) {
+                fixedG1Sums[i] = fixedG1Sums[i] + g1;
+                return;
+            }
+        }
+
+        otherG1.push_back(g1);
+        otherG2.push_back(g2);
+    }
+};
+
+} // end of libaad namespace
@@ -20,12 +20,16 @@ class PublicParameters;
 
 size_t getNumCores(); 
 
+/**
+ * Computes \sum_i exp_i * base_i using up to 'numThreads' of the Scheduler's threads (or all of them, if 0).
+ */
 template<class Group>
 Group multiExp(
     typename std::vector<Group>::const_iterator base_begin, 
     typename std::vector<Group>::const_iterator base_end, 
     typename std::vector<Fr>::const_iterator exp_begin,
-    typename std::vector<Fr>::const_iterator exp_end
+    typename std::vector<Fr>::const_iterator exp_end,
+    size_t numThreads = 0
 );
 
 template<class Group>
@@ -33,13 +37,108 @@ Group multiExp(
     const std::vector<Group>& bases, 
     const std::vector<Fr>& exps
 ); 
- 
+
+/**
+ * Like above, but for bases and exponents that are not in a std::vector (e.g., bases in a memory-mapped file).
+ */
+template<class Group>
+Group multiExp(
+    const Group * base_begin,
+    const Group * base_end,
+    const Fr * exp_begin,
+    const Fr * exp_end,
+    size_t numThreads = 0
+);
+
+/**
+ * Like multiExp(), but first splits every exponent in two halves using the group's endomorphism (see Endomorphism.h),
+ * which halves the number of doublings. Falls back to multiExp() if the endomorphism is not available.
+ */
+template<class Group>
+Group multiExpEndo(
+    typename std::vector<Group>::const_iterator base_begin,
+    typename std::vector<Group>::const_iterator base_end,
+    typename std::vector<Fr>::const_iterator exp_begin,
+    typename std::vector<Fr>::const_iterator exp_end,
+    size_t numThreads = 0
+);
+
+template<class Group>
+Group multiExpEndo(
+    const Group * base_begin,
+    const Group * base_end,
+    const Fr * exp_begin,
+    const Fr * exp_end,
+    size_t numThreads = 0
+);
+
+/**
+ * Like above, but with the endomorphism images of the bases precomputed (e.g., see
+ * PublicParameters::precomputeEndomorphisms()), starting at 'endo_begin'. If 'endo_begin' is null, computes them.
+ */
+template<class Group>
+Group multiExpEndo(
+    const Group * base_begin,
+    const Group * base_end,
+    const Group * endo_begin,
+    const Fr * exp_begin,
+    const Fr * exp_end,
+    size_t numThreads = 0
+);
+
 class PolyCommit {
+protected:
+    static bool useEndomorphisms;   // if true, commitments use multiExpEndo() instead of multiExp()
+
 public:
+    /**
+     * Enables or disables GLV/GLS endomorphisms when committing (disabled by default). When enabled, the public
+     * parameters' endomorphism images are precomputed the first time they are committed with (see
+     * PublicParameters::precomputeEndomorphisms()).
+     * Should be called before any commitments are computed (i.e., not concurrently with them).
+     */
+    static void setUseEndomorphisms(bool use) { useEndomorphisms = use; }
+    static bool getUseEndomorphisms() { return useEndomorphisms; }
+
     static void checkDegree(const PublicParameters& pp, const vector<Fr>& poly);
 
     static G1 commitG1(const PublicParameters& pp, const vector<Fr>& poly, bool isExtractable);
     static G2 commitG2(const PublicParameters& pp, const vector<Fr>& poly, bool isExtractable = false);
+
+    /**
+     * Commits to many polynomials at once, e.g., to all the frontier nodes in a proof. Most of these polynomials are
+     * small, so rather than parallelizing each multi-exponentiation (which does not pay off for a few hundred bases),
+     * we commit to different polynomials on different threads, each with a single-threaded multi-exponentiation.
+     * Large polynomials are still committed to one at a time, using all threads.
+     *
+     * The i-th polynomial is committed to extractably if isExtractable[i] is true. Sets comms[i] to its commitment.
+     */
+    static void commitG1Batch(const PublicParameters& pp, const vector<const vector<Fr>*>& polys,
+        const vector<bool>& isExtractable, vector<G1>& comms);
+    static void commitG1Batch(const PublicParameters& pp, const vector<const vector<Fr>*>& polys,
+        bool isExtractable, vector<G1>& comms);
+    static void commitG2Batch(const PublicParameters& pp, const vector<const vector<Fr>*>& polys, vector<G2>& comms);
+
+    /**
+     * Commits to 'poly' using the bases starting at 'bases' (e.g., the g1^{s^i}), which need not be in a std::vector
+     * (see PublicParameters::g1si). The caller must check there are enough bases (see checkDegree()). If endomorphisms
+     * are enabled, 'endoBases' can point to the bases' precomputed endomorphism images (see
+     * PublicParameters::getEndomorphisms()).
+     */
+    template<class Group>
+    static Group commit(
+        const Group * bases,
+        const vector<Fr>& poly,
+        size_t numThreads = 0,
+        const Group * endoBases = nullptr);
+
+protected:
+    template<class Group>
+    static void commitBatch(
+        const PublicParameters& pp,
+        const vector<const Group*>& bases,
+        const vector<const vector<Fr>*>& polys,
+        vector<Group>& comms);
 };
 
 } // end of namespace libaad
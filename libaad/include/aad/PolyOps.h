@@ -81,8 +81,15 @@ inline const vector<FieldT> poly_subtract(const vector<FieldT> &a, const vector<
        return ret;
 }
 
+/**
+ * Computes the Bezout coefficients a and b such that a x + b y = gcd(x, y).
+ *
+ * If 'numThreads' is bigger than 1, NTL's multiplications inside XGCD() run on that many threads. NTL's thread pool
+ * is thread-local, so it is only set up for this call and torn down afterwards, leaving NTL single-threaded for
+ * whatever else the calling thread runs later (see Scheduler).
+ */
 template<typename FieldT>
-void eea_ntl(const vector<FieldT> &x, const vector<FieldT> &y, vector<FieldT> &a, vector<FieldT> &b) {
+void eea_ntl(const vector<FieldT> &x, const vector<FieldT> &y, vector<FieldT> &a, vector<FieldT> &b, long numThreads = 1) {
     ZZ_pX polyA, polyB, polyS, polyT, polyD;
 
     libaad::conv_fr_zp(x, polyA);
@@ -91,6 +98,11 @@ void eea_ntl(const vector<FieldT> &x, const vector<FieldT> &y, vector<FieldT> &a
     polyT = ZZ_pX(INIT_MONO, 0);
     polyD = ZZ_pX(INIT_MONO, 0);
 
+    struct NtlThreads {
+        bool set;
+        NtlThreads(long n) : set(n > 1) { if(set) NTL::SetNumThreads(n); }
+        ~NtlThreads() { if(set) NTL::SetNumThreads(1); }
+    } threads(numThreads);
     XGCD(polyD, polyS, polyT, polyA, polyB);
 
     libaad::convNtlToLibff(polyS, a);
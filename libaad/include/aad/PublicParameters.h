@@ -1,10 +1,15 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <vector>
 #include <fstream>
+#include <memory>
+#include <mutex>
 #include <utility>
 
 #include <aad/EllipticCurves.h>
+#include <aad/MappedFile.h>
 
 #include <libff/common/serialization.hpp>
 #include <libfqfft/polynomial_arithmetic/basic_operations.hpp>
@@ -20,29 +25,211 @@ using libaad::Fr;
 
 namespace libaad {
 
+/**
+ * A read-only view of consecutive group elements, which either live in a std::vector or in a memory-mapped file.
+ */
+template<class Group>
+class PointSpan {
+protected:
+    const Group * ptr;
+    size_t len;
+
+public:
+    PointSpan() : ptr(nullptr), len(0) {}
+    PointSpan(const Group * ptr, size_t len) : ptr(ptr), len(len) {}
+    PointSpan(const std::vector<Group>& v) : ptr(v.data()), len(v.size()) {}
+
+public:
+    const Group * data() const { return ptr; }
+    size_t size() const { return len; }
+    const Group * begin() const { return ptr; }
+    const Group * end() const { return ptr + len; }
+    const Group& operator[](size_t i) const { return ptr[i]; }
+};
+
 class PublicParameters {
 public:
-    size_t q;
-    std::vector<G1> g1si, g1tausi; // g1^{s^i} and g1^{\tau s^i}
-    std::vector<G2> g2si;          // g2^{s^i}
+    size_t q;                      // the highest power we have (though maybe not loaded yet, see ensureDegree())
+    PointSpan<G1> g1si, g1tausi;   // g1^{s^i} and g1^{\tau s^i}
+    PointSpan<G2> g2si;            // g2^{s^i}
     //std::vector<G2> g2tausi;       // g2^{\tau s^i}
     Fr s, tau;
     G2 g2tau;
+    G2Prepared g2tauPrepared;      // g2^{\tau}, prepared for pairings
+
+protected:
+    // When reading the parameters from text files, we store them here. When mapping them from a binary file, these
+    // are empty and the spans above point inside 'mapped'. In both cases, the spans cover all q+1 parameters from the
+    // start, but only the first 'numLoaded' are valid. Loading more never moves the ones already loaded: the vectors
+    // have room for all q+1 parameters, so they never reallocate.
+    //
+    // NOTE: These are mutable because loading more parameters on demand does not change the parameters, logically.
+    mutable std::vector<G1> g1siVec, g1tausiVec;
+    mutable std::vector<G2> g2siVec;
+    std::unique_ptr<MappedFile> mapped;
+
+    std::string trapFile;                   // where to load more parameters from
+    bool progress, verify;                  // what to do when loading more parameters
+    mutable std::atomic<size_t> numLoaded;  // the number of parameters loaded so far
+    mutable std::mutex loadMutex;           // held while loading more parameters
+    // The endomorphism images of the parameters (see precomputeEndomorphisms()), which, like the vectors above, have
+    // room for all q+1 of them and are valid for the first 'numLoaded'. The pointers are set before 'endoReady'.
+    mutable std::vector<G1> g1siEndoVec, g1tausiEndoVec;
+    mutable std::vector<G2> g2siEndoVec;
+    mutable const G1 * g1siEndo, * g1tausiEndo;
+    mutable const G2 * g2siEndo;
+    mutable std::atomic<bool> endoReady;
+    // Where the next parameter to read is (i.e., parameter 'numLoaded'): in which '<trapFile>-<i>' file and at which
+    // byte offset, so loading more parameters does not scan the files from the start again (see readText())
+    mutable size_t textFileNo;
+    mutable std::streamoff textFileOffset;
 
 protected:
     PublicParameters(size_t q)
-        : q(q)
+        : q(q), progress(false), verify(false), numLoaded(0), g1siEndo(nullptr), g1tausiEndo(nullptr),
+          g2siEndo(nullptr), endoReady(false), textFileNo(0), textFileOffset(0)
     {
         resize(q);
     }
 
+    /**
+     * Maps the parameters from the binary file 'binFile' (see fromBinary()).
+     */
+    PublicParameters(const std::string& trapFile, const std::string& binFile, int maxQ, bool progress, bool verify,
+        bool hugePages, int initialQ);
+
+    /**
+     * Reads s, tau, q and g2^tau from trapFile and then caps q at 'maxQ', if given.
+     */
+    void readTrapdoors(int maxQ);
+
+    /**
+     * Loads parameters [numLoaded, end) from the '<trapFile>-<i>' files or the binary file.
+     * Must be called with loadMutex held. Loads in parallel, but waits for its jobs without running unrelated jobs on
+     * this thread, which could call ensureDegree() and try to lock loadMutex again.
+     */
+    void load(size_t end) const;
+
+    /**
+     * Reads parameters [begin, end) from the '<trapFile>-<i>' files, where 'begin' is numLoaded. The files are first
+     * split into chunks of parameters, starting where the previous call stopped, and then the chunks are parsed in
+     * parallel, directly into g1siVec, g1tausiVec and g2siVec.
+     */
+    void readText(size_t begin, size_t end) const;
+
+    /**
+     * Maps the binary file and points the spans inside it.
+     */
+    void mapBinary(const std::string& binFile, bool hugePages);
+
+    /**
+     * Checks the i-th parameters against the trapdoors (i.e., si = s^i and tausi = \tau s^i).
+     */
+    void checkPower(size_t i, const Fr& si, const Fr& tausi) const;
+
+    /**
+     * Checks parameters [begin, end) against the trapdoors, in parallel chunks. Rather than checking each parameter, we
+     * check a random linear combination of each chunk: i.e., for random r_i's and rho = \sum_i r_i s^i, that
+     * \sum_i r_i g1^{s^i} = g1^rho, that \sum_i r_i g2^{s^i} = g2^rho and that e(\sum_i r_i g1^{s^i}, g2^tau) =
+     * e(\sum_i r_i g1^{\tau s^i}, g2). If any parameter in the chunk is wrong, these hold only with negligible
+     * probability. This costs three multi-exponentiations per chunk, instead of three exponentiations and two pairings
+     * per parameter.
+     */
+    void verifyBatched(size_t begin, size_t end) const;
+
+    /**
+     * Computes the endomorphism images of parameters [begin, end). Must be called with loadMutex held.
+     */
+    void computeEndomorphisms(size_t begin, size_t end) const;
+
 public:
     /**
      * Reads s, tau and q from trapFile.
-     * Then reads the q-PKE parameters from trapFile + "-0", trapFile + "-1", ...
-     * and so on, until q parameters are read.
+     * Then, reads the q-PKE parameters from trapFile + "-0", trapFile + "-1", ... and so on, until q parameters are read.
+     *
+     * If 'initialQ' is given, only the first initialQ+1 parameters are loaded (and verified) now, and the rest are
+     * loaded as they are needed (see ensureDegree()), so the parameters only ever take as much memory as the
+     * largest polynomial committed to so far needs.
      */
-    PublicParameters(const std::string& trapFile, int maxQ = -1, bool progress = true, bool verify = false);
+    PublicParameters(const std::string& trapFile, int maxQ = -1, bool progress = true, bool verify = false, int initialQ = -1);
+
+    /**
+     * Like the constructor, but rather than reading the q-PKE parameters from the text files, maps the binary file
+     * 'binFile' (e.g., getBinaryFile(trapFile)) in memory without copying or parsing it (see writeBinary()), optionally
+     * backed by huge pages.
+     */
+    static std::unique_ptr<PublicParameters> fromBinary(const std::string& trapFile, const std::string& binFile,
+        int maxQ = -1, bool progress = true, bool verify = false, bool hugePages = false, int initialQ = -1);
+
+    /**
+     * Maps the binary version of the parameters in trapFile (see getBinaryFile()), if there is one that can be used
+     * (see fromBinary()), and otherwise reads them from the text files (see the constructor). This is how the
+     * benchmarks and tools load the parameters, so they get the binary format's faster loading whenever the .bin
+     * file was written (e.g., by ParamsToBinary or ParamsGenPowers).
+     */
+    static std::unique_ptr<PublicParameters> open(const std::string& trapFile, int maxQ = -1, bool progress = true,
+        bool verify = false, int initialQ = -1, bool hugePages = false);
+
+    // NOTE: the spans may point inside the object itself
+    PublicParameters(const PublicParameters&) = delete;
+    PublicParameters& operator=(const PublicParameters&) = delete;
+
+public:
+    /**
+     * Makes sure the parameters needed to commit to a polynomial of the specified degree (i.e., up to g^{s^degree}) are
+     * loaded. Loads at least twice as many parameters as before, if not all, so that growing a polynomial one
+     * coefficient at a time does not load the parameters one at a time. 
+     *
+     * Thread-safe: can be called while other threads are committing using the parameters already loaded, which stay
+     * where they are. Throws if degree > q.
+     */
+    void ensureDegree(size_t degree) const;
+
+    size_t getNumLoaded() const { return numLoaded; }
+
+    /**
+     * Returns true if the parameters are mapped from a binary file (see fromBinary()), rather than read from text files.
+     */
+    bool isMapped() const { return mapped != nullptr; }
+
+    /**
+     * Computes the endomorphism images of the parameters loaded so far (see Endomorphism) and, from now on, of the
+     * ones loaded later, so commitments that use endomorphisms (see PolyCommit::setUseEndomorphisms()) do not
+     * recompute them every time. The images take as much memory as the parameters themselves. Thread-safe.
+     */
+    void precomputeEndomorphisms() const;
+
+    /**
+     * Returns the endomorphism images of the parameters starting at 'bases' (i.e., g1si.data(), g1tausi.data() or
+     * g2si.data()), valid for the first getNumLoaded(), or null if they were not precomputed.
+     */
+    const G1 * getEndomorphisms(const G1 * bases) const {
+        if(!endoReady)
+            return nullptr;
+        return bases == g1si.data() ? g1siEndo : (bases == g1tausi.data() ? g1tausiEndo : nullptr);
+    }
+    const G2 * getEndomorphisms(const G2 * bases) const {
+        if(!endoReady)
+            return nullptr;
+        return bases == g2si.data() ? g2siEndo : nullptr;
+    }
+
+    /**
+     * Returns where the tools write the binary version of the parameters in trapFile (see ParamsToBinary).
+     */
+    static std::string getBinaryFile(const std::string& trapFile) {
+        return trapFile + ".bin";
+    }
+
+    /**
+     * Writes the q-PKE parameters to 'binFile' in a binary format that can be mapped in memory and used as is: the
+     * g1^{s^i}, g1^{\tau s^i} and g2^{s^i} arrays, each page-aligned, with every point in affine coordinates and stored
+     * exactly like its in-memory representation (i.e., sizeof(G1) or sizeof(G2) bytes per point).
+     *
+     * WARNING: The format is not portable across curves, compilers or architectures. We record the point sizes and
+     * check g1 and g2 when loading, which catches most mismatches.
+     */
+    void writeBinary(const std::string& binFile) const;
 
 public:
     static std::tuple<Fr, Fr> generateTrapdoors(size_t q, const std::string& outFile);
@@ -51,15 +238,31 @@ public:
     static void regenerateTrapdoors(std::string& outFile);
 
     static void generate(size_t startIncl, size_t endExcl, const Fr& s, const Fr& tau, const std::string& outFile, bool progress);
+
+    /**
+     * Generates all q+1 q-PKE parameters using all of the Scheduler's threads and writes them directly to 'binFile'
+     * in the binary format (see writeBinary()), without keeping them all in memory. Like generate(), uses fixed-base
+     * window tables for g1, g1^tau and g2 and normalizes points to affine coordinates in batches.
+     */
+    static void generateBinary(size_t q, const Fr& s, const Fr& tau, const std::string& binFile, bool progress);
     
     void resize(size_t q) {
-        g1si.resize(q+1); // g^{s^i} with i from 0 to q, including q
-        g1tausi.resize(q+1);
-        g2si.resize(q+1);
+        g1siVec.resize(q+1); // g^{s^i} with i from 0 to q, including q
+        g1tausiVec.resize(q+1);
+        g2siVec.resize(q+1);
         //g2tausi.resize(q+1);
+
+        g1si = g1siVec;
+        g1tausi = g1tausiVec;
+        g2si = g2siVec;
+        numLoaded = q+1;
+
+        // the parameters are filled in afterwards (e.g., by generate()), so any images we had are stale
+        endoReady = false;
     }
 
     G1 getG1toS() const {
+        ensureDegree(1);
         return g1si[1];
     }
 
@@ -68,6 +271,7 @@ public:
     }
 
     G2 getG2toS() const {
+        ensureDegree(1);
         return g2si[1];
     }
     
@@ -75,20 +279,57 @@ public:
         return g2tau;
     }
 
-    bool operator!=(const PublicParameters& pp) {
+    /**
+     * Most pairings we compute have g2 or g2^{\tau} as their G2 argument, so we precompute their Miller loop line coefficients once.
+     * The prepared g2 does not depend on the public parameters, so it's available without them (e.g., when simulating).
+     */
+    static const G2Prepared& getPreparedG2() {
+        static const G2Prepared g2Prepared = PrepareG2(G2::one());
+        return g2Prepared;
+    }
+
+    const G2Prepared& getPreparedG2toTau() const {
+        return g2tauPrepared;
+    }
+
+    bool operator!=(const PublicParameters& pp) const {
         return ! operator==(pp);
     }
 
-    bool operator==(const PublicParameters& pp) {
+    /**
+     * Compares all q+1 parameters, so it first loads all of them in both (see ensureDegree()), which can take a while
+     * and takes up as much memory as loading them eagerly. See equalsLoaded() for a comparison that loads nothing.
+     */
+    bool operator==(const PublicParameters& pp) const {
+        if(q != pp.q)
+            return false;
+        ensureDegree(q);
+        pp.ensureDegree(q);
+        return equalsLoaded(pp);
+    }
+
+    /**
+     * Compares q, the trapdoors and only the parameters loaded so far in both (i.e., the first min(getNumLoaded(),
+     * pp.getNumLoaded())), without loading any more. So, unlike operator==, it can return true for different
+     * parameters, if they only differ in the ones not loaded yet.
+     */
+    bool equalsLoaded(const PublicParameters& pp) const {
         if(q != pp.q)
             return false;
         if(s != pp.s)
             return false;
         if(tau != pp.tau)
             return false;
-    
-        size_t max = static_cast<size_t>(q);
-        for(size_t i = 0; i <= max; i++) {
+        if(g2tau != pp.g2tau)
+            return false;
+
+        return equalPrefix(pp, std::min<size_t>(numLoaded, pp.numLoaded));
+    }
+
+protected:
+    // compares the first 'count' parameters
+    bool equalPrefix(const PublicParameters& pp, size_t count) const {
+        for(size_t i = 0; i < count; i++) {
             if(g1si[i] != pp.g1si[i])
                 return false;
             if(g1tausi[i] != pp.g1tausi[i])
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <aad/MappedFile.h>
+#include <aad/Snapshot.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace libaad {
+
+/**
+ * Where a spilled AT is in its (mapped) spill file.
+ */
+class SpilledRegion {
+public:
+    std::shared_ptr<MappedFile> file;
+    size_t offset, size;
+
+public:
+    SpilledRegion()
+        : offset(0), size(0)
+    {}
+
+    SpilledRegion(const std::shared_ptr<MappedFile>& file, size_t offset, size_t size)
+        : file(file), offset(offset), size(size)
+    {}
+
+public:
+    bool isSet() const { return file != nullptr; }
+    const unsigned char * data() const { return file->data() + offset; }
+};
+
+/**
+ * A second, on-disk tier for the data only the roots of an AAD's forest have: their ATs and AT polynomials (about
+ * 512 coefficients per leaf), which make up most of an AAD's memory and stay around until the root is merged. For
+ * the oldest (i.e., largest) roots, that can take a very long time, during which they are only needed for proofs.
+ *
+ * The store keeps this data under a RAM budget: when over budget, the coldest roots (i.e., the ones least recently
+ * used by a merge) are spilled to files in 'dir', in the snapshot format (see SnapshotWriter). The files are
+ * memory-mapped and read back in sequentially when a merge needs them again (see AAD::DataType::getAT() and
+ * AAD::DataType::getAccPoly()). Proofs look keys up in the mapped ATs' sorted leaf hashes instead (see
+ * AAD::DataType::containsKey()). Roots that take up less than 'minSpillBytes' are never spilled.
+ *
+ * Since a root's data does not change until it is merged, it is written to a spill file at most once: reading it
+ * back in keeps the file, so spilling the root again just drops it from RAM. Spill files are unlinked as soon as
+ * they are mapped, so their space is reclaimed once their root is merged, and they never outlive the process.
+ */
+class RootStore {
+public:
+    static const size_t DefaultMinSpillBytes = 1024 * 1024;
+
+protected:
+    std::string dir;
+    size_t ramBudget;       // in bytes
+    size_t minSpillBytes;
+    uint64_t numSpills, bytesSpilled;
+
+public:
+    RootStore(const std::string& dir, size_t ramBudget, size_t minSpillBytes = DefaultMinSpillBytes);
+
+public:
+    size_t getRamBudget() const { return ramBudget; }
+    uint64_t getNumSpills() const { return numSpills; }
+    uint64_t getBytesSpilled() const { return bytesSpilled; }
+
+    /**
+     * Creates a new spill file, writes it with 'writeFunc' and returns its mapping. Throws std::runtime_error if the
+     * file could not be written.
+     */
+    std::shared_ptr<MappedFile> spill(const std::function<void(SnapshotWriter&)>& writeFunc);
+
+    /**
+     * Spills the coldest roots until the roots' data in RAM fits in the budget (or nothing else can be spilled).
+     * 'roots' must have getResidentBytes(), getLastUsed() and spill(RootStore&), like AAD::DataType.
+     */
+    template<class DataType>
+    void enforceBudget(const std::vector<DataType*>& roots) {
+        size_t resident = 0;
+        std::vector<std::tuple<DataType*, size_t>> candidates;
+        for(auto data : roots) {
+            size_t bytes = data->getResidentBytes();
+            resident += bytes;
+            if(bytes >= minSpillBytes && bytes > 0)
+                candidates.push_back(std::make_tuple(data, bytes));
+        }
+
+        if(resident <= ramBudget)
+            return;
+
+        // coldest first and, among roots last used at the same time (e.g., by the same proof), largest first
+        std::sort(candidates.begin(), candidates.end(),
+            [](const std::tuple<DataType*, size_t>& a, const std::tuple<DataType*, size_t>& b) {
+                auto aUsed = std::get<0>(a)->getLastUsed(), bUsed = std::get<0>(b)->getLastUsed();
+                return aUsed < bUsed || (aUsed == bUsed && std::get<1>(a) > std::get<1>(b));
+            });
+
+        for(auto& tup : candidates) {
+            if(resident <= ramBudget)
+                break;
+            std::get<0>(tup)->spill(*this);
+            resident -= std::get<1>(tup);
+        }
+    }
+};
+
+} // end of namespace libaad
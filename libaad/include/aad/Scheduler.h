@@ -0,0 +1,164 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace libaad {
+
+class Scheduler;
+
+/**
+ * A group of jobs submitted to the Scheduler, which can be waited on together. While waiting, the waiting
+ * thread runs jobs itself (any jobs, not just this group's), so jobs can submit and wait on nested groups
+ * without tying up worker threads. Once there is nothing left to run, but this group's jobs are still running
+ * on other threads, the waiting thread goes to sleep until they are done or until there is something to run again.
+ *
+ * A group created with 'runOthers' set to false only runs its own jobs while waiting. This is for waiting while
+ * holding something other jobs might need (e.g., a lock): an unrelated job picked up by the waiting thread could
+ * wait on it too, on the same thread, and never finish.
+ */
+class TaskGroup {
+    friend class Scheduler;
+
+protected:
+    Scheduler& sched;
+    std::atomic<size_t> pending;    // number of jobs submitted but not done yet
+    std::atomic<size_t> queued;     // number of jobs submitted but not picked up yet
+    std::mutex mutex;               // protects 'error' (done() holds it until it is done with the group)
+    std::exception_ptr error;
+    bool runOthers;
+
+public:
+    TaskGroup(bool runOthers = true);
+    ~TaskGroup();
+
+public:
+    /**
+     * Submits a job to the scheduler as part of this group.
+     */
+    void run(std::function<void()> func);
+
+    /**
+     * Returns after all jobs in this group are done. If a job threw, rethrows its exception (the first one, if several threw).
+     */
+    void wait();
+
+protected:
+    void done(std::exception_ptr e);
+
+    /**
+     * Runs jobs until this group's jobs are done, sleeping on the scheduler's 'waitCv' if there is nothing to run.
+     * Returns holding 'lock' on 'mutex', so done() is done with the group too.
+     */
+    void waitForJobs(std::unique_lock<std::mutex>& lock);
+};
+
+/**
+ * The library-wide work-stealing scheduler that all of libaad's parallel stages (multi-exponentiations, batch
+ * commitments, merge task graphs, proof verification) submit their jobs to, so they share a single set of threads
+ * instead of each spawning their own.
+ *
+ * Every worker has its own deque of jobs: it pushes and pops jobs it submits at the back and, when it runs out,
+ * steals from the front of other workers' deques. Jobs submitted from outside the scheduler (e.g., from the main
+ * thread) go to a shared queue.
+ *
+ * Jobs run with the NTL modulus set up by libaad::initialize() installed (see installNtlContext()), since NTL's modulus
+ * is thread-local and a freshly-started thread has none.
+ *
+ * NOTE: NTL is mostly kept single-threaded, since its thread pool would compete with ours. Parallelism comes from
+ * running independent NTL operations on different workers instead. The one exception is the EEA at the root of a
+ * merged tree, which the rest of the merge waits on, so eea_ntl() sets up NTL's threads just for that call.
+ */
+class Scheduler {
+    friend class TaskGroup;
+
+protected:
+    struct Job {
+        std::function<void()> func;
+        TaskGroup* group;
+    };
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+        std::thread thread;
+    };
+
+protected:
+    size_t numThreads;
+    bool pinThreads;
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    std::mutex mutex;               // protects 'shared' and is used to put idle workers to sleep
+    std::condition_variable cv;
+    std::deque<Job> shared;         // jobs submitted from outside the scheduler
+    std::atomic<size_t> numQueued;  // number of jobs in all queues
+    std::atomic<bool> stopping;
+    std::atomic<size_t> numGroups;  // number of TaskGroup's referring to this scheduler
+
+    std::mutex waitMutex;           // used to put threads waiting on a TaskGroup to sleep
+    std::condition_variable waitCv; // notified when jobs are submitted or a group's last job is done
+    std::atomic<size_t> numSleeping; // number of threads sleeping on 'waitCv'
+
+public:
+    /**
+     * Creates a scheduler that runs jobs on 'numThreads' threads (i.e., numThreads - 1 workers plus the thread that
+     * waits on the jobs), or as many as there are cores, if 0. If 'pinThreads' is true, each worker is pinned to its own core.
+     */
+    Scheduler(size_t numThreads = 0, bool pinThreads = false);
+    ~Scheduler();
+
+public:
+    /**
+     * Returns the library-wide scheduler (creating it the first time).
+     */
+    static Scheduler& get();
+
+    /**
+     * Like get(), but also counts a new TaskGroup as referring to the scheduler (see configure()), in one step, so the
+     * scheduler cannot be replaced in between.
+     */
+    static Scheduler& acquire();
+
+    /**
+     * Replaces the library-wide scheduler with one that has the specified number of threads (or one per core, if 0)
+     * and affinity. Must not be called while jobs are running: throws std::logic_error if a TaskGroup still refers
+     * to the current scheduler (e.g., if called from a job).
+     */
+    static void configure(size_t numThreads, bool pinThreads = false);
+
+    size_t getNumThreads() const { return numThreads; }
+    bool isPinningThreads() const { return pinThreads; }
+
+    /**
+     * Calls func(i) for all i in [begin, end), using up to 'maxParallelism' threads (or all, if 0), and returns
+     * after all calls are done. Indices are handed out one at a time, so calls can take different amounts of time.
+     * If 'runOthers' is false, the calling thread does not run other jobs while it waits (see TaskGroup).
+     */
+    static void parallelFor(size_t begin, size_t end, const std::function<void(size_t)>& func, size_t maxParallelism = 0,
+        bool runOthers = true);
+
+protected:
+    void submit(Job&& job);
+
+    /**
+     * Runs a queued job, if there is one. If 'only' is not null, only runs a job of that group.
+     */
+    bool runOne(const TaskGroup* only = nullptr);
+    bool popJob(Job& job, const TaskGroup* only);
+    void workerLoop(size_t idx);
+
+    /**
+     * Wakes up the threads sleeping in TaskGroup::waitForJobs(), if any.
+     */
+    void notifyWaiters();
+};
+
+} // end of namespace libaad
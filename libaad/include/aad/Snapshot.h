@@ -0,0 +1,184 @@
+#pragma once
+
+#include <aad/BitString.h>
+#include <aad/CompactPoint.h>
+#include <aad/EllipticCurves.h>
+#include <aad/MappedFile.h>
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace libaad {
+
+/**
+ * A polynomial restored from a snapshot, whose coefficients stay in the memory-mapped snapshot file until they are
+ * actually needed (e.g., by the next merge). The snapshot file must stay mapped for as long as this object is set.
+ */
+class MappedPoly {
+protected:
+    const Fr * coeffs;
+    size_t count;
+
+public:
+    MappedPoly()
+        : coeffs(nullptr), count(0)
+    {}
+
+    MappedPoly(const Fr * coeffs, size_t count)
+        : coeffs(coeffs), count(count)
+    {}
+
+public:
+    bool isSet() const { return coeffs != nullptr; }
+    const Fr * data() const { return coeffs; }
+    size_t size() const { return count; }
+
+    void reset() {
+        coeffs = nullptr;
+        count = 0;
+    }
+
+    /**
+     * Copies the coefficients into 'poly', if not done already, and then forgets about them.
+     */
+    void loadInto(std::vector<Fr>& poly) {
+        if(coeffs != nullptr) {
+            poly.assign(coeffs, coeffs + count);
+            reset();
+        }
+    }
+};
+
+/**
+ * Writes a snapshot file, field by field. Group elements and field elements are written in their in-memory
+ * representation (group elements in affine coordinates), so a snapshot can only be restored by a build of the
+ * library that uses the same curve. Polynomials are aligned, so they can be used in place from a memory-mapped
+ * snapshot (see SnapshotReader::readPoly()).
+ *
+ * The snapshot is written to a temporary file, which is synced to disk and then replaces 'file' in close(). This way, a crash never leaves a
+ * partial snapshot behind and an AAD restored from 'file' (which maps it) can safely take a new snapshot into it.
+ */
+class SnapshotWriter {
+protected:
+    std::string file, tmpFile;
+    std::ofstream fout;
+    uint64_t pos;
+
+public:
+    SnapshotWriter(const std::string& file);
+    ~SnapshotWriter();
+
+public:
+    void writeBytes(const void * bytes, size_t count);
+
+    template<class T>
+    void write(const T& val) {
+        static_assert(std::is_trivially_copyable<T>::value, "Can only write trivially-copyable types as they are");
+        writeBytes(&val, sizeof(T));
+    }
+
+    void write(const std::string& str);
+    void write(const BitString& bs);
+    void write(const G1& g1);
+    void write(const G2& g2);
+
+    // NOTE: written like any other point, so snapshots do not depend on how points are stored in memory
+    template<class Group>
+    void write(const CompactPoint<Group>& p) { write(p.get()); }
+
+    /**
+     * Writes the coefficients of a polynomial, so they can be mapped in place by SnapshotReader::readPoly().
+     */
+    void writePoly(const Fr * coeffs, size_t count);
+    void writePoly(const std::vector<Fr>& poly) { writePoly(poly.data(), poly.size()); }
+
+    /**
+     * Pads the file with zeros up to the next multiple of 'alignment' bytes.
+     */
+    void align(size_t alignment);
+
+    uint64_t getPosition() const { return pos; }
+
+    /**
+     * Flushes the snapshot, syncs it to disk and moves it over 'file', syncing the directory too, so that once close()
+     * returns the snapshot survives a crash (or power loss). Throws std::runtime_error if the snapshot could not be written.
+     */
+    void close();
+};
+
+/**
+ * Reads a snapshot written by SnapshotWriter, in the same order it was written, from a memory-mapped file.
+ * Throws std::runtime_error if the snapshot ends unexpectedly.
+ */
+class SnapshotReader {
+protected:
+    std::shared_ptr<MappedFile> mapped;
+    size_t pos;
+
+public:
+    SnapshotReader(const std::string& file);
+
+    /**
+     * Reads from an already-mapped snapshot, starting at offset 'pos'.
+     */
+    SnapshotReader(const std::shared_ptr<MappedFile>& mapped, size_t pos = 0);
+
+public:
+    /**
+     * Returns a pointer to the next 'count' bytes in the mapped file and skips over them.
+     */
+    const unsigned char * readBytes(size_t count);
+
+    /**
+     * Like readBytes(), but for 'count' elements of 'size' bytes each. Throws std::runtime_error if that is more
+     * than is left (e.g., because 'count' was read from a corrupted snapshot), rather than overflow.
+     */
+    const unsigned char * readBytes(uint64_t count, size_t size);
+
+    template<class T>
+    void read(T& val) {
+        static_assert(std::is_trivially_copyable<T>::value, "Can only read trivially-copyable types as they are");
+        std::memcpy(&val, readBytes(sizeof(T)), sizeof(T));
+    }
+
+    void read(std::string& str);
+    void read(BitString& bs);
+    void read(G1& g1);
+    void read(G2& g2);
+
+    template<class Group>
+    void read(CompactPoint<Group>& p) {
+        Group g;
+        read(g);
+        p = g;
+    }
+
+    /**
+     * Skips over a polynomial written by SnapshotWriter::writePoly() and returns its coefficients in the mapped
+     * file, without reading them in.
+     */
+    MappedPoly readPoly();
+
+    void align(size_t alignment);
+
+    bool atEnd() const { return pos == mapped->size(); }
+    size_t getPosition() const { return pos; }
+
+    /**
+     * Returns the number of bytes left to read (e.g., to bound a count read from the snapshot before reserving room
+     * for that many elements).
+     */
+    size_t getRemaining() const { return mapped->size() - pos; }
+
+    /**
+     * The mapped snapshot file, which must be kept alive for as long as MappedPoly's returned by readPoly() are used.
+     */
+    const std::shared_ptr<MappedFile>& getMappedFile() const { return mapped; }
+};
+
+} // end of namespace libaad
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <aad/BitString.h>
+
+#include <array>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <tuple>
+#include <vector>
+
+#include <xassert/XAssert.h>
+
+namespace libaad {
+
+/**
+ * Extracts AT frontiers from the sorted list of the AT's leaf hashes, rather than by walking the AT trie.
+ *
+ * The trie of a sorted set of hashes is implicit in the longest common prefixes (LCPs) of the hashes: the
+ * hashes underneath a trie node at depth d form a contiguous range in the sorted list and the node has
+ * two children iff the first and last hash in its range differ at bit d. Thus, we recurse on ranges rather
+ * than on nodes, skip over chains of single-child nodes in one LCP computation and only build BitStrings for
+ * the frontier nodes themselves.
+ *
+ * The frontier nodes are emitted in the same order as AccumulatedTree::getFrontierHelper() does.
+ */
+class SortedFrontier {
+public:
+    static constexpr size_t NumWords = 8;
+    static constexpr size_t MaxBits = NumWords * 64;
+
+    /**
+     * A fixed-width hash of up to 512 bits, most significant bit first: bit i of the hash is bit 63 - (i % 64)
+     * of word i / 64. Comparing two Hash objects lexicographically (i.e., with operator<) compares the hashes
+     * lexicographically as bit strings.
+     */
+    using Hash = std::array<uint64_t, NumWords>;
+
+    /**
+     * A range [beg, end) of sorted hashes that share their first 'depth' bits.
+     */
+    using Range = std::tuple<size_t, size_t>;
+
+public:
+    static Hash toHash(const BitString& bs) {
+        assertLessThanOrEqual(bs.size(), MaxBits);
+        Hash h;
+        h.fill(0);
+        for(size_t i = 0; i < bs.size(); i++) {
+            if(bs[i])
+                h[i / 64] |= uint64_t(1) << (63 - i % 64);
+        }
+        return h;
+    }
+
+    static bool getBit(const Hash& h, size_t i) {
+        return (h[i / 64] >> (63 - i % 64)) & 1;
+    }
+
+    /**
+     * Returns the first 'numBits' bits of the hash as a BitString.
+     */
+    static BitString toBitString(const Hash& h, size_t numBits) {
+        assertLessThanOrEqual(numBits, MaxBits);
+        BitString bs;
+        bs.resize(numBits);
+        for(size_t i = 0; i < numBits; i++) {
+            bs[i] = getBit(h, i);
+        }
+        return bs;
+    }
+
+    /**
+     * Returns the length of the longest common prefix of two hashes (in bits).
+     */
+    static size_t lcp(const Hash& a, const Hash& b) {
+        for(size_t w = 0; w < NumWords; w++) {
+            uint64_t diff = a[w] ^ b[w];
+            if(diff != 0)
+                return w * 64 + static_cast<size_t>(__builtin_clzll(diff));
+        }
+        return MaxBits;
+    }
+
+    /**
+     * Returns the frontier nodes of depth at most 'maxDepth' in the subtrie of the hashes in the range [beg, end),
+     * which must be sorted and share their first 'depth' bits. The frontier nodes are appended to 'frontier'.
+     * If 'lowerRanges' is not null, appends the ranges of hashes under every trie node of depth 'maxDepth' to it
+     * (i.e., the equivalent of the 'lower roots' returned by AccumulatedTree::getUpperFrontier()).
+     */
+    static void getFrontier(const std::vector<Hash>& sorted, size_t beg, size_t end, size_t depth, size_t maxDepth,
+        std::vector<BitString>& frontier, std::vector<Range>* lowerRanges)
+    {
+        assertStrictlyLessThan(beg, end);
+        assertLessThanOrEqual(maxDepth, MaxBits);
+        assertLessThanOrEqual(depth, maxDepth);
+
+        const Hash& first = sorted[beg];
+        // All hashes in the range share the first 'common' bits, so the trie nodes at depths [depth, common) have a single child
+        size_t common = std::min(lcp(first, sorted[end - 1]), maxDepth);
+
+        // Missing left children come before the subtrie in DFS order
+        for(size_t d = depth; d < common; d++) {
+            if(getBit(first, d))
+                frontier.push_back(siblingLabel(first, d));
+        }
+
+        if(common == maxDepth) {
+            if(lowerRanges != nullptr)
+                lowerRanges->push_back(std::make_tuple(beg, end));
+        } else {
+            // The node at depth 'common' has both children: hashes with bit 'common' set to 0 come first.
+            auto splitIt = std::partition_point(sorted.begin() + static_cast<long>(beg), sorted.begin() + static_cast<long>(end),
+                [common](const Hash& h) { return !getBit(h, common); });
+            size_t split = static_cast<size_t>(splitIt - sorted.begin());
+            assertTrue(split > beg && split < end);
+
+            getFrontier(sorted, beg, split, common + 1, maxDepth, frontier, lowerRanges);
+            getFrontier(sorted, split, end, common + 1, maxDepth, frontier, lowerRanges);
+        }
+
+        // Missing right children come after the subtrie in DFS order, deepest first
+        for(size_t d = common; d > depth; d--) {
+            if(!getBit(first, d - 1))
+                frontier.push_back(siblingLabel(first, d - 1));
+        }
+    }
+
+    /**
+     * Returns the upper frontier (i.e., of depth at most maxDepth / 2) of an AT with the specified sorted leaf hashes
+     * and the ranges of hashes under each 'lower root' (i.e., each key).
+     */
+    static void getUpperFrontier(const std::vector<Hash>& sorted, size_t maxDepth, std::vector<BitString>& frontier, std::vector<Range>& lowerRanges) {
+        assertTrue(maxDepth % 2 == 0);
+        frontier.clear();
+        lowerRanges.clear();
+        if(!sorted.empty())
+            getFrontier(sorted, 0, sorted.size(), 0, maxDepth / 2, frontier, &lowerRanges);
+    }
+
+    /**
+     * Returns the lower frontier of a key, given the range of the sorted leaf hashes of its values (see getUpperFrontier()).
+     * Unlike getFrontier(), the frontier is returned sorted by BitString::operator< (i.e., by length and then lexicographically),
+     * which is the order the frontier expects lower frontier prefixes in.
+     */
+    static void getLowerFrontier(const std::vector<Hash>& sorted, const Range& range, size_t maxDepth, std::vector<BitString>& frontier) {
+        frontier.clear();
+        getFrontier(sorted, std::get<0>(range), std::get<1>(range), maxDepth / 2, maxDepth, frontier, nullptr);
+        sortByLength(frontier);
+    }
+
+    /**
+     * Stable-sorts frontier nodes by their length. Since frontier nodes of the same length are emitted in lexicographic
+     * order, this sorts them by BitString::operator<, but in linear time.
+     */
+    static void sortByLength(std::vector<BitString>& frontier) {
+        if(frontier.empty())
+            return;
+
+        size_t maxLen = 0;
+        for(auto& bs : frontier)
+            maxLen = std::max(maxLen, bs.size());
+
+        // count how many nodes of each length, then turn counts into starting offsets
+        std::vector<size_t> offsets(maxLen + 2, 0);
+        for(auto& bs : frontier)
+            offsets[bs.size() + 1]++;
+        for(size_t len = 1; len < offsets.size(); len++)
+            offsets[len] += offsets[len - 1];
+
+        std::vector<BitString> sorted(frontier.size());
+        for(auto& bs : frontier)
+            sorted[offsets[bs.size()]++] = std::move(bs);
+        frontier.swap(sorted);
+    }
+
+    /**
+     * Looks up 'bs' in the trie of the 'count' sorted hashes stored at 'sorted' (e.g., in a mapped snapshot, so they
+     * need not be aligned), like BinaryTree::findNode() would: returns true if 'bs' is a prefix of one of the hashes
+     * and, otherwise, sets 'missing' to the first prefix of 'bs' that is not in the trie.
+     */
+    static bool findPrefix(const unsigned char * sorted, size_t count, const BitString& bs, BitString& missing) {
+        assertLessThanOrEqual(bs.size(), MaxBits);
+        auto hashAt = [sorted](size_t i) {
+            Hash h;
+            std::memcpy(h.data(), sorted + i * sizeof(Hash), sizeof(Hash));
+            return h;
+        };
+
+        // the hash sharing the longest prefix with 'bs' is right before or right after where 'bs' would go
+        Hash h = toHash(bs);
+        size_t beg = 0, end = count;
+        while(beg < end) {
+            size_t mid = beg + (end - beg) / 2;
+            if(hashAt(mid) < h)
+                beg = mid + 1;
+            else
+                end = mid;
+        }
+
+        size_t common = 0;
+        if(beg < count)
+            common = std::max(common, lcp(h, hashAt(beg)));
+        if(beg > 0)
+            common = std::max(common, lcp(h, hashAt(beg - 1)));
+
+        if(common >= bs.size())
+            return true;
+        missing = toBitString(h, common + 1);
+        return false;
+    }
+
+protected:
+    /**
+     * Returns the label of the sibling of the trie node at depth d + 1 on the path to hash 'h'
+     */
+    static BitString siblingLabel(const Hash& h, size_t d) {
+        BitString label = toBitString(h, d + 1);
+        label[d] = !label[d];
+        return label;
+    }
+};
+
+} // end of libaad namespace
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+namespace libaad {
+
+/**
+ * A small graph of tasks, where each task runs only after all the tasks it depends on are done. Used to run the
+ * independent steps of a merge (e.g., committing to the AT, computing the frontier and the subset proofs)
+ * at the same time. Tasks are submitted to the library-wide Scheduler as soon as they are ready.
+ *
+ * Tasks must be added in topological order: i.e., a task can only depend on tasks added before it.
+ */
+class TaskGraph {
+public:
+    using TaskId = size_t;
+
+protected:
+    struct Task {
+        std::function<void()> func;
+        std::vector<TaskId> dependents;     // tasks that depend on this one
+        size_t numDeps;                     // number of tasks this one depends on
+    };
+
+    std::vector<Task> tasks;
+    size_t numThreads;
+
+public:
+    /**
+     * Runs the tasks on the Scheduler's threads, or one by one on the calling thread if 'numThreads' is 1.
+     */
+    TaskGraph(size_t numThreads = 0);
+
+public:
+    size_t size() const { return tasks.size(); }
+
+    /**
+     * Adds a task that runs after all the tasks in 'deps' are done and returns its ID.
+     */
+    TaskId add(std::function<void()> func, const std::vector<TaskId>& deps = std::vector<TaskId>());
+
+    /**
+     * Runs all tasks and returns after they are done. If a task throws, the tasks that were not started yet are skipped
+     * and the exception is rethrown here. Can be called from inside a Scheduler job (e.g., from another graph's task). The graph is emptied afterwards, so it can be reused.
+     */
+    void run();
+};
+
+} // end of namespace libaad
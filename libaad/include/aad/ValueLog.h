@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace libaad {
+
+/**
+ * An append-only, memory-mapped log of values, so an AAD's leaves can refer to their value by its (fixed-size) offset
+ * in the log, rather than store it (see AAD::setValueLog()). This keeps forest leaves small and their values out of the
+ * heap, which matters for large values. Keys are not logged, since the AAD interns every distinct key once anyway (see
+ * KeyInterner) and its leaves refer to them by id.
+ *
+ * Every record is the size of the value (as a uint32_t), followed by its bytes: the characters of a std::string, or
+ * the bytes of any other (trivially-copyable) type (see toBytes()).
+ *
+ * Pairs are written with pwrite() and read through a read-only mapping of the whole address range the log can grow to
+ * ('maxSize'), which is reserved up front. Thus, the mapping never moves and views of the log (see View) stay valid
+ * for as long as the log is around. The log only backs an AAD's leaves in memory: it is truncated when opened and
+ * removed when closed (snapshots and append logs store the values themselves).
+ *
+ * Appends must not be concurrent, but views can be read while appending: the log's size is only advanced (with
+ * release semantics) once a record is fully written, and readers load it with acquire semantics.
+ */
+class ValueLog {
+public:
+    /**
+     * A view of a value in the log, without copying it out.
+     */
+    class View {
+    public:
+        const char * data;
+        size_t size;
+
+    public:
+        View()
+            : data(nullptr), size(0)
+        {}
+
+        View(const char * data, size_t size)
+            : data(data), size(size)
+        {}
+
+    public:
+        std::string toString() const { return std::string(data, size); }
+
+        bool operator==(const View& other) const {
+            return size == other.size && std::memcmp(data, other.data, size) == 0;
+        }
+        bool operator!=(const View& other) const { return !operator==(other); }
+    };
+
+protected:
+    std::string file;
+    int fd;
+    const char * ptr;   // the mapping, of 'maxSize' bytes
+    uint64_t maxSize;
+    std::atomic<uint64_t> len;  // only written by append(), after the record's bytes
+
+public:
+    ValueLog(const std::string& file, uint64_t maxSize = 1ull << 40);
+    ~ValueLog();
+
+    ValueLog(const ValueLog&) = delete;
+    ValueLog& operator=(const ValueLog&) = delete;
+
+public:
+    /**
+     * Appends a value to the log and returns its offset. Throws std::runtime_error if the log cannot grow.
+     */
+    uint64_t append(const View& v);
+
+    template<class V>
+    uint64_t append(const V& v) {
+        return append(toBytes(v));
+    }
+
+    View getValue(uint64_t offset) const;
+
+    /**
+     * Returns the number of bytes appended so far.
+     */
+    uint64_t size() const { return len.load(std::memory_order_acquire); }
+
+    const std::string& getFile() const { return file; }
+
+public:
+    template<class T>
+    static View toBytes(const T& val) {
+        static_assert(std::is_trivially_copyable<T>::value, "Can only log strings or trivially-copyable types");
+        return View(reinterpret_cast<const char *>(&val), sizeof(T));
+    }
+
+    static View toBytes(const std::string& str) {
+        return View(str.data(), str.size());
+    }
+
+    static View toBytes(std::string_view str) {
+        return View(str.data(), str.size());
+    }
+
+    template<class T>
+    static void fromBytes(const View& view, T& val) {
+        static_assert(std::is_trivially_copyable<T>::value, "Can only log strings or trivially-copyable types");
+        if(view.size != sizeof(T))
+            throw std::runtime_error("Value log record has the wrong size for its type");
+        std::memcpy(&val, view.data, sizeof(T));
+    }
+
+    static void fromBytes(const View& view, std::string& str) {
+        str.assign(view.data, view.size);
+    }
+
+};
+
+} // end of namespace libaad
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+#include <aad/AccumulatedTree.h>
+#include <aad/BitString.h>
+#include <aad/CommitUtils.h>
+#include <aad/EllipticCurves.h>
+#include <aad/LeafPolyCache.h>
+#include <aad/LruCache.h>
+#include <aad/PublicParameters.h>
+
+#include <xassert/XAssert.h>
+#include <xutils/Log.h>
+
+namespace libaad {
+
+/**
+ * Client-side state that is reused across membership proof verifications, e.g., when repeatedly verifying
+ * lookups of the same hot keys across different versions of the AAD.
+ *
+ * For every value in a proof, the client needs the accumulator of that value's leaf AT, which has 513 prefixes
+ * of hashKV(k, v, leafNo) as roots. We cache:
+ *  - the leaf accumulators themselves, keyed by (k, v, leafNo), and
+ *  - for every key, the polynomial whose roots are the first SecParam*2 + 1 prefixes (i.e., those of the key hash),
+ *    so a new value of a known key only needs the polynomial of its value-hash prefixes (see LeafPolyCache).
+ *    This needs a CryptoHash that can hash values on their own (see HasValueHash); with other hashes, leaf
+ *    polynomials are interpolated from scratch.
+ *
+ * Both caches are bounded ('maxLeaves' leaf accumulators and 'maxKeys' key polynomials) and evict their
+ * least-recently-used entries, so a long-lived client does not grow without bound.
+ *
+ * Can be used by several threads at the same time (e.g., when the trees of a proof are verified in parallel).
+ */
+template<class Key, class Val, int SecParam, class CryptoHash>
+class VerifierContext {
+protected:
+    const PublicParameters* pp;
+
+    mutable std::mutex mutex;
+    LruCache<std::tuple<Key, Val, int>, G1> leafAccs;
+    LeafPolyCache<Key, SecParam, CryptoHash> polyCache;
+
+    size_t numLeafHits, numLeafMisses;
+
+public:
+    VerifierContext(const PublicParameters* pp, size_t maxKeys = 4096, size_t maxLeaves = 65536)
+        : pp(pp), leafAccs(maxLeaves), polyCache(maxKeys), numLeafHits(0), numLeafMisses(0)
+    {}
+
+public:
+    const PublicParameters* getPublicParameters() const { return pp; }
+
+    size_t getNumCachedLeaves() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return leafAccs.size();
+    }
+
+    size_t getNumLeafHits() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return numLeafHits;
+    }
+
+    size_t getNumLeafMisses() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return numLeafMisses;
+    }
+
+    // NOTE: the key polynomial cache has its own lock
+    size_t getNumCachedKeys() const { return polyCache.getNumCachedKeys(); }
+    size_t getNumKeyHits() const { return polyCache.getNumHits(); }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        leafAccs.clear();
+        polyCache.clear();
+    }
+
+    /**
+     * Returns the accumulator of the leaf AT of the specified key-value pair, computing and caching it if needed.
+     */
+    G1 getLeafAcc(const Key& k, const Val& v, int leafNo) {
+        auto id = std::make_tuple(k, v, leafNo);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto cached = leafAccs.find(id);
+            if(cached != nullptr) {
+                numLeafHits++;
+                return *cached;
+            }
+            numLeafMisses++;
+        }
+
+        std::vector<Fr> leafPoly;
+        if constexpr(HasValueHash<CryptoHash>::value) {
+            BitString path;
+            polyCache.getLeafPoly(k, v, leafNo, path, leafPoly);
+        } else {
+            AccumulatedTree at(SecParam*4, CryptoHash().hashKV(k, v, leafNo));
+            CommitUtils::interpolateAT(&at, leafPoly);
+        }
+        G1 acc = pp != nullptr ? PolyCommit::commitG1(*pp, leafPoly, false) : CommitUtils::simulateCommitment<G1>(leafPoly);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        leafAccs.insert(std::move(id), acc);
+        return acc;
+    }
+};
+
+} // end of libaad namespace
@@ -0,0 +1,294 @@
+#include <aad/Configuration.h>
+
+#include <aad/AppendLog.h>
+
+#include <cerrno>
+#include <fstream>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <xassert/XAssert.h>
+#include <xutils/Log.h>
+
+using namespace std;
+
+namespace libaad {
+
+static const char AppendLogMagic[8] = { 'L', 'I', 'B', 'A', 'A', 'D', 'W', 'L' };
+static const uint32_t AppendLogVersion = 1;
+static const size_t AppendLogHeaderSize = sizeof(AppendLogMagic) + sizeof(AppendLogVersion);
+
+// every record starts with its leaf number, payload size and checksum
+static const size_t RecordHeaderSize = sizeof(uint64_t) + sizeof(uint32_t) + sizeof(uint64_t);
+// a larger payload can only come from a corrupted record
+static const uint32_t MaxPayloadSize = 1u << 30;
+
+/**
+ * FNV-1a, which is plenty to detect torn records (we do not need to detect malicious changes to our own log).
+ */
+static uint64_t checksum(uint64_t leafNo, uint32_t size, const char * payload) {
+    uint64_t h = 14695981039346656037ull;
+    auto mix = [&h](const unsigned char * bytes, size_t count) {
+        for(size_t i = 0; i < count; i++) {
+            h ^= bytes[i];
+            h *= 1099511628211ull;
+        }
+    };
+    mix(reinterpret_cast<const unsigned char *>(&leafNo), sizeof(leafNo));
+    mix(reinterpret_cast<const unsigned char *>(&size), sizeof(size));
+    mix(reinterpret_cast<const unsigned char *>(payload), size);
+    return h;
+}
+
+AppendLog::AppendLog(const std::string& file, size_t groupSize, std::chrono::milliseconds maxDelay)
+    : file(file), fd(-1), groupSize(groupSize), maxDelay(maxDelay),
+      numAppended(0), numDurable(0), numSyncs(0), flushRequested(false), stopping(false), inCommit(false)
+{
+    assertStrictlyPositive(groupSize);
+
+    // make sure we do not append after a torn record, which would make all our records unreadable
+    replay(file, UINT64_MAX, ReplayFunc());
+
+    fd = ::open(file.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if(fd < 0) {
+        logerror << "Could not open append log '" << file << "' for writing" << endl;
+        throw std::runtime_error("Could not open append log");
+    }
+
+    struct stat st;
+    if(::fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Could not get the size of the append log");
+    }
+    if(st.st_size == 0) {
+        std::string hdr(AppendLogMagic, sizeof(AppendLogMagic));
+        encode(hdr, AppendLogVersion);
+        try {
+            commit(hdr);
+        } catch(...) {
+            ::close(fd);
+            throw;
+        }
+    }
+
+    flusher = std::thread(&AppendLog::flusherLoop, this);
+}
+
+AppendLog::~AppendLog() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    pendingCv.notify_one();
+    flusher.join();
+
+    if(error != nullptr) {
+        logerror << "Some appends could not be written to the append log '" << file << "'" << endl;
+    }
+    ::close(fd);
+}
+
+void AppendLog::append(uint64_t leafNo, const std::string& payload) {
+    assertLessThanOrEqual(payload.size(), MaxPayloadSize);
+    auto size = static_cast<uint32_t>(payload.size());
+
+    std::unique_lock<std::mutex> lock(mutex);
+    if(error != nullptr)
+        std::rethrow_exception(error);
+
+    bool wasEmpty = pending.empty();
+    encode(pending, leafNo);
+    encode(pending, size);
+    encode(pending, checksum(leafNo, size, payload.data()));
+    pending.append(payload);
+    numAppended++;
+
+    // wake up the flusher to start the group's delay, or to commit the group if it is full
+    if(wasEmpty || numAppended - numDurable >= groupSize) {
+        lock.unlock();
+        pendingCv.notify_one();
+    }
+}
+
+void AppendLog::sync() {
+    std::unique_lock<std::mutex> lock(mutex);
+    waitDurable(lock);
+}
+
+void AppendLog::truncate() {
+    std::unique_lock<std::mutex> lock(mutex);
+    waitDurable(lock);
+    // waitDurable() only waits for our records: the flusher could still be writing a later group (e.g., appended
+    // while we waited), whose write() would race with our ftruncate()
+    durableCv.wait(lock, [this] { return !inCommit; });
+    if(error != nullptr)
+        std::rethrow_exception(error);
+
+    // NOTE: the flusher is idle and has nothing to write until we release the lock, and our writes are O_APPEND, so
+    // they go right after the header from now on
+    if(::ftruncate(fd, static_cast<off_t>(AppendLogHeaderSize)) != 0 || ::fdatasync(fd) != 0) {
+        logerror << "Could not truncate append log '" << file << "'" << endl;
+        throw std::runtime_error("Could not truncate append log");
+    }
+}
+
+uint64_t AppendLog::getNumSyncs() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return numSyncs;
+}
+
+void AppendLog::waitDurable(std::unique_lock<std::mutex>& lock) {
+    uint64_t target = numAppended;
+    if(numDurable < target) {
+        flushRequested = true;
+        pendingCv.notify_one();
+        durableCv.wait(lock, [this, target] { return numDurable >= target || error != nullptr; });
+    }
+
+    if(error != nullptr)
+        std::rethrow_exception(error);
+}
+
+void AppendLog::flusherLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while(true) {
+        pendingCv.wait(lock, [this] { return stopping || !pending.empty(); });
+        if(pending.empty())
+            break;  // stopping, with nothing left to commit
+
+        // wait for the rest of the group, unless someone is waiting on it
+        pendingCv.wait_for(lock, maxDelay, [this] {
+            return stopping || flushRequested || numAppended - numDurable >= groupSize;
+        });
+
+        std::string records;
+        records.swap(pending);
+        uint64_t committed = numAppended;
+        flushRequested = false;
+        inCommit = true;
+
+        lock.unlock();
+        std::exception_ptr e;
+        try {
+            commit(records);
+        } catch(...) {
+            e = std::current_exception();
+        }
+        lock.lock();
+        inCommit = false;
+
+        if(e != nullptr) {
+            error = e;
+        } else {
+            numDurable = committed;
+            numSyncs++;
+        }
+        durableCv.notify_all();
+    }
+}
+
+void AppendLog::commit(const std::string& records) {
+    size_t written = 0;
+    while(written < records.size()) {
+        ssize_t n = ::write(fd, records.data() + written, records.size() - written);
+        if(n < 0) {
+            if(errno == EINTR)
+                continue;
+            logerror << "Could not write to append log '" << file << "' (errno = " << errno << ")" << endl;
+            throw std::runtime_error("Could not write to append log");
+        }
+        written += static_cast<size_t>(n);
+    }
+
+    if(::fdatasync(fd) != 0) {
+        logerror << "Could not sync append log '" << file << "' (errno = " << errno << ")" << endl;
+        throw std::runtime_error("Could not sync append log");
+    }
+}
+
+uint64_t AppendLog::replay(const std::string& file, uint64_t fromLeafNo, const ReplayFunc& func) {
+    std::ifstream fin(file, std::ios::binary);
+    if(!fin.is_open())
+        return 0;
+
+    // the end of the last complete record, where we truncate the log if the next record is torn
+    size_t validEnd = 0;
+    bool torn = false;
+    uint64_t numReplayed = 0;
+
+    std::vector<char> hdr(AppendLogHeaderSize);
+    if(!fin.read(hdr.data(), static_cast<std::streamsize>(hdr.size()))) {
+        // crashed while creating the log (the header is written before any record)
+        torn = fin.gcount() > 0;
+    } else {
+        uint32_t version;
+        std::memcpy(&version, hdr.data() + sizeof(AppendLogMagic), sizeof(version));
+        if(std::memcmp(hdr.data(), AppendLogMagic, sizeof(AppendLogMagic)) != 0 || version != AppendLogVersion) {
+            logerror << "'" << file << "' is not an append log (or has an unsupported version)" << endl;
+            throw std::runtime_error("Not an append log (or unsupported version)");
+        }
+        validEnd = AppendLogHeaderSize;
+
+        bool havePrev = false;
+        uint64_t prevLeafNo = 0;
+        std::string payload;
+        while(true) {
+            char recHdr[RecordHeaderSize];
+            if(!fin.read(recHdr, RecordHeaderSize)) {
+                torn = fin.gcount() > 0;
+                break;
+            }
+
+            uint64_t leafNo, sum;
+            uint32_t size;
+            std::memcpy(&leafNo, recHdr, sizeof(leafNo));
+            std::memcpy(&size, recHdr + sizeof(leafNo), sizeof(size));
+            std::memcpy(&sum, recHdr + sizeof(leafNo) + sizeof(size), sizeof(sum));
+            if(size > MaxPayloadSize) {
+                torn = true;
+                break;
+            }
+
+            payload.resize(size);
+            if(!fin.read(&payload[0], static_cast<std::streamsize>(size)) || checksum(leafNo, size, payload.data()) != sum) {
+                torn = true;
+                break;
+            }
+
+            if(havePrev && leafNo != prevLeafNo + 1) {
+                logerror << "Append log '" << file << "' has a record for leaf #" << leafNo << " right after leaf #" << prevLeafNo << endl;
+                throw std::runtime_error("Append log skips over some appends");
+            }
+            havePrev = true;
+            prevLeafNo = leafNo;
+
+            if(leafNo >= fromLeafNo) {
+                if(leafNo != fromLeafNo + numReplayed) {
+                    logerror << "Append log '" << file << "' starts at leaf #" << leafNo << ", but we need leaf #" << fromLeafNo << " onwards" << endl;
+                    throw std::runtime_error("Append log is missing some appends");
+                }
+                if(func)
+                    func(leafNo, payload);
+                numReplayed++;
+            }
+
+            validEnd += RecordHeaderSize + size;
+        }
+    }
+    fin.close();
+
+    if(torn) {
+        logwarn << "Truncating torn record at the end of append log '" << file << "' (at offset " << validEnd << ")" << endl;
+        if(::truncate(file.c_str(), static_cast<off_t>(validEnd)) != 0) {
+            logerror << "Could not truncate append log '" << file << "'" << endl;
+            throw std::runtime_error("Could not truncate torn append log record");
+        }
+    }
+
+    return numReplayed;
+}
+
+} // end of namespace libaad
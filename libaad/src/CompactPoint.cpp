@@ -0,0 +1,281 @@
+#include <aad/Configuration.h>
+
+#include <aad/CompactPoint.h>
+#include <aad/Endomorphism.h>
+
+#include <cstring>
+#include <stdexcept>
+
+#include <xassert/XAssert.h>
+
+using namespace std;
+
+namespace libaad {
+
+#ifdef CURVE_BN128
+// The top two bits of X's last 64-bit word (see CompactPoint)
+static const uint64_t InfinityBit = 1ull << 63;
+static const uint64_t ParityBit = 1ull << 62;
+
+/**
+ * Returns true if the (Montgomery) representation of 'y' is odd, which, like libff's point compression, we use to tell
+ * y from -y. For a point in G2, this is the parity of Y's first coefficient.
+ */
+template<class Coord>
+static bool isOdd(const Coord& y) {
+    return (reinterpret_cast<const unsigned char *>(&y)[0] & 1) != 0;
+}
+
+// The base field modulus p, as 64-bit words, least significant first (like bn::Fp's Montgomery representation)
+static const uint64_t FpModulus[] = { 0x3c208c16d87cfd47ull, 0x97816a916871ca8dull, 0xb85045b68181585dull, 0x30644e72e131a029ull };
+static_assert(sizeof(bn::Fp) == sizeof(FpModulus), "bn::Fp is not four 64-bit words");
+
+/**
+ * Returns true if each of the Fp elements in the 'size' bytes at 'bytes' (e.g., the two of an Fp2) is less than p.
+ * Otherwise, the bytes are not how bn::Fp stores an element, but a second encoding of the element minus p.
+ */
+static bool isCanonical(const unsigned char * bytes, size_t size) {
+    assertTrue(size % sizeof(FpModulus) == 0);
+    for(size_t off = 0; off < size; off += sizeof(FpModulus)) {
+        // compare from the most significant word down
+        for(size_t i = 4; i-- > 0;) {
+            uint64_t word;
+            std::memcpy(&word, bytes + off + i * sizeof(word), sizeof(word));
+            if(word != FpModulus[i]) {
+                if(word > FpModulus[i])
+                    return false;
+                break;
+            }
+            if(i == 0)
+                return false;   // equal to p
+        }
+    }
+    return true;
+}
+
+template<class Group>
+static uint64_t getLastWord(const unsigned char * bytes) {
+    uint64_t word;
+    std::memcpy(&word, bytes + sizeof(Group::X) - sizeof(word), sizeof(word));
+    return word;
+}
+
+template<class Group>
+static void setLastWord(unsigned char * bytes, uint64_t word) {
+    std::memcpy(bytes + sizeof(Group::X) - sizeof(word), &word, sizeof(word));
+}
+
+/**
+ * Stores 'p' in 'size' bytes: its affine X and Y or, if 'compressed', only X and the parity of Y.
+ */
+template<class Group>
+static void pack(const Group& p, const decltype(Group::X)& one, unsigned char * bytes, size_t size, bool compressed) {
+    if(p.is_zero()) {
+        std::memset(bytes, 0, size);
+        setLastWord<Group>(bytes, InfinityBit);
+        return;
+    }
+
+    // points read from snapshots (or proofs) are already affine, so we can skip the inversion
+    Group a(p);
+    if(a.Z != one)
+        a.to_affine_coordinates();
+
+    std::memcpy(bytes, &a.X, sizeof(a.X));
+    assertEqual(getLastWord<Group>(bytes) & (InfinityBit | ParityBit), 0);
+    if(compressed) {
+        if(isOdd(a.Y))
+            setLastWord<Group>(bytes, getLastWord<Group>(bytes) | ParityBit);
+    } else {
+        std::memcpy(bytes + sizeof(a.X), &a.Y, sizeof(a.Y));
+    }
+}
+
+/**
+ * The inverse of pack(). Returns false if the bytes are not a point stored by pack() (e.g., the X of a compressed point
+ * is not on the curve), which only happens if they did not come from pack() (e.g., they came from a corrupted proof).
+ * So that every point has a single encoding (e.g., proofs can be hashed or compared as bytes), this also rejects
+ * coordinates that are not less than p and points at infinity with anything but zeros after the flag.
+ */
+template<class Group>
+static bool unpack(const unsigned char * bytes, const decltype(Group::X)& one, const decltype(Group::X)& coeffB,
+    bool compressed, Group& p)
+{
+    size_t size = compressed ? sizeof(p.X) : sizeof(p.X) + sizeof(p.Y);
+    uint64_t flags = getLastWord<Group>(bytes) & (InfinityBit | ParityBit);
+    if(flags & InfinityBit) {
+        if(getLastWord<Group>(bytes) != InfinityBit)
+            return false;
+        for(size_t i = 0; i < size; i++) {
+            bool isFlagWord = i >= sizeof(p.X) - sizeof(uint64_t) && i < sizeof(p.X);
+            if(!isFlagWord && bytes[i] != 0)
+                return false;
+        }
+        p = Group::zero();
+        return true;
+    }
+    if(!compressed && (flags & ParityBit))
+        return false;
+
+    std::memcpy(&p.X, bytes, sizeof(p.X));
+    setLastWord<Group>(reinterpret_cast<unsigned char *>(&p.X), getLastWord<Group>(bytes) & ~flags);
+    if(!isCanonical(reinterpret_cast<const unsigned char *>(&p.X), sizeof(p.X)))
+        return false;
+    if(compressed) {
+        // y^2 = x^3 + b
+        using Coord = decltype(Group::X);
+        Coord x2, y2;
+        Coord::square(x2, p.X);
+        Coord::mul(y2, x2, p.X);
+        Coord::add(y2, y2, coeffB);
+        if(!Coord::squareRoot(p.Y, y2))
+            return false;
+        if(isOdd(p.Y) != ((flags & ParityBit) != 0))
+            Coord::neg(p.Y, p.Y);
+        // y = 0 has no odd root (not that BN128 has any such points)
+        if(isOdd(p.Y) != ((flags & ParityBit) != 0))
+            return false;
+    } else {
+        std::memcpy(&p.Y, bytes + sizeof(p.X), sizeof(p.Y));
+        if(!isCanonical(reinterpret_cast<const unsigned char *>(&p.Y), sizeof(p.Y)))
+            return false;
+    }
+    p.Z = one;
+    return true;
+}
+
+#ifdef COMPRESS_STORED_POINTS
+static const bool CompressStored = true;
+#else
+static const bool CompressStored = false;
+#endif
+
+static const bn::Fp& getFpOne() {
+    static const bn::Fp one(1);
+    return one;
+}
+
+static const bn::Fp2& getFp2One() {
+    static const bn::Fp2 one(bn::Fp(1), bn::Fp(0));
+    return one;
+}
+#endif
+
+template<>
+void CompactPoint<G1>::set(const G1& p) {
+#ifdef CURVE_BN128
+    pack(p, getFpOne(), bytes, Size, CompressStored);
+#else
+    std::memcpy(bytes, &p, Size);
+#endif
+}
+
+template<>
+void CompactPoint<G2>::set(const G2& p) {
+#ifdef CURVE_BN128
+    pack(p, getFp2One(), bytes, Size, CompressStored);
+#else
+    std::memcpy(bytes, &p, Size);
+#endif
+}
+
+template<>
+G1 CompactPoint<G1>::get() const {
+#ifdef CURVE_BN128
+    G1 p;
+    bool ok = unpack(bytes, getFpOne(), libff::bn128_coeff_b, CompressStored, p);
+    assertTrue(ok);
+    (void)ok;
+    return p;
+#else
+    G1 p;
+    std::memcpy(&p, bytes, Size);
+    return p;
+#endif
+}
+
+template<>
+G2 CompactPoint<G2>::get() const {
+#ifdef CURVE_BN128
+    G2 p;
+    bool ok = unpack(bytes, getFp2One(), libff::bn128_twist_coeff_b, CompressStored, p);
+    assertTrue(ok);
+    (void)ok;
+    return p;
+#else
+    G2 p;
+    std::memcpy(&p, bytes, Size);
+    return p;
+#endif
+}
+
+template<>
+void CompactPoint<G1>::setZero() {
+#ifdef CURVE_BN128
+    std::memset(bytes, 0, Size);
+    setLastWord<G1>(bytes, InfinityBit);
+#else
+    set(G1::zero());
+#endif
+}
+
+template<>
+void CompactPoint<G2>::setZero() {
+#ifdef CURVE_BN128
+    std::memset(bytes, 0, Size);
+    setLastWord<G2>(bytes, InfinityBit);
+#else
+    set(G2::zero());
+#endif
+}
+
+template<>
+void CompactPoint<G1>::compress(const G1& p, unsigned char * out) {
+#ifdef CURVE_BN128
+    pack(p, getFpOne(), out, CompressedSize, true);
+#else
+    std::memcpy(out, &p, CompressedSize);
+#endif
+}
+
+template<>
+void CompactPoint<G2>::compress(const G2& p, unsigned char * out) {
+#ifdef CURVE_BN128
+    pack(p, getFp2One(), out, CompressedSize, true);
+#else
+    std::memcpy(out, &p, CompressedSize);
+#endif
+}
+
+template<>
+G1 CompactPoint<G1>::decompress(const unsigned char * in) {
+    G1 p;
+#ifdef CURVE_BN128
+    if(!unpack(in, getFpOne(), libff::bn128_coeff_b, true, p))
+        throw std::runtime_error("Compressed G1 point is malformed or not on the curve");
+#else
+    std::memcpy(&p, in, CompressedSize);
+#endif
+    if(!p.is_well_formed())
+        throw std::runtime_error("Compressed G1 point is not on the curve");
+    return p;
+}
+
+template<>
+G2 CompactPoint<G2>::decompress(const unsigned char * in) {
+    G2 p;
+#ifdef CURVE_BN128
+    if(!unpack(in, getFp2One(), libff::bn128_twist_coeff_b, true, p))
+        throw std::runtime_error("Compressed G2 point is malformed or not on the curve");
+#else
+    std::memcpy(&p, in, CompressedSize);
+#endif
+    if(!p.is_well_formed())
+        throw std::runtime_error("Compressed G2 point is not on the curve");
+    // unlike G1, the twist has points outside the subgroup of order r, which a verifier must not pair with
+    if(!Endomorphism::isInG2(p))
+        throw std::runtime_error("Compressed G2 point is not in G2");
+    return p;
+}
+
+} // end of namespace libaad
@@ -0,0 +1,309 @@
+#include <aad/Configuration.h>
+
+#include <aad/Endomorphism.h>
+
+#include <gmpxx.h>
+
+#include <xassert/XAssert.h>
+#include <xutils/Log.h>
+
+using namespace std;
+
+namespace libaad {
+
+/**
+ * The scalar lambda by which an endomorphism acts on its group, together with a short basis of the lattice
+ * {(a, b) : a + b lambda = 0 mod r}, which we need to split scalars into halves (see Guide to ECC, Alg. 3.74).
+ */
+struct EndoParams {
+    bool ok;
+    mpz_class r, lambda;
+    mpz_class a1, b1, a2, b2;
+
+    EndoParams() : ok(false) {}
+
+    void setLambda(const mpz_class& l) {
+        lambda = l;
+
+        // Run the extended Euclidean algorithm on (r, lambda), with r_i = s_i r + t_i lambda, until r_i < sqrt(r).
+        mpz_class sqrtR;
+        mpz_sqrt(sqrtR.get_mpz_t(), r.get_mpz_t());
+
+        mpz_class r0 = r, r1 = lambda, t0 = 0, t1 = 1, q, tmp;
+        while(r1 >= sqrtR) {
+            q = r0 / r1;
+            tmp = r0 - q * r1; r0 = r1; r1 = tmp;
+            tmp = t0 - q * t1; t0 = t1; t1 = tmp;
+        }
+
+        // now r0 >= sqrt(r) > r1, and every (r_i, -t_i) is a lattice vector
+        a1 = r1;
+        b1 = -t1;
+
+        q = r0 / r1;
+        mpz_class r2 = r0 - q * r1, t2 = t0 - q * t1;
+        if(r0 * r0 + t0 * t0 <= r2 * r2 + t2 * t2) {
+            a2 = r0;
+            b2 = -t0;
+        } else {
+            a2 = r2;
+            b2 = -t2;
+        }
+    }
+
+    /**
+     * Returns round(a / r), for any sign of a.
+     */
+    mpz_class roundDiv(const mpz_class& a) const {
+        mpz_class q, num = 2 * a + r, den = 2 * r;
+        mpz_fdiv_q(q.get_mpz_t(), num.get_mpz_t(), den.get_mpz_t());
+        return q;
+    }
+
+    /**
+     * Splits k into k1 + k2 lambda (mod r), where |k1| and |k2| are about sqrt(r).
+     */
+    void decompose(const Fr& k, mpz_class& k1, mpz_class& k2) const {
+        mpz_class kz;
+        k.as_bigint().to_mpz(kz.get_mpz_t());
+
+        mpz_class c1 = roundDiv(b2 * kz), c2 = roundDiv(-b1 * kz);
+        k1 = kz - c1 * a1 - c2 * a2;
+        k2 = -c1 * b1 - c2 * b2;
+    }
+};
+
+static Fr mpzToFr(const mpz_class& z) {
+    assertTrue(z >= 0);
+    return Fr(libff::bigint<Fr::num_limbs>(z.get_mpz_t()));
+}
+
+#ifdef CURVE_BN128
+static mpz_class getOrder() {
+    mpz_class r;
+    Fr::mod.to_mpz(r.get_mpz_t());
+    return r;
+}
+
+// BN128 base field modulus
+static const char * const BN128_P = "21888242871839275222246405745257275088696311157297823662689037894645226208583";
+// A primitive cube root of unity in Fp, for phi(x, y) = (beta x, y)
+static const char * const BN128_BETA = "2203960485148121921418603742825762020974279258880205651966";
+// The cube root of unity in Fr by which phi acts on G1 (or its square, depending on beta; we check which one)
+static const char * const BN128_LAMBDA1 = "4407920970296243842393367215006156084916469457145843978461";
+// The BN parameter x, with psi acting on G2 as multiplication by p = 6x^2 (mod r)
+static const char * const BN128_X = "4965661367192848881";
+
+static bn::Fp2 conj(const bn::Fp2& a) {
+    bn::Fp2 c = a;
+    bn::Fp::neg(c.b_, a.b_);
+    return c;
+}
+
+static bn::Fp2 pow(const bn::Fp2& a, const mpz_class& e) {
+    bn::Fp2 res(bn::Fp(1), bn::Fp(0));
+    for(size_t i = mpz_sizeinbase(e.get_mpz_t(), 2); i-- > 0;) {
+        bn::Fp2::square(res, res);
+        if(mpz_tstbit(e.get_mpz_t(), i))
+            bn::Fp2::mul(res, res, a);
+    }
+    return res;
+}
+
+static bn::Fp2 inverse(const bn::Fp2& a) {
+    mpz_class p(BN128_P);
+    return pow(a, p * p - 2);
+}
+
+static const bn::Fp& getBeta() {
+    static const bn::Fp beta{std::string(BN128_BETA)};
+    return beta;
+}
+
+/**
+ * psi(x, y) = (gx conj(x), gy conj(y)) for two constants in Fp2 that depend on the twist. Rather than hard-code
+ * them for herumi's particular representation of the twist, we derive them from the generator, since
+ * psi(Q) = p Q: i.e., gx = x(pQ) / conj(x(Q)) and gy = y(pQ) / conj(y(Q)), in affine coordinates.
+ */
+struct PsiConstants {
+    bn::Fp2 gx, gy;
+
+    PsiConstants() {
+        mpz_class x(BN128_X);
+        mpz_class lambda = (6 * x * x) % getOrder();
+
+        G2 q = G2::one(), pq = mpzToFr(lambda) * G2::one();
+        q.to_affine_coordinates();
+        pq.to_affine_coordinates();
+
+        bn::Fp2::mul(gx, pq.X, inverse(conj(q.X)));
+        bn::Fp2::mul(gy, pq.Y, inverse(conj(q.Y)));
+    }
+};
+
+static const PsiConstants& getPsiConstants() {
+    static const PsiConstants c;
+    return c;
+}
+#endif
+
+G1 Endomorphism::apply(const G1& p) {
+#ifdef CURVE_BN128
+    G1 res = p;
+    bn::Fp::mul(res.X, p.X, getBeta());
+    return res;
+#else
+    (void)p;
+    throw std::logic_error("No GLV endomorphism for this curve");
+#endif
+}
+
+G2 Endomorphism::apply(const G2& q) {
+#ifdef CURVE_BN128
+    const PsiConstants& c = getPsiConstants();
+    G2 res;
+    bn::Fp2::mul(res.X, conj(q.X), c.gx);
+    bn::Fp2::mul(res.Y, conj(q.Y), c.gy);
+    res.Z = conj(q.Z);
+    return res;
+#else
+    (void)q;
+    throw std::logic_error("No GLS endomorphism for this curve");
+#endif
+}
+
+/**
+ * Checks that endo(P) = lambda P for a random P and that scalars are split correctly.
+ */
+template<class Group>
+static bool checkEndomorphism(const EndoParams& params) {
+    Group p = Fr::random_element() * Group::one();
+    if(Endomorphism::apply(p) != mpzToFr(params.lambda) * p)
+        return false;
+
+    Fr k = Fr::random_element();
+    mpz_class k1, k2;
+    params.decompose(k, k1, k2);
+
+    mpz_class bound = mpz_class(1) << 130;
+    if(abs(k1) >= bound || abs(k2) >= bound)
+        return false;
+
+    mpz_class sum = (k1 + k2 * params.lambda) % params.r;
+    if(sum < 0)
+        sum += params.r;
+    return mpzToFr(sum) == k;
+}
+
+template<class Group>
+static const EndoParams& getParams();
+
+template<>
+const EndoParams& getParams<G1>() {
+    static const EndoParams params = [] {
+        EndoParams p;
+#ifdef CURVE_BN128
+        p.r = getOrder();
+        mpz_class lambda(BN128_LAMBDA1);
+
+        // beta is one of the two primitive cube roots of unity in Fp, and phi acts either as lambda or as lambda^2
+        p.setLambda(lambda);
+        p.ok = checkEndomorphism<G1>(p);
+        if(!p.ok) {
+            p.setLambda((lambda * lambda) % p.r);
+            p.ok = checkEndomorphism<G1>(p);
+        }
+
+        if(!p.ok)
+            logerror << "GLV endomorphism check failed for G1, disabling it" << endl;
+#endif
+        return p;
+    }();
+    return params;
+}
+
+template<>
+const EndoParams& getParams<G2>() {
+    static const EndoParams params = [] {
+        EndoParams p;
+#ifdef CURVE_BN128
+        p.r = getOrder();
+        mpz_class x(BN128_X);
+        p.setLambda((6 * x * x) % p.r);
+        p.ok = checkEndomorphism<G2>(p);
+
+        if(!p.ok)
+            logerror << "GLS endomorphism check failed for G2, disabling it" << endl;
+#endif
+        return p;
+    }();
+    return params;
+}
+
+template<class Group>
+bool Endomorphism::has() {
+    return getParams<Group>().ok;
+}
+
+template<class Group>
+void Endomorphism::split(
+    const Group * base_begin,
+    const Group * base_end,
+    const Fr * exp_begin,
+    const Fr * exp_end,
+    std::vector<Group>& bases,
+    std::vector<Fr>& exps,
+    const Group * endo_begin)
+{
+    const EndoParams& params = getParams<Group>();
+    assertTrue(params.ok);
+    assertEqual(base_end - base_begin, exp_end - exp_begin);
+
+    size_t sz = static_cast<size_t>(base_end - base_begin);
+    bases.reserve(bases.size() + 2*sz);
+    exps.reserve(exps.size() + 2*sz);
+
+    mpz_class k1, k2;
+    for(auto b = base_begin, e = exp_begin; b != base_end; b++, e++) {
+        params.decompose(*e, k1, k2);
+
+        // multi-exponentiations only take non-negative exponents, so move the sign onto the base
+        bases.push_back(k1 < 0 ? -(*b) : *b);
+        exps.push_back(mpzToFr(abs(k1)));
+
+        Group endo = endo_begin != nullptr ? endo_begin[b - base_begin] : apply(*b);
+        bases.push_back(k2 < 0 ? -endo : endo);
+        exps.push_back(mpzToFr(abs(k2)));
+    }
+}
+
+bool Endomorphism::isInG2(const G2& q) {
+    const EndoParams& params = getParams<G2>();
+    if(params.ok)
+        return apply(q) == mpzToFr(params.lambda) * q;
+    else
+        return Fr::mod * q == G2::zero();
+}
+
+template bool Endomorphism::has<G1>();
+template bool Endomorphism::has<G2>();
+
+template void Endomorphism::split<G1>(
+    const G1 * base_begin,
+    const G1 * base_end,
+    const Fr * exp_begin,
+    const Fr * exp_end,
+    std::vector<G1>& bases,
+    std::vector<Fr>& exps,
+    const G1 * endo_begin);
+
+template void Endomorphism::split<G2>(
+    const G2 * base_begin,
+    const G2 * base_end,
+    const Fr * exp_begin,
+    const Fr * exp_end,
+    std::vector<G2>& bases,
+    std::vector<Fr>& exps,
+    const G2 * endo_begin);
+
+} // end of namespace libaad
@@ -0,0 +1,162 @@
+#include <aad/Configuration.h>
+
+#include <aad/FlatProof.h>
+
+#include <xassert/XAssert.h>
+
+using namespace std;
+
+namespace libaad {
+
+const uint32_t FlatProof::Magic;
+const uint32_t FlatProof::Version;
+const uint32_t FlatProof::NoProof;
+const size_t FlatProof::HashSize;
+const size_t FlatProof::MaxDepth;
+
+void FlatProofWriter::beginForest() {
+    assertFalse(trees.empty());
+    trees.back().forest = getCursor();
+}
+
+void FlatProofWriter::beginFrontier() {
+    assertFalse(trees.empty());
+    trees.back().frontier = getCursor();
+}
+
+void FlatProofWriter::addNode(bool hasChildren, uint8_t mask) {
+    assertStrictlyLessThan(numNodes, FlatProof::NoProof);
+    if(numNodes % 8 == 0)
+        shape.push_back(0);
+    if(hasChildren)
+        shape.back() = static_cast<char>(static_cast<unsigned char>(shape.back()) | (0x80 >> (numNodes % 8)));
+    masks.push_back(static_cast<char>(mask));
+    numNodes++;
+}
+
+void FlatProofWriter::addData(std::string_view str) {
+    assertStrictlyLessThan(str.size(), static_cast<size_t>(UINT32_MAX));
+    addData(static_cast<uint32_t>(str.size()));
+    data.append(str.data(), str.size());
+}
+
+void FlatProofWriter::addData(const BitString& bs) {
+    addData(static_cast<uint32_t>(bs.size()));
+
+    // packed 8 bits per byte, most significant bit first (like in snapshots)
+    std::string bytes((bs.size() + 7) / 8, 0);
+    for(size_t i = 0; i < bs.size(); i++) {
+        if(bs[i])
+            bytes[i / 8] = static_cast<char>(static_cast<unsigned char>(bytes[i / 8]) | (0x80 >> (i % 8)));
+    }
+    data.append(bytes);
+}
+
+FlatProof::Cursor FlatProofWriter::getCursor() const {
+    assertStrictlyLessThan(points.size(), static_cast<size_t>(FlatProof::NoProof));
+    assertStrictlyLessThan(hashes.size(), static_cast<size_t>(FlatProof::NoProof));
+    assertStrictlyLessThan(data.size(), static_cast<size_t>(FlatProof::NoProof));
+    return FlatProof::Cursor{numNodes, static_cast<uint32_t>(points.size()),
+        static_cast<uint32_t>(hashes.size()), static_cast<uint32_t>(data.size())};
+}
+
+size_t FlatProofWriter::finish(std::string& out) const {
+    FlatProof::Header header;
+    header.magic = FlatProof::Magic;
+    header.version = FlatProof::Version;
+    header.kind = static_cast<uint32_t>(kind);
+    header.numTrees = static_cast<uint32_t>(trees.size());
+    header.numNodes = numNodes;
+    header.pointBytes = getCursor().point;
+    header.hashBytes = getCursor().hash;
+    header.dataBytes = getCursor().data;
+
+    size_t tableBytes = trees.size() * sizeof(FlatProof::TreeEntry);
+    out.clear();
+    out.reserve(sizeof(header) + tableBytes + shape.size() + masks.size() + points.size() + hashes.size() + data.size());
+    out.append(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.append(reinterpret_cast<const char *>(trees.data()), tableBytes);
+    out.append(shape);
+    out.append(masks);
+    out.append(points);
+    out.append(hashes);
+    out.append(data);
+    return out.size();
+}
+
+FlatProofReader::FlatProofReader(const unsigned char * buf, size_t len)
+    : buf(buf), len(len)
+{
+    if(len < sizeof(header))
+        throw std::runtime_error("Flat proof is too small");
+    std::memcpy(&header, buf, sizeof(header));
+
+    if(header.magic != FlatProof::Magic)
+        throw std::runtime_error("Not a flat proof");
+    if(header.version != FlatProof::Version)
+        throw std::runtime_error("Unsupported flat proof version");
+    if(header.kind != static_cast<uint32_t>(FlatProof::Kind::Membership) &&
+        header.kind != static_cast<uint32_t>(FlatProof::Kind::AppendOnly))
+        throw std::runtime_error("Unknown kind of flat proof");
+
+    // the regions must add up to the size of the proof (in 64 bits, so they cannot overflow)
+    uint64_t tableBytes = static_cast<uint64_t>(header.numTrees) * sizeof(FlatProof::TreeEntry);
+    uint64_t shapeBytes = (static_cast<uint64_t>(header.numNodes) + 7) / 8;
+    uint64_t total = sizeof(header) + tableBytes + shapeBytes + header.numNodes +
+        header.pointBytes + header.hashBytes + header.dataBytes;
+    if(total != len)
+        throw std::runtime_error("Flat proof is corrupted");
+
+    table = buf + sizeof(header);
+    shape = table + tableBytes;
+    masks = shape + shapeBytes;
+    points = masks + header.numNodes;
+    hashes = points + header.pointBytes;
+    data = hashes + header.hashBytes;
+}
+
+FlatProof::TreeEntry FlatProofReader::getTree(size_t i) const {
+    assertStrictlyLessThan(i, getNumTrees());
+    FlatProof::TreeEntry entry;
+    std::memcpy(&entry, table + i * sizeof(entry), sizeof(entry));
+    return entry;
+}
+
+bool FlatProofReader::readNode(FlatProof::Cursor& c, uint8_t& mask) const {
+    if(c.node >= header.numNodes)
+        throw std::runtime_error("Flat proof is corrupted");
+
+    mask = masks[c.node];
+    bool hasChildren = (shape[c.node / 8] & (0x80 >> (c.node % 8))) != 0;
+    c.node++;
+    return hasChildren;
+}
+
+void FlatProofReader::readData(FlatProof::Cursor& c, std::string_view& str) const {
+    uint32_t size;
+    readData(c, size);
+    auto bytes = readRegion(data, header.dataBytes, c.data, size);
+    str = std::string_view(reinterpret_cast<const char *>(bytes), size);
+}
+
+void FlatProofReader::readData(FlatProof::Cursor& c, BitString& bs) const {
+    uint32_t size;
+    readData(c, size);
+    auto bytes = readRegion(data, header.dataBytes, c.data, (static_cast<size_t>(size) + 7) / 8);
+
+    bs.resize(size);
+    for(size_t i = 0; i < size; i++) {
+        bs[i] = (bytes[i / 8] & (0x80 >> (i % 8))) != 0;
+    }
+}
+
+const unsigned char * FlatProofReader::readRegion(const unsigned char * region, uint32_t regionSize, uint32_t& offset, size_t count) const {
+    if(offset > regionSize || count > regionSize - offset)
+        throw std::runtime_error("Flat proof is corrupted");
+
+    auto bytes = region + offset;
+    offset = static_cast<uint32_t>(offset + count);
+    return bytes;
+}
+
+} // end of namespace libaad
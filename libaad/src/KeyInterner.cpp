@@ -0,0 +1,69 @@
+#include <aad/Configuration.h>
+
+#include <aad/KeyInterner.h>
+
+#include <cstring>
+
+#include <xassert/XAssert.h>
+
+using namespace std;
+
+namespace libaad {
+
+const KeyId KeyInterner<std::string>::NotFound;
+const size_t KeyInterner<std::string>::ChunkSize;
+
+KeyId KeyInterner<std::string>::intern(std::string_view k) {
+    auto it = ids.find(k);
+    if(it != ids.end())
+        return it->second;
+
+    assertStrictlyLessThan(keys.size(), static_cast<size_t>(NotFound));
+    auto id = static_cast<KeyId>(keys.size());
+    auto copy = copyToArena(k);
+    ids.emplace(copy, id);
+    keys.push_back(copy);
+    return id;
+}
+
+void KeyInterner<std::string>::truncate(size_t newSize) {
+    while(keys.size() > newSize) {
+        std::string_view k = keys.back();
+        ids.erase(k);
+        keys.pop_back();
+
+        if(k.size() > ChunkSize / 4) {
+            assertTrue(!largeKeys.empty() && largeKeys.back().get() == k.data());
+            largeKeys.pop_back();
+            arenaSize -= k.size();
+        } else if(!k.empty() && k.data() + k.size() == chunks.back().get() + chunkUsed) {
+            chunkUsed -= k.size();
+        }
+    }
+}
+
+std::string_view KeyInterner<std::string>::copyToArena(std::string_view k) {
+    if(k.empty())
+        return std::string_view();
+
+    char * dest;
+    if(k.size() > ChunkSize / 4) {
+        // a large key gets its own allocation, so it does not waste the rest of the current chunk
+        largeKeys.emplace_back(new char[k.size()]);
+        dest = largeKeys.back().get();
+        arenaSize += k.size();
+    } else {
+        if(ChunkSize - chunkUsed < k.size()) {
+            chunks.emplace_back(new char[ChunkSize]);
+            chunkUsed = 0;
+            arenaSize += ChunkSize;
+        }
+        dest = chunks.back().get() + chunkUsed;
+        chunkUsed += k.size();
+    }
+
+    std::memcpy(dest, k.data(), k.size());
+    return std::string_view(dest, k.size());
+}
+
+} // end of namespace libaad
@@ -7,12 +7,20 @@
 
 #include <libff/common/profiling.hpp>
 
+#include <atomic>
+#include <mutex>
+
 using namespace std;
 
 namespace libaad {
 
 static int g_secParam = -1;
 
+// The NTL modulus set up by initialize(), which other threads install via installNtlContext()
+static std::mutex g_ntlMutex;
+static NTL::ZZ_pContext g_ntlContext;
+static std::atomic<int> g_ntlVersion(0);
+
 void initialize(unsigned char * randSeed, int size)
 {
     (void)randSeed; // FIXME: initialize entropy source
@@ -27,8 +35,21 @@ void initialize(unsigned char * randSeed, int size)
     // Initializes the NTL finite field to be the same as libff's for BN128
     ZZ p = NTL::conv<ZZ> ("21888242871839275222246405745257275088548364400416034343698204186575808495617");
     ZZ_p::init(p);
+
+    {
+        std::lock_guard<std::mutex> lock(g_ntlMutex);
+        g_ntlContext.save();
+    }
+    g_ntlVersion++;
 }
 
+void installNtlContext() {
+    std::lock_guard<std::mutex> lock(g_ntlMutex);
+    g_ntlContext.restore();
+}
+
+int getNtlContextVersion() { return g_ntlVersion; }
+
 int getSecParam() { return g_secParam; }
 
 } // end of namespace libaad
@@ -0,0 +1,79 @@
+#include <aad/Configuration.h>
+
+#include <aad/MappedFile.h>
+
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <xassert/XAssert.h>
+#include <xutils/Log.h>
+
+using namespace std;
+
+namespace libaad {
+
+MappedFile::MappedFile(const std::string& file, bool hugePages)
+    : ptr(nullptr), len(0)
+{
+    int fd = ::open(file.c_str(), O_RDONLY);
+    if(fd < 0) {
+        logerror << "Could not open '" << file << "' for mapping" << endl;
+        throw std::runtime_error("Could not open file for mapping");
+    }
+
+    struct stat st;
+    if(::fstat(fd, &st) != 0 || st.st_size <= 0) {
+        ::close(fd);
+        logerror << "Could not get the size of '" << file << "' (or it is empty)" << endl;
+        throw std::runtime_error("Could not get file size for mapping");
+    }
+    len = static_cast<size_t>(st.st_size);
+
+    void * addr = ::mmap(nullptr, len, PROT_READ, MAP_SHARED, fd, 0);
+    // NOTE: the mapping stays valid after closing the file descriptor
+    ::close(fd);
+    if(addr == MAP_FAILED) {
+        logerror << "Could not mmap '" << file << "' (" << len << " bytes)" << endl;
+        throw std::runtime_error("Could not mmap file");
+    }
+    ptr = static_cast<unsigned char *>(addr);
+
+#ifdef MADV_HUGEPAGE
+    if(hugePages && ::madvise(addr, len, MADV_HUGEPAGE) != 0) {
+        logwarn << "Kernel declined huge pages for '" << file << "', using regular pages" << endl;
+    }
+#else
+    if(hugePages) {
+        logwarn << "Huge pages are not supported on this platform, using regular pages" << endl;
+    }
+#endif
+}
+
+void MappedFile::prefetch(const void * addr, size_t count) const {
+    // madvise() needs a page-aligned address
+    size_t pageSize = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    size_t off = static_cast<size_t>(static_cast<const unsigned char *>(addr) - ptr);
+    size_t alignedOff = off / pageSize * pageSize;
+    assertLessThanOrEqual(off + count, len);
+
+    if(::madvise(ptr + alignedOff, off + count - alignedOff, MADV_WILLNEED) != 0) {
+        logwarn << "madvise(MADV_WILLNEED) failed, pages will be read in on demand" << endl;
+    }
+}
+
+void MappedFile::adviseSequential() const {
+    if(::madvise(ptr, len, MADV_SEQUENTIAL) != 0) {
+        logwarn << "madvise(MADV_SEQUENTIAL) failed, pages will be read in with the default read-ahead" << endl;
+    }
+}
+
+MappedFile::~MappedFile() {
+    if(ptr != nullptr)
+        ::munmap(ptr, len);
+}
+
+} // end of namespace libaad
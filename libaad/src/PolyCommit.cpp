@@ -1,58 +1,206 @@
 #include <aad/Configuration.h>
 
+#include <aad/Endomorphism.h>
 #include <aad/PolyCommit.h>
 #include <aad/PublicParameters.h>
+#include <aad/Scheduler.h>
 
 #include <xutils/Log.h>
 #include <xutils/Timer.h>
 
 #include <libff/algebra/scalar_multiplication/multiexp.hpp>
 
+#include <algorithm>
 #include <thread>
 
 using namespace std;
 
 namespace libaad {
 
+/**
+ * Multi-exponentiations are split into chunks of at least this many bases, which are computed in parallel.
+ */
+static const size_t multiExpMinChunkSize = 256;
+
+/**
+ * Multi-exponentiations with more bases than this use our own Pippenger (see pippengerMultiExp()) rather than libff's
+ * Bos-Coster.
+ */
+static const long multiExpPippengerThreshold = 16384;
+
+/**
+ * Calls libff's single-threaded multi-exponentiation on a range of bases and exponents. libff only takes std::vector
+ * iterators, so we copy the range into vectors. We only do this for small ranges (see multiExp()), where the copy is
+ * negligible next to the multi-exponentiation itself.
+ */
+template<class Group, libff::multi_exp_method Method>
+static Group libffMultiExp(const Group * base_begin, const Group * base_end, const Fr * exp_begin, const Fr * exp_end) {
+    std::vector<Group> bases(base_begin, base_end);
+    std::vector<Fr> exps(exp_begin, exp_end);
+    return libff::multi_exp<Group, Fr, Method>(bases.cbegin(), bases.cend(), exps.cbegin(), exps.cend(), 1);
+}
+
+/**
+ * Single-threaded Pippenger (bucket) multi-exponentiation, like libff's BDLO12, but straight over the bases in memory,
+ * which might be large and live in a memory-mapped file (see PublicParameters), so we do not copy them.
+ *
+ * Splits every exponent into c-bit windows. For each window, from the most significant one down, adds every base to
+ * the bucket of its exponent's window value b and then sums up \sum_b b * bucket_b with a running sum, in 2^{c+1}
+ * additions.
+ */
+template<class Group>
+static Group pippengerMultiExp(const Group * bases, const Fr * exps, size_t n) {
+    using BigInt = decltype(exps[0].as_bigint());
+
+    std::vector<BigInt> scalars(n);
+    size_t numBits = 0;
+    for(size_t i = 0; i < n; i++) {
+        scalars[i] = exps[i].as_bigint();
+        numBits = std::max(numBits, scalars[i].num_bits());
+    }
+    if(numBits == 0)
+        return Group::zero();
+
+    // the same window size as libff's BDLO12
+    size_t logN = 0;
+    while((size_t(1) << (logN + 1)) <= n)
+        logN++;
+    size_t c = logN + 2 - logN / 3;
+    size_t numWindows = (numBits + c - 1) / c;
+
+    std::vector<Group> buckets(size_t(1) << c);
+    std::vector<bool> used(buckets.size());
+    Group result = Group::zero();
+    for(size_t w = numWindows; w-- > 0;) {
+        for(size_t j = 0; j < c; j++)
+            result = result.dbl();
+
+        std::fill(used.begin(), used.end(), false);
+        for(size_t i = 0; i < n; i++) {
+            size_t b = 0;
+            for(size_t j = c; j-- > 0;) {
+                size_t bit = w * c + j;
+                b = (b << 1) | (bit < numBits && scalars[i].test_bit(bit) ? 1 : 0);
+            }
+            if(b == 0)
+                continue;
+
+            buckets[b] = used[b] ? buckets[b] + bases[i] : bases[i];
+            used[b] = true;
+        }
+
+        // running = \sum_{b' >= b} bucket_b', so adding it up for every b gives \sum_b b * bucket_b
+        Group running = Group::zero(), sum = Group::zero();
+        for(size_t b = buckets.size(); b-- > 1;) {
+            if(used[b])
+                running = running + buckets[b];
+            sum = sum + running;
+        }
+        result = result + sum;
+    }
+    return result;
+}
+
+/**
+ * Returns a pointer to the element at 'it' (or nullptr for an empty range), so we can hand vector ranges to the
+ * pointer versions of multiExp() and multiExpEndo().
+ */
+template<class T>
+static const T * toPointer(typename std::vector<T>::const_iterator it, typename std::vector<T>::const_iterator end) {
+    return it == end ? nullptr : &*it;
+}
+
 template<class Group>
 Group multiExp(
-    typename std::vector<Group>::const_iterator base_begin, 
-    typename std::vector<Group>::const_iterator base_end, 
-    typename std::vector<Fr>::const_iterator exp_begin,
-    typename std::vector<Fr>::const_iterator exp_end
+    const Group * base_begin,
+    const Group * base_end,
+    const Fr * exp_begin,
+    const Fr * exp_end,
+    size_t numThreads
     )
 {
     long sz = base_end - base_begin;
     long expsz = exp_end - exp_begin;
     assertEqual(sz, expsz);
-    size_t numCores = getNumCores();
+    size_t numCores = numThreads == 0 ? Scheduler::get().getNumThreads() : numThreads;
+
+    if(sz <= 4) {
+        return libffMultiExp<Group, libff::multi_exp_method_naive>(base_begin, base_end, exp_begin, exp_end);
+    }
 
-    if(sz > 4) {
-        if(sz > 16384) {
-            return libff::multi_exp<Group, Fr, libff::multi_exp_method_BDLO12>(base_begin, base_end,
-                exp_begin, exp_end, numCores);
+    // NOTE: Rather than letting libff split the multi-exponentiation into chunks and run them on its own OpenMP
+    // threads, we split it into chunks ourselves and run them on the scheduler's threads, like all other parallel work.
+    size_t numChunks = std::min(numCores, std::max<size_t>(1, static_cast<size_t>(sz) / multiExpMinChunkSize));
+    auto chunkMultiExp = [&](size_t c) {
+        long chunkSz = sz / static_cast<long>(numChunks);
+        long beg = static_cast<long>(c) * chunkSz;
+        long end = c + 1 == numChunks ? sz : beg + chunkSz;
+        if(sz > multiExpPippengerThreshold) {
+            return pippengerMultiExp<Group>(base_begin + beg, exp_begin + beg, static_cast<size_t>(end - beg));
         } else {
-            return libff::multi_exp<Group, Fr, libff::multi_exp_method_bos_coster>(base_begin, base_end,
-                exp_begin, exp_end, numCores);
+            return libffMultiExp<Group, libff::multi_exp_method_bos_coster>(base_begin + beg, base_begin + end,
+                exp_begin + beg, exp_begin + end);
         }
-    } else {
-        return libff::multi_exp<Group, Fr, libff::multi_exp_method_naive>(base_begin, base_end,
-            exp_begin, exp_end, 1);
-    }
+    };
+
+    if(numChunks == 1)
+        return chunkMultiExp(0);
+
+    std::vector<Group> partial(numChunks);
+    Scheduler::parallelFor(0, numChunks, [&](size_t c) {
+        partial[c] = chunkMultiExp(c);
+    });
+
+    Group result = Group::zero();
+    for(auto& p : partial)
+        result = result + p;
+    return result;
+}
+
+template G1 multiExp<G1>(
+    const G1 * base_begin,
+    const G1 * base_end,
+    const Fr * exp_begin,
+    const Fr * exp_end,
+    size_t numThreads
+);
+
+template G2 multiExp<G2>(
+    const G2 * base_begin,
+    const G2 * base_end,
+    const Fr * exp_begin,
+    const Fr * exp_end,
+    size_t numThreads
+);
+
+template<class Group>
+Group multiExp(
+    typename std::vector<Group>::const_iterator base_begin, 
+    typename std::vector<Group>::const_iterator base_end, 
+    typename std::vector<Fr>::const_iterator exp_begin,
+    typename std::vector<Fr>::const_iterator exp_end,
+    size_t numThreads
+    )
+{
+    auto bases = toPointer<Group>(base_begin, base_end);
+    auto exps = toPointer<Fr>(exp_begin, exp_end);
+    return multiExp<Group>(bases, bases + (base_end - base_begin), exps, exps + (exp_end - exp_begin), numThreads);
 }
 
 template G1 multiExp<G1>(
     std::vector<G1>::const_iterator base_begin,
     std::vector<G1>::const_iterator base_end, 
     std::vector<Fr>::const_iterator exp_begin,
-    std::vector<Fr>::const_iterator exp_end
+    std::vector<Fr>::const_iterator exp_end,
+    size_t numThreads
 );
 
 template G2 multiExp<G2>(
     std::vector<G2>::const_iterator base_begin,
     std::vector<G2>::const_iterator base_end, 
     std::vector<Fr>::const_iterator exp_begin,
-    std::vector<Fr>::const_iterator exp_end
+    std::vector<Fr>::const_iterator exp_end,
+    size_t numThreads
 );
 
 template<class Group>
@@ -75,6 +223,102 @@ template G2 multiExp(
     const std::vector<Fr>& exps
 );
 
+template<class Group>
+Group multiExpEndo(
+    const Group * base_begin,
+    const Group * base_end,
+    const Group * endo_begin,
+    const Fr * exp_begin,
+    const Fr * exp_end,
+    size_t numThreads
+    )
+{
+    // NOTE: for a handful of bases, splitting the exponents is not worth it
+    if(base_end - base_begin <= 4 || !Endomorphism::has<Group>())
+        return multiExp<Group>(base_begin, base_end, exp_begin, exp_end, numThreads);
+
+    std::vector<Group> bases;
+    std::vector<Fr> exps;
+    Endomorphism::split<Group>(base_begin, base_end, exp_begin, exp_end, bases, exps, endo_begin);
+    return multiExp<Group>(bases.data(), bases.data() + bases.size(), exps.data(), exps.data() + exps.size(), numThreads);
+}
+
+template G1 multiExpEndo<G1>(
+    const G1 * base_begin,
+    const G1 * base_end,
+    const G1 * endo_begin,
+    const Fr * exp_begin,
+    const Fr * exp_end,
+    size_t numThreads
+);
+
+template G2 multiExpEndo<G2>(
+    const G2 * base_begin,
+    const G2 * base_end,
+    const G2 * endo_begin,
+    const Fr * exp_begin,
+    const Fr * exp_end,
+    size_t numThreads
+);
+
+template<class Group>
+Group multiExpEndo(
+    const Group * base_begin,
+    const Group * base_end,
+    const Fr * exp_begin,
+    const Fr * exp_end,
+    size_t numThreads
+    )
+{
+    return multiExpEndo<Group>(base_begin, base_end, nullptr, exp_begin, exp_end, numThreads);
+}
+
+template G1 multiExpEndo<G1>(
+    const G1 * base_begin,
+    const G1 * base_end,
+    const Fr * exp_begin,
+    const Fr * exp_end,
+    size_t numThreads
+);
+
+template G2 multiExpEndo<G2>(
+    const G2 * base_begin,
+    const G2 * base_end,
+    const Fr * exp_begin,
+    const Fr * exp_end,
+    size_t numThreads
+);
+
+template<class Group>
+Group multiExpEndo(
+    typename std::vector<Group>::const_iterator base_begin,
+    typename std::vector<Group>::const_iterator base_end,
+    typename std::vector<Fr>::const_iterator exp_begin,
+    typename std::vector<Fr>::const_iterator exp_end,
+    size_t numThreads
+    )
+{
+    auto bases = toPointer<Group>(base_begin, base_end);
+    auto exps = toPointer<Fr>(exp_begin, exp_end);
+    return multiExpEndo<Group>(bases, bases + (base_end - base_begin), exps, exps + (exp_end - exp_begin), numThreads);
+}
+
+template G1 multiExpEndo<G1>(
+    std::vector<G1>::const_iterator base_begin,
+    std::vector<G1>::const_iterator base_end,
+    std::vector<Fr>::const_iterator exp_begin,
+    std::vector<Fr>::const_iterator exp_end,
+    size_t numThreads
+);
+
+template G2 multiExpEndo<G2>(
+    std::vector<G2>::const_iterator base_begin,
+    std::vector<G2>::const_iterator base_end,
+    std::vector<Fr>::const_iterator exp_begin,
+    std::vector<Fr>::const_iterator exp_end,
+    size_t numThreads
+);
+
 size_t getNumCores() {
     static size_t numCores = std::thread::hardware_concurrency();
     if(numCores == 0)
@@ -82,6 +326,83 @@ size_t getNumCores() {
     return numCores;
 }
 
+bool PolyCommit::useEndomorphisms = false;
+
+template<class Group>
+Group PolyCommit::commit(const Group * bases, const vector<Fr>& poly, size_t numThreads, const Group * endoBases)
+{
+    // NOTE: our bases might live in a memory-mapped file, so we use the pointer versions of multiExp() and multiExpEndo()
+    const Fr * exps = poly.data();
+    if(useEndomorphisms)
+        return multiExpEndo<Group>(bases, bases + poly.size(), endoBases, exps, exps + poly.size(), numThreads);
+    else
+        return multiExp<Group>(bases, bases + poly.size(), exps, exps + poly.size(), numThreads);
+}
+
+/**
+ * Polynomials with at least this many coefficients are committed to one at a time, using all cores. Smaller ones are
+ * committed to in parallel, one per core.
+ */
+static const size_t batchParallelThreshold = 16384;
+
+template<class Group>
+void PolyCommit::commitBatch(
+    const PublicParameters& pp,
+    const vector<const Group*>& bases,
+    const vector<const vector<Fr>*>& polys,
+    vector<Group>& comms)
+{
+    assertEqual(bases.size(), polys.size());
+    comms.resize(polys.size());
+
+    std::vector<size_t> small;
+    for(size_t i = 0; i < polys.size(); i++) {
+        if(polys[i]->size() >= batchParallelThreshold) {
+            comms[i] = commit<Group>(bases[i], *polys[i], 0, pp.getEndomorphisms(bases[i]));
+        } else {
+            small.push_back(i);
+        }
+    }
+
+    // Hand out the largest polynomials first, so no core is left with a large one at the end
+    std::sort(small.begin(), small.end(), [&polys](size_t a, size_t b) {
+        return polys[a]->size() > polys[b]->size();
+    });
+
+    Scheduler::parallelFor(0, small.size(), [&](size_t j) {
+        size_t i = small[j];
+        comms[i] = commit<Group>(bases[i], *polys[i], 1, pp.getEndomorphisms(bases[i]));
+    });
+}
+
+void PolyCommit::commitG1Batch(const PublicParameters& pp, const vector<const vector<Fr>*>& polys,
+    const vector<bool>& isExtractable, vector<G1>& comms)
+{
+    assertEqual(polys.size(), isExtractable.size());
+    vector<const G1*> bases;
+    bases.reserve(polys.size());
+    for(size_t i = 0; i < polys.size(); i++) {
+        checkDegree(pp, *polys[i]);
+        bases.push_back(isExtractable[i] ? pp.g1tausi.data() : pp.g1si.data());
+    }
+
+    commitBatch<G1>(pp, bases, polys, comms);
+}
+
+void PolyCommit::commitG1Batch(const PublicParameters& pp, const vector<const vector<Fr>*>& polys,
+    bool isExtractable, vector<G1>& comms)
+{
+    commitG1Batch(pp, polys, vector<bool>(polys.size(), isExtractable), comms);
+}
+
+void PolyCommit::commitG2Batch(const PublicParameters& pp, const vector<const vector<Fr>*>& polys, vector<G2>& comms)
+{
+    for(auto p : polys)
+        checkDegree(pp, *p);
+
+    commitBatch<G2>(pp, vector<const G2*>(polys.size(), pp.g2si.data()), polys, comms);
+}
+
 void PolyCommit::checkDegree(const PublicParameters& pp, const vector<Fr>& poly) {
     // e.g., p(x) = (x-1)(x-3)(x-5)(x-2) with degree 4 and 5 coefficients but q = 3 (i.e., g, g^s, g^{s^2} and g^{s^3})
     assertStrictlyPositive(poly.size());
@@ -90,6 +411,10 @@ void PolyCommit::checkDegree(const PublicParameters& pp, const vector<Fr>& poly)
         logerror << "Poly has " << poly.size() << " coefficients but we only have q = " << pp.q << " PKE parameters" << endl;
         throw std::runtime_error("Do not have enough q-PKE parameters");
     }
+
+    if(useEndomorphisms)
+        pp.precomputeEndomorphisms();
+    pp.ensureDegree(degree);
 }
 
 G1 PolyCommit::commitG1(const PublicParameters& pp, const vector<Fr>& poly, bool isExtractable)
@@ -101,15 +426,9 @@ G1 PolyCommit::commitG1(const PublicParameters& pp, const vector<Fr>& poly, bool
     //    logperf << (isExtractable ? "Extractable" : "Non-extract.");
     //    ScopedTimer<std::chrono::milliseconds> t1(std::cout, " commitG1 took ");
         if(isExtractable) {
-            auto g1tausi_start = pp.g1tausi.cbegin();
-            auto g1tausi_end = g1tausi_start + static_cast<long>(poly.size());
-            g1comm = multiExp<G1>(g1tausi_start, g1tausi_end, 
-                poly.cbegin(), poly.cend());
+            g1comm = commit<G1>(pp.g1tausi.data(), poly, 0, pp.getEndomorphisms(pp.g1tausi.data()));
         } else {
-            auto g1si_start = pp.g1si.cbegin();
-            auto g1si_end = g1si_start + static_cast<long>(poly.size());
-            g1comm = multiExp<G1>(g1si_start, g1si_end, 
-                poly.cbegin(), poly.cend());
+            g1comm = commit<G1>(pp.g1si.data(), poly, 0, pp.getEndomorphisms(pp.g1si.data()));
         }
     //}
     //std::cout << std::flush;
@@ -124,9 +443,7 @@ G2 PolyCommit::commitG2(const PublicParameters& pp, const vector<Fr>& poly, bool
     //{
     //    logperf << "Non-extract.";
     //    ScopedTimer<std::chrono::milliseconds> t1(std::cout, " commitG2 took ");
-        auto g2si_start = pp.g2si.cbegin();
-        auto g2si_end = g2si_start + static_cast<long>(poly.size());
-        g2comm = multiExp<G2>(g2si_start, g2si_end, poly.cbegin(), poly.cend());
+        g2comm = commit<G2>(pp.g2si.data(), poly, 0, pp.getEndomorphisms(pp.g2si.data()));
     //}
     //std::cout << std::flush;
 
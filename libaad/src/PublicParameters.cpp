@@ -1,10 +1,101 @@
 #include <aad/Configuration.h>
 
+#include <aad/Endomorphism.h>
+#include <aad/PolyCommit.h>
 #include <aad/PublicParameters.h>
+#include <aad/Scheduler.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include <libff/algebra/scalar_multiplication/multiexp.hpp>
 
 namespace libaad {
 
-PublicParameters::PublicParameters(const std::string& trapFile, int maxQ, bool progress, bool verify) {
+/**
+ * The header of a binary public parameters file (see PublicParameters::writeBinary()). The header is followed by the
+ * g1^{s^i}, g1^{\tau s^i} and g2^{s^i} arrays, each starting at a page-aligned offset.
+ */
+struct BinaryParamsHeader {
+    char magic[8];
+    uint64_t version;
+    uint64_t g1Size, g2Size;    // sizeof(G1) and sizeof(G2) on the machine that wrote the file
+    uint64_t q;                 // there are q+1 points in each array
+    uint64_t g1siOffset, g1tausiOffset, g2siOffset;
+};
+
+static const char BinaryParamsMagic[8] = { 'L', 'I', 'B', 'A', 'A', 'D', 'P', 'P' };
+static const uint64_t BinaryParamsVersion = 1;
+static const uint64_t BinaryParamsAlignment = 4096;
+
+/**
+ * Number of parameters computed (or converted to affine coordinates) at a time by one thread when generating them
+ * (or writing them out).
+ */
+static const size_t generateChunkSize = 1024;
+
+static uint64_t alignUp(uint64_t off) {
+    return (off + BinaryParamsAlignment - 1) / BinaryParamsAlignment * BinaryParamsAlignment;
+}
+
+PublicParameters::PublicParameters(const std::string& trapFile, int maxQ, bool progress, bool verify, int initialQ)
+    : trapFile(trapFile), progress(progress), verify(verify), numLoaded(0), g1siEndo(nullptr), g1tausiEndo(nullptr),
+      g2siEndo(nullptr), endoReady(false), textFileNo(0), textFileOffset(0)
+{
+    readTrapdoors(maxQ);
+
+    // make room for all parameters now, so loading more of them later never moves the ones already loaded
+    g1siVec.reserve(q+1);
+    g1tausiVec.reserve(q+1);
+    g2siVec.reserve(q+1);
+
+    // NOTE: reserve() allocated the vectors' storage, so data() already points to it
+    g1si = PointSpan<G1>(g1siVec.data(), q+1);
+    g1tausi = PointSpan<G1>(g1tausiVec.data(), q+1);
+    g2si = PointSpan<G2>(g2siVec.data(), q+1);
+
+    size_t initial = initialQ < 0 ? q : std::min(q, static_cast<size_t>(initialQ));
+    load(initial + 1);
+}
+
+PublicParameters::PublicParameters(const std::string& trapFile, const std::string& binFile, int maxQ, bool progress,
+    bool verify, bool hugePages, int initialQ)
+    : trapFile(trapFile), progress(progress), verify(verify), numLoaded(0), g1siEndo(nullptr), g1tausiEndo(nullptr),
+      g2siEndo(nullptr), endoReady(false), textFileNo(0), textFileOffset(0)
+{
+    readTrapdoors(maxQ);
+    mapBinary(binFile, hugePages);
+
+    size_t initial = initialQ < 0 ? q : std::min(q, static_cast<size_t>(initialQ));
+    load(initial + 1);
+}
+
+std::unique_ptr<PublicParameters> PublicParameters::fromBinary(const std::string& trapFile, const std::string& binFile,
+    int maxQ, bool progress, bool verify, bool hugePages, int initialQ)
+{
+    return std::unique_ptr<PublicParameters>(new PublicParameters(trapFile, binFile, maxQ, progress, verify, hugePages, initialQ));
+}
+
+std::unique_ptr<PublicParameters> PublicParameters::open(const std::string& trapFile, int maxQ, bool progress,
+    bool verify, int initialQ, bool hugePages)
+{
+    std::string binFile = getBinaryFile(trapFile);
+    if(ifstream(binFile).good()) {
+        try {
+            return fromBinary(trapFile, binFile, maxQ, progress, verify, hugePages, initialQ);
+        } catch(const std::runtime_error& e) {
+            // e.g., the file was written for a smaller q or on a different architecture
+            logwarn << "Could not map '" << binFile << "' (" << e.what() << "), reading the text files instead" << endl;
+        }
+    }
+
+    return std::unique_ptr<PublicParameters>(new PublicParameters(trapFile, maxQ, progress, verify, initialQ));
+}
+
+void PublicParameters::readTrapdoors(int maxQ) {
     ifstream tin(trapFile);
     if(tin.fail()) {
         throw std::runtime_error("Could not open trapdoor file for reading");
@@ -29,95 +120,390 @@ PublicParameters::PublicParameters(const std::string& trapFile, int maxQ, bool p
         throw std::runtime_error("Error reading full trapdoor file");
     }
     testAssertEqual(g2tau, tau * G2::one());
+    g2tauPrepared = PrepareG2(g2tau);
     
     tin.close();
 
     q = maxQ <= 0 ? q : static_cast<size_t>(maxQ);
-    resize(q);
-        
+}
+
+void PublicParameters::ensureDegree(size_t degree) const {
+    if(degree < numLoaded)
+        return;
+
+    if(degree > q) {
+        logerror << "Need g^{s^" << degree << "} but we only have q = " << q << " PKE parameters" << endl;
+        throw std::runtime_error("Do not have enough q-PKE parameters");
+    }
+
+    // NOTE: load() waits for its parallel jobs without running other jobs on this thread (see TaskGroup), since those
+    // could call ensureDegree() too (e.g., two commitments of a merge's task graph) and lock loadMutex again
+    std::lock_guard<std::mutex> lock(loadMutex);
+    load(std::min(q + 1, std::max(degree + 1, 2 * numLoaded)));
+}
+
+void PublicParameters::load(size_t end) const {
+    size_t begin = numLoaded;
+    if(end <= begin)
+        return;
+
+    if(progress)
+        loginfo << "Loading q-PKE parameters [" << begin << ", " << end << ") out of " << q+1 << " ..." << endl;
+
+    if(mapped == nullptr) {
+        readText(begin, end);
+    } else {
+        // the OS pages them in anyway, but this way it does so with fewer, larger reads
+        mapped->prefetch(g1si.data() + begin, (end - begin) * sizeof(G1));
+        mapped->prefetch(g1tausi.data() + begin, (end - begin) * sizeof(G1));
+        mapped->prefetch(g2si.data() + begin, (end - begin) * sizeof(G2));
+    }
+
+    // Always check the first and last parameters, which catches files generated for different trapdoors
+    if(begin == 0)
+        checkPower(0, Fr::one(), tau);
+    checkPower(end - 1, s ^ (end - 1), tau * (s ^ (end - 1)));
+
+    if(verify) {
+        verifyBatched(begin, end);
+    }
+
+    if(endoReady) {
+        computeEndomorphisms(begin, end);
+    }
+
+    // NOTE: only now can other threads use the new parameters
+    numLoaded = end;
+}
+
+void PublicParameters::checkPower(size_t i, const Fr& si, const Fr& tausi) const {
     G1 g1 = G1::one();
     G2 g2 = G2::one();
-    Fr si = Fr::one();  // will store s^i
-    Fr tausi = tau;     // will store \tau s^i
 
-    size_t i = 0;
-    int iter = 0;
-    G1 tmpG1si;
-    int prevPct = -1;
-    while(i <= q) {
-        std::string inFile = trapFile + "-" + std::to_string(iter);
-        loginfo << q - i << " params left to read, looking at " << inFile << " ..." << endl;
-        ifstream fin(inFile);
+    testAssertEqual(g1si[i], si*g1);
+    testAssertEqual(g1tausi[i], tausi*g1);
+    testAssertEqual(ReducedPairing(g1si[i], g2tauPrepared), ReducedPairing(g1tausi[i], getPreparedG2()));
+    testAssertEqual(g2si[i], si*g2);
+    //testAssertEqual(g2tausi[i], tausi*g2);
+}
 
-        if(fin.fail()) {
-            throw std::runtime_error("Could not open public parameters file for reading");
+/**
+ * Scans a '<trapFile>-<i>' file, which has three lines per parameter, from byte offset 'start' until it has seen
+ * 'maxParams' parameters. Returns the number of parameters seen and, in 'offsets', the byte offset of every
+ * 'chunkSize'-th parameter (starting with 'start'). 'end' is set to the byte offset right after the last one seen.
+ */
+static size_t indexParamsFile(const std::string& file, std::streamoff start, size_t maxParams, size_t chunkSize,
+    std::vector<std::streamoff>& offsets, std::streamoff& end)
+{
+    ifstream fin(file, std::ios::binary);
+    if(fin.fail()) {
+        logerror << "Could not open '" << file << "' for reading" << endl;
+        throw std::runtime_error("Could not open public parameters file for reading");
+    }
+    fin.seekg(start);
+
+    std::vector<char> buf(1024*1024);
+    size_t lines = 0;
+    std::streamoff pos = start;
+    offsets.push_back(start);
+    end = start;
+    while(lines < 3*maxParams && (fin.read(buf.data(), static_cast<std::streamsize>(buf.size())) || fin.gcount() > 0)) {
+        size_t n = static_cast<size_t>(fin.gcount());
+        for(size_t j = 0; j < n && lines < 3*maxParams; j++) {
+            if(buf[j] == '\n') {
+                lines++;
+                if(lines % 3 == 0)
+                    end = pos + static_cast<std::streamoff>(j) + 1;
+                if(lines % (3*chunkSize) == 0)
+                    offsets.push_back(end);
+            }
         }
-        
-        size_t line = 0;
-        while(i <= q) {
-            line++;
+        pos += static_cast<std::streamoff>(n);
+    }
 
-            fin >> tmpG1si;
-            if(fin.eof()) {
-                logdbg << "Reached end of '" << inFile << "' at line " << line << endl;
-                break;
+    if(lines % 3 != 0) {
+        logerror << "'" << file << "' has " << lines << " lines after byte " << start << ", which is not a multiple of 3" << endl;
+        throw std::runtime_error("Public parameters file is truncated");
+    }
+    return lines / 3;
+}
+
+/**
+ * Number of parameters parsed (or verified) at a time by one thread.
+ */
+static const size_t paramsChunkSize = 4096;
+
+void PublicParameters::readText(size_t begin, size_t end) const {
+    assertEqual(begin, numLoaded.load());
+
+    // NOTE: the vectors have room for all parameters, so this does not move the ones other threads might be using
+    assertLessThanOrEqual(end, g1siVec.capacity());
+    g1siVec.resize(end);
+    g1tausiVec.resize(end);
+    g2siVec.resize(end);
+
+    // A chunk of consecutive parameters in one of the files
+    struct Chunk {
+        std::string file;
+        std::streamoff offset;
+        size_t first, last;     // parameters [first, last)
+    };
+
+    // we pick up where the previous call stopped (i.e., at parameter 'begin'), rather than scan the files from the start
+    std::vector<Chunk> chunks;
+    size_t numParams = begin, fileNo = textFileNo;
+    std::streamoff fileOffset = textFileOffset;
+    while(numParams < end) {
+        std::string inFile = trapFile + "-" + std::to_string(fileNo);
+
+        std::vector<std::streamoff> offsets;
+        std::streamoff fileEnd;
+        size_t count = indexParamsFile(inFile, fileOffset, end - numParams, paramsChunkSize, offsets, fileEnd);
+        if(count == 0) {
+            if(fileOffset == 0) {
+                throw std::runtime_error("Did not read all parameters.");
             }
 
-            g1si[i] = tmpG1si;
+            // we already read this file to its end, so the next parameters are in the next file
+            fileNo++;
+            fileOffset = 0;
+            continue;
+        }
+
+        for(size_t c = 0; c * paramsChunkSize < count; c++) {
+            size_t first = numParams + c * paramsChunkSize;
+            size_t last = std::min(first + paramsChunkSize, numParams + count);
+            chunks.push_back(Chunk{inFile, offsets[c], first, last});
+        }
+        numParams += count;
+        fileOffset = fileEnd;
+    }
+    assertEqual(numParams, end);
+
+    std::atomic<size_t> chunksDone(0);
+    Scheduler::parallelFor(0, chunks.size(), [&](size_t c) {
+        const Chunk& chunk = chunks[c];
+        ifstream fin(chunk.file);
+        fin.seekg(chunk.offset);
+
+        for(size_t i = chunk.first; i < chunk.last; i++) {
+            fin >> g1siVec[i];
             libff::consume_OUTPUT_NEWLINE(fin);
-            fin >> g1tausi[i];
+            fin >> g1tausiVec[i];
             libff::consume_OUTPUT_NEWLINE(fin);
-            fin >> g2si[i];
+            fin >> g2siVec[i];
             libff::consume_OUTPUT_NEWLINE(fin);
             //fin >> g2tausi[i];
             //libff::consume_OUTPUT_NEWLINE(fin);
+        }
 
-            // Check what we're reading against trapdoors
+        if(fin.fail()) {
+            logerror << "Could not parse parameters [" << chunk.first << ", " << chunk.last << ") in " << chunk.file << endl;
+            throw std::runtime_error("Error reading public parameters file");
+        }
 
-            //logtrace << g1si[i] << endl;
-            //logtrace << si*g1 << endl << endl;
+        size_t done = ++chunksDone;
+        if(progress && (done * 10 / chunks.size() != (done - 1) * 10 / chunks.size())) {
+            loginfo << done * 100 / chunks.size() << "% ... (" << done << " out of " << chunks.size() << " chunks)" << endl;
+        }
+    }, 0, false);
 
-            // Fully verify the parameters, if verify is true
-            if(verify) {
-                testAssertEqual(g1si[i], si*g1);
-                testAssertEqual(g1tausi[i], tausi*g1);
-                testAssertEqual(ReducedPairing(g1si[i], g2tau), ReducedPairing(g1tausi[i], G2::one()));
-                testAssertEqual(g2si[i], si*g2);
-                //testAssertEqual(g2tausi[i], tausi*g2);
-            }
-        
-            if(progress) {
-                //int pct = static_cast<int>(static_cast<double>(c)/static_cast<double>(endExcl-startIncl) * 10000.0);
-                int pct = static_cast<int>(static_cast<double>(i)/static_cast<double>(q+1) * 100.0);
-                if(pct > prevPct) {
-                    //loginfo << pct/100.0 << "% ... (i = " << i << " out of " << endExcl-1 << ")" << endl;
-                    loginfo << pct << "% ... (i = " << i << " out of " << q+1 << ")" << endl;
-                    prevPct = pct;
-                    
-                    // Occasionally check the parameters
-                    testAssertEqual(g1si[i], si*g1);
-                    testAssertEqual(g1tausi[i], tausi*g1);
-                    testAssertEqual(ReducedPairing(g1si[i], g2tau), ReducedPairing(g1tausi[i], G2::one()));
-                    testAssertEqual(g2si[i], si*g2);
-                }
-            }
+    // only now, since the next call must not skip over parameters we failed to read
+    textFileNo = fileNo;
+    textFileOffset = fileOffset;
+}
 
-            si = si * s;
-            tausi = tausi * s;
-            i++;
+void PublicParameters::mapBinary(const std::string& binFile, bool hugePages) {
+    loginfo << "Mapping binary q-PKE parameters from " << binFile << " (huge pages = " << hugePages << ") ..." << endl;
+    mapped.reset(new MappedFile(binFile, hugePages));
 
+    if(mapped->size() < sizeof(BinaryParamsHeader)) {
+        throw std::runtime_error("Binary public parameters file is too small");
+    }
+    const BinaryParamsHeader& hdr = *reinterpret_cast<const BinaryParamsHeader*>(mapped->data());
+
+    if(std::memcmp(hdr.magic, BinaryParamsMagic, sizeof(BinaryParamsMagic)) != 0 || hdr.version != BinaryParamsVersion) {
+        throw std::runtime_error("Not a binary public parameters file (or unsupported version)");
+    }
+    if(hdr.g1Size != sizeof(G1) || hdr.g2Size != sizeof(G2)) {
+        logerror << "Binary public parameters have " << hdr.g1Size << "-byte G1 and " << hdr.g2Size 
+            << "-byte G2 points, but ours are " << sizeof(G1) << " and " << sizeof(G2) << " bytes" << endl;
+        throw std::runtime_error("Binary public parameters were written for a different curve or architecture");
+    }
+    if(hdr.q < q) {
+        logerror << "Binary public parameters only have q = " << hdr.q << " but we need q = " << q << endl;
+        throw std::runtime_error("Not enough parameters in binary public parameters file");
+    }
+
+    // NOTE: checked without computing offset + n*size, which could wrap around for a corrupted (or foreign) header
+    size_t n = static_cast<size_t>(hdr.q) + 1, size = mapped->size();
+    auto fits = [size, n](uint64_t offset, size_t pointSize) {
+        return offset <= size && n <= (size - offset) / pointSize;
+    };
+    if(hdr.q >= SIZE_MAX || !fits(hdr.g1siOffset, sizeof(G1)) || !fits(hdr.g1tausiOffset, sizeof(G1)) ||
+       !fits(hdr.g2siOffset, sizeof(G2)))
+    {
+        throw std::runtime_error("Binary public parameters file is truncated");
+    }
+
+    // NOTE: we only need the first q+1 points, even if the file has more, and we only load some of them for now
+    g1si = PointSpan<G1>(reinterpret_cast<const G1*>(mapped->data() + hdr.g1siOffset), q+1);
+    g1tausi = PointSpan<G1>(reinterpret_cast<const G1*>(mapped->data() + hdr.g1tausiOffset), q+1);
+    g2si = PointSpan<G2>(reinterpret_cast<const G2*>(mapped->data() + hdr.g2siOffset), q+1);
+}
+
+void PublicParameters::verifyBatched(size_t begin, size_t end) const {
+    size_t numChunks = (end - begin + paramsChunkSize - 1) / paramsChunkSize;
+
+    std::atomic<size_t> chunksDone(0);
+    Scheduler::parallelFor(0, numChunks, [&](size_t c) {
+        size_t first = begin + c * paramsChunkSize;
+        size_t last = std::min(first + paramsChunkSize, end);
+
+        std::vector<Fr> r(last - first);
+        Fr rho = Fr::zero();
+        Fr si = s ^ first;
+        for(auto& ri : r) {
+            ri = Fr::random_element();
+            rho += ri * si;
+            si *= s;
+        }
+
+        // one thread per chunk
+        G1 a = PolyCommit::commit<G1>(g1si.data() + first, r, 1);
+        G1 t = PolyCommit::commit<G1>(g1tausi.data() + first, r, 1);
+        G2 b = PolyCommit::commit<G2>(g2si.data() + first, r, 1);
+
+        if(a != rho * G1::one() || b != rho * G2::one() ||
+           ReducedPairing(a, g2tauPrepared) != ReducedPairing(t, getPreparedG2()))
+        {
+            logerror << "Public parameters [" << first << ", " << last << ") are wrong" << endl;
+            throw std::runtime_error("Public parameters did not verify");
         }
 
-        fin.close();
-        iter++; // move to the next file
+        size_t done = ++chunksDone;
+        if(progress && (done * 10 / numChunks != (done - 1) * 10 / numChunks)) {
+            loginfo << "Verified " << done * 100 / numChunks << "% ... (" << done << " out of " << numChunks << " chunks)" << endl;
+        }
+    }, 0, false);
+}
+
+void PublicParameters::precomputeEndomorphisms() const {
+    if(endoReady)
+        return;
+
+    std::lock_guard<std::mutex> lock(loadMutex);
+    if(endoReady)
+        return;
+
+    // make room for all images now, for the same reason as in the constructor
+    g1siEndoVec.reserve(q+1);
+    g1tausiEndoVec.reserve(q+1);
+    g2siEndoVec.reserve(q+1);
+    computeEndomorphisms(0, numLoaded);
+
+    // NOTE: a group without an endomorphism gets no images, so multiExpEndo() falls back to multiExp() for it
+    g1siEndo = Endomorphism::has<G1>() ? g1siEndoVec.data() : nullptr;
+    g1tausiEndo = Endomorphism::has<G1>() ? g1tausiEndoVec.data() : nullptr;
+    g2siEndo = Endomorphism::has<G2>() ? g2siEndoVec.data() : nullptr;
+    endoReady = true;
+}
+
+void PublicParameters::computeEndomorphisms(size_t begin, size_t end) const {
+    bool hasG1 = Endomorphism::has<G1>(), hasG2 = Endomorphism::has<G2>();
+    if(hasG1) {
+        assertLessThanOrEqual(end, g1siEndoVec.capacity());
+        g1siEndoVec.resize(end);
+        g1tausiEndoVec.resize(end);
+    }
+    if(hasG2) {
+        assertLessThanOrEqual(end, g2siEndoVec.capacity());
+        g2siEndoVec.resize(end);
     }
 
-    if(i < q) {
-        throw std::runtime_error("Did not read all parameters.");
+    // NOTE: like load(), does not run unrelated jobs while waiting, since we hold loadMutex
+    size_t numChunks = (end - begin + paramsChunkSize - 1) / paramsChunkSize;
+    Scheduler::parallelFor(0, numChunks, [&](size_t c) {
+        size_t first = begin + c * paramsChunkSize;
+        size_t last = std::min(first + paramsChunkSize, end);
+        for(size_t i = first; i < last; i++) {
+            if(hasG1) {
+                g1siEndoVec[i] = Endomorphism::apply(g1si[i]);
+                g1tausiEndoVec[i] = Endomorphism::apply(g1tausi[i]);
+            }
+            if(hasG2)
+                g2siEndoVec[i] = Endomorphism::apply(g2si[i]);
+        }
+    }, 0, false);
+}
+
+/**
+ * Creates a binary public parameters file for q+1 parameters and writes its header. The points are then written at
+ * their offsets in the file with writeBinaryPoints(), in any order.
+ */
+static BinaryParamsHeader createBinaryFile(ofstream& fout, const std::string& binFile, size_t q) {
+    fout.open(binFile, std::ios::binary | std::ios::trunc);
+    if(fout.fail()) {
+        throw std::runtime_error("Could not open binary public parameters file for writing");
     }
 
-    if(i != q+1) {
-        throw std::runtime_error("Expected to read exactly q parameters.");
+    uint64_t n = static_cast<uint64_t>(q) + 1;
+    BinaryParamsHeader hdr;
+    std::memset(&hdr, 0, sizeof(hdr));
+    std::memcpy(hdr.magic, BinaryParamsMagic, sizeof(BinaryParamsMagic));
+    hdr.version = BinaryParamsVersion;
+    hdr.g1Size = sizeof(G1);
+    hdr.g2Size = sizeof(G2);
+    hdr.q = q;
+    hdr.g1siOffset = alignUp(sizeof(hdr));
+    hdr.g1tausiOffset = alignUp(hdr.g1siOffset + n*sizeof(G1));
+    hdr.g2siOffset = alignUp(hdr.g1tausiOffset + n*sizeof(G1));
+
+    fout.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+    return hdr;
+}
+
+/**
+ * Writes 'count' points, which must be in affine coordinates, as the parameters starting at 'first' in the section at
+ * 'sectionOffset'. Any gap before them is left zeroed.
+ */
+template<class Group>
+static void writeBinaryPoints(ofstream& fout, uint64_t sectionOffset, size_t first, const Group * points, size_t count) {
+    fout.seekp(static_cast<std::streamoff>(sectionOffset + first * sizeof(Group)));
+    fout.write(reinterpret_cast<const char*>(points), static_cast<std::streamsize>(count * sizeof(Group)));
+}
+
+void PublicParameters::writeBinary(const std::string& binFile) const {
+    ensureDegree(q);
+
+    ofstream fout;
+    BinaryParamsHeader hdr = createBinaryFile(fout, binFile, q);
+
+    // Like generateBinary(), every round, each thread converts a few chunks of points to affine coordinates (so a point
+    // is the same no matter how we computed it) and then the main thread writes the round out in one go.
+    size_t roundSize = 4 * Scheduler::get().getNumThreads() * generateChunkSize;
+    auto writePoints = [&fout, roundSize](uint64_t sectionOffset, const auto& points) {
+        using Group = typename std::decay<decltype(points[0])>::type;
+        std::vector<Group> affine;
+        for(size_t first = 0; first < points.size(); first += roundSize) {
+            affine.assign(points.data() + first, points.data() + std::min(first + roundSize, points.size()));
+            size_t numChunks = (affine.size() + generateChunkSize - 1) / generateChunkSize;
+            Scheduler::parallelFor(0, numChunks, [&affine](size_t c) {
+                size_t last = std::min((c + 1) * generateChunkSize, affine.size());
+                for(size_t i = c * generateChunkSize; i < last; i++)
+                    affine[i].to_affine_coordinates();
+            });
+            writeBinaryPoints(fout, sectionOffset, first, affine.data(), affine.size());
+        }
+    };
+
+    writePoints(hdr.g1siOffset, g1si);
+    writePoints(hdr.g1tausiOffset, g1tausi);
+    writePoints(hdr.g2siOffset, g2si);
+
+    fout.close();
+    if(fout.fail()) {
+        throw std::runtime_error("Could not write binary public parameters file");
     }
 }
 
@@ -192,6 +578,50 @@ std::tuple<Fr, Fr> PublicParameters::generateTrapdoors(size_t q, const std::stri
     return std::make_tuple(s, tau);
 }
 
+/**
+ * Fixed-base window tables for g1, g1^tau and g2, so that computing a parameter only takes about one addition per
+ * window, rather than a full scalar multiplication.
+ */
+struct PowerTables {
+    size_t scalarSize, window;
+    libff::window_table<G1> g1, g1tau;
+    libff::window_table<G2> g2;
+
+    PowerTables(const Fr& tau, size_t numPowers)
+        : scalarSize(Fr::size_in_bits()),
+          window(libff::get_exp_window_size<G1>(numPowers))
+    {
+        g1 = libff::get_window_table(scalarSize, window, G1::one());
+        g1tau = libff::get_window_table(scalarSize, window, tau * G1::one());
+        g2 = libff::get_window_table(scalarSize, window, G2::one());
+    }
+
+    /**
+     * Computes the parameters [first, last) into the beginning of g1si, g1tausi and g2si, in affine coordinates.
+     */
+    void computePowers(const Fr& s, size_t first, size_t last, 
+        std::vector<G1>& g1si, std::vector<G1>& g1tausi, std::vector<G2>& g2si) const
+    {
+        size_t count = last - first;
+        g1si.resize(count);
+        g1tausi.resize(count);
+        g2si.resize(count);
+
+        Fr si = s ^ first;
+        for(size_t i = 0; i < count; i++) {
+            g1si[i] = libff::windowed_exp(scalarSize, window, g1, si);
+            g1tausi[i] = libff::windowed_exp(scalarSize, window, g1tau, si);
+            g2si[i] = libff::windowed_exp(scalarSize, window, g2, si);
+            si *= s;
+        }
+
+        // one field inversion per batch, rather than one per point
+        G1::batch_to_special_all_non_zeros(g1si);
+        G1::batch_to_special_all_non_zeros(g1tausi);
+        G2::batch_to_special_all_non_zeros(g2si);
+    }
+};
+
 void PublicParameters::generate(size_t startIncl, size_t endExcl, const Fr& s, const Fr& tau, const std::string& outFile, bool progress)
 {
     if(startIncl >= endExcl) {
@@ -205,45 +635,87 @@ void PublicParameters::generate(size_t startIncl, size_t endExcl, const Fr& s, c
         throw std::runtime_error("Could not open public parameters file for writing");
     }
 
-    G1 g1tau = tau * G1::one();
+    PowerTables tables(tau, endExcl - startIncl);
 
     //logdbg << "i \\in [" << startIncl << ", " << endExcl << "), s = " << s << ", tau = " << tau << endl;
 
-    // generate and write g1, g1^\tau, g2, g2^\tau 
-    Fr si = s ^ startIncl;
-
     // generate q-PKE powers and write to file
     int prevPct = -1;
-    size_t c = 0;
-    for (size_t i = startIncl; i < endExcl; i++) {
-        G1 g1si = si * G1::one();
-        G1 g1tausi = si * (g1tau);
-        G2 g2si = si * G2::one();
-        //G2 g2tausi = si * (tau * G2::one());
-
-        fout << g1si << "\n";
-        fout << g1tausi << "\n";
-        fout << g2si << "\n";
-        //fout << g2tausi << "\n";
-    
-        si *= s;
+    std::vector<G1> g1si, g1tausi;
+    std::vector<G2> g2si;
+    for (size_t first = startIncl; first < endExcl; first += generateChunkSize) {
+        size_t last = std::min(first + generateChunkSize, endExcl);
+        tables.computePowers(s, first, last, g1si, g1tausi, g2si);
+
+        for(size_t j = 0; j < last - first; j++) {
+            fout << g1si[j] << "\n";
+            fout << g1tausi[j] << "\n";
+            fout << g2si[j] << "\n";
+            //fout << g2tausi << "\n";
+        }
 
         if(progress) {
-            //int pct = static_cast<int>(static_cast<double>(c)/static_cast<double>(endExcl-startIncl) * 10000.0);
-            int pct = static_cast<int>(static_cast<double>(c)/static_cast<double>(endExcl-startIncl) * 100.0);
+            int pct = static_cast<int>(static_cast<double>(last - startIncl)/static_cast<double>(endExcl-startIncl) * 100.0);
             if(pct > prevPct) {
-                //loginfo << pct/100.0 << "% ... (i = " << i << " out of " << endExcl-1 << ")" << endl;
-                loginfo << pct << "% ... (i = " << i << " out of " << endExcl-1 << ")" << endl;
+                loginfo << pct << "% ... (i = " << last - 1 << " out of " << endExcl-1 << ")" << endl;
                 prevPct = pct;
                 
                 fout << std::flush;
             }
         }
-
-        c++;
     }
     
     fout.close();
 }
 
+void PublicParameters::generateBinary(size_t q, const Fr& s, const Fr& tau, const std::string& binFile, bool progress)
+{
+    size_t numThreads = Scheduler::get().getNumThreads();
+    loginfo << "Generating q = " << q << " parameters in " << binFile << " using " << numThreads << " threads ..." << endl;
+
+    ofstream fout;
+    BinaryParamsHeader hdr = createBinaryFile(fout, binFile, q);
+    PowerTables tables(tau, q + 1);
+
+    // Every round, each thread computes one chunk and then the main thread writes all of them out. This way, we only
+    // ever keep a few chunks in memory.
+    size_t numChunks = (q + 1 + generateChunkSize - 1) / generateChunkSize;
+    size_t chunksPerRound = 4 * numThreads;
+    std::vector<std::vector<G1>> g1si(chunksPerRound), g1tausi(chunksPerRound);
+    std::vector<std::vector<G2>> g2si(chunksPerRound);
+
+    int prevPct = -1;
+    for(size_t roundStart = 0; roundStart < numChunks; roundStart += chunksPerRound) {
+        size_t roundEnd = std::min(roundStart + chunksPerRound, numChunks);
+
+        Scheduler::parallelFor(roundStart, roundEnd, [&](size_t c) {
+            size_t first = c * generateChunkSize;
+            size_t last = std::min(first + generateChunkSize, q + 1);
+            size_t j = c - roundStart;
+            tables.computePowers(s, first, last, g1si[j], g1tausi[j], g2si[j]);
+        });
+
+        for(size_t c = roundStart; c < roundEnd; c++) {
+            size_t j = c - roundStart;
+            size_t first = c * generateChunkSize;
+            writeBinaryPoints(fout, hdr.g1siOffset, first, g1si[j].data(), g1si[j].size());
+            writeBinaryPoints(fout, hdr.g1tausiOffset, first, g1tausi[j].data(), g1tausi[j].size());
+            writeBinaryPoints(fout, hdr.g2siOffset, first, g2si[j].data(), g2si[j].size());
+        }
+
+        if(progress) {
+            int pct = static_cast<int>(static_cast<double>(roundEnd)/static_cast<double>(numChunks) * 100.0);
+            if(pct > prevPct) {
+                loginfo << pct << "% ... (" << std::min(roundEnd * generateChunkSize, q + 1) << " out of " << q+1 << ")" << endl;
+                prevPct = pct;
+            }
+        }
+    }
+
+    fout.close();
+    if(fout.fail()) {
+        throw std::runtime_error("Could not write binary public parameters file");
+    }
+}
+
 }
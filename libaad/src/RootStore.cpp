@@ -0,0 +1,48 @@
+#include <aad/Configuration.h>
+
+#include <aad/RootStore.h>
+
+#include <atomic>
+#include <cstdio>
+#include <stdexcept>
+
+#include <unistd.h>
+
+#include <xassert/XAssert.h>
+#include <xutils/Log.h>
+
+using namespace std;
+
+namespace libaad {
+
+const size_t RootStore::DefaultMinSpillBytes;
+
+RootStore::RootStore(const std::string& dir, size_t ramBudget, size_t minSpillBytes)
+    : dir(dir), ramBudget(ramBudget), minSpillBytes(minSpillBytes), numSpills(0), bytesSpilled(0)
+{
+}
+
+std::shared_ptr<MappedFile> RootStore::spill(const std::function<void(SnapshotWriter&)>& writeFunc) {
+    // several AADs (in several processes) can share the same directory
+    static std::atomic<uint64_t> nextFileNo(0);
+    std::string file = dir + "/aad-root-" + std::to_string(::getpid()) + "-" + std::to_string(nextFileNo++) + ".spill";
+
+    {
+        SnapshotWriter out(file);
+        writeFunc(out);
+        out.close();
+    }
+
+    std::shared_ptr<MappedFile> mapped(new MappedFile(file));
+    // the mapping keeps the file's contents around until it is unmapped
+    if(std::remove(file.c_str()) != 0) {
+        logwarn << "Could not unlink spill file '" << file << "', it will be left behind" << endl;
+    }
+    mapped->adviseSequential();
+
+    numSpills++;
+    bytesSpilled += mapped->size();
+    return mapped;
+}
+
+} // end of namespace libaad
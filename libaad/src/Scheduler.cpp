@@ -0,0 +1,364 @@
+#include <aad/Configuration.h>
+
+#include <aad/Library.h>
+#include <aad/PolyCommit.h>
+#include <aad/Scheduler.h>
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <NTL/ZZ_p.h>
+
+#include <xassert/XAssert.h>
+#include <xutils/Log.h>
+
+using namespace std;
+
+namespace libaad {
+
+// the scheduler (and worker index) of the current thread, if it is one of a scheduler's workers
+static thread_local Scheduler* tlsScheduler = nullptr;
+static thread_local size_t tlsWorkerIdx = 0;
+// the version of the library's NTL modulus installed on the current worker (see getNtlContextVersion())
+static thread_local int tlsNtlVersion = -1;
+
+// g_sched is only replaced under g_schedMutex, but get() reads it through g_schedPtr, without locking
+static std::mutex g_schedMutex;
+static std::unique_ptr<Scheduler> g_sched;
+static std::atomic<Scheduler*> g_schedPtr(nullptr);
+
+TaskGroup::TaskGroup(bool runOthers)
+    : sched(Scheduler::acquire()), pending(0), queued(0), runOthers(runOthers)
+{
+}
+
+TaskGroup::~TaskGroup() {
+    // NOTE: jobs refer to this group, so we cannot go away before they are done
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        waitForJobs(lock);
+    }
+    sched.numGroups--;
+}
+
+void TaskGroup::run(std::function<void()> func) {
+    pending++;
+    queued++;
+    sched.submit(Scheduler::Job{std::move(func), this});
+}
+
+void TaskGroup::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    waitForJobs(lock);
+
+    if(error != nullptr) {
+        auto e = error;
+        error = nullptr;
+        std::rethrow_exception(e);
+    }
+}
+
+void TaskGroup::waitForJobs(std::unique_lock<std::mutex>& lock) {
+    while(pending > 0) {
+        lock.unlock();
+        if(!sched.runOne(runOthers ? nullptr : this)) {
+            // Nothing to run, so we sleep until our jobs are done or there is something to run again (e.g., jobs
+            // submitted by the jobs we are waiting on). NOTE: we count ourselves as sleeping before we check, and
+            // submit() and done() count the job before they check for sleepers, so one of us sees the other.
+            std::unique_lock<std::mutex> waitLock(sched.waitMutex);
+            sched.numSleeping++;
+            sched.waitCv.wait(waitLock, [this] {
+                return pending == 0 || (runOthers ? sched.numQueued > 0 : queued > 0);
+            });
+            sched.numSleeping--;
+        }
+        lock.lock();
+    }
+}
+
+void TaskGroup::done(std::exception_ptr e) {
+    // NOTE: the group can be destroyed as soon as 'pending' reaches zero and we release the lock, after which we
+    // must not touch it
+    std::lock_guard<std::mutex> lock(mutex);
+    if(e != nullptr && error == nullptr)
+        error = e;
+    if(--pending == 0)
+        sched.notifyWaiters();
+}
+
+Scheduler::Scheduler(size_t numThreads, bool pinThreads)
+    : numThreads(numThreads == 0 ? getNumCores() : numThreads), pinThreads(pinThreads), numQueued(0), stopping(false),
+      numGroups(0), numSleeping(0)
+{
+    // the thread waiting on the jobs runs them too, so we need one less worker
+    for(size_t i = 0; i + 1 < this->numThreads; i++)
+        workers.emplace_back(new Worker());
+    for(size_t i = 0; i < workers.size(); i++)
+        workers[i]->thread = std::thread(&Scheduler::workerLoop, this, i);
+}
+
+Scheduler::~Scheduler() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+    for(auto& w : workers)
+        w->thread.join();
+}
+
+/**
+ * Returns the library-wide scheduler, creating it if there is none yet. Must be called with g_schedMutex held.
+ */
+static Scheduler& getLocked() {
+    if(g_sched == nullptr) {
+        g_sched.reset(new Scheduler());
+        g_schedPtr.store(g_sched.get(), std::memory_order_release);
+    }
+    return *g_sched;
+}
+
+Scheduler& Scheduler::get() {
+    Scheduler* sched = g_schedPtr.load(std::memory_order_acquire);
+    if(sched != nullptr)
+        return *sched;
+
+    std::lock_guard<std::mutex> lock(g_schedMutex);
+    return getLocked();
+}
+
+Scheduler& Scheduler::acquire() {
+    // NOTE: configure() checks 'numGroups' under the same lock, so it either sees our group or replaces the scheduler
+    // before we get it
+    std::lock_guard<std::mutex> lock(g_schedMutex);
+    Scheduler& sched = getLocked();
+    sched.numGroups++;
+    return sched;
+}
+
+void Scheduler::configure(size_t numThreads, bool pinThreads) {
+    std::lock_guard<std::mutex> lock(g_schedMutex);
+    if(g_sched != nullptr && g_sched->numGroups > 0)
+        throw std::logic_error("Cannot reconfigure the scheduler while jobs are running");
+
+    g_schedPtr.store(nullptr, std::memory_order_release);
+    g_sched.reset(nullptr);     // stops the old workers first
+    g_sched.reset(new Scheduler(numThreads, pinThreads));
+    g_schedPtr.store(g_sched.get(), std::memory_order_release);
+    loginfo << "Scheduler uses " << g_sched->getNumThreads() << " thread(s)" << (pinThreads ? " pinned to cores" : "") << endl;
+}
+
+void Scheduler::parallelFor(size_t begin, size_t end, const std::function<void(size_t)>& func, size_t maxParallelism,
+    bool runOthers)
+{
+    if(begin >= end)
+        return;
+
+    Scheduler& sched = get();
+    size_t n = std::min(maxParallelism == 0 ? sched.getNumThreads() : maxParallelism, end - begin);
+    if(n <= 1) {
+        for(size_t i = begin; i < end; i++)
+            func(i);
+        return;
+    }
+
+    std::atomic<size_t> next(begin);
+    std::atomic<bool> failed(false);
+    auto loop = [&]() {
+        try {
+            size_t i;
+            while(!failed && (i = next++) < end)
+                func(i);
+        } catch(...) {
+            failed = true;
+            throw;
+        }
+    };
+
+    TaskGroup group(runOthers);
+    for(size_t t = 1; t < n; t++)
+        group.run(loop);
+
+    std::exception_ptr error;
+    try {
+        loop();
+    } catch(...) {
+        error = std::current_exception();
+    }
+    group.wait();   // rethrows if any of the other threads threw
+
+    if(error != nullptr)
+        std::rethrow_exception(error);
+}
+
+void Scheduler::submit(Job&& job) {
+    numQueued++;
+    if(tlsScheduler == this) {
+        // jobs submitted by a worker go on its own deque, where it will likely run them itself
+        Worker& w = *workers[tlsWorkerIdx];
+        std::lock_guard<std::mutex> lock(w.mutex);
+        w.jobs.push_back(std::move(job));
+    } else {
+        std::lock_guard<std::mutex> lock(mutex);
+        shared.push_back(std::move(job));
+    }
+
+    // NOTE: taking the lock ensures a worker that just found no jobs is already waiting and gets notified
+    { std::lock_guard<std::mutex> lock(mutex); }
+    cv.notify_one();
+
+    notifyWaiters();
+}
+
+void Scheduler::notifyWaiters() {
+    if(numSleeping == 0)
+        return;
+
+    // NOTE: like in submit(), taking the lock ensures a waiter that just checked is already waiting and gets notified
+    { std::lock_guard<std::mutex> lock(waitMutex); }
+    waitCv.notify_all();
+}
+
+/**
+ * Takes a job of group 'only' (or any job, if null) from 'jobs', looking from the back or from the front first.
+ */
+template<class Job>
+static bool takeJob(std::deque<Job>& jobs, bool fromBack, const TaskGroup* only, Job& job) {
+    if(jobs.empty())
+        return false;
+
+    if(only == nullptr) {
+        if(fromBack) {
+            job = std::move(jobs.back());
+            jobs.pop_back();
+        } else {
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        return true;
+    }
+
+    auto matches = [only](const Job& j) { return j.group == only; };
+    typename std::deque<Job>::iterator it;
+    if(fromBack) {
+        auto rit = std::find_if(jobs.rbegin(), jobs.rend(), matches);
+        if(rit == jobs.rend())
+            return false;
+        it = std::prev(rit.base());
+    } else {
+        it = std::find_if(jobs.begin(), jobs.end(), matches);
+        if(it == jobs.end())
+            return false;
+    }
+    job = std::move(*it);
+    jobs.erase(it);
+    return true;
+}
+
+bool Scheduler::popJob(Job& job, const TaskGroup* only) {
+    if(numQueued == 0)
+        return false;
+
+    bool isWorker = tlsScheduler == this;
+
+    // first, take the most recent job from our own deque
+    if(isWorker) {
+        Worker& w = *workers[tlsWorkerIdx];
+        std::lock_guard<std::mutex> lock(w.mutex);
+        if(takeJob(w.jobs, true, only, job)) {
+            numQueued--;
+            job.group->queued--;
+            return true;
+        }
+    }
+
+    // then, take the oldest job submitted from outside
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(takeJob(shared, false, only, job)) {
+            numQueued--;
+            job.group->queued--;
+            return true;
+        }
+    }
+
+    // last, steal the oldest job of another worker
+    size_t start = isWorker ? tlsWorkerIdx + 1 : 0;
+    for(size_t k = 0; k < workers.size(); k++) {
+        size_t v = (start + k) % workers.size();
+        if(isWorker && v == tlsWorkerIdx)
+            continue;
+
+        Worker& w = *workers[v];
+        std::lock_guard<std::mutex> lock(w.mutex);
+        if(takeJob(w.jobs, false, only, job)) {
+            numQueued--;
+            job.group->queued--;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool Scheduler::runOne(const TaskGroup* only) {
+    Job job;
+    if(!popJob(job, only))
+        return false;
+
+    // Jobs run with the library's NTL modulus installed (e.g., for poly_divide_ntl() or eea_ntl()). Workers install it
+    // once (and again if initialize() is called again), but a waiting thread that helps out might have its own
+    // modulus, so we put that back after the job.
+    NTL::ZZ_pBak bak;
+    if(tlsScheduler == this) {
+        int version = getNtlContextVersion();
+        if(tlsNtlVersion != version) {
+            installNtlContext();
+            tlsNtlVersion = version;
+        }
+    } else {
+        bak.save();
+        installNtlContext();
+    }
+
+    std::exception_ptr e;
+    try {
+        job.func();
+    } catch(...) {
+        e = std::current_exception();
+    }
+    job.group->done(e);
+    return true;
+}
+
+void Scheduler::workerLoop(size_t idx) {
+    tlsScheduler = this;
+    tlsWorkerIdx = idx;
+
+#ifdef __linux__
+    if(pinThreads) {
+        // NOTE: leaves core 0 to the main thread
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET((idx + 1) % getNumCores(), &cpus);
+        if(pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0)
+            logwarn << "Could not pin scheduler worker #" << idx << " to a core" << endl;
+    }
+#endif
+
+    while(!stopping) {
+        if(runOne())
+            continue;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this] { return stopping || numQueued > 0; });
+    }
+}
+
+} // end of namespace libaad
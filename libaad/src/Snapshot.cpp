@@ -0,0 +1,213 @@
+#include <aad/Configuration.h>
+
+#include <aad/Snapshot.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <xassert/XAssert.h>
+#include <xutils/Log.h>
+
+using namespace std;
+
+namespace libaad {
+
+/**
+ * Polynomials are aligned to cache lines in the snapshot, which also satisfies Fr's alignment when mapped.
+ */
+static const size_t polyAlignment = 64;
+
+SnapshotWriter::SnapshotWriter(const std::string& file)
+    : file(file), tmpFile(file + ".tmp"), pos(0)
+{
+    fout.open(tmpFile, std::ios::binary | std::ios::trunc);
+    if(fout.fail()) {
+        logerror << "Could not open snapshot file '" << tmpFile << "' for writing" << endl;
+        throw std::runtime_error("Could not open snapshot file for writing");
+    }
+}
+
+SnapshotWriter::~SnapshotWriter() {
+    // if close() was not called (e.g., an exception was thrown while writing), discard the partial snapshot
+    if(fout.is_open()) {
+        fout.close();
+        std::remove(tmpFile.c_str());
+    }
+}
+
+void SnapshotWriter::writeBytes(const void * bytes, size_t count) {
+    fout.write(static_cast<const char *>(bytes), static_cast<std::streamsize>(count));
+    pos += count;
+}
+
+void SnapshotWriter::write(const std::string& str) {
+    write(static_cast<uint64_t>(str.size()));
+    writeBytes(str.data(), str.size());
+}
+
+void SnapshotWriter::write(const BitString& bs) {
+    write(static_cast<uint32_t>(bs.size()));
+
+    // packed 8 bits per byte, most significant bit first
+    std::vector<unsigned char> bytes((bs.size() + 7) / 8, 0);
+    for(size_t i = 0; i < bs.size(); i++) {
+        if(bs[i])
+            bytes[i / 8] = static_cast<unsigned char>(bytes[i / 8] | (0x80 >> (i % 8)));
+    }
+    writeBytes(bytes.data(), bytes.size());
+}
+
+void SnapshotWriter::write(const G1& g1) {
+    G1 p(g1);
+    p.to_affine_coordinates();
+    writeBytes(&p, sizeof(G1));
+}
+
+void SnapshotWriter::write(const G2& g2) {
+    G2 p(g2);
+    p.to_affine_coordinates();
+    writeBytes(&p, sizeof(G2));
+}
+
+void SnapshotWriter::writePoly(const Fr * coeffs, size_t count) {
+    write(static_cast<uint64_t>(count));
+    align(polyAlignment);
+    writeBytes(coeffs, count * sizeof(Fr));
+}
+
+void SnapshotWriter::align(size_t alignment) {
+    static const char zeros[polyAlignment] = { 0 };
+    assertLessThanOrEqual(alignment, polyAlignment);
+
+    size_t padding = static_cast<size_t>((alignment - pos % alignment) % alignment);
+    writeBytes(zeros, padding);
+}
+
+/**
+ * Makes sure the contents of 'path' (a file or a directory, whose fsync() persists the entries in it, e.g., a file
+ * renamed into it) reach the disk.
+ */
+static bool syncPath(const std::string& path, bool isDir) {
+    int fd = ::open(path.c_str(), O_RDONLY | (isDir ? O_DIRECTORY : 0));
+    if(fd < 0)
+        return false;
+
+    int rc;
+    do {
+        rc = ::fsync(fd);
+    } while(rc != 0 && errno == EINTR);
+    ::close(fd);
+    return rc == 0;
+}
+
+static std::string parentDir(const std::string& file) {
+    auto slash = file.find_last_of('/');
+    if(slash == std::string::npos)
+        return ".";
+    return slash == 0 ? "/" : file.substr(0, slash);
+}
+
+void SnapshotWriter::close() {
+    fout.close();
+    if(fout.fail()) {
+        std::remove(tmpFile.c_str());
+        logerror << "Could not write snapshot file '" << tmpFile << "'" << endl;
+        throw std::runtime_error("Could not write snapshot file");
+    }
+
+    // the snapshot must be on disk before it replaces the old one, or a crash could leave a partial snapshot behind
+    if(!syncPath(tmpFile, false)) {
+        std::remove(tmpFile.c_str());
+        logerror << "Could not sync snapshot file '" << tmpFile << "' (errno = " << errno << ")" << endl;
+        throw std::runtime_error("Could not sync snapshot file");
+    }
+
+    // NOTE: rename() is atomic and does not disturb existing mappings of the old 'file'
+    if(std::rename(tmpFile.c_str(), file.c_str()) != 0) {
+        std::remove(tmpFile.c_str());
+        logerror << "Could not move snapshot '" << tmpFile << "' to '" << file << "'" << endl;
+        throw std::runtime_error("Could not move snapshot file in place");
+    }
+
+    // the rename itself is only durable once the directory is synced
+    if(!syncPath(parentDir(file), true)) {
+        logerror << "Could not sync the directory of snapshot '" << file << "' (errno = " << errno << ")" << endl;
+        throw std::runtime_error("Could not sync snapshot directory");
+    }
+}
+
+SnapshotReader::SnapshotReader(const std::string& file)
+    : mapped(new MappedFile(file)), pos(0)
+{}
+
+SnapshotReader::SnapshotReader(const std::shared_ptr<MappedFile>& mapped, size_t pos)
+    : mapped(mapped), pos(pos)
+{
+    assertLessThanOrEqual(pos, mapped->size());
+}
+
+const unsigned char * SnapshotReader::readBytes(size_t count) {
+    if(count > mapped->size() - pos) {
+        logerror << "Snapshot ends after " << mapped->size() << " bytes, but expected "
+            << count << " more bytes at offset " << pos << endl;
+        throw std::runtime_error("Snapshot is truncated or corrupted");
+    }
+
+    const unsigned char * bytes = mapped->data() + pos;
+    pos += count;
+    return bytes;
+}
+
+const unsigned char * SnapshotReader::readBytes(uint64_t count, size_t size) {
+    assertStrictlyPositive(size);
+    if(count > (mapped->size() - pos) / size) {
+        logerror << "Snapshot ends after " << mapped->size() << " bytes, but expected "
+            << count << " elements of " << size << " bytes at offset " << pos << endl;
+        throw std::runtime_error("Snapshot is truncated or corrupted");
+    }
+    return readBytes(static_cast<size_t>(count) * size);
+}
+
+void SnapshotReader::read(std::string& str) {
+    uint64_t size;
+    read(size);
+    auto bytes = readBytes(static_cast<size_t>(size));
+    str.assign(reinterpret_cast<const char *>(bytes), static_cast<size_t>(size));
+}
+
+void SnapshotReader::read(BitString& bs) {
+    uint32_t size;
+    read(size);
+    auto bytes = readBytes((static_cast<size_t>(size) + 7) / 8);    // NOTE: 'size' + 7 could overflow a uint32_t
+
+    bs.resize(size);
+    for(size_t i = 0; i < size; i++) {
+        bs[i] = (bytes[i / 8] & (0x80 >> (i % 8))) != 0;
+    }
+}
+
+void SnapshotReader::read(G1& g1) {
+    std::memcpy(static_cast<void *>(&g1), readBytes(sizeof(G1)), sizeof(G1));
+}
+
+void SnapshotReader::read(G2& g2) {
+    std::memcpy(static_cast<void *>(&g2), readBytes(sizeof(G2)), sizeof(G2));
+}
+
+MappedPoly SnapshotReader::readPoly() {
+    uint64_t count;
+    read(count);
+    align(polyAlignment);
+    auto coeffs = reinterpret_cast<const Fr *>(readBytes(count, sizeof(Fr)));
+    return count > 0 ? MappedPoly(coeffs, static_cast<size_t>(count)) : MappedPoly();
+}
+
+void SnapshotReader::align(size_t alignment) {
+    readBytes((alignment - pos % alignment) % alignment);
+}
+
+} // end of namespace libaad
@@ -0,0 +1,85 @@
+#include <aad/Configuration.h>
+
+#include <aad/Scheduler.h>
+#include <aad/TaskGraph.h>
+
+#include <atomic>
+#include <mutex>
+
+#include <xassert/XAssert.h>
+
+using namespace std;
+
+namespace libaad {
+
+TaskGraph::TaskGraph(size_t numThreads)
+    : numThreads(numThreads == 0 ? Scheduler::get().getNumThreads() : numThreads)
+{}
+
+TaskGraph::TaskId TaskGraph::add(std::function<void()> func, const std::vector<TaskId>& deps) {
+    TaskId id = tasks.size();
+    tasks.push_back(Task{std::move(func), std::vector<TaskId>(), deps.size()});
+    for(auto d : deps) {
+        assertStrictlyLessThan(d, id);
+        tasks[d].dependents.push_back(id);
+    }
+    return id;
+}
+
+void TaskGraph::run() {
+    std::vector<TaskId> ready;
+    for(TaskId i = 0; i < tasks.size(); i++) {
+        if(tasks[i].numDeps == 0)
+            ready.push_back(i);
+    }
+
+    if(numThreads <= 1 || tasks.size() <= 1) {
+        // NOTE: tasks were added in topological order
+        try {
+            for(auto& t : tasks)
+                t.func();
+        } catch(...) {
+            // like below, a failed graph can be reused
+            tasks.clear();
+            throw;
+        }
+        tasks.clear();
+        return;
+    }
+
+    std::mutex mutex;
+    std::atomic<bool> failed(false);
+
+    TaskGroup group;
+    std::function<void(TaskId)> runTask = [&](TaskId id) {
+        // once a task failed, we skip the rest
+        if(failed)
+            return;
+
+        try {
+            tasks[id].func();
+        } catch(...) {
+            failed = true;
+            throw;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        for(auto d : tasks[id].dependents) {
+            if(--tasks[d].numDeps == 0)
+                group.run([&runTask, d] { runTask(d); });
+        }
+    };
+
+    for(auto id : ready)
+        group.run([&runTask, id] { runTask(id); });
+
+    try {
+        group.wait();
+    } catch(...) {
+        tasks.clear();
+        throw;
+    }
+    tasks.clear();
+}
+
+} // end of namespace libaad
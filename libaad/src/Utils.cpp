@@ -2,6 +2,8 @@
 
 #include <aad/Utils.h>
 
+#include <mutex>
+
 #include <xutils/Log.h>
 #include <xutils/Utils.h>
 
@@ -18,7 +20,10 @@
 void printOpPerf(const std::chrono::microseconds::rep& usecs, const char * operation, size_t inputSize)
 {
 #ifdef LIBAAD_PROFILE
+    // NOTE: called from the tasks of a merge, which run concurrently, so the widths and the output are guarded
+    static std::mutex mutex;
     static int maxInputSizeDigits = 0, maxOverallTimeDigits = 0;
+    std::lock_guard<std::mutex> lock(mutex);
 
     int digits = Utils::numDigits(inputSize);
     if(digits > maxInputSizeDigits)
@@ -0,0 +1,106 @@
+#include <aad/Configuration.h>
+
+#include <aad/ValueLog.h>
+
+#include <cerrno>
+#include <cstdio>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <xassert/XAssert.h>
+#include <xutils/Log.h>
+
+using namespace std;
+
+namespace libaad {
+
+static const size_t RecordHeaderSize = sizeof(uint32_t);
+
+ValueLog::ValueLog(const std::string& file, uint64_t maxSize)
+    : file(file), fd(-1), ptr(nullptr), maxSize(maxSize), len(0)
+{
+    assertStrictlyPositive(maxSize);
+
+    fd = ::open(file.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) {
+        logerror << "Could not open value log '" << file << "'" << endl;
+        throw std::runtime_error("Could not open value log");
+    }
+
+    // NOTE: Mapping past the end of the file is fine, as long as we only read what we wrote. The mapping does not
+    // take up any memory (or swap) until its pages are read.
+    void * addr = ::mmap(nullptr, static_cast<size_t>(maxSize), PROT_READ, MAP_SHARED | MAP_NORESERVE, fd, 0);
+    if(addr == MAP_FAILED) {
+        ::close(fd);
+        logerror << "Could not mmap value log '" << file << "' (" << maxSize << " bytes)" << endl;
+        throw std::runtime_error("Could not mmap value log");
+    }
+    ptr = static_cast<const char *>(addr);
+}
+
+ValueLog::~ValueLog() {
+    ::munmap(const_cast<char *>(ptr), static_cast<size_t>(maxSize));
+    ::close(fd);
+    std::remove(file.c_str());
+}
+
+uint64_t ValueLog::append(const View& v) {
+    assertLessThanOrEqual(v.size, UINT32_MAX);
+
+    // only append() writes 'len', so we need not synchronize with ourselves
+    uint64_t offset = len.load(std::memory_order_relaxed);
+    uint64_t recSize = RecordHeaderSize + v.size;
+    if(recSize > maxSize - offset) {
+        logerror << "Value log '" << file << "' is full (" << maxSize << " bytes)" << endl;
+        throw std::runtime_error("Value log is full");
+    }
+
+    uint32_t size = static_cast<uint32_t>(v.size);
+    struct iovec iov[2] = {
+        { &size, RecordHeaderSize },
+        { const_cast<char *>(v.data), v.size }
+    };
+
+    uint64_t written = 0;
+    int first = 0;
+    while(written < recSize) {
+        ssize_t n = ::pwritev(fd, iov + first, 2 - first, static_cast<off_t>(offset + written));
+        if(n < 0) {
+            if(errno == EINTR)
+                continue;
+            logerror << "Could not write to value log '" << file << "' (errno = " << errno << ")" << endl;
+            throw std::runtime_error("Could not write to value log");
+        }
+        written += static_cast<uint64_t>(n);
+
+        // skip over what was written (short writes are rare, so this does not need to be fast)
+        auto left = static_cast<size_t>(n);
+        while(first < 2 && left >= iov[first].iov_len) {
+            left -= iov[first].iov_len;
+            first++;
+        }
+        if(first < 2) {
+            iov[first].iov_base = static_cast<char *>(iov[first].iov_base) + left;
+            iov[first].iov_len -= left;
+        }
+    }
+
+    // publishes the record to readers (see getValue())
+    len.store(offset + recSize, std::memory_order_release);
+    return offset;
+}
+
+ValueLog::View ValueLog::getValue(uint64_t offset) const {
+    uint64_t end = len.load(std::memory_order_acquire);
+    assertLessThanOrEqual(offset + RecordHeaderSize, end);
+    (void)end;
+
+    uint32_t size;
+    std::memcpy(&size, ptr + offset, sizeof(size));
+    return View(ptr + offset + RecordHeaderSize, size);
+}
+
+} // end of namespace libaad
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <aad/AADS.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <list>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include <xassert/XAssert.h>
+
+namespace libaad {
+
+/**
+ * A fresh temporary directory (in $TMPDIR, or /tmp), created with mkdtemp(), for the files a test writes (e.g.,
+ * snapshots, append logs, value logs and spill files). It is removed, with everything in it, when this goes away.
+ */
+class TempDir {
+protected:
+    std::string dir;
+
+public:
+    TempDir(const std::string& prefix = "libaad-test") {
+        const char * tmp = std::getenv("TMPDIR");
+        std::string pattern = std::string(tmp != nullptr && *tmp != '\0' ? tmp : "/tmp") + "/" + prefix + "-XXXXXX";
+        std::vector<char> buf(pattern.begin(), pattern.end());
+        buf.push_back('\0');
+        if(::mkdtemp(buf.data()) == nullptr)
+            throw std::runtime_error("Could not create temporary directory");
+        dir = buf.data();
+    }
+
+    ~TempDir() {
+        // NOTE: tests only create files in here, not directories
+        DIR * d = ::opendir(dir.c_str());
+        if(d != nullptr) {
+            struct dirent * ent;
+            while((ent = ::readdir(d)) != nullptr) {
+                std::string name = ent->d_name;
+                if(name != "." && name != "..")
+                    std::remove(getPath(name).c_str());
+            }
+            ::closedir(d);
+        }
+        ::rmdir(dir.c_str());
+    }
+
+    TempDir(const TempDir&) = delete;
+    TempDir& operator=(const TempDir&) = delete;
+
+public:
+    const std::string& getDir() const { return dir; }
+
+    /**
+     * Returns the path of a file named 'name' in this directory (without creating it).
+     */
+    std::string getPath(const std::string& name) const { return dir + "/" + name; }
+};
+
+/**
+ * Appends 'count' key-value pairs to 'aad', cycling through 'numKeys' keys, so both AADs in a test that append the
+ * same number of pairs end up with the same pairs. The i-th value is padded with i*valuePadding characters (e.g., so
+ * values take up different amounts of space).
+ */
+template<class AADType>
+void appendSome(AADType& aad, int count, int numKeys, size_t valuePadding = 0) {
+    for(int i = 0; i < count; i++) {
+        int leafNo = aad.getSize();
+        aad.append("k" + std::to_string(leafNo % numKeys),
+            "v" + std::string(static_cast<size_t>(leafNo) * valuePadding, 'v') + std::to_string(leafNo));
+    }
+}
+
+/**
+ * Checks that 'other' (e.g., restored from a snapshot, recovered from an append log or spilled to disk) has the same
+ * state as 'aad' and that its proofs verify against the original digests.
+ */
+template<class AADType>
+void checkSame(AADType& aad, AADType& other) {
+    testAssertEqual(other.getSize(), aad.getSize());
+    testAssertEqual(other.getIndexedForest().getNumTrees(), aad.getIndexedForest().getNumTrees());
+    testAssertTrue(other.getDigest() == aad.getDigest());
+    for(int version = 1; version <= aad.getSize(); version++) {
+        testAssertTrue(other.getDigest(version) == aad.getDigest(version));
+    }
+
+    Digest digest = aad.getDigest();
+    auto keys = aad.getKeys(), otherKeys = other.getKeys();
+    std::sort(keys.begin(), keys.end());
+    std::sort(otherKeys.begin(), otherKeys.end());
+    testAssertTrue(keys == otherKeys);
+    for(auto& k : keys) {
+        auto vals = aad.getValues(k);
+        testAssertTrue(other.getValues(k) == vals);
+
+        // values in a value log can also be read without copying them
+        if(other.getValueLog() != nullptr) {
+            auto views = other.getValueViews(k);
+            testAssertEqual(views.size(), vals.size());
+            auto it = vals.begin();
+            for(auto& view : views) {
+                testAssertEqual(view.toString(), *it++);
+            }
+        }
+
+        testAssertTrue(other.completeMembershipProof(k)->verify(k, vals, digest));
+    }
+    for(int j = 0; j < 4; j++) {
+        std::string key = "missing" + std::to_string(j);
+        testAssertTrue(other.completeMembershipProof(key)->verify(key, std::list<std::string>(), digest));
+    }
+
+    if(aad.getSize() > 1) {
+        auto proof = other.appendOnlyProof(1);
+        testAssertTrue(proof->verify(aad.getDigest(1), digest));
+    }
+}
+
+} // end of namespace libaad
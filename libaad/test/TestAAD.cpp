@@ -1,6 +1,11 @@
 #include <aad/Configuration.h>
 
+#include <algorithm>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
 #include <boost/unordered_map.hpp>
 
 #include <aad/AADS.h>
@@ -11,14 +16,24 @@
 #include <xassert/XAssert.h>
 #include <xutils/Timer.h>
 
+#include "AADTestUtils.h"
+
 using namespace libaad;
 using namespace libaad;
 using std::endl;
 using std::cout;
 
-void testAppendsAndProofs(PublicParameters *pp, int n = 1024);
+void testAppendsAndProofs(PublicParameters *pp, int n = 1024, bool incrementalFrontier = false, size_t upperChunkSize = 1);
 void simpleAadTest();
 void testFrees(int n);
+void testVerifierContext(PublicParameters *pp);
+void testLeafPolyCache();
+void testSnapshot(PublicParameters *pp, int n, bool incrementalFrontier, size_t upperChunkSize);
+void testRootStore(PublicParameters *pp, int n, bool incrementalFrontier);
+void testKeyInterning(PublicParameters *pp, int n);
+void testFlatProofs(PublicParameters *pp, int n, size_t upperChunkSize);
+void testIncrementalFrontierDigests(PublicParameters *pp, int n);
+void testCorruptedSnapshot(PublicParameters *pp, int n);
 
 void printUsage(const char * prog) {
     cout << "Usage: " << prog << " [rand-seed] [num-appends] [public-params]" << endl;
@@ -52,12 +67,14 @@ int main(int argc, char *argv[])
     }
     if(argc > 3) {
         ppFile = argv[3];
-        pp.reset(new PublicParameters(ppFile, n*SecParam*4, true, false));
+        pp = PublicParameters::open(ppFile, n*SecParam*4, true, false);
     }
     loginfo << "Seeding PRNG with seed " << seed << endl;
     srand(seed);
 
     testFrees(7);
+    testVerifierContext(pp.get());
+    testLeafPolyCache();
     
     Frontier frontier;
     BitString bs;
@@ -69,8 +86,40 @@ int main(int argc, char *argv[])
         testAppendsAndProofs(pp.get(), n);
     }
 
+    loginfo << endl;
+    loginfo << "Testing appends and proofs with incremental frontiers" << endl;
+    testAppendsAndProofs(pp.get(), n, true);
+
+    loginfo << endl;
+    loginfo << "Testing that incremental frontiers do not change the digests" << endl;
+    testIncrementalFrontierDigests(pp.get(), n);
+
+    loginfo << endl;
+    loginfo << "Testing appends and proofs with chunked upper frontiers" << endl;
+    testAppendsAndProofs(pp.get(), n, false, 32);
+
     //std::cout << std::endl << std::endl;
 
+    loginfo << endl;
+    loginfo << "Testing snapshots" << endl;
+    testSnapshot(pp.get(), n, false, 1);
+    testSnapshot(pp.get(), n, true, 32);
+    testCorruptedSnapshot(pp.get(), n);
+
+    loginfo << endl;
+    loginfo << "Testing spilling roots to disk" << endl;
+    testRootStore(pp.get(), n, false);
+    testRootStore(pp.get(), n, true);
+
+    loginfo << endl;
+    loginfo << "Testing interned keys and std::string_view appends" << endl;
+    testKeyInterning(pp.get(), n);
+
+    loginfo << endl;
+    loginfo << "Testing flat proofs" << endl;
+    testFlatProofs(pp.get(), n, 1);
+    testFlatProofs(pp.get(), n, 32);
+
     loginfo << endl;
     loginfo << "Doing a simple AAD test" << endl;
 
@@ -124,8 +173,78 @@ void testFrees(int n) {
 }
 
 
-void testAppendsAndProofs(PublicParameters *pp, int n) {
-    AAD<std::string, std::string> aad(pp);
+void testVerifierContext(PublicParameters *pp) {
+    using AADType = AAD<std::string, std::string>;
+    // room for half of the leaves, so older leaves get evicted
+    AADType::VerifierContextType ctx(pp, 4096, 8);
+
+    for(int i = 0; i < 4; i++) {
+        for(int leafNo = 0; leafNo < 4; leafNo++) {
+            std::string key = "k" + std::to_string(i), value = "v" + std::to_string(leafNo);
+
+            // the cached leaf accumulator (computed from the key and value polynomials) should match the leaf AT's
+            AccumulatedTree at(SecParam*4, Sha256().hashKV(key, value, leafNo));
+            G1 acc;
+            std::tie(acc, std::ignore) = CommitUtils::commitAT(&at, pp, false);
+
+            testAssertEqual(ctx.getLeafAcc(key, value, leafNo), acc);
+            testAssertEqual(ctx.getLeafAcc(key, value, leafNo), acc);
+        }
+    }
+
+    testAssertEqual(ctx.getNumCachedKeys(), 4);
+    testAssertEqual(ctx.getNumCachedLeaves(), 8);
+    testAssertEqual(ctx.getNumLeafMisses(), 16);
+    testAssertEqual(ctx.getNumLeafHits(), 16);
+    testAssertEqual(ctx.getNumKeyHits(), 12);
+
+    // the last leaf is still cached, but the first one was evicted
+    ctx.getLeafAcc("k3", "v3", 3);
+    testAssertEqual(ctx.getNumLeafHits(), 17);
+    ctx.getLeafAcc("k0", "v0", 0);
+    testAssertEqual(ctx.getNumLeafMisses(), 17);
+    testAssertEqual(ctx.getNumCachedLeaves(), 8);
+}
+
+void testLeafPolyCache() {
+    // a small cache, so it evicts keys along the way
+    AAD<std::string, std::string>::LeafPolyCacheType cache(3);
+
+    // a hot key appended every other time, in between cold keys appended only once
+    for(int i = 0; i < 16; i++) {
+        std::string key = i % 2 == 0 ? "hot" : "k" + std::to_string(i), value = "v" + std::to_string(i);
+
+        BitString path;
+        std::vector<Fr> leafPoly;
+        cache.getLeafPoly(key, value, i, path, leafPoly);
+        testAssertEqual(path, Sha256().hashKV(key, value, i));
+
+        // the leaf polynomial computed as keyPoly * valuePoly should match the one interpolated from all of the leaf AT's prefixes
+        AccumulatedTree at(SecParam*4, path);
+        std::vector<Fr> hashes, expectedPoly;
+        hashToField(at.getPrefixes(), hashes);
+        poly_from_roots_ntl(expectedPoly, hashes);
+        testAssertEqual(leafPoly.size(), expectedPoly.size());
+        testAssertTrue(leafPoly == expectedPoly);
+    }
+
+    // evicting the least-recently-used key never evicts the hot key, so it hits every time after the first
+    testAssertEqual(cache.getNumCachedKeys(), 3);
+    testAssertEqual(cache.getNumHits(), 7);
+    testAssertEqual(cache.getNumMisses(), 9);
+}
+
+void testAppendsAndProofs(PublicParameters *pp, int n, bool incrementalFrontier, size_t upperChunkSize) {
+    using AADType = AAD<std::string, std::string>;
+    AADType aad(pp);
+    // the client reuses a verifier context across versions of the AAD
+    AADType::VerifierContextType ctx(pp);
+    aad.setIncrementalFrontier(incrementalFrontier);
+    aad.setUpperFrontierChunkSize(upperChunkSize);
+    // the leaf polynomial cache is off by default, so we turn it on in one of the runs
+    testAssertNull(aad.getLeafPolyCache());
+    if(incrementalFrontier)
+        aad.setLeafPolyCacheSize(16);
     size_t maxNumKeys = 3*static_cast<size_t>(n)/4;
     int prevPct = -1;
     bool progress = n >= 1024;
@@ -149,7 +268,10 @@ void testAppendsAndProofs(PublicParameters *pp, int n) {
             auto vals = aad.getValues(k);
             loginfo << "Proving membership of key " << k <<  " with " << vals.size() << " value(s)" << endl;
             auto proof = aad.completeMembershipProof(k);
-            testAssertTrue(proof->verify(k, vals, digest));
+            // alternate between checking pairings one by one and all at once, and between one and several threads
+            proof->setBatchVerification(i % 2 == 1);
+            proof->setNumThreads(i % 3 == 2 ? 4 : 1);
+            testAssertTrue(proof->verify(k, vals, digest, i % 4 >= 2 ? &ctx : nullptr));
 
             //int membProofSz = proof->getProofSize();
             //logdbg << "Membership proof size: " << Utils::humanizeBytes(membProofSz) << " (" << tup.second.size() << " values)" << endl;
@@ -161,6 +283,8 @@ void testAppendsAndProofs(PublicParameters *pp, int n) {
             std::string key = "n" + std::to_string(idx);
             loginfo << "Proving non-membership of key " << key << endl;
             auto proof = aad.completeMembershipProof(key);
+            proof->setBatchVerification(j % 2 == 1);
+            proof->setNumThreads(j % 3 == 2 ? 4 : 1);
             testAssertTrue(proof->verify(key, std::list<std::string>(), digest));
 
             //int nonMembProofSz = proof->getProofSize();
@@ -176,3 +300,295 @@ void testAppendsAndProofs(PublicParameters *pp, int n) {
   
  
 }
+
+void testIncrementalFrontierDigests(PublicParameters *pp, int n) {
+    using AADType = AAD<std::string, std::string>;
+    AADType aad(pp), incremental(pp);
+    incremental.setIncrementalFrontier(true);
+
+    // few keys, so most merges have keys without new values, whose lower frontiers get reused
+    appendSome(aad, n, 4);
+    appendSome(incremental, n, 4);
+    checkSame(aad, incremental);
+}
+
+void testSnapshot(PublicParameters *pp, int n, bool incrementalFrontier, size_t upperChunkSize) {
+    using AADType = AAD<std::string, std::string>;
+    TempDir tmp;
+    std::string file = tmp.getPath("snapshot");
+    int numKeys = std::max(n / 2, 1);
+
+    AADType aad(pp);
+    aad.setIncrementalFrontier(incrementalFrontier);
+    aad.setUpperFrontierChunkSize(upperChunkSize);
+    appendSome(aad, n - 1, numKeys);  // so the forest has several trees
+    aad.saveSnapshot(file);
+
+    AADType restored(pp);
+    restored.restoreSnapshot(file);
+    // the roots' ATs and AT polynomials are left in the snapshot
+    for(auto& tup : restored.getIndexedForest().getTrees()) {
+        testAssertEqual(std::get<1>(tup)->getData()->getResidentBytes(), 0);
+    }
+    checkSame(aad, restored);
+
+    // appending to the restored AAD merges the restored roots, whose ATs and AT polynomials are still in the snapshot,
+    // and reuses their retained frontier leaves for the keys that got no new values, as if they had never left RAM
+    auto numReusedKeys = [](AADType& aad) {
+        int num = 0;
+        for(auto& tup : aad.getIndexedForest().getTrees()) {
+            auto frontier = std::get<1>(tup)->getData()->frontier.get();
+            if(frontier != nullptr)
+                num += frontier->getNumReusedKeys();
+        }
+        return num;
+    };
+    aad.append("fresh", "v");
+    restored.append("fresh", "v");
+    testAssertEqual(numReusedKeys(restored), numReusedKeys(aad));
+    if(incrementalFrontier)
+        testAssertTrue(numReusedKeys(restored) > 0);
+    checkSame(aad, restored);
+
+    appendSome(aad, n + 1, numKeys);
+    appendSome(restored, n + 1, numKeys);
+    checkSame(aad, restored);
+
+    // the restored AAD can take a snapshot over the one it was restored from
+    restored.saveSnapshot(file);
+    AADType restoredAgain(pp);
+    restoredAgain.restoreSnapshot(file);
+    checkSame(aad, restoredAgain);
+
+    // a snapshot cannot be restored into an AAD with different parameters
+    AAD<std::string, std::string, false> noFrontier(pp);
+    try {
+        noFrontier.restoreSnapshot(file);
+        testAssertTrue(false);
+    } catch(const std::runtime_error&) {
+    }
+}
+
+void testCorruptedSnapshot(PublicParameters *pp, int n) {
+    using AADType = AAD<std::string, std::string>;
+    TempDir tmp;
+    std::string file = tmp.getPath("snapshot"), badFile = tmp.getPath("bad-snapshot");
+
+    AADType aad(pp);
+    appendSome(aad, std::max(n - 1, 1), std::max(n / 2, 1));
+    aad.saveSnapshot(file);
+
+    std::string bytes;
+    {
+        std::ifstream fin(file, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+    }
+    testAssertFalse(bytes.empty());
+    auto writeBad = [&badFile](const std::string& contents) {
+        std::ofstream fout(badFile, std::ios::binary | std::ios::trunc);
+        fout.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+    };
+
+    // a truncated snapshot is always caught, and leaves no keys behind
+    size_t step = std::max(bytes.size() / 32, static_cast<size_t>(1));
+    for(size_t len = 0; len < bytes.size(); len += step) {
+        writeBad(bytes.substr(0, len));
+        AADType restored(pp);
+        try {
+            restored.restoreSnapshot(badFile);
+            testAssertTrue(false);
+        } catch(const std::runtime_error&) {
+        }
+        testAssertEqual(restored.getSize(), 0);
+        testAssertEqual(restored.getNumKeys(), static_cast<size_t>(0));
+    }
+
+    // a corrupted one either restores (e.g., if only an accumulator was overwritten) or throws std::runtime_error,
+    // rather than crash, recurse without bound or throw something else
+    for(size_t pos = 0; pos < bytes.size(); pos += step) {
+        std::string corrupted = bytes;
+        for(size_t i = pos; i < std::min(pos + 4, corrupted.size()); i++)
+            corrupted[i] = static_cast<char>(0xff);
+        writeBad(corrupted);
+        AADType restored(pp);
+        try {
+            restored.restoreSnapshot(badFile);
+        } catch(const std::runtime_error&) {
+            testAssertEqual(restored.getNumKeys(), static_cast<size_t>(0));
+        }
+    }
+}
+
+void testRootStore(PublicParameters *pp, int n, bool incrementalFrontier) {
+    using AADType = AAD<std::string, std::string>;
+    TempDir tmp;
+    std::string file = tmp.getPath("snapshot");
+    int numKeys = std::max(n / 2, 1);
+
+    // with no RAM budget, every root is spilled after every append (and after trimRoots())
+    auto checkSpilled = [](AADType& aad) {
+        for(auto& tup : aad.getIndexedForest().getTrees()) {
+            testAssertEqual(std::get<1>(tup)->getData()->getResidentBytes(), 0);
+        }
+    };
+
+    AADType aad(pp), spilled(pp);
+    aad.setIncrementalFrontier(incrementalFrontier);
+    spilled.setIncrementalFrontier(incrementalFrontier);
+    spilled.setRootStore(tmp.getDir(), 0, 0);
+
+    appendSome(aad, n - 1, numKeys);
+    appendSome(spilled, n - 1, numKeys);
+    testAssertTrue(spilled.getRootStore()->getNumSpills() > 0);
+    checkSpilled(spilled);
+
+    // proofs look keys up in the spill files, and roots read back in are dropped from RAM without being written again
+    auto numSpills = spilled.getRootStore()->getNumSpills();
+    auto bytesSpilled = spilled.getRootStore()->getBytesSpilled();
+    checkSame(aad, spilled);
+    spilled.trimRoots();
+    checkSpilled(spilled);
+    spilled.getRootATs();
+    checkSame(aad, spilled);
+    spilled.trimRoots();
+    checkSpilled(spilled);
+    testAssertEqual(spilled.getRootStore()->getNumSpills(), numSpills);
+    testAssertEqual(spilled.getRootStore()->getBytesSpilled(), bytesSpilled);
+
+    // merges read the spilled roots back in
+    appendSome(aad, n + 1, numKeys);
+    appendSome(spilled, n + 1, numKeys);
+    checkSame(aad, spilled);
+
+    // spilled roots are copied into snapshots as they are
+    spilled.saveSnapshot(file);
+    AADType restored(pp);
+    restored.restoreSnapshot(file);
+    checkSame(aad, restored);
+}
+
+void testKeyInterning(PublicParameters *pp, int n) {
+    using AADType = AAD<std::string, std::string>;
+    int numKeys = std::max(n / 4, 1);
+
+    // appends from a single buffer, as a server parsing requests would
+    AADType aad(pp), viewed(pp);
+    std::string buf;
+    for(int i = 0; i < n; i++) {
+        std::string k = "key" + std::to_string(i % numKeys), v = "value" + std::to_string(i);
+        aad.append(k, v);
+
+        buf = k + v;
+        viewed.append(std::string_view(buf).substr(0, k.size()), std::string_view(buf).substr(k.size()));
+    }
+
+    // every distinct key is stored once, no matter how many values it has
+    testAssertEqual(aad.getNumKeys(), static_cast<size_t>(numKeys));
+    testAssertEqual(viewed.getNumKeys(), static_cast<size_t>(numKeys));
+    testAssertEqual(viewed.getKeys().size(), static_cast<size_t>(numKeys));
+    testAssertEqual(viewed.getKeyInterner().find("missing"), KeyInterner<std::string>::NotFound);
+
+    testAssertTrue(viewed.getDigest() == aad.getDigest());
+    Digest digest = aad.getDigest();
+    for(auto& k : aad.getKeys()) {
+        auto vals = aad.getValues(k);
+        testAssertTrue(viewed.getValues(k) == vals);
+        testAssertTrue(viewed.completeMembershipProof(k)->verify(k, vals, digest));
+
+        // ranges yield views of the same values, in the same order, without copying them
+        auto range = viewed.getValuesRange(std::string_view(k));
+        testAssertEqual(range.size(), vals.size());
+        auto it = vals.begin();
+        for(std::string_view v : range) {
+            testAssertTrue(v == *it);
+            it++;
+        }
+    }
+
+    std::string missing = "missing";
+    testAssertTrue(viewed.getValuesRange(missing).empty());
+    testAssertTrue(viewed.getValues(missing).empty());
+    testAssertTrue(viewed.completeMembershipProof(missing)->verify(missing, std::list<std::string>(), digest));
+
+    // a key that is not there yet is not interned by lookups or proofs
+    testAssertEqual(viewed.getNumKeys(), static_cast<size_t>(numKeys));
+}
+
+void testFlatProofs(PublicParameters *pp, int n, size_t upperChunkSize) {
+    using AADType = AAD<std::string, std::string>;
+    int numKeys = std::max(n / 3, 1);
+
+    AADType aad(pp);
+    aad.setUpperFrontierChunkSize(upperChunkSize);
+    std::string buf;
+    for(int i = 0; i < n; i++) {
+        aad.append("k" + std::to_string(i % numKeys), "v" + std::to_string(i));
+        Digest digest = aad.getDigest();
+
+        // flat proofs verify exactly when the proofs made of trees do
+        for(auto& k : aad.getKeys()) {
+            auto vals = aad.getValues(k);
+            size_t size = aad.writeMembershipProof(k, buf);
+            testAssertEqual(size, buf.size());
+
+            AADType::FlatMembProofType proof(pp, buf);
+            proof.setBatchVerification(i % 2 == 1);
+            proof.setNumThreads(i % 3 == 2 ? 4 : 1);
+            testAssertTrue(proof.verify(k, vals, digest));
+            testAssertTrue(aad.completeMembershipProof(k)->verify(k, vals, digest));
+
+            // ...and not for the wrong values
+            auto moreVals = vals;
+            moreVals.push_back("extra");
+            testAssertFalse(AADType::FlatMembProofType(pp, buf).verify(k, moreVals, digest));
+        }
+
+        std::string missing = "missing" + std::to_string(i);
+        aad.writeMembershipProof(missing, buf);
+        testAssertTrue(AADType::FlatMembProofType(pp, buf).verify(missing, std::list<std::string>(), digest));
+
+        for(int version = 1; version <= aad.getSize(); version++) {
+            aad.writeAppendOnlyProof(version, buf);
+            AADType::FlatAppendOnlyProofType proof(pp, buf);
+            proof.setBatchVerification(version % 2 == 0);
+            testAssertTrue(proof.verify(aad.getDigest(version), digest));
+            testAssertTrue(aad.appendOnlyProof(version)->verify(aad.getDigest(version), digest));
+        }
+    }
+
+    // corrupted proofs are rejected, rather than read past their end
+    Digest digest = aad.getDigest();
+    std::string k = "k0";
+    auto vals = aad.getValues(k);
+    aad.writeMembershipProof(k, buf);
+
+    for(size_t len : { size_t(0), sizeof(FlatProof::Header), buf.size() - 1 }) {
+        try {
+            AADType::FlatMembProofType proof(pp, reinterpret_cast<const unsigned char *>(buf.data()), len);
+            testAssertTrue(false);
+        } catch(const std::runtime_error&) {
+        }
+    }
+
+    try {
+        AADType::FlatAppendOnlyProofType proof(pp, buf);
+        testAssertTrue(false);
+    } catch(const std::runtime_error&) {
+    }
+
+    // a node of an unknown type (the first node is the root of the first tree's forest or frontier proof)
+    FlatProof::Header header;
+    std::memcpy(&header, buf.data(), sizeof(header));
+    size_t masks = sizeof(header) + header.numTrees * sizeof(FlatProof::TreeEntry) + (header.numNodes + 7) / 8;
+    std::string corrupted = buf;
+    corrupted[masks] = static_cast<char>(corrupted[masks] | FlatProof::TypeMask);
+    testAssertFalse(AADType::FlatMembProofType(pp, corrupted).verify(k, vals, digest));
+
+    // a different Merkle hash (only checked with public parameters)
+    if(pp != nullptr && header.hashBytes > 0) {
+        corrupted = buf;
+        size_t hashes = masks + header.numNodes + header.pointBytes;
+        corrupted[hashes] = static_cast<char>(corrupted[hashes] ^ 1);
+        testAssertFalse(AADType::FlatMembProofType(pp, corrupted).verify(k, vals, digest));
+    }
+}
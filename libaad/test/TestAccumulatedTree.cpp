@@ -7,6 +7,7 @@
 #include <xassert/XAssert.h>
 
 #include <algorithm>
+#include <cstdlib>
 
 using namespace libaad;
 using libaad::AccumulatedTree;
@@ -18,6 +19,7 @@ using std::endl;
 void testLowerFrontier();
 void testFrontier();
 void testAccumulatedTree();
+void testSortedFrontier(int maxDepth, int numKeys, int numLeaves);
 
 int main(int argc, char *argv[])
 {
@@ -28,6 +30,9 @@ int main(int argc, char *argv[])
     testFrontier();
     testLowerFrontier();
     testAccumulatedTree();
+    testSortedFrontier(4, 2, 3);
+    testSortedFrontier(16, 8, 32);
+    testSortedFrontier(512, 16, 64);
 
     std::cout << "Test '" << argv[0] << "' finished successfully" << std::endl;
 
@@ -210,3 +215,83 @@ void testAccumulatedTree() {
 
     testAssertTrue(expected.empty());
 }
+
+BitString randomBits(int numBits) {
+    BitString bs;
+    for(int i = 0; i < numBits; i++) {
+        bs << (rand() % 2);
+    }
+    return bs;
+}
+
+/**
+ * Checks that frontiers computed from sorted leaf hashes match the ones computed by walking the AT.
+ */
+void testSortedFrontier(int maxDepth, int numKeys, int numLeaves) {
+    loginfo << "Testing sorted frontiers for AT of depth " << maxDepth << " with " << numLeaves << " leaves" << endl;
+
+    // pick some keys and give them random values, building the AT via merges and appends
+    std::vector<BitString> keys;
+    for(int i = 0; i < numKeys; i++) {
+        keys.push_back(randomBits(maxDepth / 2));
+    }
+    auto randomLeaf = [&keys, maxDepth]() {
+        BitString leaf = keys[static_cast<size_t>(rand() % static_cast<int>(keys.size()))];
+        leaf << randomBits(maxDepth / 2);
+        return leaf;
+    };
+
+    std::unique_ptr<AccumulatedTree> left(new AccumulatedTree(maxDepth, randomLeaf()));
+    std::unique_ptr<AccumulatedTree> right(new AccumulatedTree(maxDepth, randomLeaf()));
+    for(int i = 2; i < numLeaves; i++) {
+        (i % 2 == 0 ? left : right)->appendPath(randomLeaf());
+    }
+    AccumulatedTree tree(std::move(left), std::move(right));
+    testAssertTrue(tree.hasSortedLeaves());
+    const auto& sorted = tree.getSortedLeaves();
+    testAssertTrue(std::is_sorted(sorted.begin(), sorted.end()));
+
+    // full frontier, in the same order
+    std::vector<BitString> trieFrontier, sortedFrontier;
+    tree.getFullFrontier(trieFrontier);
+    SortedFrontier::getFrontier(sorted, 0, sorted.size(), 0, static_cast<size_t>(maxDepth), sortedFrontier, nullptr);
+    testAssertTrue(trieFrontier == sortedFrontier);
+
+    // upper frontier and lower roots, in the same order
+    std::vector<Node*> lowerRoots;
+    std::vector<SortedFrontier::Range> lowerRanges;
+    tree.getUpperFrontier(trieFrontier, lowerRoots);
+    tree.getUpperFrontier(sortedFrontier, lowerRanges);
+    testAssertTrue(trieFrontier == sortedFrontier);
+    testAssertEqual(lowerRoots.size(), lowerRanges.size());
+
+    // lower frontiers, sorted
+    for(size_t i = 0; i < lowerRoots.size(); i++) {
+        BitString keyHash = lowerRoots[i]->getLabel();
+        testAssertEqual(keyHash, SortedFrontier::toBitString(sorted[std::get<0>(lowerRanges[i])], static_cast<size_t>(maxDepth / 2)));
+        testAssertEqual(AccumulatedTree::getNumLeaves(lowerRoots[i]),
+            static_cast<int>(std::get<1>(lowerRanges[i]) - std::get<0>(lowerRanges[i])));
+
+        trieFrontier.clear();
+        tree.getLowerFrontier(trieFrontier, keyHash, lowerRoots[i]);
+        std::sort(trieFrontier.begin(), trieFrontier.end());
+        tree.getLowerFrontier(sortedFrontier, lowerRanges[i]);
+        testAssertTrue(trieFrontier == sortedFrontier);
+    }
+
+    // key lookups, for keys in the AT and (most likely) not in it
+    auto sortedBytes = reinterpret_cast<const unsigned char *>(sorted.data());
+    for(int i = 0; i < 2 * numKeys; i++) {
+        BitString keyHash = i < numKeys ? keys[static_cast<size_t>(i)] : randomBits(maxDepth / 2);
+        bool found;
+        BitString trieMissing, sortedMissing;
+        std::tie(found, std::ignore, trieMissing) = tree.containsKey(keyHash);
+        testAssertEqual(SortedFrontier::findPrefix(sortedBytes, sorted.size(), keyHash, sortedMissing), found);
+        if(!found)
+            testAssertEqual(trieMissing, sortedMissing);
+    }
+
+    // partial paths invalidate the sorted leaves
+    tree.appendPath(randomBits(maxDepth / 2));
+    testAssertFalse(tree.hasSortedLeaves());
+}
@@ -0,0 +1,243 @@
+#include <aad/Configuration.h>
+
+#include <aad/AADS.h>
+#include <aad/AppendLog.h>
+#include <aad/Library.h>
+
+#include <cstdio>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include <xassert/XAssert.h>
+#include <xutils/Log.h>
+
+#include "AADTestUtils.h"
+
+using namespace libaad;
+using std::endl;
+
+void testReplay(const std::string& logFile);
+void testConcurrentTruncate(const std::string& logFile);
+void testTornRecord(const std::string& logFile);
+void testRecovery(const std::string& snapFile, const std::string& logFile);
+void testFailedAppend(const std::string& logFile);
+
+int main(int argc, char *argv[])
+{
+    (void)argc;
+    initialize(nullptr, 0);
+
+    {
+        TempDir tmp;
+        std::string logFile = tmp.getPath("append-log"), snapFile = tmp.getPath("snapshot");
+
+        testReplay(logFile);
+        testConcurrentTruncate(logFile);
+        testTornRecord(logFile);
+        testRecovery(snapFile, logFile);
+        testFailedAppend(logFile);
+    }
+
+    std::cout << "Test '" << argv[0] << "' finished successfully" << std::endl;
+    return 0;
+}
+
+std::string makePayload(uint64_t leafNo) {
+    std::string payload;
+    AppendLog::encode(payload, std::string("k") + std::to_string(leafNo % 5));
+    AppendLog::encode(payload, std::string("v") + std::to_string(leafNo));
+    return payload;
+}
+
+void testReplay(const std::string& logFile) {
+    size_t groupSize = 16;
+    uint64_t n = 100;
+    {
+        // a long delay, so only full groups (and the last one, in sync()) are committed
+        AppendLog log(logFile, groupSize, std::chrono::milliseconds(10000));
+        for(uint64_t i = 0; i < n; i++) {
+            log.append(i, makePayload(i));
+        }
+        log.sync();
+        // appends are committed in groups
+        testAssertTrue(log.getNumSyncs() <= n / groupSize + 2);
+    }
+
+    // replays only the records from the specified leaf on
+    uint64_t next = 40;
+    auto numReplayed = AppendLog::replay(logFile, 40, [&next](uint64_t leafNo, const std::string& payload) {
+        testAssertEqual(leafNo, next);
+        testAssertTrue(payload == makePayload(leafNo));
+
+        std::string k, v;
+        size_t pos = 0;
+        AppendLog::decode(payload, pos, k);
+        AppendLog::decode(payload, pos, v);
+        testAssertEqual(pos, payload.size());
+        testAssertEqual(v, "v" + std::to_string(leafNo));
+        next++;
+    });
+    testAssertEqual(numReplayed, n - 40);
+    testAssertEqual(next, n);
+
+    // reopening the log appends after the existing records
+    {
+        AppendLog log(logFile, groupSize);
+        log.append(n, makePayload(n));
+    }
+    testAssertEqual(AppendLog::replay(logFile, 0, AppendLog::ReplayFunc()), n + 1);
+
+    // an empty log after truncation
+    {
+        AppendLog log(logFile, groupSize);
+        log.truncate();
+        log.append(n + 1, makePayload(n + 1));
+    }
+    testAssertEqual(AppendLog::replay(logFile, n + 1, AppendLog::ReplayFunc()), 1);
+
+    // the log must have all appends after the specified leaf
+    try {
+        AppendLog::replay(logFile, n, AppendLog::ReplayFunc());
+        testAssertTrue(false);
+    } catch(const std::runtime_error&) {
+    }
+
+    std::remove(logFile.c_str());
+}
+
+void testConcurrentTruncate(const std::string& logFile) {
+    uint64_t n = 2000;
+    {
+        // small groups and no delay, so the flusher is often writing while we truncate
+        AppendLog log(logFile, 4, std::chrono::milliseconds(0));
+        std::thread appender([&log, n] {
+            for(uint64_t i = 0; i < n; i++) {
+                log.append(i, makePayload(i));
+            }
+        });
+        for(int i = 0; i < 50; i++) {
+            log.truncate();
+            std::this_thread::yield();
+        }
+        appender.join();
+    }
+
+    // no group was cut in half by a truncation, so the log has consecutive, intact records (i.e., replaying it
+    // neither throws nor truncates a torn record)
+    auto fileSize = [&logFile]() {
+        std::ifstream fin(logFile, std::ios::binary | std::ios::ate);
+        return static_cast<long>(fin.tellg());
+    };
+    long size = fileSize();
+    AppendLog::replay(logFile, UINT64_MAX, AppendLog::ReplayFunc());
+    testAssertEqual(fileSize(), size);
+
+    std::remove(logFile.c_str());
+}
+
+void testTornRecord(const std::string& logFile) {
+    {
+        AppendLog log(logFile);
+        for(uint64_t i = 0; i < 10; i++) {
+            log.append(i, makePayload(i));
+        }
+    }
+
+    std::ifstream fin(logFile, std::ios::binary | std::ios::ate);
+    auto fullSize = static_cast<long>(fin.tellg());
+    fin.close();
+
+    // a record torn at the end (e.g., half of its payload is missing) is truncated
+    testAssertEqual(::truncate(logFile.c_str(), fullSize - 3), 0);
+    testAssertEqual(AppendLog::replay(logFile, 0, AppendLog::ReplayFunc()), 9);
+    // ...and new records are appended after the last complete one
+    {
+        AppendLog log(logFile);
+        log.append(9, makePayload(9));
+    }
+    testAssertEqual(AppendLog::replay(logFile, 0, AppendLog::ReplayFunc()), 10);
+
+    // a corrupted record at the end is truncated too
+    {
+        std::fstream f(logFile, std::ios::binary | std::ios::in | std::ios::out);
+        f.seekp(fullSize - 1);
+        f.put('X');
+    }
+    testAssertEqual(AppendLog::replay(logFile, 0, AppendLog::ReplayFunc()), 9);
+
+    std::remove(logFile.c_str());
+}
+
+void testRecovery(const std::string& snapFile, const std::string& logFile) {
+    using AADType = AAD<std::string, std::string>;
+    int n = 37, numKeys = 7;
+
+    AADType expected;
+    appendSome(expected, n, numKeys);
+
+    // a fresh AAD with no snapshot and no log yet
+    {
+        AADType aad;
+        testAssertEqual(aad.recover(snapFile, logFile), 0);
+        appendSome(aad, 20, numKeys);
+        aad.checkpoint(snapFile);
+        appendSome(aad, n - 20, numKeys);
+        aad.syncAppendLog();
+    }
+
+    // recovers the snapshot and replays the appends after it
+    AADType recovered;
+    testAssertEqual(recovered.recover(snapFile, logFile), static_cast<uint64_t>(n - 20));
+    checkSame(expected, recovered);
+
+    // new appends are logged after the replayed ones
+    appendSome(recovered, 3, numKeys);
+    appendSome(expected, 3, numKeys);
+    recovered.syncAppendLog();
+
+    AADType recoveredAgain;
+    testAssertEqual(recoveredAgain.recover(snapFile, logFile), static_cast<uint64_t>(n - 20 + 3));
+    checkSame(expected, recoveredAgain);
+
+    loginfo << "Recovered AAD with " << recoveredAgain.getSize() << " appends" << endl;
+}
+
+void testFailedAppend(const std::string& logFile) {
+    using AADType = AAD<std::string, std::string>;
+    std::string valueLogFile = logFile + "-values";
+    std::remove(logFile.c_str());
+
+    AADType expected;
+    {
+        // a value log with room for a few small values only, so a large value cannot be appended
+        AADType aad;
+        aad.setValueLog(valueLogFile, 4096);
+        testAssertEqual(aad.recover(logFile + "-no-snapshot", logFile), static_cast<uint64_t>(0));
+        for(int i = 0; i < 3; i++) {
+            aad.append("k" + std::to_string(i), "v" + std::to_string(i));
+            expected.append("k" + std::to_string(i), "v" + std::to_string(i));
+        }
+
+        try {
+            aad.append("big", std::string(8192, 'x'));
+            testAssertTrue(false);
+        } catch(const std::runtime_error&) {
+        }
+        testAssertEqual(aad.getSize(), 3);
+
+        // the failed append was not logged, so the next append's record follows the previous one
+        aad.append("k3", "v3");
+        expected.append("k3", "v3");
+        aad.syncAppendLog();
+    }
+    std::remove(valueLogFile.c_str());
+
+    AADType recovered;
+    testAssertEqual(recovered.recover(logFile + "-no-snapshot", logFile), static_cast<uint64_t>(4));
+    testAssertTrue(recovered.getDigest() == expected.getDigest());
+
+    std::remove(logFile.c_str());
+}
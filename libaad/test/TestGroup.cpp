@@ -1,11 +1,17 @@
 #include <aad/Configuration.h>
+#include <aad/CompactPoint.h>
+#include <aad/Endomorphism.h>
 #include <aad/Library.h>
+#include <aad/PairingBatch.h>
 #include <aad/PolyCommit.h>
 
 #include <xassert/XAssert.h>
 
 #include <libff/algebra/scalar_multiplication/multiexp.hpp>
 
+#include <cstring>
+#include <stdexcept>
+#include <string>
 #include <thread>
 
 using namespace libaad;
@@ -60,6 +66,24 @@ int main(int argc, char *argv[])
         gt_ab,
         ReducedPairing(G1::one(), g2b)^a);
 
+    // a batch of pairing equations, on fixed and non-fixed G2 elements, verifies as a whole...
+    PairingBatch batch(nullptr);
+    for(int i = 0; i < 5; i++) {
+        Fr x = Fr::random_element(), y = Fr::random_element();
+        batch.addEquality(x*G1::one(), y*G2::one(), (x*y)*G1::one(), G2::one(), nullptr, "fixed");
+        batch.addEquality(G1::one(), (x*y)*G2::one(), y*G1::one(), x*G2::one(), nullptr, "non-fixed");
+    }
+    testAssertTrue(batch.verify());
+    testAssertEqual(batch.verifyEach(), 0u);
+
+    // ...but one wrong equation fails the whole batch, and checking the equations one by one finds just that one
+    PairingBatch bad(nullptr);
+    bad.merge(batch);
+    bad.addEquality(a*G1::one(), G2::one(), (a + Fr::one())*G1::one(), G2::one(), nullptr, "wrong");
+    bad.merge(batch);
+    testAssertFalse(bad.verify());
+    testAssertEqual(bad.verifyEach(), 1u);
+
     std::cout << "Test '" << argv[0] << "' finished successfully" << std::endl;
 
     // test batch multiple exponentiation
@@ -124,5 +148,98 @@ int main(int argc, char *argv[])
     testAssertEqual(r2g2, r3g2);
     testAssertEqual(r3g2, r4g2);
     testAssertEqual(r4g2, r5g2);
+
+    // test multiple exponentiation with GLV/GLS endomorphisms (falls back to multiExp if they are not available)
+    G1 r6g1 = multiExpEndo<G1>(bases1.cbegin(), bases1.cend(), exp.cbegin(), exp.cend());
+    G2 r6g2 = multiExpEndo<G2>(bases2.cbegin(), bases2.cend(), exp.cbegin(), exp.cend());
+    testAssertEqual(r5g1, r6g1);
+    testAssertEqual(r5g2, r6g2);
+
+    // ...and with the bases' endomorphism images precomputed
+    if(Endomorphism::has<G1>() && Endomorphism::has<G2>()) {
+        std::vector<G1> endo1;
+        std::vector<G2> endo2;
+        for(auto& b1 : bases1)
+            endo1.push_back(Endomorphism::apply(b1));
+        for(auto& b2 : bases2)
+            endo2.push_back(Endomorphism::apply(b2));
+        testAssertEqual(multiExpEndo<G1>(bases1.data(), bases1.data() + bases1.size(), endo1.data(),
+            exp.data(), exp.data() + exp.size()), r5g1);
+        testAssertEqual(multiExpEndo<G2>(bases2.data(), bases2.data() + bases2.size(), endo2.data(),
+            exp.data(), exp.data() + exp.size()), r5g2);
+    }
+
+    // test multiple exponentiation with enough bases for our own Pippenger, rather than libff's, on one thread
+    std::vector<G1> manyBases;
+    std::vector<Fr> manyExps;
+    for(size_t i = 0; i < 16384 + 100; i++) {
+        manyBases.push_back(bases1[i % bases1.size()]);
+        manyExps.push_back(i % 7 == 0 ? Fr::zero() : Fr::random_element());
+    }
+    G1 r7g1 = libff::multi_exp<G1, Fr, libff::multi_exp_method_BDLO12>(
+        manyBases.cbegin(), manyBases.cend(), manyExps.cbegin(), manyExps.cend(), 1);
+    testAssertEqual(multiExp<G1>(manyBases.cbegin(), manyBases.cend(), manyExps.cbegin(), manyExps.cend(), 1), r7g1);
+
+#ifdef CURVE_BN128
+    // the endomorphisms are only defined on BN128, where they must pass their checks
+    testAssertTrue(Endomorphism::has<G1>());
+    testAssertTrue(Endomorphism::has<G2>());
+#endif
+
+    // test storing points compactly, including points that only differ in the sign of y and the point at infinity
+    for(size_t i = 0; i < 10; i++) {
+        testAssertEqual(CompactG1(bases1[i]).get(), bases1[i]);
+        testAssertEqual(CompactG1(-bases1[i]).get(), -bases1[i]);
+        testAssertEqual(CompactG2(bases2[i]).get(), bases2[i]);
+        testAssertEqual(CompactG2(-bases2[i]).get(), -bases2[i]);
+    }
+    testAssertEqual(CompactG1(G1::zero()).get(), G1::zero());
+    testAssertEqual(CompactG2(G2::zero()).get(), G2::zero());
+    testAssertEqual(CompactG1().get(), G1::zero());
+    testAssertEqual(CompactG2().get(), G2::zero());
+
+    // test compressing points into proofs, which must reject anything compress() would not have written
+    unsigned char buf1[CompactG1::CompressedSize], buf2[CompactG2::CompressedSize];
+    for(size_t i = 0; i < 10; i++) {
+        testAssertTrue(Endomorphism::isInG2(bases2[i]));
+        CompactG1::compress(bases1[i], buf1);
+        testAssertEqual(CompactG1::decompress(buf1), bases1[i]);
+        CompactG2::compress(bases2[i], buf2);
+        testAssertEqual(CompactG2::decompress(buf2), bases2[i]);
+    }
+#ifdef CURVE_BN128
+    auto rejects = [](const unsigned char * buf, const std::string& why) {
+        try {
+            CompactG2::decompress(buf);
+        } catch(const std::runtime_error& e) {
+            return std::string(e.what()).find(why) != std::string::npos;
+        }
+        return false;
+    };
+
+    // a point at infinity with garbage after the flag
+    CompactG2::compress(G2::zero(), buf2);
+    buf2[0] = 1;
+    testAssertTrue(rejects(buf2, "malformed"));
+
+    // X = p, which is X = 0 in disguise
+    const unsigned char p[] = {
+        0x47, 0xfd, 0x7c, 0xd8, 0x16, 0x8c, 0x20, 0x3c, 0x8d, 0xca, 0x71, 0x68, 0x91, 0x6a, 0x81, 0x97,
+        0x5d, 0x58, 0x81, 0x81, 0xb6, 0x45, 0x50, 0xb8, 0x29, 0xa0, 0x31, 0xe1, 0x72, 0x4e, 0x64, 0x30 };
+    std::memset(buf2, 0, sizeof(buf2));
+    std::memcpy(buf2, p, sizeof(p));
+    testAssertTrue(rejects(buf2, "malformed"));
+
+    // almost every point on the twist is outside G2, so a random X on the twist should be rejected
+    bool outside = false;
+    for(int i = 0; i < 64 && !outside; i++) {
+        for(auto& b : buf2)
+            b = static_cast<unsigned char>(rand());
+        buf2[sizeof(bn::Fp) - 1] &= 0x0f;   // keep both coordinates of X less than p and the flags clear
+        buf2[sizeof(buf2) - 1] &= 0x0f;
+        outside = rejects(buf2, "not in G2");
+    }
+    testAssertTrue(outside);
+#endif
     return 0;
 }
@@ -1,9 +1,17 @@
 #include <aad/Configuration.h>
 
+#include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
 
 #include <aad/Library.h>
+#include <aad/PolyCommit.h>
 #include <aad/PublicParameters.h>
+#include <aad/Scheduler.h>
+#include <aad/TaskGraph.h>
 
 #include <xassert/XAssert.h>
 #include <xutils/Timer.h>
@@ -13,6 +21,118 @@ using namespace libaad;
 using namespace libaad;
 using std::endl;
 
+/**
+ * 'pp' should have been created with initialQ = 1.
+ */
+void testLazyLoading(const PublicParameters& pp, size_t q, const std::vector<std::vector<Fr>>& polys,
+    const std::vector<G1>& g1Comms, const std::vector<bool>& extractable)
+{
+    testAssertEqual(pp.q, q);
+    testAssertEqual(pp.getNumLoaded(), 2);
+
+    Scheduler::parallelFor(0, polys.size(), [&](size_t i) {
+        testAssertEqual(g1Comms[i], PolyCommit::commitG1(pp, polys[i], extractable[i]));
+        testAssertTrue(pp.getNumLoaded() >= polys[i].size());
+    });
+
+    std::vector<Fr> tooBig(q + 2, Fr::one());
+    bool threw = false;
+    try {
+        PolyCommit::commitG1(pp, tooBig, false);
+    } catch(const std::runtime_error&) {
+        threw = true;
+    }
+    testAssertTrue(threw);
+}
+
+/**
+ * Commits to polynomials from the tasks of one TaskGraph (like a merge does), so a task that loads more parameters
+ * waits on its loading jobs while sibling tasks need the same parameters.
+ */
+void testConcurrentLoading(const std::string& trapFile, const std::vector<std::vector<Fr>>& polys,
+    const std::vector<G1>& g1Comms, const std::vector<bool>& extractable)
+{
+    // a worker and the main thread, even on a single core, so either can end up loading while the other waits
+    Scheduler::configure(2);
+
+    for(int rep = 0; rep < 8; rep++) {
+        // verifying makes loading run parallel jobs, like reading the text files does
+        PublicParameters pp(trapFile, -1, false, true, 1);
+        std::vector<G1> comms(polys.size());
+
+        // more tasks than threads, so a thread waiting on its loading jobs finds sibling tasks queued
+        TaskGraph g;
+        for(size_t i = polys.size(); i-- > 0;) {
+            g.add([&, i] { comms[i] = PolyCommit::commitG1(pp, polys[i], extractable[i]); });
+            for(int j = 0; j < 8; j++)
+                g.add([&, i] { testAssertEqual(PolyCommit::commitG1(pp, polys[i], extractable[i]), g1Comms[i]); });
+        }
+        g.run();
+
+        for(size_t i = 0; i < polys.size(); i++)
+            testAssertEqual(comms[i], g1Comms[i]);
+    }
+
+    Scheduler::configure(0);
+}
+
+/**
+ * Copies the parameters in trapFile (and its 'numFiles' text files) with g1^{s^2} replaced by g1^{s^3}, a valid point
+ * in the wrong place, and checks that only the batched verification catches it (the first and last parameters, which
+ * are always checked, are fine).
+ */
+void testCorruptedParams(const std::string& trapFile, size_t numFiles) {
+    std::string badFile = trapFile + "-corrupted";
+    {
+        std::ifstream fin(trapFile);
+        std::ofstream fout(badFile);
+        fout << fin.rdbuf();
+    }
+    for(size_t i = 0; i < numFiles; i++) {
+        std::ifstream fin(trapFile + "-" + std::to_string(i));
+        std::ofstream fout(badFile + "-" + std::to_string(i));
+        std::vector<std::string> lines;
+        std::string line;
+        while(std::getline(fin, line))
+            lines.push_back(line);
+
+        // three lines per parameter: g1^{s^i}, g1^{\tau s^i} and g2^{s^i}
+        if(i == 0)
+            lines[3*2] = lines[3*3];
+        for(auto& l : lines)
+            fout << l << "\n";
+    }
+
+    // without verification, the corrupted power goes unnoticed
+    {
+        PublicParameters pp(badFile, -1, false, false);
+        testAssertEqual(pp.g1si[2], pp.g1si[3]);
+    }
+
+    // ...but the batched verification rejects it, whether it is loaded up front or later
+    bool threw = false;
+    try {
+        PublicParameters pp(badFile, -1, false, true);
+    } catch(const std::runtime_error&) {
+        threw = true;
+    }
+    testAssertTrue(threw);
+
+    threw = false;
+    PublicParameters ppLazy(badFile, -1, false, true, 1);
+    try {
+        ppLazy.ensureDegree(2);
+    } catch(const std::runtime_error&) {
+        threw = true;
+    }
+    testAssertTrue(threw);
+    testAssertEqual(ppLazy.getNumLoaded(), 2);
+
+    std::remove(badFile.c_str());
+    for(size_t i = 0; i < numFiles; i++)
+        std::remove((badFile + "-" + std::to_string(i)).c_str());
+}
+
 int main(int argc, char *argv[])
 {
     (void)argc; (void)argv;
@@ -38,7 +158,118 @@ int main(int argc, char *argv[])
         PublicParameters::generate(start, end, s, tau, trapFile + "-" + std::to_string(i), false); 
     }
 
+    // the parameters are read from the text files we just wrote, even if a previous run left a binary file behind
+    std::string binFile = PublicParameters::getBinaryFile(trapFile);
     PublicParameters pp(trapFile);
+    PublicParameters ppVerified(trapFile, -1, true, true);
+    testAssertTrue(pp == ppVerified);
+    if(chunkSize > 3)    // so g1^{s^3} is in the first file
+        testCorruptedParams(trapFile, numChunks);
+
+    // batch commitments should match one-by-one commitments
+    std::vector<std::vector<Fr>> polys;
+    for(size_t deg = 0; deg <= q; deg = 2*deg + 1) {
+        polys.push_back(std::vector<Fr>());
+        for(size_t i = 0; i <= deg; i++)
+            polys.back().push_back(Fr::random_element());
+    }
+    std::vector<const std::vector<Fr>*> polyPtrs;
+    std::vector<bool> extractable;
+    for(size_t i = 0; i < polys.size(); i++) {
+        polyPtrs.push_back(&polys[i]);
+        extractable.push_back(i % 2 == 1);
+    }
+
+    std::vector<G1> g1Comms;
+    std::vector<G2> g2Comms;
+    PolyCommit::commitG1Batch(pp, polyPtrs, extractable, g1Comms);
+    PolyCommit::commitG2Batch(pp, polyPtrs, g2Comms);
+    testAssertEqual(g1Comms.size(), polys.size());
+    testAssertEqual(g2Comms.size(), polys.size());
+    for(size_t i = 0; i < polys.size(); i++) {
+        testAssertEqual(g1Comms[i], PolyCommit::commitG1(pp, polys[i], extractable[i]));
+        testAssertEqual(g2Comms[i], PolyCommit::commitG2(pp, polys[i], false));
+    }
+
+    // lazily-loaded parameters should load more parameters as we commit to larger polynomials, even concurrently
+    {
+        PublicParameters ppLazy(trapFile, -1, false, true, 1);
+        testLazyLoading(ppLazy, q, polys, g1Comms, extractable);
+    }
+    testConcurrentLoading(trapFile, polys, g1Comms, extractable);
+
+    // the binary format should give us back the same parameters, and the same commitments, without copying them
+    pp.writeBinary(binFile);
+    {
+        auto ppBin = PublicParameters::fromBinary(trapFile, binFile, -1, false, true);
+        testAssertTrue(pp == *ppBin);
+        for(size_t i = 0; i < polys.size(); i++) {
+            testAssertEqual(g1Comms[i], PolyCommit::commitG1(*ppBin, polys[i], extractable[i]));
+            testAssertEqual(g2Comms[i], PolyCommit::commitG2(*ppBin, polys[i], false));
+        }
+
+        auto ppBinSmall = PublicParameters::fromBinary(trapFile, binFile, static_cast<int>(q/2), false, false, true);
+        testAssertEqual(ppBinSmall->q, q/2);
+        testAssertEqual(ppBinSmall->g1si.size(), q/2 + 1);
+        testAssertEqual(ppBinSmall->g1si[q/2], pp.g1si[q/2]);
+
+        auto ppBinLazy = PublicParameters::fromBinary(trapFile, binFile, -1, false, true, false, 1);
+        testLazyLoading(*ppBinLazy, q, polys, g1Comms, extractable);
+
+        // the text parameters are only read from the text files, even though there is a binary file now
+        PublicParameters ppText(trapFile, -1, false, false, 1);
+        testAssertTrue(ppText.g1si.data() != ppBin->g1si.data());
+        testAssertEqual(ppText.getNumLoaded(), 2);
+
+        // equalsLoaded() only compares the ones loaded so far, while operator== loads and compares all of them
+        testAssertTrue(ppText.equalsLoaded(pp));
+        testAssertEqual(ppText.getNumLoaded(), 2);
+        testAssertTrue(ppText == pp);
+        testAssertEqual(ppText.getNumLoaded(), q + 1);
+
+        // g^s is loaded on demand too, even if only g^{s^0} was loaded up front
+        PublicParameters ppOne(trapFile, -1, false, false, 0);
+        testAssertEqual(ppOne.getNumLoaded(), 1);
+        testAssertEqual(ppOne.getG1toS(), pp.g1si[1]);
+        testAssertEqual(ppOne.getG2toS(), pp.g2si[1]);
+        testAssertTrue(ppOne.getNumLoaded() >= 2);
+
+        // open() maps the binary file, since there is one now
+        auto ppOpen = PublicParameters::open(trapFile, -1, false, false);
+        testAssertTrue(ppOpen->isMapped());
+        testAssertTrue(*ppOpen == pp);
+
+        // a header whose array offset is so large that offset + size wraps around is rejected, not mapped
+        std::string badFile = binFile + "-bad";
+        {
+            std::ifstream fin(binFile, std::ios::binary);
+            std::ofstream fout(badFile, std::ios::binary);
+            fout << fin.rdbuf();
+            uint64_t badOffset = UINT64_MAX - 15;
+            fout.seekp(5 * sizeof(uint64_t));   // the g1^{s^i} offset, after the magic, version, point sizes and q
+            fout.write(reinterpret_cast<const char *>(&badOffset), sizeof(badOffset));
+        }
+        bool threw = false;
+        try {
+            PublicParameters::fromBinary(trapFile, badFile, -1, false, false);
+        } catch(const std::runtime_error&) {
+            threw = true;
+        }
+        testAssertTrue(threw);
+        std::remove(badFile.c_str());
+    }
+    std::remove(binFile.c_str());
+
+    // without a binary file, open() reads the text files
+    testAssertFalse(PublicParameters::open(trapFile, -1, false, false, 1)->isMapped());
+
+    // generating the binary file directly should give us the same parameters
+    PublicParameters::generateBinary(q, s, tau, binFile, false);
+    {
+        auto ppGen = PublicParameters::fromBinary(trapFile, binFile, -1, false, true);
+        testAssertTrue(pp == *ppGen);
+    }
+    std::remove(binFile.c_str());
 
     std::cout << "Test '" << argv[0] << "' finished successfully" << std::endl;
 
@@ -0,0 +1,167 @@
+#include <aad/Configuration.h>
+
+#include <aad/Library.h>
+#include <aad/PolyInterpolation.h>
+#include <aad/Scheduler.h>
+#include <aad/TaskGraph.h>
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <xassert/XAssert.h>
+#include <xutils/Log.h>
+
+using namespace libaad;
+using std::endl;
+
+/**
+ * Builds a diamond-shaped graph of 'width' tasks between a source and a sink and checks every task
+ * runs exactly once and after its dependencies.
+ */
+void testDiamond(size_t numThreads, size_t width) {
+    TaskGraph g(numThreads);
+    std::vector<int> done(width + 2, 0);
+    std::atomic<int> numRun(0);
+
+    auto src = g.add([&] { done[0] = 1; numRun++; });
+    std::vector<TaskGraph::TaskId> mids;
+    for(size_t i = 1; i <= width; i++) {
+        mids.push_back(g.add([&, i] {
+            testAssertEqual(done[0], 1);
+            done[i] = 1;
+            numRun++;
+        }, {src}));
+    }
+    g.add([&] {
+        for(size_t i = 1; i <= width; i++)
+            testAssertEqual(done[i], 1);
+        done[width + 1] = 1;
+        numRun++;
+    }, mids);
+
+    g.run();
+    testAssertEqual(numRun.load(), static_cast<int>(width + 2));
+    testAssertEqual(done[width + 1], 1);
+    testAssertEqual(g.size(), 0u);
+}
+
+/**
+ * Runs a parallelFor() inside another one, so jobs submit and wait on jobs themselves.
+ */
+void testNestedParallelFor(size_t n) {
+    std::vector<std::atomic<int>> counts(n * n);
+    for(auto& c : counts)
+        c = 0;
+
+    Scheduler::parallelFor(0, n, [&](size_t i) {
+        Scheduler::parallelFor(0, n, [&](size_t j) {
+            counts[i * n + j]++;
+        });
+    });
+
+    for(auto& c : counts)
+        testAssertEqual(c.load(), 1);
+}
+
+/**
+ * Interpolates polynomials on the scheduler's threads, which need NTL's modulus installed.
+ */
+void testNtlOnWorkers(size_t n) {
+    std::vector<std::vector<Fr>> roots(n), expected(n), polys(n);
+    for(size_t i = 0; i < n; i++) {
+        for(size_t j = 0; j <= i; j++)
+            roots[i].push_back(Fr::random_element());
+        poly_from_roots_ntl(expected[i], roots[i]);
+    }
+
+    Scheduler::parallelFor(0, n, [&](size_t i) {
+        poly_from_roots_ntl(polys[i], roots[i]);
+    });
+
+    for(size_t i = 0; i < n; i++)
+        testAssertEqual(polys[i], expected[i]);
+}
+
+/**
+ * Runs jobs that take a while, so waiting threads run out of jobs to run and go to sleep until the jobs are done.
+ */
+void testSlowJobs(size_t n) {
+    std::vector<int> done(n, 0);
+    Scheduler::parallelFor(0, n, [&](size_t i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        done[i] = 1;
+    });
+
+    for(auto d : done)
+        testAssertEqual(d, 1);
+}
+
+int main(int argc, char *argv[])
+{
+    (void)argc; (void)argv;
+    initialize(nullptr, 0);
+
+    for(size_t numThreads : std::vector<size_t>{ 1, 2, 4, 0 }) {
+        testDiamond(numThreads, 1);
+        testDiamond(numThreads, 16);
+    }
+
+    for(size_t numThreads : std::vector<size_t>{ 1, 3, 0 }) {
+        Scheduler::configure(numThreads);
+        testNestedParallelFor(17);
+        testNtlOnWorkers(32);
+        testDiamond(0, 16);
+        testSlowJobs(8);
+    }
+
+    // the scheduler cannot be replaced while jobs (which refer to it) are running
+    bool refused = false;
+    try {
+        TaskGroup group;
+        group.run([] { Scheduler::configure(2); });
+        group.wait();
+    } catch(const std::logic_error&) {
+        refused = true;
+    }
+    testAssertTrue(refused);
+
+    // exceptions thrown by tasks are rethrown by run() and dependent tasks are skipped
+    TaskGraph g(4);
+    bool ranDependent = false;
+    auto t = g.add([] { throw std::runtime_error("task failed"); });
+    g.add([&] { ranDependent = true; }, {t});
+    bool threw = false;
+    try {
+        g.run();
+    } catch(const std::runtime_error&) {
+        threw = true;
+    }
+    testAssertTrue(threw);
+    testAssertFalse(ranDependent);
+
+    // ...also when the graph runs its tasks on the calling thread, after which the graph can be reused
+    TaskGraph serial(1);
+    bool ranAfter = false;
+    serial.add([] { throw std::runtime_error("task failed"); });
+    serial.add([&] { ranAfter = true; });
+    threw = false;
+    try {
+        serial.run();
+    } catch(const std::runtime_error&) {
+        threw = true;
+    }
+    testAssertTrue(threw);
+    testAssertFalse(ranAfter);
+
+    int numRan = 0;
+    serial.add([&] { numRan++; });
+    serial.run();
+    testAssertEqual(numRan, 1);
+
+    std::cout << "Test '" << argv[0] << "' finished successfully" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,133 @@
+#include <aad/Configuration.h>
+
+#include <aad/AADS.h>
+#include <aad/Library.h>
+#include <aad/ValueLog.h>
+
+#include <fstream>
+#include <vector>
+
+#include <xassert/XAssert.h>
+#include <xutils/Log.h>
+
+#include "AADTestUtils.h"
+
+using namespace libaad;
+using std::endl;
+
+void testValueLog(const std::string& logFile);
+void testAADWithValueLog(const std::string& logFile, const std::string& snapFile);
+
+int main(int argc, char *argv[])
+{
+    (void)argc;
+    initialize(nullptr, 0);
+
+    {
+        TempDir tmp;
+        std::string logFile = tmp.getPath("value-log"), snapFile = tmp.getPath("snapshot");
+
+        testValueLog(logFile);
+        testAADWithValueLog(logFile, snapFile);
+    }
+
+    std::cout << "Test '" << argv[0] << "' finished successfully" << std::endl;
+    return 0;
+}
+
+void testValueLog(const std::string& logFile) {
+    std::vector<uint64_t> offsets;
+    std::vector<ValueLog::View> views;
+    {
+        ValueLog log(logFile, 1024 * 1024);
+        for(int i = 0; i < 100; i++) {
+            // some large values, some empty ones
+            std::string v(static_cast<size_t>(i % 3 == 0 ? 0 : i * 100), static_cast<char>('a' + i % 26));
+            offsets.push_back(log.append(v));
+
+            // views of earlier records stay valid while appending
+            views.push_back(log.getValue(offsets.back()));
+        }
+
+        for(int i = 0; i < 100; i++) {
+            auto idx = static_cast<size_t>(i);
+            testAssertEqual(views[idx].size, static_cast<size_t>(i % 3 == 0 ? 0 : i * 100));
+            testAssertTrue(views[idx] == log.getValue(offsets[idx]));
+
+            std::string v;
+            ValueLog::fromBytes(views[idx], v);
+            testAssertEqual(v, views[idx].toString());
+        }
+
+        // trivially-copyable values are logged as they are
+        uint64_t off = log.append(3.5);
+        double v;
+        ValueLog::fromBytes(log.getValue(off), v);
+        testAssertTrue(v == 3.5);
+        uint32_t u;
+        try {
+            ValueLog::fromBytes(log.getValue(off), u);
+            testAssertTrue(false);
+        } catch(const std::runtime_error&) {
+        }
+
+        // the log cannot grow past its maximum size
+        try {
+            log.append(std::string(1024 * 1024, 'x'));
+            testAssertTrue(false);
+        } catch(const std::runtime_error&) {
+        }
+    }
+
+    // the log is removed when closed
+    testAssertFalse(std::ifstream(logFile).good());
+}
+
+void testAADWithValueLog(const std::string& logFile, const std::string& snapFile) {
+    using AADType = AAD<std::string, std::string>;
+    // values of different sizes, some of them large
+    int n = 37, numKeys = 7;
+    size_t valuePadding = 10;
+
+    AADType aad, logged;
+    logged.setValueLog(logFile);
+    appendSome(aad, n, numKeys, valuePadding);
+    appendSome(logged, n, numKeys, valuePadding);
+    testAssertTrue(logged.getValueLog()->size() > 0);
+    // logged leaves only have the value's offset, not an (empty) value
+    testAssertTrue(sizeof(AADType::LoggedLeafDataType) < sizeof(AADType::StoredLeafDataType));
+    testAssertEqual(logged.getKeyByLeafNo(5), aad.getKeyByLeafNo(5));
+    checkSame(aad, logged);
+
+    // snapshots have the key-value pairs, so they can be restored with or without a value log
+    logged.saveSnapshot(snapFile);
+    AADType restored;
+    restored.restoreSnapshot(snapFile);
+    checkSame(aad, restored);
+
+    AADType restoredLogged;
+    restoredLogged.setValueLog(logFile + "-restored");
+    restoredLogged.restoreSnapshot(snapFile);
+    checkSame(aad, restoredLogged);
+
+    appendSome(aad, 5, numKeys, valuePadding);
+    appendSome(restoredLogged, 5, numKeys, valuePadding);
+    checkSame(aad, restoredLogged);
+
+    loginfo << "Logged " << restoredLogged.getSize() << " key-value pairs in " << restoredLogged.getValueLog()->size() << " bytes" << endl;
+
+    // an append that does not fit in the log fails without interning its key, so the AAD is left as it was
+    AADType small;
+    small.setValueLog(logFile + "-small", 4096);
+    small.append("k", "v");
+    try {
+        small.append("new", std::string(8192, 'x'));
+        testAssertTrue(false);
+    } catch(const std::runtime_error&) {
+    }
+    testAssertEqual(small.getSize(), 1);
+    testAssertEqual(small.getNumKeys(), static_cast<size_t>(1));
+    testAssertEqual(small.getKeyInterner().find("new"), KeyInterner<std::string>::NotFound);
+    small.append("new", "v");
+    testAssertEqual(small.getNumKeys(), static_cast<size_t>(2));
+}